@@ -0,0 +1,9 @@
+# Boot-time benchmark run: make run KERNEL_CMDLINE=autorun=/scripts/bench.sh
+# Each line is a shell command; `time` reports TSC cycles and nanoseconds.
+time ls /
+time cat /hello.txt
+time tarbench 1000
+time strbench
+time fsbench /disk/bench/seq.bin
+cachestat
+irqstat
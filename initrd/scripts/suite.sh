@@ -0,0 +1,4 @@
+# `make bench`: run the benchmark suite, then leave QEMU
+bench
+exec /bin/sysbench
+exit 0
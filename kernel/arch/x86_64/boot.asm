@@ -7,6 +7,11 @@
 ;; lgdt is mean load global descriptor table
 ;; jmp is mean jump to a label
 
+; The kernel is linked at KERNEL_VMA + physical address (see scripts/linker.ld).
+; Until paging is on we run at the physical address, so every symbol that is
+; used here must be translated with "- KERNEL_VMA".
+KERNEL_VMA equ 0xFFFFFFFF80000000
+
 
 section .multiboot_header
 header_start: ; tell the bootloader where the OS starts
@@ -43,13 +48,21 @@ header_start: ; tell the bootloader where the OS starts
     dd 8  ; size get from tag dw(2) + dw(2) + dd(4) = 8 bytes
 header_end:
 
-section .text ; mean the code section to load in memory for Executable code 
+section .boot.text progbits alloc exec nowrite align=16 ; low (identity) code that runs before the jump to the higher half
 global _start ; is mean the entry point of the linker to start from it 
 extern kernel_main ; refernace to the external function kernel_main in kernel.cpp when linker link it will call kernel_main function
+global boot_start_tsc ; TSC at _start, the zero point of the boot phase report (kernel/lib/boottime.cpp)
 
 bits 32 ; mean the code is in 32 bit mode 
 _start: ; This is the entry point of the kernel  when Bootloader load the kernel it will start from here
-    mov esp, stack_top           ; set the stack pointer to the top of the stack
+    ; Timestamp first: rdtsc writes EDX:EAX, so park the multiboot magic in ESI
+    mov esi, eax
+    rdtsc
+    mov [boot_start_tsc - KERNEL_VMA], eax     ; low half
+    mov [boot_start_tsc - KERNEL_VMA + 4], edx ; high half
+    mov eax, esi
+
+    mov esp, stack_top - KERNEL_VMA ; set the stack pointer to the top of the stack (physical address)
     mov edi, ebx                 ; Save Multiboot info pointer
 
     call check_multiboot         ; check if the kernel is loaded by a multiboot loader
@@ -58,8 +71,9 @@ _start: ; This is the entry point of the kernel  when Bootloader load the kernel
 
     call set_up_page_tables      ; set up the page tables
     call enable_paging           ; enable paging
+    call enable_sse              ; let kernel code use the SSE unit (see kernel/arch/x86_64/fpu.cpp)
 
-    lgdt [gdt64.pointer]        ; load the GDT
+    lgdt [gdt64.pointer_low - KERNEL_VMA] ; load the GDT through its physical address
     jmp gdt64.code_segment:long_mode_start ; jump to the long mode start
 
 ; Prints "ERR: " and the error code in AL to VGA buffer 0xb8000
@@ -116,38 +130,43 @@ check_long_mode:
     jmp error ; jump to error
 
 set_up_page_tables:  ;; this function is to set up the page tables to tell cpu how to map the memory  
-    ; 1. Map PML4 entry to PDP
-    mov eax, pdp_table ; move pdp_table address to eax register  
+    ; 1. Map PML4 entries to the PDPs
+    ;    PML4[0]   -> identity map, only needed until we jump to the higher half (dropped by vmm_init)
+    ;    PML4[511] -> top 512GB, where the kernel lives (0xFFFFFFFF80000000)
+    mov eax, pdp_table_low - KERNEL_VMA ; move pdp_table_low address to eax register  
     or eax, 0b11 ; set bit 0 and bit 1 to 1 
-    mov [pml4_table], eax ; move eax to pml4_table
+    mov [pml4_table - KERNEL_VMA], eax ; move eax to pml4_table[0]
 
-    ; 2. Map PDP entry to PD
-    mov eax, pd_table ;move pd_table address to eax register 
-    or eax, 0b11 ; set bit 0 and bit 1 to 1 
-    mov [pdp_table], eax ; move eax to pdp_table
+    mov eax, pdp_table - KERNEL_VMA
+    or eax, 0b11
+    mov [pml4_table - KERNEL_VMA + 511 * 8], eax ; move eax to pml4_table[511]
 
-    ; 3. Map PD entry to PT
-    mov eax, pt_table ;move pt_table address to eax register
+    ; 2. Map PDP entries to the PD (both views share the same PD)
+    ;    pdp_table_low[0] -> 0x0000000000000000
+    ;    pdp_table[510]   -> 0xFFFFFFFF80000000
+    mov eax, pd_table - KERNEL_VMA ;move pd_table address to eax register 
     or eax, 0b11 ; set bit 0 and bit 1 to 1 
-    mov [pd_table], eax ; move eax to pd_table
+    mov [pdp_table_low - KERNEL_VMA], eax
+    mov [pdp_table - KERNEL_VMA + 510 * 8], eax
 
-    ; 4. Identity map the first 2MB using the PT (512 entries x 4KB = 2MB)
-    mov ecx, 0         ; Counter for use in loop example  calculate memory address mov eax , 0x1000(4kb) * ecx (counter) = start address of page
-.map_pt_entry:
-    mov eax, 0x1000    ; 4KB size per page
-    mul ecx            ; eax = 0x1000 * ecx (start address of page) get real Address in memory page 
-    or eax, 0b11       ; present + writable
-    mov [pt_table + ecx * 8], eax ; Write entry (64-bit entries, so * 8)
+    ; 3. Map the first 1GB with 2MB pages (512 entries x 2MB = 1GB)
+    ;    bit 7 = huge page, bit 8 = global (kept across CR3 switches once CR4.PGE is on)
+    mov ecx, 0         ; Counter for use in loop
+.map_pd_entry:
+    mov eax, ecx
+    shl eax, 21        ; eax = ecx * 2MB (start address of page)
+    or eax, 0b110000011 ; present + writable + huge + global
+    mov [pd_table - KERNEL_VMA + ecx * 8], eax ; Write entry (64-bit entries, so * 8)
 
     inc ecx ; increment counter
     cmp ecx, 512 ; compare counter with 512
-    jne .map_pt_entry ; if not equal jump to .map_pt_entry
+    jne .map_pd_entry ; if not equal jump to .map_pd_entry
 
     ret
 
 enable_paging:
     ; Load P4 to CR3
-    mov eax, pml4_table ; move pml4_table address to eax register 
+    mov eax, pml4_table - KERNEL_VMA ; move pml4_table address to eax register 
     mov cr3, eax ; move eax to cr3
 
     ; Enable PAE-flag in CR4 (Physical Address Extension) in 64bit required enable PAE  and PAE is bit5
@@ -168,6 +187,21 @@ enable_paging:
 
     ret
 
+; SSE is architectural in long mode, but the CPU still raises #UD / #NM for
+; it until CR0.EM is cleared and CR4 says the OS saves the XMM state.
+; AVX needs XSAVE and XCR0 and is turned on later from C++ (fpu_init).
+enable_sse:
+    mov eax, cr0 ; move cr0 to eax register
+    and eax, ~(1 << 2) ; clear EM (bit 2): no x87 emulation
+    or eax, 1 << 1 ; set MP (bit 1): WAIT honours TS
+    mov cr0, eax ; move eax to cr0
+
+    mov eax, cr4 ; move cr4 to eax register
+    or eax, (1 << 9) | (1 << 10) ; set OSFXSR (bit 9) and OSXMMEXCPT (bit 10)
+    mov cr4, eax ; move eax to cr4
+
+    ret
+
 bits 64
 
 long_mode_start:
@@ -178,10 +212,19 @@ long_mode_start:
     mov fs, ax
     mov gs, ax
 
-    ; Fix RDI for kernel argument (if needed)
-    ; In previous step we moved ebx to edi in 32-bit.
-    ; RDI's lower 32 bits are EDI.
-    mov rdi, rdi  ; move rdi to rdi  in 64-bit mode has rule that rdi is the first argument of function 
+    ; Upper halves of registers are undefined after the mode switch, so
+    ; zero-extend the Multiboot info pointer (physical) we saved in EDI.
+    mov edi, edi
+
+    ; We are still executing from the identity map: jump to the higher half
+    mov rax, higher_half_start
+    jmp rax
+
+section .text
+higher_half_start:
+    mov rsp, stack_top ; switch to the higher-half alias of the stack
+    lgdt [gdt64.pointer] ; reload the GDT through its higher-half address
+    xor ebp, ebp ; outermost frame: frame-pointer stack walks stop here
 
     call kernel_main ; call kernel_main function 
     hlt ; halt the CPU
@@ -190,21 +233,27 @@ section .bss
 align 4096 
 pml4_table:
     resb 4096   ; reserve 4096 bytes for pml4_table
+pdp_table_low:
+    resb 4096   ; reserve 4096 bytes for the identity-map pdp table
 pdp_table:
     resb 4096   ; reserve 4096 bytes for pdp_table
 pd_table:
     resb 4096   ; reserve 4096 bytes for pd_table
-pt_table:
-    resb 4096
 stack_bottom:
     resb 4096 * 4
 stack_top:
+boot_start_tsc:
+    resq 1      ; GRUB zeroes .bss when it loads the image, before _start runs
 
 section .rodata
 gdt64:
     dq 0 ; Zero entry
 .code_segment: equ $ - gdt64
     dq (1 << 43) | (1 << 44) | (1 << 47) | (1 << 53) ; Code segment
+.end:
 .pointer:
-    dw $ - gdt64 - 1
+    dw .end - gdt64 - 1
     dq gdt64
+.pointer_low: ; same GDT by physical address, for the lgdt before paging
+    dw .end - gdt64 - 1
+    dq gdt64 - KERNEL_VMA
@@ -0,0 +1,78 @@
+#ifndef CPU_HPP
+#define CPU_HPP
+
+#include "types.h"
+
+// Read the Time Stamp Counter (cycles since reset)
+static inline uint64_t rdtsc() {
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// rdtsc that cannot start before earlier instructions finish or let later
+// ones start before it: for timing a region of code
+static inline uint64_t rdtsc_ordered() {
+    uint32_t lo, hi;
+    asm volatile("lfence; rdtsc; lfence" : "=a"(lo), "=d"(hi) : : "memory");
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// Read RFLAGS so callers can check / restore the interrupt flag (bit 9)
+static inline uint64_t read_rflags() {
+    uint64_t flags;
+    asm volatile("pushfq; pop %0" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline bool interrupts_enabled() {
+    return (read_rflags() & (1 << 9)) != 0;
+}
+
+static inline void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t* a, uint32_t* b, uint32_t* c, uint32_t* d) {
+    asm volatile("cpuid" : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d) : "a"(leaf), "c"(subleaf));
+}
+
+// Faulting address of the last page fault
+static inline uint64_t read_cr2() {
+    uint64_t v;
+    asm volatile("mov %%cr2, %0" : "=r"(v));
+    return v;
+}
+
+static inline uint64_t read_cr3() {
+    uint64_t v;
+    asm volatile("mov %%cr3, %0" : "=r"(v));
+    return v;
+}
+
+static inline void write_cr3(uint64_t v) {
+    asm volatile("mov %0, %%cr3" : : "r"(v) : "memory");
+}
+
+static inline uint64_t read_cr4() {
+    uint64_t v;
+    asm volatile("mov %%cr4, %0" : "=r"(v));
+    return v;
+}
+
+static inline void write_cr4(uint64_t v) {
+    asm volatile("mov %0, %%cr4" : : "r"(v) : "memory");
+}
+
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint32_t lo, hi;
+    asm volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value) {
+    asm volatile("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)) : "memory");
+}
+
+// Drop the TLB entry for a single page
+static inline void invlpg(const void* addr) {
+    asm volatile("invlpg (%0)" : : "r"(addr) : "memory");
+}
+
+#endif
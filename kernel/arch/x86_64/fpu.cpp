@@ -0,0 +1,93 @@
+#include "fpu.hpp"
+#include "cpu.hpp"
+#include "percpu.hpp"
+#include "console.hpp"
+
+#define CR4_OSXSAVE     (1ULL << 18)
+#define XCR0_X87        (1ULL << 0)
+#define XCR0_SSE        (1ULL << 1)
+#define XCR0_AVX        (1ULL << 2)
+#define FPU_SAVE_SIZE   1024  // x87 + SSE + AVX is 832 bytes
+
+struct alignas(64) FpuCpu {
+    uint8_t save_area[FPU_SAVE_SIZE];  // XSAVE needs 64-byte alignment
+    bool in_use;
+    bool live;
+};
+
+static FpuCpu fpu_cpus[MAX_CPUS];
+static bool use_xsave = false;
+static bool avx = false;
+
+static inline void xsetbv(uint32_t index, uint64_t value) {
+    asm volatile("xsetbv" : : "c"(index), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+void fpu_init() {
+    uint32_t a, b, c, d;
+    cpuid(1, 0, &a, &b, &c, &d);
+    bool has_xsave = (c & (1 << 26)) != 0;
+    bool has_avx = (c & (1 << 28)) != 0;
+
+    asm volatile("fninit");
+
+    if (has_xsave) {
+        write_cr4(read_cr4() | CR4_OSXSAVE);
+        uint64_t xcr0 = XCR0_X87 | XCR0_SSE;
+        if (has_avx) xcr0 |= XCR0_AVX;
+        xsetbv(0, xcr0);
+
+        // EBX = save area size for the features now enabled in XCR0
+        cpuid(0xD, 0, &a, &b, &c, &d);
+        use_xsave = b <= FPU_SAVE_SIZE;
+        avx = has_avx && use_xsave;
+        if (!use_xsave) xsetbv(0, XCR0_X87 | XCR0_SSE);
+    }
+
+    kprint("FPU: SSE2 on, AVX "); kprint(avx ? "on" : "unsupported");
+    kprint(", state save "); kprint(use_xsave ? "XSAVE" : "FXSAVE");
+    kprint("\n");
+}
+
+bool fpu_avx_enabled() {
+    return avx;
+}
+
+static void save_state(FpuCpu* f) {
+    if (use_xsave) {
+        asm volatile("xsave64 %0" : "=m"(f->save_area) : "a"(0xFFFFFFFF), "d"(0xFFFFFFFF) : "memory");
+    } else {
+        asm volatile("fxsave64 %0" : "=m"(f->save_area) : : "memory");
+    }
+}
+
+static void restore_state(FpuCpu* f) {
+    if (use_xsave) {
+        asm volatile("xrstor64 %0" : : "m"(f->save_area), "a"(0xFFFFFFFF), "d"(0xFFFFFFFF) : "memory");
+    } else {
+        asm volatile("fxrstor64 %0" : : "m"(f->save_area) : "memory");
+    }
+}
+
+// No locking: an interrupt that lands between the check and the store runs
+// its own begin/end pair to completion before we continue, and nothing
+// migrates us to another CPU.
+bool kernel_fpu_begin() {
+    FpuCpu* f = &fpu_cpus[cpu_id()];
+    if (f->in_use) return false;
+    f->in_use = true;
+    asm volatile("" : : : "memory");
+    if (f->live) save_state(f);
+    return true;
+}
+
+void kernel_fpu_end() {
+    FpuCpu* f = &fpu_cpus[cpu_id()];
+    if (f->live) restore_state(f);
+    asm volatile("" : : : "memory");
+    f->in_use = false;
+}
+
+void fpu_set_state_live(bool live) {
+    fpu_cpus[cpu_id()].live = live;
+}
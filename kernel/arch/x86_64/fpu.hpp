@@ -0,0 +1,26 @@
+#ifndef FPU_HPP
+#define FPU_HPP
+
+#include "types.h"
+
+// The kernel is built with -mno-sse: the compiler never touches the
+// XMM/YMM registers on its own, so SIMD code must run between
+// kernel_fpu_begin() and kernel_fpu_end().
+
+// Turn on AVX (XSAVE + XCR0) when the CPU has it; SSE is enabled in boot.asm
+void fpu_init();
+
+bool fpu_avx_enabled();
+
+// Claim the SIMD unit on this CPU. Returns false if it is already claimed
+// (an interrupt arrived inside another begin/end pair); the caller must
+// then fall back to integer code. Does not nest.
+bool kernel_fpu_begin();
+void kernel_fpu_end();
+
+// Declare that the registers on this CPU hold state that is not the
+// kernel's (e.g. a user task's) and must survive kernel SIMD use. While
+// set, begin/end save and restore the full XSAVE/FXSAVE image.
+void fpu_set_state_live(bool live);
+
+#endif
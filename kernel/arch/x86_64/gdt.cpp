@@ -0,0 +1,63 @@
+#include "gdt.hpp"
+#include "console.hpp"
+
+// Descriptor bits (the base and limit are ignored in long mode)
+#define SEG_RW       (1ULL << 41)  // Readable code / writable data
+#define SEG_CODE     (1ULL << 43)
+#define SEG_USER_SEG (1ULL << 44)  // Code or data, not a system descriptor
+#define SEG_DPL3     (3ULL << 45)
+#define SEG_PRESENT  (1ULL << 47)
+#define SEG_LONG     (1ULL << 53)
+#define SEG_TSS_AVAIL 0x9ULL        // Type of an available 64-bit TSS
+
+#define GDT_ENTRIES 7  // null, 4 segments, TSS (two slots)
+
+struct GdtPtr {
+    uint16_t limit;
+    uint64_t base;
+} __attribute__((packed));
+
+static uint64_t gdt[GDT_ENTRIES] __attribute__((aligned(16)));
+static Tss tss __attribute__((aligned(16)));
+
+void gdt_init() {
+    gdt[0] = 0;
+    gdt[GDT_KERNEL_CODE / 8] = SEG_PRESENT | SEG_USER_SEG | SEG_CODE | SEG_RW | SEG_LONG;
+    gdt[GDT_KERNEL_DATA / 8] = SEG_PRESENT | SEG_USER_SEG | SEG_RW;
+    gdt[GDT_USER_DATA / 8] = SEG_PRESENT | SEG_USER_SEG | SEG_RW | SEG_DPL3;
+    gdt[GDT_USER_CODE / 8] = SEG_PRESENT | SEG_USER_SEG | SEG_CODE | SEG_RW | SEG_LONG | SEG_DPL3;
+
+    tss.iomap_base = sizeof(Tss);
+    uint64_t base = (uint64_t)&tss;
+    uint64_t limit = sizeof(Tss) - 1;
+    gdt[GDT_TSS / 8] = (limit & 0xFFFF) | ((base & 0xFFFFFF) << 16) | (SEG_TSS_AVAIL << 40) |
+                       SEG_PRESENT | (((limit >> 16) & 0xF) << 48) | (((base >> 24) & 0xFF) << 56);
+    gdt[GDT_TSS / 8 + 1] = base >> 32;
+
+    GdtPtr ptr;
+    ptr.limit = sizeof(gdt) - 1;
+    ptr.base = (uint64_t)gdt;
+    asm volatile("lgdt %0" : : "m"(ptr) : "memory");
+
+    // CS can only be reloaded by a far transfer; the kernel code selector
+    // keeps its old value, but the descriptor cache should come from the new table
+    asm volatile(
+        "pushq %[cs]\n"
+        "leaq 1f(%%rip), %%rax\n"
+        "pushq %%rax\n"
+        "lretq\n"
+        "1:\n"
+        "movw %[ds], %%ax\n"
+        "movw %%ax, %%ds\n"
+        "movw %%ax, %%es\n"
+        "movw %%ax, %%ss\n"
+        : : [cs] "i"(GDT_KERNEL_CODE), [ds] "i"(GDT_KERNEL_DATA) : "rax", "memory");
+
+    asm volatile("ltr %w0" : : "r"(GDT_TSS) : "memory");
+
+    kprint("GDT: kernel and user segments, TSS at "); kprint_hex(base); kprint("\n");
+}
+
+void gdt_set_kernel_stack(uint64_t rsp0) {
+    tss.rsp0 = rsp0;
+}
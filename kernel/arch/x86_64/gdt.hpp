@@ -0,0 +1,35 @@
+#ifndef GDT_HPP
+#define GDT_HPP
+
+#include "types.h"
+
+// Segment selectors of the GDT built by gdt_init(). The user pair is in the
+// order SYSRET expects: SS = STAR[63:48] + 8, CS = STAR[63:48] + 16.
+#define GDT_KERNEL_CODE 0x08
+#define GDT_KERNEL_DATA 0x10
+#define GDT_USER_DATA   0x18
+#define GDT_USER_CODE   0x20
+#define GDT_TSS         0x28  // 16-byte system descriptor
+#define GDT_RPL_USER    3
+
+// 64-bit Task State Segment: only the stack pointers are used
+struct Tss {
+    uint32_t reserved0;
+    uint64_t rsp0;        // Loaded on interrupts and exceptions from ring 3
+    uint64_t rsp1;
+    uint64_t rsp2;
+    uint64_t reserved1;
+    uint64_t ist[7];
+    uint64_t reserved2;
+    uint16_t reserved3;
+    uint16_t iomap_base;  // Past the limit: ring 3 has no I/O ports
+} __attribute__((packed));
+
+// Replace the boot GDT (a single kernel code segment) with kernel and user
+// segments plus the TSS, and load the task register
+void gdt_init();
+
+// Stack the CPU switches to when ring 3 is interrupted
+void gdt_set_kernel_stack(uint64_t rsp0);
+
+#endif
@@ -2,33 +2,32 @@ section .text
 extern isr_handler
 extern irq_handler
 
-%macro ISR_NOERRCODE 1
-    global isr%1 ; define global symbol for ISR
-    isr%1:
-        cli                     ; clear interrupts
-        push 0                  ; Dummy error code
-        push %1                 ; Interrupt number
-        jmp isr_common_stub
-%endmacro
+; Must match INTERRUPT_STUB_SIZE in interrupts.hpp
+%define INTERRUPT_STUB_SIZE 16
 
-%macro ISR_ERRCODE 1
-    global isr%1
-    isr%1:
-        cli
-        push %1                 ; Interrupt number
-        jmp isr_common_stub
-%endmacro
+; Exceptions for which the CPU pushes an error code
+%define HAS_ERRCODE(v) ((v) == 8 || ((v) >= 10 && (v) <= 14) || (v) == 17 || (v) == 21 || (v) == 29 || (v) == 30)
 
-%macro IRQ 2
-    global irq%1
-    irq%1:
-        cli             ; clear interrupts
-        push 0          ; Dummy error code
-        push %2         ; Interrupt number
-        jmp irq_common_stub     
+; One fixed-size entry per vector. Interrupt gates already clear IF, so
+; the entries go straight to their common stub.
+%macro INTERRUPT_ENTRY 1
+%%start:
+%if %1 < 32
+  %if HAS_ERRCODE(%1) == 0
+    push 0                  ; Dummy error code
+  %endif
+    push %1                 ; Interrupt number
+    jmp near isr_common_stub
+%else
+    push %1                 ; Vector, no error code
+    jmp near irq_common_stub
+%endif
+    times INTERRUPT_STUB_SIZE - ($ - %%start) int3
 %endmacro
 
+; Exceptions: full Registers frame
 isr_common_stub:
+    cld                  ; C code expects DF=0; iretq restores the interrupted DF
     ; Save CPU state
     push rax
     push rbx
@@ -65,97 +64,53 @@ isr_common_stub:
     pop rcx
     pop rbx
     pop rax
-    
+
     add rsp, 16          ; Clean up error code and ISR number
     iretq
 
+; Interrupts: IrqFrame. rbx and r12-r15 are preserved by irq_handler
+; itself; 6 words pushed by CPU and entry + 10 here keep rsp 16-aligned.
 irq_common_stub:
+    cld                  ; C code expects DF=0; iretq restores the interrupted DF
     push rax
-    push rbx
     push rcx
     push rdx
     push rsi
     push rdi
-    push rbp
     push r8
     push r9
     push r10
     push r11
-    push r12
-    push r13
-    push r14
-    push r15
+    push rbp
+
+    rdtsc                ; Entry timestamp for irqstat (rdx:rax, both already saved)
+    shl rdx, 32
+    or rax, rdx
+    mov rsi, rax         ; Second argument: entry TSC
 
     mov rdi, rsp
     call irq_handler
 
-    pop r15
-    pop r14
-    pop r13
-    pop r12
+    pop rbp
     pop r11
     pop r10
     pop r9
     pop r8
-    pop rbp
     pop rdi
     pop rsi
     pop rdx
     pop rcx
-    pop rbx
     pop rax
-    
-    add rsp, 16
-    iretq
 
-; Define ISRs (Exceptions)
-ISR_NOERRCODE 0
-ISR_NOERRCODE 1
-ISR_NOERRCODE 2
-ISR_NOERRCODE 3
-ISR_NOERRCODE 4
-ISR_NOERRCODE 5
-ISR_NOERRCODE 6
-ISR_NOERRCODE 7
-ISR_ERRCODE   8
-ISR_NOERRCODE 9
-ISR_ERRCODE   10
-ISR_ERRCODE   11
-ISR_ERRCODE   12
-ISR_ERRCODE   13
-ISR_ERRCODE   14
-ISR_NOERRCODE 15
-ISR_NOERRCODE 16
-ISR_ERRCODE   17
-ISR_NOERRCODE 18
-ISR_NOERRCODE 19
-ISR_NOERRCODE 20
-ISR_NOERRCODE 21
-ISR_NOERRCODE 22
-ISR_NOERRCODE 23
-ISR_NOERRCODE 24
-ISR_NOERRCODE 25
-ISR_NOERRCODE 26
-ISR_NOERRCODE 27
-ISR_NOERRCODE 28
-ISR_NOERRCODE 29
-ISR_NOERRCODE 30
-ISR_NOERRCODE 31
+    add rsp, 8           ; Vector
+    iretq
 
-; Define IRQs (Hardware Interrupts)
-IRQ 0, 32
-IRQ 1, 33
-IRQ 2, 34
-IRQ 3, 35
-IRQ 4, 36
-IRQ 5, 37
-IRQ 6, 38
-IRQ 7, 39
-IRQ 8, 40
-IRQ 9, 41
-IRQ 10, 42
-IRQ 11, 43
-IRQ 12, 44
-IRQ 13, 45
-IRQ 14, 46
-IRQ 15, 47
+; Entry table for all 256 vectors, indexed by init_interrupts()
+align INTERRUPT_STUB_SIZE
+global interrupt_stubs
+interrupt_stubs:
+%assign vector 0
+%rep 256
+    INTERRUPT_ENTRY vector
+%assign vector vector + 1
+%endrep
@@ -1,21 +1,18 @@
 #include "interrupts.hpp"
 #include "ports.hpp"
 #include "console.hpp"
+#include "cpu.hpp"
+#include "irqstat.hpp"
+#include "rcu.hpp"
+#include "trace.hpp"
+#include "proc/process.hpp"
 
-// Access assembly stubs
-extern "C" {
-    void isr0(); void isr1(); void isr2(); void isr3(); void isr4(); void isr5(); void isr6(); void isr7();
-    void isr8(); void isr9(); void isr10(); void isr11(); void isr12(); void isr13(); void isr14(); void isr15();
-    void isr16(); void isr17(); void isr18(); void isr19(); void isr20(); void isr21(); void isr22(); void isr23();
-    void isr24(); void isr25(); void isr26(); void isr27(); void isr28(); void isr29(); void isr30(); void isr31();
-    // -------------------------
-    void irq0(); void irq1(); void irq2(); void irq3(); void irq4(); void irq5(); void irq6(); void irq7();
-    void irq8(); void irq9(); void irq10(); void irq11(); void irq12(); void irq13(); void irq14(); void irq15();
-}
+// Entry table from interrupt_stubs.asm: INTERRUPT_STUB_SIZE bytes per vector
+extern "C" char interrupt_stubs[];
 
-IdtEntry idt[256];
+IdtEntry idt[IDT_VECTORS];
 IdtPtr idt_ptr;
-IsrHandler irq_routines[16] = {0};
+IrqHandler irq_routines[IDT_VECTORS] = {0}; // By vector; read under RCU on every interrupt
 
 void idt_set_gate(uint8_t num, uint64_t base, uint16_t sel, uint8_t flags) {
     idt[num].isr_low = (base & 0xFFFF);
@@ -46,89 +43,98 @@ void pic_remap() {
 }
 
 void init_interrupts() {
-    idt_ptr.limit = sizeof(IdtEntry) * 256 - 1;
+    idt_ptr.limit = sizeof(IdtEntry) * IDT_VECTORS - 1;
     idt_ptr.base = (uint64_t)&idt;
 
     // Remap PIC to avoid conflict with exceptions
     pic_remap();
 
-    // Fill IDT with ISRs (0-31)
-    idt_set_gate(0, (uint64_t)isr0, 0x08, 0x8E);
-    idt_set_gate(1, (uint64_t)isr1, 0x08, 0x8E);
-    idt_set_gate(2, (uint64_t)isr2, 0x08, 0x8E);
-    idt_set_gate(3, (uint64_t)isr3, 0x08, 0x8E);
-    idt_set_gate(4, (uint64_t)isr4, 0x08, 0x8E);
-    idt_set_gate(5, (uint64_t)isr5, 0x08, 0x8E);
-    idt_set_gate(6, (uint64_t)isr6, 0x08, 0x8E);
-    idt_set_gate(7, (uint64_t)isr7, 0x08, 0x8E);
-    idt_set_gate(8, (uint64_t)isr8, 0x08, 0x8E);
-    idt_set_gate(9, (uint64_t)isr9, 0x08, 0x8E);
-    idt_set_gate(10, (uint64_t)isr10, 0x08, 0x8E);
-    idt_set_gate(11, (uint64_t)isr11, 0x08, 0x8E);
-    idt_set_gate(12, (uint64_t)isr12, 0x08, 0x8E);
-    idt_set_gate(13, (uint64_t)isr13, 0x08, 0x8E);
-    idt_set_gate(14, (uint64_t)isr14, 0x08, 0x8E);
-    idt_set_gate(15, (uint64_t)isr15, 0x08, 0x8E);
-    idt_set_gate(16, (uint64_t)isr16, 0x08, 0x8E);
-    idt_set_gate(17, (uint64_t)isr17, 0x08, 0x8E);
-    idt_set_gate(18, (uint64_t)isr18, 0x08, 0x8E);
-    idt_set_gate(19, (uint64_t)isr19, 0x08, 0x8E);
-    idt_set_gate(20, (uint64_t)isr20, 0x08, 0x8E);
-    idt_set_gate(21, (uint64_t)isr21, 0x08, 0x8E);
-    idt_set_gate(22, (uint64_t)isr22, 0x08, 0x8E);
-    idt_set_gate(23, (uint64_t)isr23, 0x08, 0x8E);
-    idt_set_gate(24, (uint64_t)isr24, 0x08, 0x8E);
-    idt_set_gate(25, (uint64_t)isr25, 0x08, 0x8E);
-    idt_set_gate(26, (uint64_t)isr26, 0x08, 0x8E);
-    idt_set_gate(27, (uint64_t)isr27, 0x08, 0x8E);
-    idt_set_gate(28, (uint64_t)isr28, 0x08, 0x8E);
-    idt_set_gate(29, (uint64_t)isr29, 0x08, 0x8E);
-    idt_set_gate(30, (uint64_t)isr30, 0x08, 0x8E);
-    idt_set_gate(31, (uint64_t)isr31, 0x08, 0x8E);
-
-    // IRQs (32-47)
-    idt_set_gate(32, (uint64_t)irq0, 0x08, 0x8E);
-    idt_set_gate(33, (uint64_t)irq1, 0x08, 0x8E);
-    idt_set_gate(34, (uint64_t)irq2, 0x08, 0x8E);
-    idt_set_gate(35, (uint64_t)irq3, 0x08, 0x8E);
-    idt_set_gate(36, (uint64_t)irq4, 0x08, 0x8E);
-    idt_set_gate(37, (uint64_t)irq5, 0x08, 0x8E);
-    idt_set_gate(38, (uint64_t)irq6, 0x08, 0x8E);
-    idt_set_gate(39, (uint64_t)irq7, 0x08, 0x8E);
-    idt_set_gate(40, (uint64_t)irq8, 0x08, 0x8E);
-    idt_set_gate(41, (uint64_t)irq9, 0x08, 0x8E);
-    idt_set_gate(42, (uint64_t)irq10, 0x08, 0x8E);
-    idt_set_gate(43, (uint64_t)irq11, 0x08, 0x8E);
-    idt_set_gate(44, (uint64_t)irq12, 0x08, 0x8E);
-    idt_set_gate(45, (uint64_t)irq13, 0x08, 0x8E);
-    idt_set_gate(46, (uint64_t)irq14, 0x08, 0x8E);
-    idt_set_gate(47, (uint64_t)irq15, 0x08, 0x8E);
+    // Exceptions (0-31), PIC IRQs (32-47) and the rest
+    for (int v = 0; v < IDT_VECTORS; v++) {
+        idt_set_gate(v, (uint64_t)&interrupt_stubs[v * INTERRUPT_STUB_SIZE], 0x08, 0x8E);
+    }
 
     asm volatile("lidt %0" : : "m"(idt_ptr));
 }
 
-void irq_install_handler(int irq, IsrHandler handler) {
+void register_interrupt_handler(uint8_t vector, IrqHandler handler) {
+    if (vector >= IRQ_VECTOR_BASE) {
+        rcu_assign_pointer(irq_routines[vector], handler);
+    }
+}
+
+void irq_install_handler(int irq, IrqHandler handler) {
     if (irq >= 0 && irq < 16) {
-        irq_routines[irq] = handler;
+        register_interrupt_handler(IRQ_VECTOR_BASE + irq, handler);
+    }
+}
+
+// After this returns no CPU is still running the old handler, so its
+// code and data may be torn down.
+void irq_uninstall_handler(int irq) {
+    if (irq >= 0 && irq < 16) {
+        register_interrupt_handler(IRQ_VECTOR_BASE + irq, nullptr);
+        synchronize_rcu();
+    }
+}
+
+// Clear the line's PIC mask bit; slave lines also need the IRQ2 cascade
+void irq_unmask(int irq) {
+    if (irq < 0 || irq >= 16) return;
+    if (irq >= 8) {
+        outb(0xA1, inb(0xA1) & ~(1 << (irq - 8)));
+        irq = 2;
+    }
+    outb(0x21, inb(0x21) & ~(1 << irq));
+}
+
+// Set the line's PIC mask bit (the IRQ2 cascade stays open for other lines)
+void irq_mask(int irq) {
+    if (irq < 0 || irq >= 16) return;
+    if (irq >= 8) {
+        outb(0xA1, inb(0xA1) | (1 << (irq - 8)));
+    } else {
+        outb(0x21, inb(0x21) | (1 << irq));
     }
 }
 
+bool irq_masked(int irq) {
+    if (irq < 0 || irq >= 16) return true;
+    if (irq >= 8) return (inb(0xA1) & (1 << (irq - 8))) != 0;
+    return (inb(0x21) & (1 << irq)) != 0;
+}
+
 extern "C" void isr_handler(Registers* regs) {
+    irqstat_record((uint8_t)regs->int_no, 0, 0, 0); // Count the exception before we halt
+    if ((regs->cs & 3) != 0) {
+        process_fault(regs); // Raised by ring 3: only the process dies
+    }
     kprint("Received Interrupt: ");
     // Convert int_no to string manually or print custom message
     // Just a placeholder for exceptions
     panic("Unhandled Exception");
 }
 
-extern "C" void irq_handler(Registers* regs) {
-    IsrHandler handler = irq_routines[regs->int_no - 32]; // Get handler for IRQ by index // Function pointer for interrupt handler typedef void (*IsrHandler)(Registers* regs);
+extern "C" void irq_handler(IrqFrame* frame, uint64_t entry_tsc) {
+    uint64_t start_tsc = rdtsc();
+    uint64_t vector = frame->int_no;
+    if (TRACE_ENABLED(TRACE_IRQ)) trace_record(TRACE_IRQ, "irq", TRACE_PH_BEGIN, vector, entry_tsc);
+    rcu_read_lock();
+    IrqHandler handler = rcu_dereference(irq_routines[vector]);
     if (handler) {
-        handler(regs); // Call handler
+        handler(frame);
     }
+    rcu_read_unlock();
+    uint64_t end_tsc = rdtsc();
 
-    // Send EOI to PICs
-    if (regs->int_no >= 40) {
+    // Send EOI to PICs; other vectors do not come from the PIC
+    if (vector >= IRQ_VECTOR_BASE + 8 && vector < IRQ_VECTOR_BASE + 16) {
         outb(0xA0, 0x20); // Slave PIC WHEN IRQ > 7 EOI 
     }
-    outb(0x20, 0x20); // Master PIC EOI 
+    if (vector >= IRQ_VECTOR_BASE && vector < IRQ_VECTOR_BASE + 16) {
+        outb(0x20, 0x20); // Master PIC EOI 
+    }
+    TRACE_END(TRACE_IRQ, "irq", vector);
+
+    irqstat_record((uint8_t)vector, entry_tsc, start_tsc, end_tsc);
 }
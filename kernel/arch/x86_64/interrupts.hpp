@@ -19,7 +19,15 @@ struct IdtPtr {
     uint64_t base;
 } __attribute__((packed));
 
-// Registers passed from assembly stub
+#define IDT_VECTORS     256
+#define IRQ_VECTOR_BASE 32    // PIC IRQ 0..15 are remapped to vectors 32..47
+
+// interrupt_stubs.asm emits one entry of this many bytes per vector, in
+// vector order, starting at interrupt_stubs
+#define INTERRUPT_STUB_SIZE 16
+
+// Full frame built by the exception stub (vectors 0..31): every GPR, so a
+// fault can be reported or the interrupted context resumed elsewhere
 struct Registers {
     uint64_t r15, r14, r13, r12, r11, r10, r9, r8;
     uint64_t rbp, rdi, rsi, rdx, rcx, rbx, rax;
@@ -27,11 +35,26 @@ struct Registers {
     uint64_t rip, cs, rflags, rsp, ss;
 };
 
-// Function pointer for interrupt handler
-typedef void (*IsrHandler)(Registers* regs);
+// Frame built by the interrupt stub (vectors 32..255). irq_handler follows
+// the SysV ABI, so only the caller-saved registers are saved; rbp is kept
+// for stack walks from the interrupted code.
+struct IrqFrame {
+    uint64_t rbp;
+    uint64_t r11, r10, r9, r8, rdi, rsi, rdx, rcx, rax;
+    uint64_t int_no;
+    uint64_t rip, cs, rflags, rsp, ss;
+};
+
+typedef void (*IrqHandler)(IrqFrame* frame);
 
 void init_interrupts();
-void register_interrupt_handler(uint8_t n, IsrHandler handler);
-void irq_install_handler(int irq, IsrHandler handler);
+// Any vector from IRQ_VECTOR_BASE up; exceptions have fixed handling
+void register_interrupt_handler(uint8_t vector, IrqHandler handler);
+void irq_install_handler(int irq, IrqHandler handler);
+void irq_uninstall_handler(int irq);
+// Let the PIC deliver this line, or stop it. Boot-time, or with interrupts off.
+void irq_unmask(int irq);
+void irq_mask(int irq);
+bool irq_masked(int irq);
 
 #endif
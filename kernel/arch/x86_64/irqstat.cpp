@@ -0,0 +1,107 @@
+#include "irqstat.hpp"
+#include "console.hpp"
+
+static IrqStat stats[IRQSTAT_VECTORS];
+static uint64_t max_irqs_off = 0;   // Longest interval observed with IF=0
+static int max_irqs_off_vector = 0;
+
+static int bucket_for(uint64_t cycles) {
+    if (cycles == 0) return 0;
+    int b = 63 - __builtin_clzll(cycles); // floor(log2(cycles))
+    return b < IRQSTAT_BUCKETS ? b : IRQSTAT_BUCKETS - 1;
+}
+
+void irqstat_record(uint8_t vector, uint64_t entry_tsc, uint64_t start_tsc, uint64_t end_tsc) {
+    IrqStat* s = &stats[vector];
+    uint64_t cycles = end_tsc - start_tsc;
+
+    s->count++;
+    s->total_cycles += cycles;
+    s->entry_cycles += start_tsc - entry_tsc;
+    if (cycles > s->max_cycles) {
+        s->max_cycles = cycles;
+    }
+    s->hist[bucket_for(cycles)]++;
+
+    // The CPU clears IF on gate entry, so stub entry -> EOI is an irqs-off window
+    irqstat_note_irqs_off(end_tsc - entry_tsc, vector);
+}
+
+void irqstat_note_irqs_off(uint64_t cycles, int vector) {
+    if (cycles > max_irqs_off) {
+        max_irqs_off = cycles;
+        max_irqs_off_vector = vector;
+    }
+}
+
+const IrqStat* irqstat_get(uint8_t vector) {
+    return &stats[vector];
+}
+
+void irqstat_reset() {
+    for (int v = 0; v < IRQSTAT_VECTORS; v++) {
+        IrqStat* s = &stats[v];
+        s->count = 0;
+        s->total_cycles = 0;
+        s->entry_cycles = 0;
+        s->max_cycles = 0;
+        for (int b = 0; b < IRQSTAT_BUCKETS; b++) {
+            s->hist[b] = 0;
+        }
+    }
+    max_irqs_off = 0;
+    max_irqs_off_vector = 0;
+}
+
+static void print_histogram(const IrqStat* s) {
+    kprint("    hist:");
+    for (int b = 0; b < IRQSTAT_BUCKETS; b++) {
+        if (s->hist[b] == 0) continue;
+        kprint(" [");
+        kprint_int((int64_t)1 << b);
+        kprint(b == IRQSTAT_BUCKETS - 1 ? "+" : "-");
+        if (b != IRQSTAT_BUCKETS - 1) {
+            kprint_int(((int64_t)1 << (b + 1)) - 1);
+        }
+        kprint("]:");
+        kprint_int(s->hist[b]);
+    }
+    kprint("\n");
+}
+
+void irqstat_command() {
+    kprint("\n--- IRQ Stats (cycles) ---\n");
+    bool any = false;
+    for (int v = 0; v < IRQSTAT_VECTORS; v++) {
+        const IrqStat* s = &stats[v];
+        if (s->count == 0) continue;
+        any = true;
+
+        kprint("vec "); kprint_int(v);
+        if (v >= 32 && v < 48) {
+            kprint(" (IRQ "); kprint_int(v - 32); kprint(")");
+        }
+        kprint(": count="); kprint_int(s->count);
+        kprint(" avg="); kprint_int(s->total_cycles / s->count);
+        kprint(" max="); kprint_int(s->max_cycles);
+        if (s->entry_cycles != 0) {
+            kprint(" entry="); kprint_int(s->entry_cycles / s->count);
+        }
+        kprint("\n");
+        print_histogram(s);
+    }
+    if (!any) {
+        kprint("(no interrupts recorded)\n");
+    }
+
+    kprint("Max IRQs-disabled interval: ");
+    kprint_int(max_irqs_off);
+    if (max_irqs_off_vector == IRQSTAT_NO_VECTOR) {
+        kprint(" cycles (irqsave lock section)\n");
+    } else {
+        kprint(" cycles (vector ");
+        kprint_int(max_irqs_off_vector);
+        kprint(")\n");
+    }
+    kprint("--------------------------\n");
+}
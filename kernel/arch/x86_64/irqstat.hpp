@@ -0,0 +1,32 @@
+#ifndef IRQSTAT_HPP
+#define IRQSTAT_HPP
+
+#include "types.h"
+
+// Handler durations are bucketed by power of two: bucket i counts
+// durations in [2^i, 2^(i+1)) cycles. The last bucket catches everything above.
+#define IRQSTAT_BUCKETS 24
+#define IRQSTAT_VECTORS 256
+
+struct IrqStat {
+    uint64_t count;        // How many times the vector fired
+    uint64_t total_cycles; // Sum of handler durations
+    uint64_t entry_cycles; // Sum of stub entry -> handler dispatch
+    uint64_t max_cycles;   // Longest handler run
+    uint64_t hist[IRQSTAT_BUCKETS];
+};
+
+// Called from irq_handler with the TSC taken in the common stub (entry)
+// and around the registered handler (start/end).
+void irqstat_record(uint8_t vector, uint64_t entry_tsc, uint64_t start_tsc, uint64_t end_tsc);
+
+// Report a stretch of code that ran with interrupts disabled. Sections
+// outside interrupt handlers (e.g. irqsave spinlocks) pass IRQSTAT_NO_VECTOR.
+#define IRQSTAT_NO_VECTOR -1
+void irqstat_note_irqs_off(uint64_t cycles, int vector);
+
+const IrqStat* irqstat_get(uint8_t vector);
+void irqstat_reset();
+void irqstat_command();
+
+#endif
@@ -30,6 +30,14 @@ struct multiboot_tag_string {
     char string[0];
 };
 
+struct multiboot_tag_module {
+    uint32_t type;
+    uint32_t size;
+    uint32_t mod_start; // Physical range [mod_start, mod_end)
+    uint32_t mod_end;
+    char cmdline[0];    // The words after the path on the module2 line
+};
+
 struct multiboot_tag_basic_meminfo {
     uint32_t type;
     uint32_t size;
@@ -52,4 +60,20 @@ struct multiboot_tag_mmap {
     struct multiboot_mmap_entry entries[0];
 };
 
+// Walk the tag list: returns the first tag of `type` after `prev`
+// (nullptr to start from the beginning), or nullptr when there is none.
+static inline multiboot_tag* multiboot_find_tag(void* mbi, uint32_t type, multiboot_tag* prev) {
+    uint8_t* base = (uint8_t*)mbi;
+    uint32_t total_size = *(uint32_t*)base;
+    uint8_t* tag_ptr = prev ? (uint8_t*)prev + ((prev->size + 7) & ~7) : base + 8;
+
+    while ((uint32_t)(tag_ptr - base) < total_size) {
+        multiboot_tag* tag = (multiboot_tag*)tag_ptr;
+        if (tag->type == MULTIBOOT_TAG_TYPE_END) break;
+        if (tag->type == type) return tag;
+        tag_ptr += (tag->size + 7) & ~7;
+    }
+    return nullptr;
+}
+
 #endif
@@ -15,6 +15,35 @@ static inline void outb(uint16_t port, uint8_t data) {
     asm volatile("outb %0, %1" : : "a"(data), "Nd"(port)); // write a byte to a port    
 }
 
+static inline uint16_t inw(uint16_t port) {
+    uint16_t result;
+    asm volatile("inw %1, %0" : "=a"(result) : "Nd"(port));
+    return result;
+}
+
+static inline void outw(uint16_t port, uint16_t data) {
+    asm volatile("outw %0, %1" : : "a"(data), "Nd"(port));
+}
+
+static inline uint32_t inl(uint16_t port) {
+    uint32_t result;
+    asm volatile("inl %1, %0" : "=a"(result) : "Nd"(port));
+    return result;
+}
+
+static inline void outl(uint16_t port, uint32_t data) {
+    asm volatile("outl %0, %1" : : "a"(data), "Nd"(port));
+}
+
+// Move `count` 16-bit words between a port and memory (ATA PIO data)
+static inline void insw(uint16_t port, void* buf, size_t count) {
+    asm volatile("rep insw" : "+D"(buf), "+c"(count) : "d"(port) : "memory");
+}
+
+static inline void outsw(uint16_t port, const void* buf, size_t count) {
+    asm volatile("rep outsw" : "+S"(buf), "+c"(count) : "d"(port) : "memory");
+}
+
 // this function is used to wait for the I/O to complete
 static inline void io_wait() {
     outb(0x80, 0);
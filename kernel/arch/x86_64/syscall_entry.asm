@@ -0,0 +1,114 @@
+; Ring 3 entry and exit. Selector values must match gdt.hpp.
+%define USER_CS (0x20 | 3)
+%define USER_SS (0x18 | 3)
+
+section .data
+global syscall_kernel_rsp
+syscall_kernel_rsp: dq 0   ; Top of the running process's kernel stack
+syscall_user_rsp:   dq 0   ; Scratch: one CPU, and SFMASK keeps IF clear until we switch
+
+section .text
+extern syscall_dispatch
+
+; SYSCALL: rcx = user rip, r11 = user rflags, rax = number, arguments in
+; rdi, rsi, rdx, r10, r8, r9 (Linux order). The CPU does not switch stacks.
+global syscall_entry
+syscall_entry:
+    mov [rel syscall_user_rsp], rsp
+    mov rsp, [rel syscall_kernel_rsp]
+    push qword [rel syscall_user_rsp]
+    push rcx
+    push r11
+    push rax
+    push rdi
+    push rsi
+    push rdx
+    push r10
+    push r8
+    push r9              ; 10 pushes: rsp stays 16-byte aligned for the call
+    sti                  ; Syscalls may wait for the keyboard
+
+    mov rdi, rsp         ; SyscallFrame*
+    call syscall_dispatch
+
+    ; Restore every register the C code may have clobbered except rax (the
+    ; result), so no kernel values reach ring 3
+    cli
+    pop r9
+    pop r8
+    pop r10
+    pop rdx
+    pop rsi
+    pop rdi
+    add rsp, 8           ; Syscall number
+
+    ; Intel raises SYSRET's #GP for a non-canonical rip in ring 0 with the
+    ; user rsp already loaded: anything above user space leaves via iretq
+    mov rcx, [rsp + 8]   ; User rip
+    shr rcx, 47
+    jnz .iret
+    pop r11
+    pop rcx
+    pop rsp
+    o64 sysret
+
+.iret:
+    pop r11
+    pop rcx
+    pop qword [rel syscall_user_rsp]
+    push USER_SS
+    push qword [rel syscall_user_rsp]
+    push r11             ; RFLAGS
+    push USER_CS
+    push rcx             ; User rip
+    iretq
+
+; int64_t user_enter(uint64_t rip, uint64_t rsp, uint64_t* saved_rsp)
+; Save the callee-saved registers and enter ring 3 at rip with IF set.
+; Returns the code later passed to user_return.
+global user_enter
+user_enter:
+    push rbx
+    push rbp
+    push r12
+    push r13
+    push r14
+    push r15
+    mov [rdx], rsp
+
+    push USER_SS
+    push rsi             ; User rsp
+    push 0x202           ; RFLAGS: IF
+    push USER_CS
+    push rdi             ; User rip
+
+    xor eax, eax
+    xor ebx, ebx
+    xor ecx, ecx
+    xor edx, edx
+    xor esi, esi
+    xor edi, edi
+    xor ebp, ebp
+    xor r8d, r8d
+    xor r9d, r9d
+    xor r10d, r10d
+    xor r11d, r11d
+    xor r12d, r12d
+    xor r13d, r13d
+    xor r14d, r14d
+    xor r15d, r15d
+    iretq
+
+; void user_return(uint64_t saved_rsp, int64_t code)
+; Abandon the process's kernel stack and return from user_enter.
+global user_return
+user_return:
+    mov rsp, rdi
+    mov rax, rsi
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop rbp
+    pop rbx
+    ret
@@ -0,0 +1,59 @@
+#include "tsc.hpp"
+#include "cpu.hpp"
+#include "ports.hpp"
+
+#define PIT_HZ          1193182
+#define PIT_CH2_DATA    0x42
+#define PIT_COMMAND     0x43
+#define PIT_GATE_PORT   0x61
+#define CALIBRATE_MS    10
+
+static uint64_t tsc_frequency = 0;
+
+void tsc_calibrate() {
+    const uint16_t reload = (uint16_t)(PIT_HZ * CALIBRATE_MS / 1000);
+
+    // Gate channel 2 on, speaker off
+    uint8_t gate = inb(PIT_GATE_PORT);
+    outb(PIT_GATE_PORT, (gate & ~0x02) | 0x01);
+
+    // Channel 2, lo/hi byte, mode 0 (interrupt on terminal count), binary
+    outb(PIT_COMMAND, 0xB0);
+    outb(PIT_CH2_DATA, reload & 0xFF);
+    outb(PIT_CH2_DATA, reload >> 8);
+
+    // Restart the count by toggling the gate
+    gate = inb(PIT_GATE_PORT);
+    outb(PIT_GATE_PORT, gate & ~0x01);
+    outb(PIT_GATE_PORT, gate | 0x01);
+
+    uint64_t start = rdtsc();
+    while (!(inb(PIT_GATE_PORT) & 0x20)) {
+        // OUT2 goes high when the count reaches zero
+    }
+    uint64_t end = rdtsc();
+
+    tsc_frequency = (end - start) * (1000 / CALIBRATE_MS);
+}
+
+uint64_t tsc_hz() {
+    return tsc_frequency;
+}
+
+uint64_t tsc_cycles_to_ns(uint64_t cycles) {
+    if (tsc_frequency == 0) return 0;
+    // Split to avoid overflowing cycles * 1e9
+    uint64_t sec = cycles / tsc_frequency;
+    uint64_t rem = cycles % tsc_frequency;
+    return sec * 1000000000ULL + rem * 1000000000ULL / tsc_frequency;
+}
+
+uint64_t tsc_mb_per_sec(uint64_t bytes, uint64_t cycles) {
+    uint64_t ns = tsc_cycles_to_ns(cycles);
+    if (ns == 0) return 0;
+    // bytes * 1e9 / ns / 2^20; bytes * 1e9 only fits in 64 bits below 16GB
+    if (bytes < (1ULL << 34)) {
+        return (bytes * 1000000000ULL / ns) >> 20;
+    }
+    return (bytes / ns * 1000000000ULL) >> 20;
+}
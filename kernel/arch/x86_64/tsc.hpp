@@ -0,0 +1,16 @@
+#ifndef TSC_HPP
+#define TSC_HPP
+
+#include "types.h"
+
+// Measure the TSC frequency against PIT channel 2 (call once at boot,
+// before interrupts are needed for anything else on the PIT).
+void tsc_calibrate();
+
+uint64_t tsc_hz();                       // 0 until calibrated
+uint64_t tsc_cycles_to_ns(uint64_t cycles);
+
+// Bytes moved in `cycles` expressed as MB/s (0 if not calibrated)
+uint64_t tsc_mb_per_sec(uint64_t bytes, uint64_t cycles);
+
+#endif
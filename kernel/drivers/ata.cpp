@@ -0,0 +1,446 @@
+#include "ata.hpp"
+#include "block.hpp"
+#include "pci.hpp"
+#include "console.hpp"
+#include "cpu.hpp"
+#include "tsc.hpp"
+#include "interrupts.hpp"
+#include "ports.hpp"
+#include "../lib/string.hpp"
+#include "../mm/pmm.hpp"
+#include "../mm/vmm.hpp"
+
+// Task-file registers (offsets from the channel's I/O base)
+#define ATA_REG_DATA    0
+#define ATA_REG_COUNT   2
+#define ATA_REG_LBA0    3
+#define ATA_REG_LBA1    4
+#define ATA_REG_LBA2    5
+#define ATA_REG_DRIVE   6
+#define ATA_REG_STATUS  7   // Read
+#define ATA_REG_COMMAND 7   // Write
+
+#define ATA_SR_BSY  0x80
+#define ATA_SR_DF   0x20
+#define ATA_SR_DRQ  0x08
+#define ATA_SR_ERR  0x01
+
+#define ATA_CTRL_NIEN 0x02  // Device control: mask INTRQ
+#define ATA_CTRL_SRST 0x04  // Device control: software reset of both drives
+
+#define ATA_CMD_READ_PIO      0x20
+#define ATA_CMD_READ_PIO_EXT  0x24
+#define ATA_CMD_READ_DMA_EXT  0x25
+#define ATA_CMD_WRITE_PIO     0x30
+#define ATA_CMD_WRITE_PIO_EXT 0x34
+#define ATA_CMD_WRITE_DMA_EXT 0x35
+#define ATA_CMD_READ_DMA      0xC8
+#define ATA_CMD_WRITE_DMA     0xCA
+#define ATA_CMD_IDENTIFY      0xEC
+
+// Bus-master IDE registers (offsets from the channel's BMIDE base)
+#define BM_COMMAND   0
+#define BM_STATUS    2
+#define BM_PRDT      4
+#define BM_CMD_START 0x01
+#define BM_CMD_READ  0x08   // Device -> memory
+#define BM_SR_ERROR  0x02
+#define BM_SR_IRQ    0x04
+#define BM_SR_DRV0_DMA 0x20 // Drive 0 is DMA capable (drive 1: << 1)
+
+#define ATA_MAX_SECTORS 256      // Per command (LBA28 count register)
+#define ATA_MAX_CHAIN   64       // Merged requests per command
+// Status polling limits. ata_start() runs with block_lock held and IRQs
+// off, so it only gives a drive that is still busy a short grace period.
+#define ATA_START_TIMEOUT_US    10000
+#define ATA_IDENTIFY_TIMEOUT_US 1000000
+#define ATA_RESET_TIMEOUT_US    100000
+#define LBA28_LIMIT     (1ULL << 28)
+
+// Physical Region Descriptor: one DMA chunk, must not cross 64 KB
+struct AtaPrd {
+    uint32_t phys;
+    uint16_t bytes;  // 0 means 64 KB
+    uint16_t flags;
+} __attribute__((packed));
+
+#define PRD_EOT      0x8000
+#define PRDT_ENTRIES (PAGE_SIZE / sizeof(AtaPrd))
+
+struct AtaChannel;
+
+struct AtaDrive {
+    AtaChannel* channel;
+    uint8_t slave;
+    bool lba48;
+    bool dma;          // IDENTIFY reports DMA support
+    bool waiting;      // Turned away while the channel was busy
+    uint64_t sectors;
+    char model[41];
+    BlockDevice* dev;
+};
+
+// Both drives of a channel share its registers: one command at a time
+struct AtaChannel {
+    uint16_t io;
+    uint16_t ctrl;     // Alternate status (read) / device control (write)
+    uint16_t bmide;    // 0: no bus master, PIO only
+    uint8_t irq;
+    AtaPrd* prdt;
+    uint32_t prdt_phys;
+    AtaDrive drives[2];
+
+    // The command in flight
+    AtaDrive* current;
+    bool dma_active;
+    bool writing;
+    BlockRequest* pio_seg;  // PIO cursor: segment, sector in it, sectors left
+    uint32_t pio_index;
+    uint32_t pio_left;
+};
+
+static AtaChannel channels[2];
+static bool use_dma = true;
+
+// Reading the alternate status four times gives the drive the 400 ns it
+// needs to present a valid status after a select or command
+static void delay400(AtaChannel* ch) {
+    for (int i = 0; i < 4; i++) inb(ch->ctrl);
+}
+
+static uint64_t deadline_us(uint64_t us) {
+    return rdtsc() + tsc_hz() / 1000000 * us;
+}
+
+static bool wait_not_busy(AtaChannel* ch, uint64_t us) {
+    uint64_t deadline = deadline_us(us);
+    while (inb(ch->ctrl) & ATA_SR_BSY) {
+        if (rdtsc() >= deadline) return false;
+    }
+    return true;
+}
+
+static bool wait_drq(AtaChannel* ch, uint64_t us) {
+    uint64_t deadline = deadline_us(us);
+    for (;;) {
+        uint8_t st = inb(ch->ctrl);
+        if (st & (ATA_SR_ERR | ATA_SR_DF)) return false;
+        if (!(st & ATA_SR_BSY) && (st & ATA_SR_DRQ)) return true;
+        if (rdtsc() >= deadline) return false;
+    }
+}
+
+// Fill the PRD table for a request chain; false if some buffer is not
+// DMA-able (outside the direct map, odd address, above 4 GB) or too fragmented
+static bool build_prdt(AtaChannel* ch, BlockRequest* head) {
+    size_t n = 0;
+    for (BlockRequest* r = head; r; r = r->chain_next) {
+        uint64_t virt = (uint64_t)r->buf;
+        if (virt < KERNEL_VMA || virt - KERNEL_VMA >= DIRECT_MAP_SIZE) return false;
+        uint64_t phys = virt_to_phys(r->buf);
+        uint64_t len = (uint64_t)r->count * BLOCK_SECTOR_SIZE;
+        if ((phys & 1) || phys + len > 0x100000000ULL) return false;
+
+        while (len) {
+            uint64_t chunk = 0x10000 - (phys & 0xFFFF);
+            if (chunk > len) chunk = len;
+            if (n == PRDT_ENTRIES) return false;
+            ch->prdt[n].phys = (uint32_t)phys;
+            ch->prdt[n].bytes = (uint16_t)chunk; // 64 KB wraps to 0, as required
+            ch->prdt[n].flags = 0;
+            n++;
+            phys += chunk;
+            len -= chunk;
+        }
+    }
+    ch->prdt[n - 1].flags = PRD_EOT;
+    return true;
+}
+
+// Move one sector through the data port and advance the PIO cursor
+static void pio_transfer(AtaChannel* ch) {
+    uint8_t* p = (uint8_t*)ch->pio_seg->buf + (size_t)ch->pio_index * BLOCK_SECTOR_SIZE;
+    if (ch->writing) {
+        outsw(ch->io + ATA_REG_DATA, p, BLOCK_SECTOR_SIZE / 2);
+    } else {
+        insw(ch->io + ATA_REG_DATA, p, BLOCK_SECTOR_SIZE / 2);
+    }
+    ch->pio_left--;
+    if (++ch->pio_index == ch->pio_seg->count) {
+        ch->pio_seg = ch->pio_seg->chain_next;
+        ch->pio_index = 0;
+    }
+}
+
+static int ata_start(BlockDevice* dev, BlockRequest* req) {
+    AtaDrive* d = (AtaDrive*)dev->driver_data;
+    AtaChannel* ch = d->channel;
+    if (ch->current) {
+        d->waiting = true;
+        return BLOCK_EBUSY;
+    }
+
+    uint64_t lba = req->lba;
+    uint32_t count = req->chain_sectors;
+    bool ext = lba + count > LBA28_LIMIT;
+    bool writing = req->op == BlockOp::Write;
+    bool dma = use_dma && d->dma && ch->bmide && build_prdt(ch, req);
+
+    uint8_t cmd;
+    if (dma) {
+        cmd = writing ? (ext ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_WRITE_DMA)
+                      : (ext ? ATA_CMD_READ_DMA_EXT : ATA_CMD_READ_DMA);
+    } else {
+        cmd = writing ? (ext ? ATA_CMD_WRITE_PIO_EXT : ATA_CMD_WRITE_PIO)
+                      : (ext ? ATA_CMD_READ_PIO_EXT : ATA_CMD_READ_PIO);
+    }
+
+    uint8_t select = ext ? 0x40 : (uint8_t)(0xE0 | ((lba >> 24) & 0x0F));
+    outb(ch->io + ATA_REG_DRIVE, select | (uint8_t)(d->slave << 4));
+    delay400(ch);
+    if (!wait_not_busy(ch, ATA_START_TIMEOUT_US)) return BLOCK_EIO;
+
+    if (ext) {
+        // High-order bytes first; the registers are two-deep FIFOs
+        outb(ch->io + ATA_REG_COUNT, (uint8_t)(count >> 8));
+        outb(ch->io + ATA_REG_LBA0, (uint8_t)(lba >> 24));
+        outb(ch->io + ATA_REG_LBA1, (uint8_t)(lba >> 32));
+        outb(ch->io + ATA_REG_LBA2, (uint8_t)(lba >> 40));
+    }
+    outb(ch->io + ATA_REG_COUNT, (uint8_t)count); // 256 is written as 0
+    outb(ch->io + ATA_REG_LBA0, (uint8_t)lba);
+    outb(ch->io + ATA_REG_LBA1, (uint8_t)(lba >> 8));
+    outb(ch->io + ATA_REG_LBA2, (uint8_t)(lba >> 16));
+
+    ch->current = d;
+    ch->dma_active = dma;
+    ch->writing = writing;
+
+    if (dma) {
+        uint8_t dir = writing ? 0 : BM_CMD_READ;
+        outb(ch->bmide + BM_COMMAND, 0);
+        outl(ch->bmide + BM_PRDT, ch->prdt_phys);
+        outb(ch->bmide + BM_STATUS, inb(ch->bmide + BM_STATUS) | BM_SR_ERROR | BM_SR_IRQ);
+        outb(ch->bmide + BM_COMMAND, dir);
+        outb(ch->io + ATA_REG_COMMAND, cmd);
+        outb(ch->bmide + BM_COMMAND, dir | BM_CMD_START);
+        return 0;
+    }
+
+    ch->pio_seg = req;
+    ch->pio_index = 0;
+    ch->pio_left = count;
+    outb(ch->io + ATA_REG_COMMAND, cmd);
+    if (writing) {
+        // The first sector goes out now; each interrupt asks for the next
+        if (!wait_drq(ch, ATA_START_TIMEOUT_US)) {
+            ch->current = nullptr;
+            return BLOCK_EIO;
+        }
+        pio_transfer(ch);
+    }
+    return 0;
+}
+
+static void finish(AtaChannel* ch, int status) {
+    AtaDrive* d = ch->current;
+    ch->current = nullptr;
+    ch->dma_active = false;
+    block_complete(d->dev, status);
+
+    AtaDrive* other = &ch->drives[d->slave ^ 1];
+    if (other->waiting) {
+        other->waiting = false;
+        block_kick(other->dev);
+    }
+}
+
+// Shared by the IRQ handlers and the polling path. Reading the status
+// register also deasserts the drive's INTRQ.
+static void service(AtaChannel* ch) {
+    if (!ch->current) {
+        inb(ch->io + ATA_REG_STATUS); // Spurious: acknowledge and ignore
+        return;
+    }
+
+    if (ch->dma_active) {
+        uint8_t bm = inb(ch->bmide + BM_STATUS);
+        if (!(bm & BM_SR_IRQ)) return; // Transfer still running
+        outb(ch->bmide + BM_COMMAND, 0);
+        uint8_t st = inb(ch->io + ATA_REG_STATUS);
+        outb(ch->bmide + BM_STATUS, bm | BM_SR_ERROR | BM_SR_IRQ);
+        bool failed = (bm & BM_SR_ERROR) || (st & (ATA_SR_ERR | ATA_SR_DF));
+        finish(ch, failed ? BLOCK_EIO : 0);
+        return;
+    }
+
+    uint8_t st = inb(ch->io + ATA_REG_STATUS);
+    if (st & ATA_SR_BSY) return;
+    if (st & (ATA_SR_ERR | ATA_SR_DF)) {
+        finish(ch, BLOCK_EIO);
+        return;
+    }
+    if (ch->writing) {
+        if (ch->pio_left == 0) {
+            finish(ch, 0);
+        } else if (st & ATA_SR_DRQ) {
+            pio_transfer(ch);
+        }
+    } else if (st & ATA_SR_DRQ) {
+        pio_transfer(ch);
+        if (ch->pio_left == 0) finish(ch, 0);
+    }
+}
+
+static void ata_poll(BlockDevice* dev) {
+    AtaChannel* ch = ((AtaDrive*)dev->driver_data)->channel;
+    delay400(ch); // Never sample a status older than the last data transfer
+    service(ch);
+}
+
+// Stop the bus master, pulse SRST and fail whatever was in flight
+static void ata_reset(BlockDevice* dev) {
+    AtaChannel* ch = ((AtaDrive*)dev->driver_data)->channel;
+    if (ch->bmide) outb(ch->bmide + BM_COMMAND, 0);
+    outb(ch->ctrl, ATA_CTRL_SRST | ATA_CTRL_NIEN);
+    uint64_t until = deadline_us(5);
+    while (rdtsc() < until) delay400(ch);
+    outb(ch->ctrl, 0); // Interrupts back on
+    until = deadline_us(2000); // Drives may report a stale status for 2 ms
+    while (rdtsc() < until) delay400(ch);
+    wait_not_busy(ch, ATA_RESET_TIMEOUT_US); // Still busy: the next command fails
+    inb(ch->io + ATA_REG_STATUS);
+    if (ch->bmide) outb(ch->bmide + BM_STATUS, inb(ch->bmide + BM_STATUS) | BM_SR_ERROR | BM_SR_IRQ);
+
+    if (ch->current) finish(ch, BLOCK_EIO);
+}
+
+static void ata_irq_primary(IrqFrame* frame) {
+    (void)frame;
+    service(&channels[0]);
+}
+
+static void ata_irq_secondary(IrqFrame* frame) {
+    (void)frame;
+    service(&channels[1]);
+}
+
+static const BlockDeviceOps ata_ops = {
+    ata_start,
+    ata_poll,
+    ata_reset,
+};
+
+// Polled IDENTIFY DEVICE; false for empty slots and ATAPI (CD-ROM) drives
+static bool identify(AtaChannel* ch, AtaDrive* d) {
+    outb(ch->io + ATA_REG_DRIVE, (uint8_t)(0xA0 | (d->slave << 4)));
+    delay400(ch);
+    outb(ch->io + ATA_REG_COUNT, 0);
+    outb(ch->io + ATA_REG_LBA0, 0);
+    outb(ch->io + ATA_REG_LBA1, 0);
+    outb(ch->io + ATA_REG_LBA2, 0);
+    outb(ch->io + ATA_REG_COMMAND, ATA_CMD_IDENTIFY);
+
+    uint8_t st = inb(ch->io + ATA_REG_STATUS);
+    if (st == 0 || st == 0xFF) return false; // No drive / floating bus
+    if (!wait_not_busy(ch, ATA_IDENTIFY_TIMEOUT_US)) return false;
+    if (inb(ch->io + ATA_REG_LBA1) || inb(ch->io + ATA_REG_LBA2)) return false; // ATAPI signature
+    if (!wait_drq(ch, ATA_IDENTIFY_TIMEOUT_US)) return false;
+
+    uint16_t id[256];
+    insw(ch->io + ATA_REG_DATA, id, 256);
+    if (!(id[49] & (1 << 9))) return false; // No LBA
+
+    d->lba48 = (id[83] & (1 << 10)) != 0;
+    if (d->lba48) {
+        d->sectors = (uint64_t)id[100] | ((uint64_t)id[101] << 16) |
+                     ((uint64_t)id[102] << 32) | ((uint64_t)id[103] << 48);
+    } else {
+        d->sectors = (uint64_t)id[60] | ((uint64_t)id[61] << 16);
+    }
+    d->dma = (id[49] & (1 << 8)) != 0;
+
+    // Words 27..46, two characters per word, high byte first
+    for (int i = 0; i < 20; i++) {
+        d->model[2 * i] = (char)(id[27 + i] >> 8);
+        d->model[2 * i + 1] = (char)(id[27 + i] & 0xFF);
+    }
+    int len = 40;
+    while (len > 0 && d->model[len - 1] == ' ') len--;
+    d->model[len] = '\0';
+    return d->sectors != 0;
+}
+
+void ata_init() {
+    channels[0].io = 0x1F0;
+    channels[0].ctrl = 0x3F6;
+    channels[0].irq = 14;
+    channels[1].io = 0x170;
+    channels[1].ctrl = 0x376;
+    channels[1].irq = 15;
+
+    uint16_t bmide = 0;
+    PciAddress pci;
+    if (pci_find_class(0x01, 0x01, &pci)) { // Mass storage, IDE
+        uint8_t prog_if = (uint8_t)(pci_read32(pci, PCI_CLASS) >> 8);
+        if (prog_if & 0x05) {
+            kprint("ATA: controller in native PCI mode, not supported\n");
+            return;
+        }
+        uint32_t bar4 = pci_read32(pci, PCI_BAR4);
+        if ((prog_if & 0x80) && (bar4 & 1)) {
+            bmide = (uint16_t)(bar4 & 0xFFFC);
+            uint32_t cmd = pci_read32(pci, PCI_COMMAND) & 0xFFFF;
+            pci_write32(pci, PCI_COMMAND, cmd | PCI_COMMAND_IO | PCI_COMMAND_BUS_MASTER);
+        }
+    }
+
+    for (int c = 0; c < 2; c++) {
+        AtaChannel* ch = &channels[c];
+        if (inb(ch->io + ATA_REG_STATUS) == 0xFF) continue; // Nothing on this channel
+
+        outb(ch->ctrl, ATA_CTRL_NIEN); // IDENTIFY is polled
+        bool any = false;
+        for (uint8_t s = 0; s < 2; s++) {
+            AtaDrive* d = &ch->drives[s];
+            d->channel = ch;
+            d->slave = s;
+            if (!identify(ch, d)) continue;
+
+            char name[4] = {'h', 'd', (char)('a' + c * 2 + s), '\0'};
+            d->dev = block_register(name, d->sectors, ATA_MAX_SECTORS, ATA_MAX_CHAIN, &ata_ops, d);
+            if (!d->dev) continue;
+            any = true;
+
+            kprint("ATA: "); kprint(name); kprint(" \""); kprint(d->model); kprint("\", ");
+            kprint_int(d->sectors * BLOCK_SECTOR_SIZE / (1024 * 1024)); kprint(" MB");
+            if (d->lba48) kprint(", LBA48");
+            kprint(d->dma && bmide ? ", bus-master DMA\n" : ", PIO\n");
+        }
+        if (!any) continue;
+
+        if (bmide) {
+            void* frame = pmm.allocate_frame();
+            if (frame) {
+                ch->bmide = (uint16_t)(bmide + c * 8);
+                ch->prdt = (AtaPrd*)phys_to_virt((uint64_t)frame);
+                ch->prdt_phys = (uint32_t)(uint64_t)frame;
+                uint8_t capable = 0;
+                for (int s = 0; s < 2; s++) {
+                    if (ch->drives[s].dev && ch->drives[s].dma) capable |= (uint8_t)(BM_SR_DRV0_DMA << s);
+                }
+                outb(ch->bmide + BM_STATUS, (inb(ch->bmide + BM_STATUS) & ~(BM_SR_ERROR | BM_SR_IRQ)) | capable);
+            }
+        }
+
+        irq_install_handler(ch->irq, c == 0 ? ata_irq_primary : ata_irq_secondary);
+        irq_unmask(ch->irq);
+        outb(ch->ctrl, 0); // Interrupts on
+    }
+}
+
+bool ata_set_dma(bool enabled) {
+    bool old = use_dma;
+    use_dma = enabled;
+    return old;
+}
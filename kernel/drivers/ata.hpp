@@ -0,0 +1,15 @@
+#ifndef ATA_HPP
+#define ATA_HPP
+
+#include "types.h"
+
+// Legacy IDE (PATA) controller in compatibility mode: primary channel at
+// 0x1F0/IRQ14, secondary at 0x170/IRQ15. Disks are registered with the
+// block layer as hda..hdd. Transfers use bus-master DMA when the PCI IDE
+// function exposes it, interrupt-driven PIO otherwise.
+void ata_init();
+
+// Force PIO (false) or allow DMA (true); returns the previous setting
+bool ata_set_dma(bool enabled);
+
+#endif
@@ -0,0 +1,423 @@
+#include "block.hpp"
+#include "console.hpp"
+#include "cpu.hpp"
+#include "tsc.hpp"
+#include "interrupts.hpp"
+#include "../lib/spinlock.hpp"
+#include "../lib/string.hpp"
+#include "../lib/trace.hpp"
+#include "../mm/heap.hpp"
+
+static BlockDevice devices[BLOCK_MAX_DEVICES];
+static int device_count = 0;           // Grows at boot only
+static Spinlock block_lock("block");   // All queues and stats
+
+// Nothing else ticks while a wait sleeps in hlt, so the PIT (IRQ 0, left
+// at its power-on 18.2 Hz when the profiler is off) is unmasked to notice
+// a completion IRQ that never comes
+#define BLOCK_TICK_IRQ 0
+
+// Requests whose callbacks run once block_lock is dropped
+struct DoneList {
+    BlockRequest* first;
+    BlockRequest* last;
+};
+
+BlockDevice* block_register(const char* name, uint64_t sectors, uint32_t max_sectors,
+                            uint32_t max_chain, const BlockDeviceOps* ops, void* driver_data) {
+    if (device_count >= BLOCK_MAX_DEVICES) return nullptr;
+
+    BlockDevice* dev = &devices[device_count];
+    size_t len = strlen(name);
+    if (len >= BLOCK_NAME_MAX) len = BLOCK_NAME_MAX - 1;
+    memcpy(dev->name, name, len);
+    dev->name[len] = '\0';
+    dev->sectors = sectors;
+    dev->max_sectors = max_sectors;
+    dev->max_chain = max_chain;
+    dev->ops = ops;
+    dev->driver_data = driver_data;
+    device_count++;
+    return dev;
+}
+
+BlockDevice* block_find(const char* name) {
+    for (int i = 0; i < device_count; i++) {
+        if (strcmp(devices[i].name, name) == 0) return &devices[i];
+    }
+    return nullptr;
+}
+
+BlockDevice* block_device(int index) {
+    return index >= 0 && index < device_count ? &devices[index] : nullptr;
+}
+
+// --- Queue ---
+
+static uint64_t chain_end(const BlockRequest* head) {
+    return head->lba + head->chain_sectors;
+}
+
+// Can b's chain run as the continuation of a's in one command?
+static bool can_merge(const BlockDevice* dev, const BlockRequest* a, const BlockRequest* b) {
+    return a->op == b->op && chain_end(a) == b->lba &&
+           a->chain_sectors + b->chain_sectors <= dev->max_sectors &&
+           a->chain_len + b->chain_len <= dev->max_chain;
+}
+
+// Append b (the queue entry right after a) to a's chain
+static void join(BlockDevice* dev, BlockRequest* a, BlockRequest* b) {
+    a->chain_tail->chain_next = b;
+    a->chain_tail = b->chain_tail;
+    a->chain_sectors += b->chain_sectors;
+    a->chain_len += b->chain_len;
+    a->next = b->next;
+    dev->stats.merges++;
+}
+
+static void add_done(DoneList* done, BlockRequest* head, int status) {
+    for (BlockRequest* r = head; r; r = r->chain_next) r->status = status;
+    if (done->last) {
+        done->last->chain_next = head;
+    } else {
+        done->first = head;
+    }
+    done->last = head->chain_tail;
+}
+
+static void run_callbacks(DoneList* done) {
+    BlockRequest* r = done->first;
+    while (r) {
+        BlockRequest* next = r->chain_next; // The callback may reuse r
+        if (r->done) r->done(r);
+        r = next;
+    }
+}
+
+// C-LOOK: the first unit at or past the head position, wrapping to the
+// lowest LBA. Caller holds block_lock.
+static void dispatch(BlockDevice* dev, DoneList* done) {
+    while (!dev->active && dev->queue) {
+        BlockRequest* prev = nullptr;
+        BlockRequest* r = dev->queue;
+        while (r && r->lba < dev->head_lba) {
+            prev = r;
+            r = r->next;
+        }
+        if (!r) {
+            prev = nullptr;
+            r = dev->queue;
+        }
+
+        int err = dev->ops->start(dev, r);
+        if (err == BLOCK_EBUSY) return;
+
+        if (prev) {
+            prev->next = r->next;
+        } else {
+            dev->queue = r->next;
+        }
+        r->next = nullptr;
+        dev->head_lba = chain_end(r);
+
+        if (err < 0) {
+            dev->stats.errors++;
+            add_done(done, r, err);
+            continue;
+        }
+        dev->active = r;
+        dev->stats.dispatches++;
+        dev->stats.sectors += r->chain_sectors;
+    }
+}
+
+void block_submit(BlockDevice* dev, BlockRequest* req) {
+    req->next = nullptr;
+    req->chain_next = nullptr;
+    req->chain_tail = req;
+    req->chain_sectors = req->count;
+    req->chain_len = 1;
+    req->status = 0;
+    TRACE_INSTANT(TRACE_BLOCK, "block_submit", req->count);
+
+    if (req->count == 0 || req->count > dev->max_sectors ||
+        req->lba >= dev->sectors || req->count > dev->sectors - req->lba) {
+        req->status = BLOCK_EINVAL;
+        if (req->done) req->done(req);
+        return;
+    }
+
+    DoneList done = {nullptr, nullptr};
+    uint64_t flags = block_lock.lock_irqsave();
+    dev->stats.requests++;
+
+    // Sorted insert after every entry with lba <= req->lba (FIFO among equals)
+    BlockRequest* prev = nullptr;
+    BlockRequest* next = dev->queue;
+    while (next && next->lba <= req->lba) {
+        prev = next;
+        next = next->next;
+    }
+    req->next = next;
+    if (prev) {
+        prev->next = req;
+    } else {
+        dev->queue = req;
+    }
+
+    // Back merge into the predecessor, then front merge the successor
+    if (prev && can_merge(dev, prev, req)) {
+        join(dev, prev, req);
+        req = prev;
+    }
+    if (req->next && can_merge(dev, req, req->next)) {
+        join(dev, req, req->next);
+    }
+
+    dispatch(dev, &done);
+    block_lock.unlock_irqrestore(flags);
+    run_callbacks(&done);
+}
+
+void block_complete(BlockDevice* dev, int status) {
+    DoneList done = {nullptr, nullptr};
+    uint64_t flags = block_lock.lock_irqsave();
+    BlockRequest* r = dev->active;
+    dev->active = nullptr;
+    if (r) {
+        TRACE_INSTANT(TRACE_BLOCK, "block_complete", r->chain_sectors);
+        if (status < 0) dev->stats.errors++;
+        add_done(&done, r, status);
+    }
+    dispatch(dev, &done);
+    block_lock.unlock_irqrestore(flags);
+    run_callbacks(&done);
+}
+
+void block_kick(BlockDevice* dev) {
+    DoneList done = {nullptr, nullptr};
+    uint64_t flags = block_lock.lock_irqsave();
+    dispatch(dev, &done);
+    block_lock.unlock_irqrestore(flags);
+    run_callbacks(&done);
+}
+
+// --- Synchronous helpers ---
+
+static void count_down(BlockRequest* req) {
+    __atomic_sub_fetch((volatile uint32_t*)req->private_data, 1, __ATOMIC_RELEASE);
+}
+
+static void time_out(BlockDevice* dev) {
+    kprint("[BLOCK] "); kprint(dev->name); kprint(": request timed out, resetting\n");
+    uint64_t flags = irq_save();
+    dev->stats.timeouts++;
+    if (dev->ops->reset) dev->ops->reset(dev);
+    irq_restore(flags);
+    block_kick(dev); // Requests turned away while the controller hung
+}
+
+// Sleep until *pending drops to zero. "sti; hlt" cannot miss the wakeup:
+// sti only takes effect after the following instruction.
+void block_wait(BlockDevice* dev, volatile uint32_t* pending) {
+    bool sleep = interrupts_enabled();
+    bool tick = false;
+    if (sleep) {
+        uint64_t flags = irq_save();
+        tick = irq_masked(BLOCK_TICK_IRQ);
+        if (tick) irq_unmask(BLOCK_TICK_IRQ);
+        irq_restore(flags);
+    }
+
+    uint64_t timeout = tsc_hz() / 1000 * BLOCK_TIMEOUT_MS;
+    uint64_t deadline = rdtsc() + timeout;
+    uint32_t left = __atomic_load_n(pending, __ATOMIC_ACQUIRE);
+    while (left) {
+        if (rdtsc() >= deadline) {
+            time_out(dev);
+            deadline = rdtsc() + timeout;
+        }
+        if (sleep) {
+            asm volatile("cli");
+            if (__atomic_load_n(pending, __ATOMIC_ACQUIRE) == left) {
+                asm volatile("sti; hlt");
+            } else {
+                asm volatile("sti");
+            }
+        } else {
+            dev->ops->poll(dev);
+        }
+        uint32_t now = __atomic_load_n(pending, __ATOMIC_ACQUIRE);
+        if (now != left) {
+            left = now;
+            deadline = rdtsc() + timeout; // Progress: the device is alive
+        }
+    }
+
+    if (tick) {
+        uint64_t flags = irq_save();
+        irq_mask(BLOCK_TICK_IRQ);
+        irq_restore(flags);
+    }
+}
+
+static int block_rw(BlockDevice* dev, BlockOp op, uint64_t lba, uint32_t count, void* buf) {
+    volatile uint32_t pending = 1;
+    BlockRequest req;
+    req.op = op;
+    req.lba = lba;
+    req.count = count;
+    req.buf = buf;
+    req.done = count_down;
+    req.private_data = (void*)&pending;
+    block_submit(dev, &req);
+    block_wait(dev, &pending);
+    return req.status;
+}
+
+int block_read(BlockDevice* dev, uint64_t lba, uint32_t count, void* buf) {
+    return block_rw(dev, BlockOp::Read, lba, count, buf);
+}
+
+int block_write(BlockDevice* dev, uint64_t lba, uint32_t count, const void* buf) {
+    return block_rw(dev, BlockOp::Write, lba, count, (void*)buf);
+}
+
+const char* block_strerror(int err) {
+    switch (err) {
+    case BLOCK_EIO:    return "I/O error";
+    case BLOCK_EBUSY:  return "device busy";
+    case BLOCK_EINVAL: return "invalid request";
+    default:           return "unknown error";
+    }
+}
+
+// --- Benchmark ---
+
+#define BENCH_SEQ_BYTES   (16 * 1024 * 1024)
+#define BENCH_SEQ_SECTORS 256                  // 128 KB per read
+#define BENCH_RAND_READS  1000
+#define BENCH_QD          32
+#define BENCH_QD_ROUNDS   32
+#define BENCH_SMALL       8                    // 4 KB
+
+static uint64_t bench_seed;
+
+static uint64_t bench_random() {
+    bench_seed = bench_seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return bench_seed >> 33;
+}
+
+// Random 4 KB-aligned LBA inside the device
+static uint64_t random_lba(BlockDevice* dev) {
+    uint64_t slots = dev->sectors / BENCH_SMALL;
+    return (bench_random() % slots) * BENCH_SMALL;
+}
+
+// Submit BENCH_QD 4 KB reads at once and wait for all of them. Sequential
+// batches are submitted in reverse so only merging can make them one command.
+// Cycles for BENCH_QD reads submitted at once; *err gets the first failure
+static uint64_t queued_round(BlockDevice* dev, BlockRequest* reqs, uint8_t* buf, bool sequential, int* err) {
+    volatile uint32_t pending = BENCH_QD;
+    uint64_t base = random_lba(dev);
+    if (base + BENCH_QD * BENCH_SMALL > dev->sectors) base = 0;
+
+    uint64_t start = rdtsc();
+    for (int i = BENCH_QD - 1; i >= 0; i--) {
+        BlockRequest* r = &reqs[i];
+        r->op = BlockOp::Read;
+        r->lba = sequential ? base + (uint64_t)i * BENCH_SMALL : random_lba(dev);
+        r->count = BENCH_SMALL;
+        r->buf = buf + (size_t)i * BENCH_SMALL * BLOCK_SECTOR_SIZE;
+        r->done = count_down;
+        r->private_data = (void*)&pending;
+        block_submit(dev, r);
+    }
+    block_wait(dev, &pending);
+    uint64_t cycles = rdtsc() - start;
+    for (int i = 0; i < BENCH_QD && !*err; i++) {
+        *err = reqs[i].status;
+    }
+    return cycles;
+}
+
+static int print_queued(const char* label, BlockDevice* dev, BlockRequest* reqs, uint8_t* buf, bool sequential) {
+    uint64_t dispatches = dev->stats.dispatches;
+    uint64_t cycles = 0;
+    int err = 0;
+    for (int i = 0; i < BENCH_QD_ROUNDS && !err; i++) {
+        cycles += queued_round(dev, reqs, buf, sequential, &err);
+    }
+    if (err) return err;
+    uint64_t ios = (uint64_t)BENCH_QD * BENCH_QD_ROUNDS;
+    uint64_t ns = tsc_cycles_to_ns(cycles);
+    kprint("  "); kprint(label); kprint(": ");
+    kprint_int(ns ? ios * 1000000000ULL / ns : 0); kprint(" IOPS, ");
+    kprint_int(tsc_mb_per_sec(ios * BENCH_SMALL * BLOCK_SECTOR_SIZE, cycles)); kprint(" MB/s, ");
+    kprint_int(dev->stats.dispatches - dispatches); kprint(" commands for ");
+    kprint_int(ios); kprint(" requests\n");
+    return 0;
+}
+
+void block_benchmark_command(const char* name) {
+    BlockDevice* dev = name ? block_find(name) : block_device(0);
+    if (!dev) {
+        kprint(name ? "blkbench: no such device\n" : "blkbench: no block devices\n");
+        return;
+    }
+    if (dev->sectors < BENCH_QD * BENCH_SMALL) {
+        kprint("blkbench: device too small\n");
+        return;
+    }
+
+    const size_t buf_size = BENCH_QD * BENCH_SMALL * BLOCK_SECTOR_SIZE; // 128 KB
+    uint8_t* buf = (uint8_t*)kmalloc(buf_size);
+    BlockRequest* reqs = (BlockRequest*)kmalloc(BENCH_QD * sizeof(BlockRequest));
+    if (!buf || !reqs) {
+        kprint("blkbench: out of memory\n");
+        kfree(buf);
+        kfree(reqs);
+        return;
+    }
+    bench_seed = rdtsc();
+
+    kprint("\n--- Block read throughput: "); kprint(dev->name); kprint(" ---\n");
+
+    // Sequential, one 128 KB read at a time
+    uint64_t seq_sectors = BENCH_SEQ_BYTES / BLOCK_SECTOR_SIZE;
+    if (seq_sectors > dev->sectors) seq_sectors = dev->sectors - dev->sectors % BENCH_SEQ_SECTORS;
+    int err = 0;
+    uint64_t start = rdtsc();
+    for (uint64_t lba = 0; lba < seq_sectors && !err; lba += BENCH_SEQ_SECTORS) {
+        err = block_read(dev, lba, BENCH_SEQ_SECTORS, buf);
+    }
+    uint64_t cycles = rdtsc() - start;
+    if (err) {
+        kprint("blkbench: "); kprint(block_strerror(err)); kprint("\n");
+    } else {
+        kprint("  sequential 128 KB, QD1 : ");
+        kprint_int(tsc_mb_per_sec(seq_sectors * BLOCK_SECTOR_SIZE, cycles)); kprint(" MB/s\n");
+
+        // Random 4 KB, one outstanding request
+        start = rdtsc();
+        for (int i = 0; i < BENCH_RAND_READS && !err; i++) {
+            err = block_read(dev, random_lba(dev), BENCH_SMALL, buf);
+        }
+        cycles = rdtsc() - start;
+        if (!err) {
+            uint64_t ns = tsc_cycles_to_ns(cycles);
+            kprint("  random 4 KB, QD1       : ");
+            kprint_int(ns ? (uint64_t)BENCH_RAND_READS * 1000000000ULL / ns : 0); kprint(" IOPS, ");
+            kprint_int(ns / BENCH_RAND_READS / 1000); kprint(" us avg\n");
+
+            err = print_queued("random 4 KB, QD32      ", dev, reqs, buf, false);
+        }
+        if (!err) err = print_queued("sequential 4 KB, QD32  ", dev, reqs, buf, true);
+        if (err) {
+            kprint("blkbench: "); kprint(block_strerror(err)); kprint("\n");
+        }
+    }
+
+    kfree(buf);
+    kfree(reqs);
+}
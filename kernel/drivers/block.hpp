@@ -0,0 +1,113 @@
+#ifndef BLOCK_HPP
+#define BLOCK_HPP
+
+#include "types.h"
+
+#define BLOCK_SECTOR_SIZE 512
+#define BLOCK_MAX_DEVICES 4
+#define BLOCK_NAME_MAX    8
+#define BLOCK_TIMEOUT_MS  5000  // Without progress before block_wait() resets the device
+
+// Negative status values (errno numbering, like the VFS)
+#define BLOCK_EIO     -5
+#define BLOCK_EBUSY  -16
+#define BLOCK_EINVAL -22
+
+enum class BlockOp : uint8_t {
+    Read,
+    Write
+};
+
+struct BlockDevice;
+
+// One transfer of whole sectors to or from a virtually contiguous kernel
+// buffer. The submitter owns the struct until `done` runs; `done` is
+// called from interrupt context (or the polling path) with `status` set.
+struct BlockRequest {
+    BlockOp op;
+    uint64_t lba;
+    uint32_t count;           // Sectors
+    void* buf;
+    void (*done)(BlockRequest* req);
+    void* private_data;       // For the submitter
+    int status;
+
+    // Owned by the block layer while queued
+    BlockRequest* next;       // Next dispatch unit in the sorted queue
+    BlockRequest* chain_next; // Next request merged behind this one
+    BlockRequest* chain_tail;
+    uint32_t chain_sectors;   // Whole chain, valid on the head only
+    uint32_t chain_len;
+};
+
+struct BlockDeviceOps {
+    // Program the hardware for `req` and every request chained behind it
+    // (consecutive LBAs, one command). Called with the queue locked and
+    // nothing else in flight on this device. Return BLOCK_EBUSY to leave
+    // the request queued (shared controller busy); block_kick() retries.
+    int (*start)(BlockDevice* dev, BlockRequest* req);
+    // Check the hardware for a completion without relying on its IRQ
+    // (used by synchronous waits with interrupts disabled)
+    void (*poll)(BlockDevice* dev);
+    // A wait timed out: reset the hardware and complete the command in
+    // flight (on this device or one sharing its controller) with BLOCK_EIO.
+    // Called with interrupts disabled and the queue unlocked.
+    void (*reset)(BlockDevice* dev);
+};
+
+struct BlockStats {
+    uint64_t requests;        // Submitted
+    uint64_t merges;          // Requests that joined another's command
+    uint64_t dispatches;      // Hardware commands issued
+    uint64_t sectors;
+    uint64_t errors;
+    uint64_t timeouts;        // Waits that gave up and reset the device
+};
+
+struct BlockDevice {
+    char name[BLOCK_NAME_MAX];
+    uint64_t sectors;
+    uint32_t max_sectors;     // Per hardware command
+    uint32_t max_chain;       // Requests per command (scatter/gather entries)
+    const BlockDeviceOps* ops;
+    void* driver_data;
+
+    BlockRequest* queue;      // Pending, ascending LBA
+    BlockRequest* active;     // In flight
+    uint64_t head_lba;        // End of the last dispatch (elevator position)
+    BlockStats stats;
+};
+
+BlockDevice* block_register(const char* name, uint64_t sectors, uint32_t max_sectors,
+                            uint32_t max_chain, const BlockDeviceOps* ops, void* driver_data);
+BlockDevice* block_find(const char* name);
+BlockDevice* block_device(int index);  // nullptr past the last device
+
+// Queue a request; it may be merged with a neighbour and is dispatched in
+// one-way elevator (C-LOOK) order.
+void block_submit(BlockDevice* dev, BlockRequest* req);
+
+// Drivers: the active command finished; completes its chain and starts
+// the next dispatch unit.
+void block_complete(BlockDevice* dev, int status);
+
+// Drivers: the controller became free, dispatch if the device is idle
+void block_kick(BlockDevice* dev);
+
+// Wait until *pending (decremented by completion callbacks) reaches zero.
+// Sleeps with hlt when interrupts are enabled and polls the driver otherwise.
+// After BLOCK_TIMEOUT_MS without a completion the device is reset, which
+// fails the command in flight with BLOCK_EIO.
+void block_wait(BlockDevice* dev, volatile uint32_t* pending);
+
+// Submit and wait. Sleeps with hlt when interrupts are enabled and polls
+// the driver otherwise.
+int block_read(BlockDevice* dev, uint64_t lba, uint32_t count, void* buf);
+int block_write(BlockDevice* dev, uint64_t lba, uint32_t count, const void* buf);
+
+const char* block_strerror(int err);
+
+// Sequential / random / queued read throughput (the `blkbench` command)
+void block_benchmark_command(const char* name);
+
+#endif
@@ -1,11 +1,22 @@
 #include "console.hpp"
 #include "ports.hpp"
 #include "serial.hpp"
+#include "spinlock.hpp"
+#include "string.hpp"
+#include "../mm/vmm.hpp"
+#include "tsc.hpp"
 
 Console console;
 
+// Protects the cursor position, color and the VGA buffer contents
+static Spinlock console_lock("console");
+
+#define VGA_PHYS 0xB8000
+
 void Console::init() {
-    buffer = (volatile uint16_t*)0xB8000;  // address of the video memory 
+    buffer = (volatile uint16_t*)phys_to_virt(VGA_PHYS);  // address of the video memory (higher-half alias)
+    dirty_first = VGA_HEIGHT;
+    dirty_last = 0;
     row = 0;
     column = 0;
     color = (uint8_t)Color::White | ((uint8_t)Color::Black << 4);
@@ -26,39 +37,93 @@ void Console::set_color(Color fg, Color bg) {
     color = (uint8_t)fg | ((uint8_t)bg << 4);
 }
 
+// Switch the console to a write-combining alias of VGA memory. Needs vmm.init().
+void Console::enable_write_combining() {
+    volatile uint16_t* wc = (volatile uint16_t*)vmm.map_io(VGA_PHYS, VGA_WIDTH * VGA_HEIGHT * 2, MemType::WriteCombining);
+    if (!wc) return;
+
+    ScopedIrqLock guard(console_lock);
+    buffer = wc;
+    mark_dirty(0, VGA_HEIGHT - 1);
+    flush();
+}
+
 void Console::put_entry_at(char c, uint8_t color, size_t x, size_t y) {
     const size_t index = y * VGA_WIDTH + x; // calculate the index of the entry
-    buffer[index] = (uint16_t)c | ((uint16_t)color << 8); // set the entry
+    shadow[index] = (uint16_t)c | ((uint16_t)color << 8); // set the entry
+    mark_dirty(y, y);
 }
 
-void Console::clear() {
-    for (size_t y = 0; y < VGA_HEIGHT; y++) {
-        for (size_t x = 0; x < VGA_WIDTH; x++) {
-            put_entry_at(' ', color, x, y);  // clear the screen with loop 
-        }
+void Console::mark_dirty(size_t first, size_t last) {
+    if (first < dirty_first) dirty_first = first;
+    if (last > dirty_last) dirty_last = last;
+}
+
+// Copy whole rows from the shadow buffer with 64-bit stores. Through a WC
+// mapping these coalesce into full-line bursts instead of one uncached bus
+// transaction per cell.
+void Console::copy_rows(volatile uint16_t* dst, size_t first, size_t last) {
+    const uint64_t* src = (const uint64_t*)&shadow[first * VGA_WIDTH];
+    volatile uint64_t* out = (volatile uint64_t*)&dst[first * VGA_WIDTH];
+    size_t words = (last - first + 1) * VGA_WIDTH / 4;
+    for (size_t i = 0; i < words; i++) {
+        out[i] = src[i];
     }
+    asm volatile("sfence" ::: "memory"); // Drain the WC buffers
+}
+
+void Console::flush() {
+    if (dirty_first > dirty_last) return;
+    copy_rows(buffer, dirty_first, dirty_last);
+    dirty_first = VGA_HEIGHT;
+    dirty_last = 0;
+}
+
+void Console::clear() {
+    ScopedIrqLock guard(console_lock);
+    clear_unlocked();
+}
+
+void Console::clear_unlocked() {
+    memset16(shadow, (uint16_t)' ' | ((uint16_t)color << 8), VGA_WIDTH * VGA_HEIGHT);
+    mark_dirty(0, VGA_HEIGHT - 1);
     row = 0;
     column = 0;
+    flush();
     update_cursor();
 }
 
 void Console::scroll() {
-    // Move everything up by one row
-    for (size_t y = 0; y < VGA_HEIGHT - 1; y++) { // loop through the rows
-        for (size_t x = 0; x < VGA_WIDTH; x++) { // loop through the columns
-            const size_t src_index = (y + 1) * VGA_WIDTH + x; // calculate the source index
-            const size_t dst_index = y * VGA_WIDTH + x; // calculate the destination index
-            buffer[dst_index] = buffer[src_index]; // copy the source to the destination
-        }
-    }
+    // Move everything up by one row (in the shadow buffer: reading back
+    // uncached or write-combined video memory is very slow)
+    memmove(&shadow[0], &shadow[VGA_WIDTH], (VGA_HEIGHT - 1) * VGA_WIDTH * sizeof(shadow[0]));
 
     // Clear the last row
-    for (size_t x = 0; x < VGA_WIDTH; x++) {
-        put_entry_at(' ', color, x, VGA_HEIGHT - 1);
-    }
+    memset16(&shadow[(VGA_HEIGHT - 1) * VGA_WIDTH], (uint16_t)' ' | ((uint16_t)color << 8), VGA_WIDTH);
+    mark_dirty(0, VGA_HEIGHT - 1);
 }
 
 void Console::write_char(char c) {
+    ScopedIrqLock guard(console_lock);
+    put_char(c);
+    flush();
+    update_cursor();
+}
+
+void Console::cursor_back(size_t n) {
+    ScopedIrqLock guard(console_lock);
+    for (; n > 0; n--) {
+        if (column > 0) {
+            column--;
+        } else if (row > 0) {
+            row--;
+            column = VGA_WIDTH - 1;
+        }
+    }
+    update_cursor();
+}
+
+void Console::put_char(char c) {
     if (c == '\n') {
         column = 0;
         if (++row == VGA_HEIGHT) { // if the row is equal to the height of the screen
@@ -86,28 +151,95 @@ void Console::write_char(char c) {
             }
         }
     }
-    update_cursor();
 }
 
 void Console::write_string(const char* str) {
+    ScopedIrqLock guard(console_lock);
     while (*str) {
-        write_char(*str++);
+        put_char(*str++);
     }
+    flush();
+    update_cursor();
 }
 
 void Console::write_string(const char* str, Color fg) {
+    ScopedIrqLock guard(console_lock);
     uint8_t old_color = color;
     set_color(fg, (Color)(old_color >> 4));
-    write_string(str);
+    while (*str) {
+        put_char(*str++);
+    }
+    flush();
+    update_cursor();
     color = old_color;
 }
 
+// Must not take console_lock: we may be panicking while it is held
 void Console::panic_screen(const char* msg) {
     set_color(Color::White, Color::Red); // set the color to white on red
-    clear();
-    write_string("!!! KERNEL PANIC !!!\n\n");
-    write_string(msg);
-    write_string("\n\nSystem Halted.");
+    clear_unlocked();
+    for (const char* s = "!!! KERNEL PANIC !!!\n\n"; *s; s++) put_char(*s);
+    for (const char* s = msg; *s; s++) put_char(*s);
+    for (const char* s = "\n\nSystem Halted."; *s; s++) put_char(*s);
+    flush();
+    update_cursor();
+}
+
+// Flush bandwidth: the old per-cell uncached stores vs. full-row flushes
+// through UC and WC mappings of the same VGA memory.
+#define FLUSH_BENCH_ROUNDS 200
+
+static void print_flush_result(const char* label, uint64_t cycles) {
+    const uint64_t bytes = (uint64_t)FLUSH_BENCH_ROUNDS * Console::VGA_WIDTH * Console::VGA_HEIGHT * 2;
+    kprint("  "); kprint(label); kprint(": ");
+    kprint_int(cycles / FLUSH_BENCH_ROUNDS); kprint(" cycles/screen, ");
+    kprint_int(tsc_mb_per_sec(bytes, cycles)); kprint(" MB/s\n");
+}
+
+void Console::benchmark_flush() {
+    static volatile uint16_t* uc_alias = nullptr;
+    static volatile uint16_t* wc_alias = nullptr;
+    if (!uc_alias) uc_alias = (volatile uint16_t*)vmm.map_io(VGA_PHYS, VGA_WIDTH * VGA_HEIGHT * 2, MemType::Uncached);
+    if (!wc_alias) wc_alias = (volatile uint16_t*)vmm.map_io(VGA_PHYS, VGA_WIDTH * VGA_HEIGHT * 2, MemType::WriteCombining);
+    if (!uc_alias || !wc_alias) {
+        kprint("fbbench: IO window exhausted\n");
+        return;
+    }
+
+    uint64_t cell_cycles, uc_cycles, wc_cycles;
+    {
+        // Every alias gets the current screen contents, so nothing visibly changes
+        ScopedIrqLock guard(console_lock);
+
+        uint64_t start = rdtsc();
+        for (int r = 0; r < FLUSH_BENCH_ROUNDS; r++) {
+            for (size_t i = 0; i < VGA_WIDTH * VGA_HEIGHT; i++) {
+                uc_alias[i] = shadow[i];
+            }
+        }
+        cell_cycles = rdtsc() - start;
+
+        start = rdtsc();
+        for (int r = 0; r < FLUSH_BENCH_ROUNDS; r++) {
+            copy_rows(uc_alias, 0, VGA_HEIGHT - 1);
+        }
+        uc_cycles = rdtsc() - start;
+
+        start = rdtsc();
+        for (int r = 0; r < FLUSH_BENCH_ROUNDS; r++) {
+            copy_rows(wc_alias, 0, VGA_HEIGHT - 1);
+        }
+        wc_cycles = rdtsc() - start;
+    }
+
+    kprint("\n--- Console flush bandwidth (");
+    kprint_int(FLUSH_BENCH_ROUNDS); kprint(" full screens) ---\n");
+    print_flush_result("per-cell, UC  ", cell_cycles);
+    print_flush_result("row flush, UC ", uc_cycles);
+    print_flush_result("row flush, WC ", wc_cycles);
+    if (!vmm.pat_enabled()) {
+        kprint("  (no PAT: WC mapping fell back to UC)\n");
+    }
 }
 
 // Global Implementations
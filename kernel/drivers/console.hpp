@@ -32,18 +32,29 @@ public:
     void write_char(char c);
     void write_string(const char* str);
     void write_string(const char* str, Color color);
+    void cursor_back(size_t n); // Move back over n cells without erasing them
     void set_color(Color fg, Color bg);
     void panic_screen(const char* msg);
+    void enable_write_combining();
+    void benchmark_flush();
 
 private:
+    void put_char(char c); // Caller holds the console lock
+    void clear_unlocked();
     void scroll();
     void put_entry_at(char c, uint8_t color, size_t x, size_t y);
     void update_cursor();
+    void mark_dirty(size_t first, size_t last);
+    void flush(); // Push dirty rows of the shadow buffer to video memory
+    void copy_rows(volatile uint16_t* dst, size_t first, size_t last);
 
     size_t row;
     size_t column;
     uint8_t color;
     volatile uint16_t* buffer;
+    uint16_t shadow[VGA_WIDTH * VGA_HEIGHT] __attribute__((aligned(8))); // What the screen should show
+    size_t dirty_first; // Rows [dirty_first, dirty_last] differ from video memory
+    size_t dirty_last;
 };
 
 extern Console console;
@@ -1,76 +1,23 @@
 #include "keyboard.hpp"
 #include "interrupts.hpp"
 #include "ports.hpp"
-#include "console.hpp"
-#include "../lib/helpers.hpp"
-#include "../fs/tarfs.hpp"
-
-// Simple command buffer
-char command_buffer[128];
-int buffer_index = 0;
-
-// Simple string comparison helper
-int strcmp(const char* s1, const char* s2) {
-    while (*s1 && (*s1 == *s2)) {
-        s1++;
-        s2++;
-    }
-    return *(const unsigned char*)s1 - *(const unsigned char*)s2;
-}
 
-bool is_space(char c) {
-    return c == ' ' || c == '\t';
-}
+// The IRQ handler only reads the scancode and appends it to this ring.
+// Decoding, echo and line editing happen in kernel context (tty.cpp), so a
+// keystroke costs the interrupt a port read and a store, and keys typed
+// while a command runs wait here instead of being lost.
+static volatile uint8_t scancode_ring[KEYBOARD_RING_SIZE];
+static volatile uint32_t ring_head = 0;   // Written by the IRQ handler only
+static volatile uint32_t ring_tail = 0;   // Written by the consumer only
+static uint64_t scancodes_received = 0;
+static uint64_t scancodes_dropped = 0;
+static uint32_t ring_max_queued = 0;
 
-void execute_command(char* input) {
-    while (is_space(*input)) input++;
-
-    if (*input == '\0') {
-        return;
-    }
-
-    char* cmd = input;
-    char* arg = input;
-    while (*arg && !is_space(*arg)) arg++;
-    if (*arg) {
-        *arg++ = '\0';
-        while (is_space(*arg)) arg++;
-    }
-
-    if (strcmp(cmd, "meminfo") == 0) {
-        if (*arg != '\0') {
-            kprint("meminfo: this command takes no arguments\n");
-            return;
-        }
-        meminfo_command();
-        return;
-    }
-
-    if (strcmp(cmd, "ls") == 0) {
-        if (*arg != '\0') {
-            kprint("ls: path arguments are not supported yet\n");
-            return;
-        }
-        tarfs_ls();
-        return;
-    }
-
-    if (strcmp(cmd, "cat") == 0) {
-        if (*arg == '\0') {
-            kprint("cat: missing file operand\n");
-            return;
-        }
-        tarfs_cat(arg);
-        return;
-    }
-
-    kprint("Unknown command: ");
-    kprint(cmd);
-    kprint("\n");
-}
+static_assert((KEYBOARD_RING_SIZE & (KEYBOARD_RING_SIZE - 1)) == 0,
+              "KEYBOARD_RING_SIZE must be a power of two");
 
 // Simple US QWERTY Scan Code Set 1 Map
-unsigned char kbdus[128] =
+static const unsigned char kbdus[128] =
 {
     0,  27, '1', '2', '3', '4', '5', '6', '7', '8',	/* 9 */
   '9', '0', '-', '=', '\b',	/* Backspace */
@@ -109,7 +56,7 @@ unsigned char kbdus[128] =
     0,	/* All other keys are undefined */
 };
 
-unsigned char kbdus_shift[128] =
+static const unsigned char kbdus_shift[128] =
 {
     0,  27, '!', '@', '#', '$', '%', '^', '&', '*',	/* 9 */
   '(', ')', '_', '+', '\b',	/* Backspace */
@@ -148,70 +95,133 @@ unsigned char kbdus_shift[128] =
     0,	/* All other keys are undefined */
 };
 
-static bool is_shift = false;
-static bool is_caps_lock = false;
 
-void keyboard_callback(Registers* regs) {
-    uint8_t scancode = inb(0x60); //read  scan code from port  0x60 
-    
-    // Handle specific keys before checking for release
-    if (scancode == 0x2A || scancode == 0x36) { // Left or Right Shift Down
-        is_shift = true;
-        return;
-    } else if (scancode == 0xAA || scancode == 0xB6) { // Left or Right Shift Up
-        is_shift = false;
-        return;
-    } else if (scancode == 0x3A) { // Caps Lock Down
-        is_caps_lock = !is_caps_lock;
+// Decoder state; only the consumer touches it
+static bool left_shift = false;
+static bool right_shift = false;
+static bool left_ctrl = false;
+static bool right_ctrl = false;
+static bool is_caps_lock = false;
+static bool extended = false;   // Previous byte was the 0xE0 prefix
+static int prefix_skip = 0;     // Bytes left of a Pause (0xE1) sequence
+
+static void keyboard_callback(IrqFrame* frame) {
+    uint8_t scancode = inb(0x60); // read scan code from port 0x60
+    (void)frame;
+
+    scancodes_received++;
+    uint32_t head = ring_head;
+    uint32_t queued = head - ring_tail;
+    if (queued == KEYBOARD_RING_SIZE) {
+        scancodes_dropped++;
         return;
     }
+    scancode_ring[head & (KEYBOARD_RING_SIZE - 1)] = scancode;
+    __atomic_store_n(&ring_head, head + 1, __ATOMIC_RELEASE);
+    if (queued + 1 > ring_max_queued) {
+        ring_max_queued = queued + 1;
+    }
+}
 
-    // Ignore other break codes
-    if (scancode & 0x80) {
-        return;
+// Keys sent with the 0xE0 prefix: cursor block, right Ctrl, keypad Enter and '/'
+static int decode_extended(uint8_t code, bool release) {
+    switch (code) {
+    case 0x1D: right_ctrl = !release; return -1;
+    case 0x2A: case 0x36: return -1; // Fake shifts around the cursor block
+    }
+    if (release) return -1;
+
+    switch (code) {
+    case 0x1C: return '\n';
+    case 0x35: return '/';
+    case 0x47: return KEY_HOME;
+    case 0x48: return KEY_UP;
+    case 0x4B: return KEY_LEFT;
+    case 0x4D: return KEY_RIGHT;
+    case 0x4F: return KEY_END;
+    case 0x50: return KEY_DOWN;
+    case 0x53: return KEY_DELETE;
+    default:   return -1;
+    }
+}
+
+// One scancode to a key, or -1 for prefixes, releases and modifiers
+static int decode(uint8_t scancode) {
+    if (prefix_skip > 0) {
+        prefix_skip--;
+        return -1;
+    }
+    if (scancode == 0xE1) { // Pause: E1 1D 45 E1 9D C5, no break code
+        prefix_skip = 5;
+        return -1;
+    }
+    if (scancode == 0xE0) {
+        extended = true;
+        return -1;
     }
 
-    // Key pressed (Make code)
-    char c = 0;
-    
-    // Choose which map to use
-    if (is_shift) {
-        c = kbdus_shift[scancode];
-    } else {
-        c = kbdus[scancode];
+    bool release = (scancode & 0x80) != 0;
+    uint8_t code = scancode & 0x7F;
+    if (extended) {
+        extended = false;
+        return decode_extended(code, release);
     }
 
-    if (c != 0) {
-        // Handle Caps Lock for letters
-        if (is_caps_lock) {
-            if (c >= 'a' && c <= 'z') {
-                c -= 32; // To Upper
-            } else if (c >= 'A' && c <= 'Z') {
-                c += 32; // To Lower
-            }
-        }
-        
-        console.write_char(c); // print the character to the console
-        
-        // Command Handling
-        if (c == '\n') {
-            command_buffer[buffer_index] = '\0'; // Null-terminate
-            execute_command(command_buffer);
-            
-            kprint("> "); // Prompt
-            buffer_index = 0;
-        } else if (c == '\b') {
-            if (buffer_index > 0) {
-                buffer_index--;
-            }
-        } else {
-            if (buffer_index < 127) {
-                command_buffer[buffer_index++] = c;
-            }
+    switch (code) {
+    case 0x2A: left_shift = !release; return -1;
+    case 0x36: right_shift = !release; return -1;
+    case 0x1D: left_ctrl = !release; return -1;
+    }
+    if (release) return -1;
+
+    switch (code) {
+    case 0x3A: is_caps_lock = !is_caps_lock; return -1;
+    // Keypad with Num Lock off
+    case 0x47: return KEY_HOME;
+    case 0x48: return KEY_UP;
+    case 0x4B: return KEY_LEFT;
+    case 0x4D: return KEY_RIGHT;
+    case 0x4F: return KEY_END;
+    case 0x50: return KEY_DOWN;
+    case 0x53: return KEY_DELETE;
+    }
+
+    char c = (left_shift || right_shift) ? kbdus_shift[code] : kbdus[code];
+    if (c == 0) return -1;
+
+    bool letter = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    if (letter && is_caps_lock) {
+        c ^= 0x20; // Swap case
+    }
+    if (left_ctrl || right_ctrl) {
+        return letter ? (c & 0x1F) : -1; // Ctrl+A = 1 ... Ctrl+Z = 26
+    }
+    return (unsigned char)c;
+}
+
+bool keyboard_has_input() {
+    return __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE) != ring_tail;
+}
+
+int keyboard_read_key() {
+    for (;;) {
+        uint32_t tail = ring_tail;
+        if (tail == __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE)) {
+            return -1;
         }
+        uint8_t scancode = scancode_ring[tail & (KEYBOARD_RING_SIZE - 1)];
+        __atomic_store_n(&ring_tail, tail + 1, __ATOMIC_RELEASE);
+
+        int key = decode(scancode);
+        if (key >= 0) return key;
     }
-    
-    (void)regs; // Unused
+}
+
+void keyboard_stats(KeyboardStats* out) {
+    out->scancodes = scancodes_received;
+    out->dropped = scancodes_dropped;
+    out->max_queued = ring_max_queued;
+    out->queued = ring_head - ring_tail;
 }
 
 void init_keyboard() {
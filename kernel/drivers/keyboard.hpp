@@ -1,6 +1,33 @@
 #ifndef KEYBOARD_HPP
 #define KEYBOARD_HPP
 
+#include "types.h"
+
+// Raw scancodes queued by IRQ 1 and not yet decoded. At two scancodes per
+// keystroke this holds about 2000 keys of type-ahead.
+#define KEYBOARD_RING_SIZE 4096
+
+// Non-ASCII keys returned by keyboard_read_key()
+#define KEY_UP      0x100
+#define KEY_DOWN    0x101
+#define KEY_LEFT    0x102
+#define KEY_RIGHT   0x103
+#define KEY_HOME    0x104
+#define KEY_END     0x105
+#define KEY_DELETE  0x106
+
+struct KeyboardStats {
+    uint64_t scancodes;   // Received by the IRQ handler
+    uint64_t dropped;     // Arrived while the ring was full
+    uint32_t max_queued;  // Deepest the ring has been
+    uint32_t queued;
+};
+
 void init_keyboard();
 
+// Consumer side, called from kernel context only (the tty line discipline)
+bool keyboard_has_input();
+int keyboard_read_key(); // ASCII (Ctrl+letter as 1..26) or KEY_*; -1 once the ring is empty
+void keyboard_stats(KeyboardStats* out);
+
 #endif
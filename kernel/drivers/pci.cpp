@@ -0,0 +1,43 @@
+#include "pci.hpp"
+#include "ports.hpp"
+
+#define PCI_CONFIG_ADDRESS 0xCF8
+#define PCI_CONFIG_DATA    0xCFC
+
+static uint32_t config_address(PciAddress addr, uint8_t offset) {
+    return (1u << 31) | ((uint32_t)addr.bus << 16) | ((uint32_t)addr.slot << 11) |
+           ((uint32_t)addr.func << 8) | (offset & 0xFC);
+}
+
+uint32_t pci_read32(PciAddress addr, uint8_t offset) {
+    outl(PCI_CONFIG_ADDRESS, config_address(addr, offset));
+    return inl(PCI_CONFIG_DATA);
+}
+
+void pci_write32(PciAddress addr, uint8_t offset, uint32_t value) {
+    outl(PCI_CONFIG_ADDRESS, config_address(addr, offset));
+    outl(PCI_CONFIG_DATA, value);
+}
+
+// Brute-force scan of every bus/slot; functions 1..7 only on multi-function devices
+bool pci_find_class(uint8_t class_code, uint8_t subclass, PciAddress* out) {
+    for (int bus = 0; bus < 256; bus++) {
+        for (uint8_t slot = 0; slot < 32; slot++) {
+            PciAddress addr = {(uint8_t)bus, slot, 0};
+            if ((pci_read32(addr, PCI_VENDOR_ID) & 0xFFFF) == 0xFFFF) continue;
+
+            uint8_t header = (uint8_t)(pci_read32(addr, PCI_HEADER_TYPE & 0xFC) >> 16);
+            uint8_t funcs = (header & 0x80) ? 8 : 1;
+            for (uint8_t func = 0; func < funcs; func++) {
+                addr.func = func;
+                if ((pci_read32(addr, PCI_VENDOR_ID) & 0xFFFF) == 0xFFFF) continue;
+                uint32_t cls = pci_read32(addr, PCI_CLASS);
+                if ((cls >> 24) == class_code && ((cls >> 16) & 0xFF) == subclass) {
+                    *out = addr;
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
@@ -0,0 +1,30 @@
+#ifndef PCI_HPP
+#define PCI_HPP
+
+#include "types.h"
+
+// Legacy configuration mechanism #1 (ports 0xCF8 / 0xCFC)
+
+#define PCI_VENDOR_ID   0x00
+#define PCI_COMMAND     0x04
+#define PCI_CLASS       0x08  // Revision, prog-if, subclass, class
+#define PCI_HEADER_TYPE 0x0E
+#define PCI_BAR0        0x10
+#define PCI_BAR4        0x20
+
+#define PCI_COMMAND_IO         (1 << 0)
+#define PCI_COMMAND_BUS_MASTER (1 << 2)
+
+struct PciAddress {
+    uint8_t bus;
+    uint8_t slot;
+    uint8_t func;
+};
+
+uint32_t pci_read32(PciAddress addr, uint8_t offset);
+void pci_write32(PciAddress addr, uint8_t offset, uint32_t value);
+
+// First function with the given class and subclass; false if none
+bool pci_find_class(uint8_t class_code, uint8_t subclass, PciAddress* out);
+
+#endif
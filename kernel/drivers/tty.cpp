@@ -0,0 +1,195 @@
+#include "tty.hpp"
+#include "keyboard.hpp"
+#include "console.hpp"
+#include "../lib/shell.hpp"
+#include "../lib/string.hpp"
+
+// The line being edited; cursor is an index into it
+static char line[TTY_LINE_MAX];
+static size_t line_len = 0;
+static size_t cursor = 0;
+
+// History ring: entry i (0 = oldest kept) lives in
+// history[(history_total - history_count + i) % TTY_HISTORY_SIZE]
+static char history[TTY_HISTORY_SIZE][TTY_LINE_MAX];
+static size_t history_total = 0;  // Lines ever added
+static size_t history_count = 0;  // Lines still kept
+static size_t browse = 0;         // Steps back from the edited line (0 = not browsing)
+static char scratch[TTY_LINE_MAX]; // The edited line while browsing
+
+static const char* history_entry(size_t i) {
+    return history[(history_total - history_count + i) % TTY_HISTORY_SIZE];
+}
+
+static void history_add(const char* text) {
+    if (text[0] == '\0') return;
+    if (history_count > 0 && strcmp(history_entry(history_count - 1), text) == 0) {
+        return; // Repeating the last command does not fill the ring
+    }
+    memcpy(history[history_total % TTY_HISTORY_SIZE], text, strlen(text) + 1);
+    history_total++;
+    if (history_count < TTY_HISTORY_SIZE) {
+        history_count++;
+    }
+}
+
+// Echo line[from, line_len), blank `erase` cells after it, then put the
+// screen cursor back at `cursor`
+static void redraw_from(size_t from, size_t erase) {
+    for (size_t i = from; i < line_len; i++) {
+        console.write_char(line[i]);
+    }
+    for (size_t i = 0; i < erase; i++) {
+        console.write_char(' ');
+    }
+    console.cursor_back(line_len - cursor + erase);
+}
+
+// Swap the edited line for `text` (a history entry)
+static void replace_line(const char* text) {
+    size_t old_len = line_len;
+    console.cursor_back(cursor);
+    line_len = strlen(text); // Always shorter than TTY_LINE_MAX
+    memcpy(line, text, line_len);
+    cursor = line_len;
+    redraw_from(0, old_len > line_len ? old_len - line_len : 0);
+}
+
+static void insert_char(char c) {
+    if (line_len >= TTY_LINE_MAX - 1) return;
+    memmove(&line[cursor + 1], &line[cursor], line_len - cursor);
+    line[cursor] = c;
+    line_len++;
+    cursor++;
+    console.write_char(c);
+    redraw_from(cursor, 0);
+}
+
+static void delete_at_cursor() {
+    if (cursor == line_len) return;
+    memmove(&line[cursor], &line[cursor + 1], line_len - cursor - 1);
+    line_len--;
+    redraw_from(cursor, 1);
+}
+
+static void history_up() {
+    if (browse == history_count) return;
+    if (browse == 0) {
+        memcpy(scratch, line, line_len);
+        scratch[line_len] = '\0';
+    }
+    browse++;
+    replace_line(history_entry(history_count - browse));
+}
+
+static void history_down() {
+    if (browse == 0) return;
+    browse--;
+    replace_line(browse == 0 ? scratch : history_entry(history_count - browse));
+}
+
+static void reset_line() {
+    line_len = 0;
+    cursor = 0;
+    browse = 0;
+}
+
+void tty_prompt() {
+    kprint("> ");
+}
+
+// Apply one key; true once a command has run
+static bool handle_key(int key) {
+    switch (key) {
+    case '\n': {
+        console.write_char('\n');
+        char command[TTY_LINE_MAX];
+        memcpy(command, line, line_len);
+        command[line_len] = '\0';
+        reset_line();
+        history_add(command);
+        execute_command(command);
+        tty_prompt();
+        return true;
+    }
+    case '\b':
+        if (cursor > 0) {
+            console.cursor_back(1);
+            cursor--;
+            delete_at_cursor();
+        }
+        break;
+    case KEY_DELETE:
+    case 0x04: // Ctrl+D
+        delete_at_cursor();
+        break;
+    case KEY_LEFT:
+    case 0x02: // Ctrl+B
+        if (cursor > 0) {
+            cursor--;
+            console.cursor_back(1);
+        }
+        break;
+    case KEY_RIGHT:
+    case 0x06: // Ctrl+F
+        if (cursor < line_len) {
+            console.write_char(line[cursor++]);
+        }
+        break;
+    case KEY_HOME:
+    case 0x01: // Ctrl+A
+        console.cursor_back(cursor);
+        cursor = 0;
+        break;
+    case KEY_END:
+    case 0x05: // Ctrl+E
+        while (cursor < line_len) {
+            console.write_char(line[cursor++]);
+        }
+        break;
+    case KEY_UP:
+    case 0x10: // Ctrl+P
+        history_up();
+        break;
+    case KEY_DOWN:
+    case 0x0E: // Ctrl+N
+        history_down();
+        break;
+    case 0x15: // Ctrl+U: clear the line
+        browse = 0;
+        replace_line("");
+        break;
+    case 0x03: // Ctrl+C: abandon the line
+        while (cursor < line_len) {
+            console.write_char(line[cursor++]);
+        }
+        kprint("^C\n");
+        reset_line();
+        tty_prompt();
+        break;
+    default:
+        if (key >= ' ' && key < 0x7F) {
+            insert_char((char)key);
+        }
+        break;
+    }
+    return false;
+}
+
+void tty_process_input() {
+    int key;
+    while ((key = keyboard_read_key()) >= 0) {
+        if (handle_key(key)) {
+            return; // Let the idle loop poll RCU between commands
+        }
+    }
+}
+
+void tty_history_command() {
+    for (size_t i = 0; i < history_count; i++) {
+        kprint_int((int64_t)(history_total - history_count + i + 1));
+        kprint("  ");
+        kprint(history_entry(i));
+        kprint("\n");
+    }
+}
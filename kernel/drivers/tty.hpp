@@ -0,0 +1,22 @@
+#ifndef TTY_HPP
+#define TTY_HPP
+
+#include "types.h"
+#include "../lib/shell.hpp"
+
+// Line discipline for the console shell. Runs in kernel context from the
+// idle loop: decodes queued keystrokes, echoes and edits the current line
+// and hands completed lines to the shell.
+#define TTY_LINE_MAX      SHELL_LINE_MAX
+#define TTY_HISTORY_SIZE  32
+
+void tty_prompt();
+
+// Consume queued keys until the ring is empty or one command has run
+// (the idle loop calls it again while input remains)
+void tty_process_input();
+
+// Print the command history, oldest first (the `history` command)
+void tty_history_command();
+
+#endif
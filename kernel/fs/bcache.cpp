@@ -0,0 +1,510 @@
+#include "bcache.hpp"
+#include "console.hpp"
+#include "tsc.hpp"
+#include "../lib/spinlock.hpp"
+#include "../lib/string.hpp"
+#include "../mm/pmm.hpp"
+#include "../mm/vmm.hpp"
+
+#define BUF_VALID      (1u << 0)  // data holds the block
+#define BUF_DIRTY      (1u << 1)
+#define BUF_READAHEAD  (1u << 2)  // Prefetched and not read yet
+#define BUF_REFERENCED (1u << 3)  // CLOCK second chance
+
+#define HASH_BITS    10
+#define HASH_BUCKETS (1u << HASH_BITS)
+
+// The cache only grows while more than 1/GROW_WATERMARK of memory is free;
+// past that it recycles its own buffers.
+#define GROW_WATERMARK 8
+
+#define SYNC_BATCH 64             // Writes in flight per bcache_sync() round
+
+// Read-ahead: a stream becomes sequential on its second consecutive block.
+// The window starts at RA_MIN blocks and doubles each time the reader gets
+// within half a window of the prefetched end, up to one ATA command.
+#define RA_STREAMS 4              // Per device
+#define RA_MIN     4
+#define RA_MAX     32             // 128 KB
+
+struct RaStream {
+    uint64_t next;                // Block expected next
+    uint64_t ra_end;              // One past the last block prefetched
+    uint32_t window;              // 0 until the stream looks sequential
+    uint64_t last_used;           // 0 = free slot
+};
+
+struct RaDevice {
+    BlockDevice* dev;
+    RaStream streams[RA_STREAMS];
+};
+
+static Buffer buffers[BCACHE_MAX_BUFFERS];
+static Buffer* hash_table[HASH_BUCKETS];
+static Buffer* spare_list;        // Unhashed headers that still own a frame
+static Buffer* empty_list;        // Headers without a frame
+static uint32_t clock_hand;
+static RaDevice ra_devices[BLOCK_MAX_DEVICES];
+static uint64_t ra_tick;
+static BcacheStats stats;
+static Spinlock bcache_lock("bcache"); // Everything above; completions take it too
+static int bcache_mover;          // PMM mover id: buffer frames are movable
+
+static uint32_t hash_of(const BlockDevice* dev, uint64_t block) {
+    uint64_t key = block ^ ((uint64_t)dev >> 6);
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> (64 - HASH_BITS));
+}
+
+static Buffer* lookup(const BlockDevice* dev, uint64_t block) {
+    for (Buffer* b = hash_table[hash_of(dev, block)]; b; b = b->hash_next) {
+        if (b->dev == dev && b->block == block) return b;
+    }
+    return nullptr;
+}
+
+static void unhash(Buffer* b) {
+    Buffer** link = &hash_table[hash_of(b->dev, b->block)];
+    while (*link != b) link = &(*link)->hash_next;
+    *link = b->hash_next;
+    b->hash_next = nullptr;
+    b->dev = nullptr;
+}
+
+// CLOCK over every header: skip anything pinned, in flight or dirty, and
+// give recently referenced buffers a second chance. Two sweeps are enough
+// to clear every REFERENCED bit.
+static Buffer* evict() {
+    for (uint32_t n = 0; n < 2 * BCACHE_MAX_BUFFERS; n++) {
+        Buffer* b = &buffers[clock_hand];
+        clock_hand = (clock_hand + 1) % BCACHE_MAX_BUFFERS;
+        if (!b->dev || b->pins || b->io_pending || (b->flags & BUF_DIRTY)) continue;
+        if (b->flags & BUF_REFERENCED) {
+            b->flags &= ~BUF_REFERENCED;
+            continue;
+        }
+        if (b->flags & BUF_READAHEAD) stats.readahead_wasted++;
+        stats.evictions++;
+        unhash(b);
+        return b;
+    }
+    return nullptr;
+}
+
+static bool may_grow() {
+    return pmm.get_free_memory() > pmm.get_total_memory() / GROW_WATERMARK;
+}
+
+// A header with a frame, hashed under (dev, block) and otherwise blank.
+// Caller holds bcache_lock.
+static Buffer* grab(BlockDevice* dev, uint64_t block) {
+    Buffer* b = spare_list;
+    if (b) {
+        spare_list = b->hash_next;
+    } else if (empty_list && may_grow()) {
+        // Our reclaim hook cannot take bcache_lock here, so this never recurses
+        void* frame = pmm.allocate_movable_frame(bcache_mover, empty_list);
+        if (frame) {
+            b = empty_list;
+            empty_list = b->hash_next;
+            b->data = (uint8_t*)phys_to_virt((uint64_t)frame);
+            stats.buffers++;
+        }
+    }
+    if (!b) b = evict();
+    if (!b) return nullptr;
+
+    uint32_t h = hash_of(dev, block);
+    b->dev = dev;
+    b->block = block;
+    b->flags = 0;
+    b->pins = 0;
+    b->error = 0;
+    b->hash_next = hash_table[h];
+    hash_table[h] = b;
+    return b;
+}
+
+// PMM reclaim hook. Runs in whatever context ran out of frames, possibly
+// with bcache_lock already held further up the stack, so it only tries.
+static uint64_t bcache_reclaim(uint64_t wanted) {
+    uint64_t flags = irq_save();
+    if (!bcache_lock.try_lock()) {
+        irq_restore(flags);
+        return 0;
+    }
+    uint64_t freed = 0;
+    while (freed < wanted) {
+        Buffer* b = spare_list;
+        if (b) {
+            spare_list = b->hash_next;
+        } else {
+            b = evict();
+            if (!b) break;
+        }
+        pmm.free_frame((void*)virt_to_phys(b->data));
+        b->data = nullptr;
+        b->hash_next = empty_list;
+        empty_list = b;
+        stats.buffers--;
+        freed++;
+    }
+    stats.reclaimed += freed;
+    bcache_lock.unlock();
+    irq_restore(flags);
+    return freed;
+}
+
+// PMM compaction moving the frame of buffer `owner`. Anything pinned or in
+// flight has its address handed out, so only idle buffers move.
+static bool bcache_migrate(void* owner, uint64_t from, uint64_t to) {
+    Buffer* b = (Buffer*)owner;
+    uint64_t flags = bcache_lock.lock_irqsave();
+    bool ok = b->data == phys_to_virt(from) && b->pins == 0 && !b->io_pending;
+    if (ok) {
+        memcpy(phys_to_virt(to), b->data, BCACHE_BLOCK_SIZE);
+        b->data = (uint8_t*)phys_to_virt(to);
+    }
+    bcache_lock.unlock_irqrestore(flags);
+    return ok;
+}
+
+void bcache_init() {
+    for (uint32_t i = 0; i < BCACHE_MAX_BUFFERS; i++) {
+        buffers[i].hash_next = i + 1 < BCACHE_MAX_BUFFERS ? &buffers[i + 1] : nullptr;
+    }
+    empty_list = &buffers[0];
+    pmm.set_reclaim_hook(bcache_reclaim);
+    bcache_mover = pmm.register_mover(bcache_migrate);
+}
+
+// --- I/O ---
+
+static void read_done(BlockRequest* req) {
+    Buffer* b = (Buffer*)req->private_data;
+    uint64_t flags = bcache_lock.lock_irqsave();
+    if (req->status < 0) {
+        b->error = req->status;
+    } else {
+        b->flags |= BUF_VALID;
+    }
+    __atomic_store_n(&b->io_pending, 0, __ATOMIC_RELEASE);
+    bcache_lock.unlock_irqrestore(flags);
+}
+
+static void write_done(BlockRequest* req) {
+    Buffer* b = (Buffer*)req->private_data;
+    uint64_t flags = bcache_lock.lock_irqsave();
+    if (req->status < 0) {
+        b->error = req->status;
+        if (!(b->flags & BUF_DIRTY)) stats.dirty++;
+        b->flags |= BUF_DIRTY;
+    }
+    __atomic_store_n(&b->io_pending, 0, __ATOMIC_RELEASE);
+    bcache_lock.unlock_irqrestore(flags);
+}
+
+// Caller set io_pending and dropped bcache_lock (completions may run
+// before block_submit returns)
+static void start_io(Buffer* b, BlockOp op) {
+    BlockRequest* r = &b->req;
+    r->op = op;
+    r->lba = b->block * BCACHE_SECTORS;
+    r->count = BCACHE_SECTORS;
+    r->buf = b->data;
+    r->done = op == BlockOp::Read ? read_done : write_done;
+    r->private_data = b;
+    block_submit(b->dev, r);
+}
+
+// --- Read-ahead ---
+
+static RaDevice* ra_device(BlockDevice* dev) {
+    for (int i = 0; i < BLOCK_MAX_DEVICES; i++) {
+        if (ra_devices[i].dev == dev) return &ra_devices[i];
+        if (!ra_devices[i].dev) {
+            ra_devices[i].dev = dev;
+            return &ra_devices[i];
+        }
+    }
+    return nullptr;
+}
+
+// Feed an access to the stream detector. Returns how many blocks from
+// *start should be prefetched now.
+static uint32_t plan_readahead(BlockDevice* dev, uint64_t block, uint64_t* start) {
+    RaDevice* rd = ra_device(dev);
+    if (!rd) return 0;
+    ra_tick++;
+
+    RaStream* s = nullptr;
+    RaStream* victim = &rd->streams[0];
+    for (int i = 0; i < RA_STREAMS; i++) {
+        RaStream* st = &rd->streams[i];
+        if (st->last_used && st->next == block) {
+            s = st;
+            break;
+        }
+        if (st->last_used < victim->last_used) victim = st;
+    }
+    if (!s) {
+        // New (or broken) stream: wait for a second block before prefetching
+        victim->next = block + 1;
+        victim->ra_end = block + 1;
+        victim->window = 0;
+        victim->last_used = ra_tick;
+        return 0;
+    }
+
+    s->next = block + 1;
+    s->last_used = ra_tick;
+    if (s->ra_end < s->next) s->ra_end = s->next;
+    if (s->window && s->ra_end - s->next >= s->window / 2) return 0;
+
+    s->window = s->window ? s->window * 2 : RA_MIN;
+    if (s->window > RA_MAX) s->window = RA_MAX;
+
+    uint64_t end = s->next + s->window;
+    uint64_t blocks = dev->sectors / BCACHE_SECTORS;
+    if (end > blocks) end = blocks;
+    if (end <= s->ra_end) return 0;
+    *start = s->ra_end;
+    s->ra_end = end;
+    return (uint32_t)(end - *start);
+}
+
+// Claim buffers for the blocks read ahead of `block` that are not cached.
+// Caller holds bcache_lock and submits the returned buffers after dropping it.
+static int queue_readahead(BlockDevice* dev, uint64_t block, Buffer** out) {
+    uint64_t start;
+    uint32_t count = plan_readahead(dev, block, &start);
+    int n = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (lookup(dev, start + i)) continue;
+        Buffer* b = grab(dev, start + i);
+        if (!b) break;
+        // Referenced, so CLOCK does not throw it out before the reader arrives
+        b->flags = BUF_READAHEAD | BUF_REFERENCED;
+        b->io_pending = 1;
+        out[n++] = b;
+    }
+    stats.readahead += n;
+    return n;
+}
+
+// --- API ---
+
+int bcache_read(BlockDevice* dev, uint64_t block, Buffer** out) {
+    if (block >= dev->sectors / BCACHE_SECTORS) return BLOCK_EINVAL;
+
+    Buffer* prefetch[RA_MAX];
+    for (int attempt = 0;; attempt++) {
+        uint64_t flags = bcache_lock.lock_irqsave();
+        Buffer* b = lookup(dev, block);
+        if (!b) {
+            b = grab(dev, block);
+            if (!b) {
+                // Everything is pinned or dirty: write back once and retry
+                bool dirty = stats.dirty != 0;
+                bcache_lock.unlock_irqrestore(flags);
+                if (attempt == 0 && dirty) {
+                    bcache_sync(nullptr);
+                    continue;
+                }
+                return BCACHE_ENOMEM;
+            }
+        }
+
+        bool submit = false;
+        if ((b->flags & BUF_VALID) || b->io_pending) {
+            stats.hits++;
+        } else {
+            stats.misses++;
+            b->error = 0;
+            b->io_pending = 1;
+            submit = true;
+        }
+        if (b->flags & BUF_READAHEAD) {
+            b->flags &= ~BUF_READAHEAD;
+            stats.readahead_hits++;
+        }
+        b->flags |= BUF_REFERENCED;
+        b->pins++;
+        int n = queue_readahead(dev, block, prefetch);
+        bcache_lock.unlock_irqrestore(flags);
+
+        // The demand read goes first; the prefetches queue up behind it and
+        // are merged by the block layer
+        if (submit) start_io(b, BlockOp::Read);
+        for (int i = 0; i < n; i++) start_io(prefetch[i], BlockOp::Read);
+        block_wait(dev, &b->io_pending);
+
+        if (!(b->flags & BUF_VALID)) {
+            int err = b->error ? b->error : BLOCK_EIO;
+            bcache_release(b);
+            return err;
+        }
+        *out = b;
+        return 0;
+    }
+}
+
+void bcache_release(Buffer* buf) {
+    uint64_t flags = bcache_lock.lock_irqsave();
+    buf->pins--;
+    bcache_lock.unlock_irqrestore(flags);
+}
+
+void bcache_mark_dirty(Buffer* buf) {
+    uint64_t flags = bcache_lock.lock_irqsave();
+    if (!(buf->flags & BUF_DIRTY)) {
+        buf->flags |= BUF_DIRTY;
+        stats.dirty++;
+    }
+    bcache_lock.unlock_irqrestore(flags);
+}
+
+// Writes go out in batches so the elevator can merge neighbouring blocks.
+// Stops at the first failed batch; failed blocks stay dirty.
+int bcache_sync(BlockDevice* dev) {
+    Buffer* batch[SYNC_BATCH];
+    for (;;) {
+        int n = 0;
+        uint64_t flags = bcache_lock.lock_irqsave();
+        for (uint32_t i = 0; i < BCACHE_MAX_BUFFERS && n < SYNC_BATCH; i++) {
+            Buffer* b = &buffers[i];
+            if (!b->dev || !(b->flags & BUF_DIRTY) || b->io_pending) continue;
+            if (dev && b->dev != dev) continue;
+            b->flags &= ~BUF_DIRTY;
+            b->error = 0;
+            b->io_pending = 1;
+            b->pins++;
+            stats.dirty--;
+            stats.writebacks++;
+            batch[n++] = b;
+        }
+        bcache_lock.unlock_irqrestore(flags);
+        if (n == 0) return 0;
+
+        for (int i = 0; i < n; i++) start_io(batch[i], BlockOp::Write);
+        int result = 0;
+        for (int i = 0; i < n; i++) {
+            block_wait(batch[i]->dev, &batch[i]->io_pending);
+            if (batch[i]->error) result = batch[i]->error;
+            bcache_release(batch[i]);
+        }
+        if (result) return result;
+    }
+}
+
+void bcache_stats(BcacheStats* out) {
+    uint64_t flags = bcache_lock.lock_irqsave();
+    *out = stats;
+    bcache_lock.unlock_irqrestore(flags);
+}
+
+void bcache_reset_stats() {
+    uint64_t flags = bcache_lock.lock_irqsave();
+    uint64_t buffers_held = stats.buffers;
+    uint64_t dirty = stats.dirty;
+    stats = BcacheStats();
+    stats.buffers = buffers_held;
+    stats.dirty = dirty;
+    bcache_lock.unlock_irqrestore(flags);
+}
+
+// Forget every clean, idle block of `dev` (the benchmark's cold start)
+static void drop_device(BlockDevice* dev) {
+    uint64_t flags = bcache_lock.lock_irqsave();
+    for (uint32_t i = 0; i < BCACHE_MAX_BUFFERS; i++) {
+        Buffer* b = &buffers[i];
+        if (b->dev != dev || b->pins || b->io_pending || (b->flags & BUF_DIRTY)) continue;
+        unhash(b);
+        b->hash_next = spare_list;
+        spare_list = b;
+    }
+    RaDevice* rd = ra_device(dev);
+    if (rd) {
+        for (int i = 0; i < RA_STREAMS; i++) rd->streams[i].last_used = 0;
+    }
+    bcache_lock.unlock_irqrestore(flags);
+}
+
+// --- Benchmark ---
+
+#define BENCH_BYTES       (8 * 1024 * 1024)   // Fits in the cache
+#define BENCH_RAND_READS  2000
+
+static uint64_t bench_seed;
+
+static uint64_t bench_random() {
+    bench_seed = bench_seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return bench_seed >> 33;
+}
+
+static uint64_t percent(uint64_t part, uint64_t whole) {
+    return whole ? part * 100 / whole : 0;
+}
+
+// Read `count` blocks (sequentially from 0 or at random below `range`)
+// and report the pass against the counters it moved
+static int bench_pass(const char* label, BlockDevice* dev, uint64_t count, uint64_t range, bool sequential) {
+    BcacheStats before, after;
+    bcache_stats(&before);
+    int err = 0;
+    uint64_t start = rdtsc();
+    for (uint64_t i = 0; i < count && !err; i++) {
+        Buffer* b;
+        err = bcache_read(dev, sequential ? i : bench_random() % range, &b);
+        if (!err) bcache_release(b);
+    }
+    uint64_t cycles = rdtsc() - start;
+    if (err) {
+        kprint("cachebench: ");
+        kprint(err == BCACHE_ENOMEM ? "out of memory" : block_strerror(err));
+        kprint("\n");
+        return err;
+    }
+    bcache_stats(&after);
+
+    uint64_t hits = after.hits - before.hits;
+    uint64_t ra = after.readahead - before.readahead;
+    kprint("  "); kprint(label); kprint(": ");
+    kprint_int(tsc_mb_per_sec(count * BCACHE_BLOCK_SIZE, cycles)); kprint(" MB/s, ");
+    kprint_int(tsc_cycles_to_ns(cycles) / count); kprint(" ns/block, ");
+    kprint_int(percent(hits, count)); kprint("% hits, ");
+    kprint_int(ra); kprint(" read ahead\n");
+    return 0;
+}
+
+void bcache_benchmark_command(const char* name) {
+    BlockDevice* dev = name ? block_find(name) : block_device(0);
+    if (!dev) {
+        kprint(name ? "cachebench: no such device\n" : "cachebench: no block devices\n");
+        return;
+    }
+    uint64_t blocks = BENCH_BYTES / BCACHE_BLOCK_SIZE;
+    if (blocks > dev->sectors / BCACHE_SECTORS) blocks = dev->sectors / BCACHE_SECTORS;
+    if (blocks == 0) {
+        kprint("cachebench: device too small\n");
+        return;
+    }
+    bench_seed = rdtsc();
+    BcacheStats before, after;
+    bcache_stats(&before);
+
+    kprint("\n--- Buffer cache: "); kprint(dev->name); kprint(", ");
+    kprint_int(blocks * BCACHE_BLOCK_SIZE / 1024); kprint(" KB ---\n");
+
+    drop_device(dev);
+    if (bench_pass("cold sequential", dev, blocks, blocks, true)) return;
+    if (bench_pass("warm sequential", dev, blocks, blocks, true)) return;
+    if (bench_pass("warm random    ", dev, BENCH_RAND_READS, blocks, false)) return;
+    drop_device(dev);
+    if (bench_pass("cold random    ", dev, BENCH_RAND_READS / 4, blocks, false)) return;
+
+    bcache_stats(&after);
+    uint64_t ra = after.readahead - before.readahead;
+    kprint("  read-ahead: "); kprint_int(ra); kprint(" blocks, ");
+    kprint_int(percent(after.readahead_hits - before.readahead_hits, ra)); kprint("% used, ");
+    kprint_int(after.readahead_wasted - before.readahead_wasted); kprint(" evicted unread\n");
+}
@@ -0,0 +1,63 @@
+#ifndef BCACHE_HPP
+#define BCACHE_HPP
+
+#include "../lib/types.h"
+#include "../drivers/block.hpp"
+
+// Buffer cache: 4 KB blocks of block devices, keyed by (device, block
+// number) and held in PMM frames. Readers pin a buffer for as long as they
+// use its data; unpinned clean buffers are recycled in CLOCK order or
+// handed back to the PMM when it runs dry.
+#define BCACHE_BLOCK_SIZE   4096
+#define BCACHE_SECTORS      (BCACHE_BLOCK_SIZE / BLOCK_SECTOR_SIZE)
+#define BCACHE_MAX_BUFFERS  4096      // Headers; frames are allocated lazily
+
+#define BCACHE_ENOMEM -12
+
+struct Buffer {
+    BlockDevice* dev;         // nullptr while the header is unused
+    uint64_t block;           // In BCACHE_BLOCK_SIZE units
+    uint8_t* data;            // One frame, nullptr if not backed
+
+    // Private to the cache
+    uint32_t pins;
+    uint32_t flags;
+    volatile uint32_t io_pending;
+    int error;                // Status of the last failed read
+    Buffer* hash_next;        // Hash chain, or the spare / empty list
+    BlockRequest req;
+};
+
+struct BcacheStats {
+    uint64_t buffers;          // Headers holding a frame
+    uint64_t dirty;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t readahead;        // Blocks prefetched
+    uint64_t readahead_hits;   // ...and later read
+    uint64_t readahead_wasted; // ...and evicted unread
+    uint64_t evictions;        // Buffers recycled by CLOCK
+    uint64_t reclaimed;        // Frames given back to the PMM
+    uint64_t writebacks;       // Dirty blocks written
+};
+
+void bcache_init();
+
+// Pin block `block` of `dev`, reading it if it is not cached (0 or a
+// negative BLOCK_* / BCACHE_ENOMEM error). Sequential access patterns are
+// detected per device and read ahead asynchronously.
+int bcache_read(BlockDevice* dev, uint64_t block, Buffer** out);
+void bcache_release(Buffer* buf);
+
+// The pinned buffer's data was modified; written back by bcache_sync() or
+// when the cache needs the buffer
+void bcache_mark_dirty(Buffer* buf);
+int bcache_sync(BlockDevice* dev);        // nullptr: every device
+
+void bcache_stats(BcacheStats* out);
+void bcache_reset_stats();
+
+// Cold / warm sequential scans and random reads (the `cachebench` command)
+void bcache_benchmark_command(const char* name);
+
+#endif
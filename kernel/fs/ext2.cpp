@@ -0,0 +1,1035 @@
+#include "ext2.hpp"
+#include "bcache.hpp"
+#include "vfs.hpp"
+#include "console.hpp"
+#include "tsc.hpp"
+#include "../lib/spinlock.hpp"
+#include "../lib/string.hpp"
+#include "../mm/heap.hpp"
+
+#define EXT2_MAGIC         0xEF53
+#define EXT2_SUPER_OFFSET  1024
+#define EXT2_ROOT_INO      2
+#define EXT2_NDIR_BLOCKS   12
+#define EXT2_GOOD_OLD_INODE_SIZE 128
+
+#define EXT2_COMPAT_DIR_INDEX    0x0020
+#define EXT2_INCOMPAT_FILETYPE   0x0002
+#define EXT3_INCOMPAT_RECOVER    0x0004   // Journal not replayed: we see the last checkpoint
+#define EXT4_INCOMPAT_EXTENTS    0x0040
+#define EXT4_INCOMPAT_64BIT      0x0080
+#define EXT4_INCOMPAT_FLEX_BG    0x0200
+#define EXT2_INCOMPAT_SUPPORTED  (EXT2_INCOMPAT_FILETYPE | EXT3_INCOMPAT_RECOVER | \
+                                  EXT4_INCOMPAT_EXTENTS | EXT4_INCOMPAT_64BIT | EXT4_INCOMPAT_FLEX_BG)
+
+#define EXT2_FLAGS_UNSIGNED_HASH 0x0002
+
+#define EXT2_INDEX_FL        0x00001000   // Directory has an htree index
+#define EXT4_EXTENTS_FL      0x00080000
+#define EXT4_INLINE_DATA_FL  0x10000000
+
+#define EXT2_S_IFMT  0xF000
+#define EXT2_S_IFDIR 0x4000
+#define EXT2_S_IFREG 0x8000
+
+#define EXT2_FT_DIR  2
+
+#define EXT4_EXT_MAGIC     0xF30A
+#define EXT4_EXT_MAX_DEPTH 5
+#define EXT4_INIT_MAX_LEN  32768          // Longer ee_len: unwritten extent
+
+// htree hash functions (s_def_hash_version / dx_root_info.hash_version)
+#define DX_HASH_LEGACY            0
+#define DX_HASH_HALF_MD4          1
+#define DX_HASH_TEA               2
+#define DX_HASH_LEGACY_UNSIGNED   3
+#define DX_HASH_HALF_MD4_UNSIGNED 4
+#define DX_HASH_TEA_UNSIGNED      5
+
+#define NODE_BUCKETS   256
+#define RUN_MIN_BYTES  (16 * 1024)        // Smaller reads go through the buffer cache
+
+struct Ext2Superblock {
+    uint32_t s_inodes_count;
+    uint32_t s_blocks_count;
+    uint32_t s_r_blocks_count;
+    uint32_t s_free_blocks_count;
+    uint32_t s_free_inodes_count;
+    uint32_t s_first_data_block;
+    uint32_t s_log_block_size;
+    uint32_t s_log_frag_size;
+    uint32_t s_blocks_per_group;
+    uint32_t s_frags_per_group;
+    uint32_t s_inodes_per_group;
+    uint32_t s_mtime;
+    uint32_t s_wtime;
+    uint16_t s_mnt_count;
+    uint16_t s_max_mnt_count;
+    uint16_t s_magic;
+    uint16_t s_state;
+    uint16_t s_errors;
+    uint16_t s_minor_rev_level;
+    uint32_t s_lastcheck;
+    uint32_t s_checkinterval;
+    uint32_t s_creator_os;
+    uint32_t s_rev_level;
+    uint16_t s_def_resuid;
+    uint16_t s_def_resgid;
+    // Revision 1 and later
+    uint32_t s_first_ino;
+    uint16_t s_inode_size;
+    uint16_t s_block_group_nr;
+    uint32_t s_feature_compat;
+    uint32_t s_feature_incompat;
+    uint32_t s_feature_ro_compat;
+    uint8_t  s_uuid[16];
+    char     s_volume_name[16];
+    char     s_last_mounted[64];
+    uint32_t s_algorithm_usage_bitmap;
+    uint8_t  s_prealloc_blocks;
+    uint8_t  s_prealloc_dir_blocks;
+    uint16_t s_reserved_gdt_blocks;
+    uint8_t  s_journal_uuid[16];
+    uint32_t s_journal_inum;
+    uint32_t s_journal_dev;
+    uint32_t s_last_orphan;
+    uint32_t s_hash_seed[4];
+    uint8_t  s_def_hash_version;
+    uint8_t  s_jnl_backup_type;
+    uint16_t s_desc_size;
+    uint32_t s_default_mount_opts;
+    uint32_t s_first_meta_bg;
+    uint32_t s_mkfs_time;
+    uint32_t s_jnl_blocks[17];
+    uint32_t s_blocks_count_hi;
+    uint32_t s_r_blocks_count_hi;
+    uint32_t s_free_blocks_count_hi;
+    uint16_t s_min_extra_isize;
+    uint16_t s_want_extra_isize;
+    uint32_t s_flags;
+} __attribute__((packed));
+
+static_assert(__builtin_offsetof(Ext2Superblock, s_hash_seed) == 236, "superblock layout");
+static_assert(__builtin_offsetof(Ext2Superblock, s_flags) == 352, "superblock layout");
+
+struct Ext2GroupDesc {
+    uint32_t bg_block_bitmap;
+    uint32_t bg_inode_bitmap;
+    uint32_t bg_inode_table;
+    uint16_t bg_free_blocks_count;
+    uint16_t bg_free_inodes_count;
+    uint16_t bg_used_dirs_count;
+    uint16_t bg_flags;
+    uint32_t bg_exclude_bitmap;
+    uint16_t bg_block_bitmap_csum;
+    uint16_t bg_inode_bitmap_csum;
+    uint16_t bg_itable_unused;
+    uint16_t bg_checksum;
+    // 64-bit descriptors only
+    uint32_t bg_block_bitmap_hi;
+    uint32_t bg_inode_bitmap_hi;
+    uint32_t bg_inode_table_hi;
+} __attribute__((packed));
+
+struct Ext2Inode {
+    uint16_t i_mode;
+    uint16_t i_uid;
+    uint32_t i_size;
+    uint32_t i_atime;
+    uint32_t i_ctime;
+    uint32_t i_mtime;
+    uint32_t i_dtime;
+    uint16_t i_gid;
+    uint16_t i_links_count;
+    uint32_t i_blocks;
+    uint32_t i_flags;
+    uint32_t i_osd1;
+    uint32_t i_block[15];
+    uint32_t i_generation;
+    uint32_t i_file_acl;
+    uint32_t i_size_high;
+} __attribute__((packed));
+
+struct Ext2DirEntry {
+    uint32_t inode;             // 0: unused slot
+    uint16_t rec_len;
+    uint8_t  name_len;
+    uint8_t  file_type;         // With EXT2_INCOMPAT_FILETYPE only
+    char     name[];
+} __attribute__((packed));
+
+// Block 0 of an indexed directory: "." and ".." entries, then this, then
+// the first level of DxEntry records
+struct DxRootInfo {
+    uint32_t reserved_zero;
+    uint8_t  hash_version;
+    uint8_t  info_length;       // 8
+    uint8_t  indirect_levels;
+    uint8_t  unused_flags;
+} __attribute__((packed));
+
+// Entry 0 keeps (limit, count) where the hash would be
+struct DxEntry {
+    uint32_t hash;
+    uint32_t block;             // Logical block of the directory
+} __attribute__((packed));
+
+struct Ext4ExtentHeader {
+    uint16_t eh_magic;
+    uint16_t eh_entries;
+    uint16_t eh_max;
+    uint16_t eh_depth;          // 0: entries are Ext4Extent
+    uint32_t eh_generation;
+} __attribute__((packed));
+
+struct Ext4Extent {
+    uint32_t ee_block;
+    uint16_t ee_len;
+    uint16_t ee_start_hi;
+    uint32_t ee_start_lo;
+} __attribute__((packed));
+
+struct Ext4ExtentIdx {
+    uint32_t ei_block;
+    uint32_t ei_leaf_lo;
+    uint16_t ei_leaf_hi;
+    uint16_t ei_unused;
+} __attribute__((packed));
+
+// In-memory inode. Nodes stay allocated for as long as the mount exists,
+// so vnodes can point at them.
+struct Ext2Node {
+    uint32_t ino;
+    uint16_t mode;
+    uint32_t flags;
+    uint64_t size;
+    uint32_t block[15];         // Block map or extent tree root
+    // Last mapping looked up, so sequential reads skip the walk
+    uint64_t run_lblock;
+    uint64_t run_pblock;        // 0: hole
+    uint32_t run_len;           // 0: nothing cached
+    Ext2Node* hash_next;
+};
+
+struct Ext2Fs {
+    BlockDevice* dev;
+    uint32_t block_shift;
+    uint32_t block_size;
+    uint64_t blocks_count;
+    uint32_t inodes_count;
+    uint32_t inodes_per_group;
+    uint32_t inode_size;
+    uint32_t desc_size;
+    uint64_t gdt_block;         // First block of the group descriptor table
+    bool filetype;
+    bool dir_index;
+    bool unsigned_hash;
+    uint32_t hash_seed[4];
+    Ext2Node* nodes[NODE_BUCKETS];
+};
+
+static Spinlock ext2_lock("ext2"); // Node tables, run caches and stats
+static Ext2Stats stats;
+
+static Ext2Fs* fs_of(Mount* mnt) {
+    return (Ext2Fs*)mnt->fs_data;
+}
+
+static bool is_dir(const Ext2Node* node) {
+    return (node->mode & EXT2_S_IFMT) == EXT2_S_IFDIR;
+}
+
+// Block layer and cache errors share the VFS errno numbering
+static int io_error(int err) {
+    return err == BCACHE_ENOMEM ? VFS_ENOMEM : VFS_EIO;
+}
+
+// Pin the cache block holding filesystem block `blk`
+static int read_block(Ext2Fs* fs, uint64_t blk, Buffer** buf, const uint8_t** data) {
+    if (blk == 0 || blk >= fs->blocks_count) return VFS_EIO; // Corrupt pointer
+    uint64_t byte = blk << fs->block_shift;
+    int err = bcache_read(fs->dev, byte / BCACHE_BLOCK_SIZE, buf);
+    if (err < 0) return io_error(err);
+    *data = (*buf)->data + byte % BCACHE_BLOCK_SIZE;
+    return 0;
+}
+
+// --- Inodes ---
+
+static int read_inode(Ext2Fs* fs, uint32_t ino, Ext2Node* node) {
+    if (ino == 0 || ino > fs->inodes_count) return VFS_EIO;
+    uint32_t group = (ino - 1) / fs->inodes_per_group;
+    uint32_t index = (ino - 1) % fs->inodes_per_group;
+
+    Buffer* buf;
+    const uint8_t* data;
+    uint64_t desc = (uint64_t)group * fs->desc_size;
+    int err = read_block(fs, fs->gdt_block + (desc >> fs->block_shift), &buf, &data);
+    if (err < 0) return err;
+    const Ext2GroupDesc* gd = (const Ext2GroupDesc*)(data + (desc & (fs->block_size - 1)));
+    uint64_t table = gd->bg_inode_table;
+    if (fs->desc_size >= sizeof(Ext2GroupDesc)) table |= (uint64_t)gd->bg_inode_table_hi << 32;
+    bcache_release(buf);
+
+    uint64_t off = (uint64_t)index * fs->inode_size;
+    err = read_block(fs, table + (off >> fs->block_shift), &buf, &data);
+    if (err < 0) return err;
+    const Ext2Inode* raw = (const Ext2Inode*)(data + (off & (fs->block_size - 1)));
+    node->ino = ino;
+    node->mode = raw->i_mode;
+    node->flags = raw->i_flags;
+    node->size = raw->i_size;
+    if ((raw->i_mode & EXT2_S_IFMT) == EXT2_S_IFREG) node->size |= (uint64_t)raw->i_size_high << 32;
+    memcpy(node->block, raw->i_block, sizeof(node->block));
+    bcache_release(buf);
+    return 0;
+}
+
+static Ext2Node* find_node(Ext2Fs* fs, uint32_t ino) {
+    for (Ext2Node* n = fs->nodes[ino % NODE_BUCKETS]; n; n = n->hash_next) {
+        if (n->ino == ino) return n;
+    }
+    return nullptr;
+}
+
+static int get_node(Ext2Fs* fs, uint32_t ino, Ext2Node** out) {
+    {
+        ScopedIrqLock guard(ext2_lock);
+        *out = find_node(fs, ino);
+        if (*out) return 0;
+    }
+
+    Ext2Node* node = (Ext2Node*)kzalloc(sizeof(Ext2Node));
+    if (!node) return VFS_ENOMEM;
+    int err = read_inode(fs, ino, node);
+    if (err < 0) {
+        kfree(node);
+        return err;
+    }
+
+    ScopedIrqLock guard(ext2_lock);
+    Ext2Node* raced = find_node(fs, ino);
+    if (raced) {
+        kfree(node);
+        *out = raced;
+        return 0;
+    }
+    node->hash_next = fs->nodes[ino % NODE_BUCKETS];
+    fs->nodes[ino % NODE_BUCKETS] = node;
+    *out = node;
+    return 0;
+}
+
+static void free_nodes(Ext2Fs* fs) {
+    for (int i = 0; i < NODE_BUCKETS; i++) {
+        Ext2Node* n = fs->nodes[i];
+        while (n) {
+            Ext2Node* next = n->hash_next;
+            kfree(n);
+            n = next;
+        }
+    }
+}
+
+// --- Block mapping ---
+
+static uint32_t clamp_run(uint64_t n) {
+    return n > 0xFFFFFFFFULL ? 0xFFFFFFFFu : (uint32_t)n;
+}
+
+// Longest run starting at ptrs[index] that is contiguous on disk (or all holes)
+static void scan_ptrs(const uint32_t* ptrs, uint64_t index, uint64_t count, uint64_t* pblock, uint32_t* len) {
+    uint32_t first = ptrs[index];
+    uint32_t n = 1;
+    while (index + n < count && ptrs[index + n] == (first ? first + n : 0)) n++;
+    *pblock = first;
+    *len = n;
+}
+
+// Classic block map: 12 direct pointers, then single, double and triple
+// indirect blocks. Runs stop at the end of the pointer block they start in.
+static int indirect_run(Ext2Fs* fs, const Ext2Node* node, uint64_t lblock, uint64_t* pblock, uint32_t* len) {
+    if (lblock < EXT2_NDIR_BLOCKS) {
+        scan_ptrs(node->block, lblock, EXT2_NDIR_BLOCKS, pblock, len);
+        return 0;
+    }
+
+    uint64_t ppb = fs->block_size / sizeof(uint32_t);
+    uint64_t l = lblock - EXT2_NDIR_BLOCKS;
+    uint64_t path[3];
+    int depth;
+    uint64_t blk;
+    if (l < ppb) {
+        depth = 1;
+        blk = node->block[12];
+        path[0] = l;
+    } else if ((l -= ppb) < ppb * ppb) {
+        depth = 2;
+        blk = node->block[13];
+        path[0] = l / ppb;
+        path[1] = l % ppb;
+    } else if ((l -= ppb * ppb) < ppb * ppb * ppb) {
+        depth = 3;
+        blk = node->block[14];
+        path[0] = l / (ppb * ppb);
+        path[1] = (l / ppb) % ppb;
+        path[2] = l % ppb;
+    } else {
+        return VFS_EFBIG;
+    }
+
+    for (int level = 0;; level++) {
+        if (blk == 0) {
+            // Missing pointer block: a hole to the end of its subtree
+            uint64_t span = 1, pos = 0;
+            for (int i = depth - 1; i >= level; i--) {
+                pos += path[i] * span;
+                span *= ppb;
+            }
+            *pblock = 0;
+            *len = clamp_run(span - pos);
+            return 0;
+        }
+
+        Buffer* buf;
+        const uint8_t* data;
+        int err = read_block(fs, blk, &buf, &data);
+        if (err < 0) return err;
+        const uint32_t* ptrs = (const uint32_t*)data;
+        if (level == depth - 1) {
+            scan_ptrs(ptrs, path[level], ppb, pblock, len);
+            bcache_release(buf);
+            return 0;
+        }
+        blk = ptrs[path[level]];
+        bcache_release(buf);
+    }
+}
+
+// ext4 extent tree: index nodes down to a leaf of (logical start, length,
+// physical start) records
+static int extent_run(Ext2Fs* fs, const Ext2Node* node, uint64_t lblock, uint64_t* pblock, uint32_t* len) {
+    const uint8_t* data = (const uint8_t*)node->block;
+    Buffer* buf = nullptr;
+    uint64_t limit = 1ULL << 32;    // Where the subtree we descended into ends
+
+    for (int level = 0; level <= EXT4_EXT_MAX_DEPTH; level++) {
+        const Ext4ExtentHeader* eh = (const Ext4ExtentHeader*)data;
+        if (eh->eh_magic != EXT4_EXT_MAGIC) break;
+
+        if (eh->eh_depth == 0) {
+            const Ext4Extent* ex = (const Ext4Extent*)(eh + 1);
+            uint64_t hole_end = limit;
+            int i = eh->eh_entries - 1;
+            while (i >= 0 && ex[i].ee_block > lblock) hole_end = ex[i--].ee_block;
+
+            *pblock = 0;
+            *len = clamp_run(hole_end - lblock);
+            if (i >= 0) {
+                uint32_t elen = ex[i].ee_len;
+                bool unwritten = elen > EXT4_INIT_MAX_LEN;
+                if (unwritten) elen -= EXT4_INIT_MAX_LEN;
+                if (lblock < (uint64_t)ex[i].ee_block + elen) {
+                    uint64_t skip = lblock - ex[i].ee_block;
+                    uint64_t start = ((uint64_t)ex[i].ee_start_hi << 32) | ex[i].ee_start_lo;
+                    *pblock = unwritten ? 0 : start + skip; // Unwritten extents read as zeros
+                    *len = (uint32_t)(elen - skip);
+                }
+            }
+            if (buf) bcache_release(buf);
+            return 0;
+        }
+
+        const Ext4ExtentIdx* ix = (const Ext4ExtentIdx*)(eh + 1);
+        if (eh->eh_entries == 0) break;
+        int i = eh->eh_entries - 1;
+        while (i > 0 && ix[i].ei_block > lblock) i--;
+        if (i + 1 < eh->eh_entries && ix[i + 1].ei_block < limit) limit = ix[i + 1].ei_block;
+        uint64_t child = ((uint64_t)ix[i].ei_leaf_hi << 32) | ix[i].ei_leaf_lo;
+
+        if (buf) bcache_release(buf);
+        buf = nullptr;
+        int err = read_block(fs, child, &buf, &data);
+        if (err < 0) return err;
+    }
+    if (buf) bcache_release(buf);
+    return VFS_EIO;
+}
+
+// Map logical block `lblock` to a run of at most `max` blocks that are
+// contiguous on disk (*pblock = first block) or all holes (*pblock = 0)
+static int map_run(Ext2Fs* fs, Ext2Node* node, uint64_t lblock, uint32_t max, uint64_t* pblock, uint32_t* len) {
+    {
+        ScopedIrqLock guard(ext2_lock);
+        if (node->run_len && lblock >= node->run_lblock && lblock - node->run_lblock < node->run_len) {
+            uint64_t skip = lblock - node->run_lblock;
+            *pblock = node->run_pblock ? node->run_pblock + skip : 0;
+            *len = node->run_len - (uint32_t)skip;
+            if (*len > max) *len = max;
+            return 0;
+        }
+    }
+
+    uint64_t p;
+    uint32_t n;
+    int err = (node->flags & EXT4_EXTENTS_FL) ? extent_run(fs, node, lblock, &p, &n)
+                                              : indirect_run(fs, node, lblock, &p, &n);
+    if (err < 0) return err;
+    if (p && (p >= fs->blocks_count || n > fs->blocks_count - p)) return VFS_EIO;
+
+    {
+        ScopedIrqLock guard(ext2_lock);
+        node->run_lblock = lblock;
+        node->run_pblock = p;
+        node->run_len = n;
+    }
+    *pblock = p;
+    *len = n > max ? max : n;
+    return 0;
+}
+
+static int read_dir_block(Ext2Fs* fs, Ext2Node* dir, uint64_t lblock, Buffer** buf, const uint8_t** data) {
+    uint64_t pblock;
+    uint32_t len;
+    int err = map_run(fs, dir, lblock, 1, &pblock, &len);
+    if (err < 0) return err;
+    if (pblock == 0) return VFS_EIO;  // Directories have no holes
+    return read_block(fs, pblock, buf, data);
+}
+
+// --- Directory lookup ---
+
+// 1 with *ino set, 0 if absent, VFS_EIO on a malformed block
+static int find_in_block(Ext2Fs* fs, const uint8_t* data, const char* name, size_t len, uint32_t* ino) {
+    size_t off = 0;
+    while (off + sizeof(Ext2DirEntry) <= fs->block_size) {
+        const Ext2DirEntry* de = (const Ext2DirEntry*)(data + off);
+        if (de->rec_len < sizeof(Ext2DirEntry) || de->rec_len > fs->block_size - off) return VFS_EIO;
+        if (de->inode && de->name_len == len && memcmp(de->name, name, len) == 0) {
+            *ino = de->inode;
+            return 1;
+        }
+        off += de->rec_len;
+    }
+    return 0;
+}
+
+static int linear_lookup(Ext2Fs* fs, Ext2Node* dir, const char* name, size_t len, uint32_t* ino, uint64_t* scanned) {
+    uint64_t blocks = (dir->size + fs->block_size - 1) >> fs->block_shift;
+    for (uint64_t lb = 0; lb < blocks; lb++) {
+        Buffer* buf;
+        const uint8_t* data;
+        int err = read_dir_block(fs, dir, lb, &buf, &data);
+        if (err < 0) return err;
+        (*scanned)++;
+        int found = find_in_block(fs, data, name, len, ino);
+        bcache_release(buf);
+        if (found != 0) return found;
+    }
+    return 0;
+}
+
+// Hashes from the Linux ext2/3/4 htree implementation (fs/ext4/hash.c)
+
+static uint32_t rol32(uint32_t x, int s) {
+    return (x << s) | (x >> (32 - s));
+}
+
+static uint32_t dx_hack_hash(const char* name, size_t len, bool is_unsigned) {
+    uint32_t hash0 = 0x12a3fe2d, hash1 = 0x37abe8f9;
+    for (size_t i = 0; i < len; i++) {
+        int c = is_unsigned ? (int)(uint8_t)name[i] : (int)(signed char)name[i];
+        uint32_t hash = hash1 + (hash0 ^ (uint32_t)(c * 7152373));
+        if (hash & 0x80000000) hash -= 0x7fffffff;
+        hash1 = hash0;
+        hash0 = hash;
+    }
+    return hash0 << 1;
+}
+
+// Pack up to num * 4 bytes of the name into words, padded with its length
+static void str2hashbuf(const char* msg, size_t len, uint32_t* buf, int num, bool is_unsigned) {
+    uint32_t pad = (uint32_t)len | ((uint32_t)len << 8);
+    pad |= pad << 16;
+    uint32_t val = pad;
+    if (len > (size_t)num * 4) len = (size_t)num * 4;
+    for (size_t i = 0; i < len; i++) {
+        int c = is_unsigned ? (int)(uint8_t)msg[i] : (int)(signed char)msg[i];
+        val = (uint32_t)c + (val << 8);
+        if (i % 4 == 3) {
+            *buf++ = val;
+            val = pad;
+            num--;
+        }
+    }
+    if (--num >= 0) *buf++ = val;
+    while (--num >= 0) *buf++ = pad;
+}
+
+#define MD4_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define MD4_G(x, y, z) (((x) & (y)) + (((x) ^ (y)) & (z)))
+#define MD4_H(x, y, z) ((x) ^ (y) ^ (z))
+#define MD4_ROUND(f, a, b, c, d, x, s) (a += f(b, c, d) + (x), a = rol32(a, s))
+#define MD4_K2 013240474631U
+#define MD4_K3 015666365641U
+
+static void half_md4_transform(uint32_t buf[4], const uint32_t in[8]) {
+    uint32_t a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+
+    MD4_ROUND(MD4_F, a, b, c, d, in[0], 3);
+    MD4_ROUND(MD4_F, d, a, b, c, in[1], 7);
+    MD4_ROUND(MD4_F, c, d, a, b, in[2], 11);
+    MD4_ROUND(MD4_F, b, c, d, a, in[3], 19);
+    MD4_ROUND(MD4_F, a, b, c, d, in[4], 3);
+    MD4_ROUND(MD4_F, d, a, b, c, in[5], 7);
+    MD4_ROUND(MD4_F, c, d, a, b, in[6], 11);
+    MD4_ROUND(MD4_F, b, c, d, a, in[7], 19);
+
+    MD4_ROUND(MD4_G, a, b, c, d, in[1] + MD4_K2, 3);
+    MD4_ROUND(MD4_G, d, a, b, c, in[3] + MD4_K2, 5);
+    MD4_ROUND(MD4_G, c, d, a, b, in[5] + MD4_K2, 9);
+    MD4_ROUND(MD4_G, b, c, d, a, in[7] + MD4_K2, 13);
+    MD4_ROUND(MD4_G, a, b, c, d, in[0] + MD4_K2, 3);
+    MD4_ROUND(MD4_G, d, a, b, c, in[2] + MD4_K2, 5);
+    MD4_ROUND(MD4_G, c, d, a, b, in[4] + MD4_K2, 9);
+    MD4_ROUND(MD4_G, b, c, d, a, in[6] + MD4_K2, 13);
+
+    MD4_ROUND(MD4_H, a, b, c, d, in[3] + MD4_K3, 3);
+    MD4_ROUND(MD4_H, d, a, b, c, in[7] + MD4_K3, 9);
+    MD4_ROUND(MD4_H, c, d, a, b, in[2] + MD4_K3, 11);
+    MD4_ROUND(MD4_H, b, c, d, a, in[6] + MD4_K3, 15);
+    MD4_ROUND(MD4_H, a, b, c, d, in[1] + MD4_K3, 3);
+    MD4_ROUND(MD4_H, d, a, b, c, in[5] + MD4_K3, 9);
+    MD4_ROUND(MD4_H, c, d, a, b, in[0] + MD4_K3, 11);
+    MD4_ROUND(MD4_H, b, c, d, a, in[4] + MD4_K3, 15);
+
+    buf[0] += a;
+    buf[1] += b;
+    buf[2] += c;
+    buf[3] += d;
+}
+
+static void tea_transform(uint32_t buf[4], const uint32_t in[4]) {
+    uint32_t sum = 0;
+    uint32_t b0 = buf[0], b1 = buf[1];
+    for (int n = 0; n < 16; n++) {
+        sum += 0x9E3779B9;
+        b0 += ((b1 << 4) + in[0]) ^ (b1 + sum) ^ ((b1 >> 5) + in[1]);
+        b1 += ((b0 << 4) + in[2]) ^ (b0 + sum) ^ ((b0 >> 5) + in[3]);
+    }
+    buf[0] += b0;
+    buf[1] += b1;
+}
+
+// Major hash of a name; false for an unknown hash version
+static bool dx_hash(const Ext2Fs* fs, uint8_t version, const char* name, size_t len, uint32_t* out) {
+    uint32_t buf[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+    if (fs->hash_seed[0] | fs->hash_seed[1] | fs->hash_seed[2] | fs->hash_seed[3]) {
+        memcpy(buf, fs->hash_seed, sizeof(buf));
+    }
+
+    bool is_unsigned = version >= DX_HASH_LEGACY_UNSIGNED;
+    uint32_t in[8];
+    uint32_t hash;
+    switch (version) {
+    case DX_HASH_LEGACY:
+    case DX_HASH_LEGACY_UNSIGNED:
+        hash = dx_hack_hash(name, len, is_unsigned);
+        break;
+    case DX_HASH_HALF_MD4:
+    case DX_HASH_HALF_MD4_UNSIGNED:
+        for (size_t off = 0; off < len; off += 32) {
+            str2hashbuf(name + off, len - off, in, 8, is_unsigned);
+            half_md4_transform(buf, in);
+        }
+        hash = buf[1];
+        break;
+    case DX_HASH_TEA:
+    case DX_HASH_TEA_UNSIGNED:
+        for (size_t off = 0; off < len; off += 16) {
+            str2hashbuf(name + off, len - off, in, 4, is_unsigned);
+            tea_transform(buf, in);
+        }
+        hash = buf[0];
+        break;
+    default:
+        return false;
+    }
+    hash &= ~1u;
+    if (hash == 0xFFFFFFFEu) hash = 0xFFFFFFFCu; // Reserved end-of-directory value
+    *out = hash;
+    return true;
+}
+
+#define DX_FALLBACK 2   // Index unusable: scan the directory instead
+
+// Walk the htree from the root block to the one leaf block whose hash range
+// holds the name
+static int dx_lookup(Ext2Fs* fs, Ext2Node* dir, const char* name, size_t len, uint32_t* ino, uint64_t* scanned) {
+    Buffer* buf;
+    const uint8_t* data;
+    int err = read_dir_block(fs, dir, 0, &buf, &data);
+    if (err < 0) return err;
+
+    // "." (12 bytes) and ".." (rest of the block) hide the index from old readers
+    const DxRootInfo* info = (const DxRootInfo*)(data + 24);
+    uint8_t version = info->hash_version;
+    if (fs->unsigned_hash && version <= DX_HASH_TEA) version += 3;
+    uint32_t hash;
+    if (info->reserved_zero || info->info_length != sizeof(DxRootInfo) || info->indirect_levels > 1 ||
+        !dx_hash(fs, version, name, len, &hash)) {
+        bcache_release(buf);
+        return DX_FALLBACK;
+    }
+    uint32_t levels = info->indirect_levels;
+    size_t entries_off = 24 + sizeof(DxRootInfo);
+
+    for (uint32_t level = 0;; level++) {
+        const DxEntry* e = (const DxEntry*)(data + entries_off);
+        uint16_t limit = (uint16_t)(e[0].hash & 0xFFFF);
+        uint16_t count = (uint16_t)(e[0].hash >> 16);
+        if (count == 0 || count > limit || entries_off + (size_t)count * sizeof(DxEntry) > fs->block_size) {
+            bcache_release(buf);
+            return DX_FALLBACK;
+        }
+
+        // Last entry whose hash is <= ours (entry 0 covers everything below e[1])
+        uint32_t lo = 1, hi = count;
+        while (lo < hi) {
+            uint32_t mid = (lo + hi) / 2;
+            if (e[mid].hash > hash) {
+                hi = mid;
+            } else {
+                lo = mid + 1;
+            }
+        }
+        uint32_t child = e[lo - 1].block;
+        // A run of equal hashes may continue in the next block (low bit set)
+        bool spills = lo < count && (e[lo].hash & ~1u) == hash;
+        bcache_release(buf);
+
+        err = read_dir_block(fs, dir, child, &buf, &data);
+        if (err < 0) return err;
+        if (level == levels) {
+            (*scanned)++;
+            int found = find_in_block(fs, data, name, len, ino);
+            bcache_release(buf);
+            if (found == 0 && spills) return DX_FALLBACK;
+            return found;
+        }
+        entries_off = 8;   // Interior node: an empty dirent spanning the block
+    }
+}
+
+static int find_entry(Ext2Fs* fs, Ext2Node* dir, const char* name, size_t len, uint32_t* ino) {
+    uint64_t scanned = 0;
+    int ret = DX_FALLBACK;
+    if (fs->dir_index && (dir->flags & EXT2_INDEX_FL)) {
+        ret = dx_lookup(fs, dir, name, len, ino, &scanned);
+    }
+    bool hashed = ret != DX_FALLBACK;
+    if (!hashed) ret = linear_lookup(fs, dir, name, len, ino, &scanned);
+
+    {
+        ScopedIrqLock guard(ext2_lock);
+        if (hashed) {
+            stats.hashed_lookups++;
+        } else {
+            stats.linear_lookups++;
+        }
+        stats.dir_blocks += scanned;
+    }
+    if (ret < 0) return ret;
+    return ret ? 0 : VFS_ENOENT;
+}
+
+// --- VFS operations ---
+
+static void to_vnode(Mount* mnt, Ext2Node* node, Vnode* out) {
+    out->mount = mnt;
+    out->ino = node->ino;
+    out->type = is_dir(node) ? VnodeType::Directory : VnodeType::File;
+    out->size = node->size;
+    out->priv = node;
+}
+
+static int ext2_lookup(Mount* mnt, const char* path, Vnode* out) {
+    Ext2Fs* fs = fs_of(mnt);
+    Ext2Node* node;
+    int err = get_node(fs, EXT2_ROOT_INO, &node);
+    if (err < 0) return err;
+
+    const char* p = path;
+    while (*p) {
+        size_t len = 0;
+        while (p[len] && p[len] != '/') len++;
+        if (!is_dir(node)) return VFS_ENOTDIR;
+
+        uint32_t ino;
+        err = find_entry(fs, node, p, len, &ino);
+        if (err < 0) return err;
+        err = get_node(fs, ino, &node);
+        if (err < 0) return err;
+
+        p += len;
+        if (*p == '/') p++;
+    }
+    to_vnode(mnt, node, out);
+    return 0;
+}
+
+// Whole blocks that start a read and span at least RUN_MIN_BYTES go to
+// the device directly, one command per contiguous run; the rest (and
+// small reads, which the cache's read-ahead turns into large ones) are
+// copied out of the buffer cache.
+static int64_t ext2_read(const Vnode* vn, void* buf, size_t len, uint64_t offset) {
+    Ext2Fs* fs = fs_of(vn->mount);
+    Ext2Node* node = (Ext2Node*)vn->priv;
+    if ((node->mode & EXT2_S_IFMT) != EXT2_S_IFREG || (node->flags & EXT4_INLINE_DATA_FL)) {
+        return VFS_ENOTSUP;
+    }
+    if (offset >= node->size) return 0;
+    if (len > node->size - offset) len = (size_t)(node->size - offset);
+
+    uint8_t* out = (uint8_t*)buf;
+    uint32_t sectors_per_block = fs->block_size / BLOCK_SECTOR_SIZE;
+    uint32_t max_blocks = fs->dev->max_sectors / sectors_per_block;
+    uint64_t run_reads = 0, run_bytes = 0, cached_bytes = 0;
+    size_t done = 0;
+    int err = 0;
+
+    while (done < len) {
+        uint64_t pos = offset + done;
+        uint64_t lblock = pos >> fs->block_shift;
+        size_t in_block = pos & (fs->block_size - 1);
+        size_t left = len - done;
+        uint64_t wanted = (in_block + left + fs->block_size - 1) >> fs->block_shift;
+
+        uint64_t pblock;
+        uint32_t run;
+        err = map_run(fs, node, lblock, clamp_run(wanted), &pblock, &run);
+        if (err < 0) break;
+
+        size_t n;
+        if (pblock == 0) {
+            n = ((size_t)run << fs->block_shift) - in_block;
+            if (n > left) n = left;
+            memset(out + done, 0, n);
+        } else if (in_block == 0 && left >= RUN_MIN_BYTES && left >= fs->block_size) {
+            uint32_t blocks = run < max_blocks ? run : max_blocks;
+            if (blocks > (left >> fs->block_shift)) blocks = (uint32_t)(left >> fs->block_shift);
+            err = block_read(fs->dev, pblock * sectors_per_block, blocks * sectors_per_block, out + done);
+            if (err < 0) {
+                err = io_error(err);
+                break;
+            }
+            n = (size_t)blocks << fs->block_shift;
+            run_reads++;
+            run_bytes += n;
+        } else {
+            Buffer* b;
+            const uint8_t* data;
+            err = read_block(fs, pblock, &b, &data);
+            if (err < 0) break;
+            n = fs->block_size - in_block;
+            if (n > left) n = left;
+            memcpy(out + done, data + in_block, n);
+            bcache_release(b);
+            cached_bytes += n;
+        }
+        done += n;
+    }
+
+    {
+        ScopedIrqLock guard(ext2_lock);
+        stats.run_reads += run_reads;
+        stats.run_bytes += run_bytes;
+        stats.cached_bytes += cached_bytes;
+    }
+    if (done == 0 && err < 0) return err;
+    return (int64_t)done;
+}
+
+static int ext2_getattr(const Vnode* vn, VfsStat* out) {
+    const Ext2Node* node = (const Ext2Node*)vn->priv;
+    out->ino = node->ino;
+    out->type = is_dir(node) ? VnodeType::Directory : VnodeType::File;
+    out->size = node->size;
+    return 0;
+}
+
+// The cookie is the byte offset of the next entry. Names that do not fit a
+// VfsDirent are skipped.
+static int ext2_readdir(const Vnode* vn, uint64_t* cookie, VfsDirent* out) {
+    Ext2Fs* fs = fs_of(vn->mount);
+    Ext2Node* dir = (Ext2Node*)vn->priv;
+
+    while (*cookie < dir->size) {
+        Buffer* buf;
+        const uint8_t* data;
+        int err = read_dir_block(fs, dir, *cookie >> fs->block_shift, &buf, &data);
+        if (err < 0) return err;
+
+        size_t off = *cookie & (fs->block_size - 1);
+        const Ext2DirEntry* de = (const Ext2DirEntry*)(data + off);
+        if (off + sizeof(Ext2DirEntry) > fs->block_size || de->rec_len < sizeof(Ext2DirEntry) ||
+            de->rec_len > fs->block_size - off) {
+            bcache_release(buf);
+            return VFS_EIO;
+        }
+        *cookie += de->rec_len;
+
+        size_t n = de->name_len;
+        bool dot = (n == 1 && de->name[0] == '.') || (n == 2 && de->name[0] == '.' && de->name[1] == '.');
+        if (de->inode == 0 || dot || n >= VFS_NAME_MAX) {
+            bcache_release(buf);
+            continue;
+        }
+        memcpy(out->name, de->name, n);
+        out->name[n] = '\0';
+        uint32_t ino = de->inode;
+        bool typed = fs->filetype;
+        out->type = de->file_type == EXT2_FT_DIR ? VnodeType::Directory : VnodeType::File;
+        bcache_release(buf);
+
+        if (!typed) {
+            Ext2Node* node;
+            err = get_node(fs, ino, &node);
+            if (err < 0) return err;
+            out->type = is_dir(node) ? VnodeType::Directory : VnodeType::File;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+static const VfsOps ext2_ops = {
+    "ext2",
+    ext2_lookup,
+    ext2_read,
+    nullptr,           // map_view: file data is not resident
+    ext2_getattr,
+    ext2_readdir,
+    nullptr,           // Read-only
+    nullptr,
+    nullptr,
+    nullptr,
+};
+
+int ext2_mount(const char* path, BlockDevice* dev) {
+    Buffer* buf;
+    int err = bcache_read(dev, 0, &buf);   // The superblock sits at byte 1024
+    if (err < 0) return io_error(err);
+    Ext2Superblock sb;
+    memcpy(&sb, buf->data + EXT2_SUPER_OFFSET, sizeof(sb));
+    bcache_release(buf);
+
+    if (sb.s_magic != EXT2_MAGIC || sb.s_inodes_per_group == 0) return VFS_EINVAL;
+    uint32_t incompat = sb.s_rev_level ? sb.s_feature_incompat : 0;
+    if (sb.s_log_block_size > 2 || (incompat & ~EXT2_INCOMPAT_SUPPORTED)) {
+        return VFS_ENOTSUP;   // Blocks above 4 KB would straddle cache blocks
+    }
+
+    Ext2Fs* fs = (Ext2Fs*)kzalloc(sizeof(Ext2Fs));
+    if (!fs) return VFS_ENOMEM;
+    fs->dev = dev;
+    fs->block_shift = 10 + sb.s_log_block_size;
+    fs->block_size = 1u << fs->block_shift;
+    fs->blocks_count = sb.s_blocks_count;
+    if (incompat & EXT4_INCOMPAT_64BIT) fs->blocks_count |= (uint64_t)sb.s_blocks_count_hi << 32;
+    fs->inodes_count = sb.s_inodes_count;
+    fs->inodes_per_group = sb.s_inodes_per_group;
+    fs->inode_size = sb.s_rev_level ? sb.s_inode_size : EXT2_GOOD_OLD_INODE_SIZE;
+    fs->desc_size = (incompat & EXT4_INCOMPAT_64BIT) && sb.s_desc_size >= 64 ? sb.s_desc_size : 32;
+    fs->gdt_block = sb.s_first_data_block + 1;
+    fs->filetype = incompat & EXT2_INCOMPAT_FILETYPE;
+    fs->dir_index = sb.s_rev_level && (sb.s_feature_compat & EXT2_COMPAT_DIR_INDEX);
+    fs->unsigned_hash = sb.s_flags & EXT2_FLAGS_UNSIGNED_HASH;
+    memcpy(fs->hash_seed, sb.s_hash_seed, sizeof(fs->hash_seed));
+
+    Ext2Node* root;
+    if (fs->inode_size < EXT2_GOOD_OLD_INODE_SIZE || fs->inode_size > fs->block_size ||
+        fs->blocks_count > dev->sectors / (fs->block_size / BLOCK_SECTOR_SIZE)) {
+        err = VFS_EINVAL;
+    } else {
+        err = get_node(fs, EXT2_ROOT_INO, &root);
+        if (err == 0 && !is_dir(root)) err = VFS_EIO;
+    }
+    if (err == 0) err = vfs_mount(path, &ext2_ops, fs);
+    if (err < 0) {
+        free_nodes(fs);
+        kfree(fs);
+        return err;
+    }
+    vfs_dcache_invalidate(); // `path` may have resolved on the parent mount
+    return 0;
+}
+
+void ext2_stats(Ext2Stats* out) {
+    ScopedIrqLock guard(ext2_lock);
+    *out = stats;
+}
+
+// --- Benchmark ---
+
+#define BENCH_MAX_BYTES (32 * 1024 * 1024)
+#define BENCH_BUF_SIZE  (1024 * 1024)
+
+static const size_t bench_sizes[] = {4096, 64 * 1024, BENCH_BUF_SIZE};
+
+void ext2_benchmark_command(const char* path) {
+    int fd = vfs_open(path, VFS_O_RDONLY);
+    VfsStat st;
+    if (fd >= 0 && vfs_fstat(fd, &st) == 0 && st.type == VnodeType::Directory) {
+        vfs_close(fd);
+        fd = VFS_EISDIR;
+    }
+    if (fd < 0) {
+        kprint("fsbench: "); kprint(path); kprint(": "); kprint(vfs_strerror(fd)); kprint("\n");
+        return;
+    }
+    uint64_t total = st.size < BENCH_MAX_BYTES ? st.size : BENCH_MAX_BYTES;
+    uint8_t* buf = total ? (uint8_t*)kmalloc(BENCH_BUF_SIZE) : nullptr;
+    if (!buf) {
+        kprint(total ? "fsbench: out of memory\n" : "fsbench: file is empty\n");
+        vfs_close(fd);
+        return;
+    }
+
+    kprint("\n--- File read throughput: "); kprint(path); kprint(", ");
+    kprint_int(total / 1024); kprint(" KB ---\n");
+
+    for (size_t i = 0; i < sizeof(bench_sizes) / sizeof(bench_sizes[0]); i++) {
+        size_t chunk = bench_sizes[i];
+        Ext2Stats before, after;
+        ext2_stats(&before);
+
+        uint64_t off = 0;
+        int64_t n = 0;
+        uint64_t start = rdtsc();
+        while (off < total) {
+            size_t want = total - off < chunk ? (size_t)(total - off) : chunk;
+            n = vfs_pread(fd, buf, want, off);
+            if (n <= 0) break;
+            off += (uint64_t)n;
+        }
+        uint64_t cycles = rdtsc() - start;
+        if (n < 0) {
+            kprint("fsbench: "); kprint(path); kprint(": "); kprint(vfs_strerror((int)n)); kprint("\n");
+            break;
+        }
+        ext2_stats(&after);
+
+        uint64_t runs = after.run_reads - before.run_reads;
+        kprint("  "); kprint_int(chunk / 1024); kprint(" KB reads: ");
+        kprint_int(tsc_mb_per_sec(off, cycles)); kprint(" MB/s, ");
+        kprint_int(runs); kprint(" multi-block reads");
+        if (runs) {
+            kprint(" (avg "); kprint_int((after.run_bytes - before.run_bytes) / runs / 1024); kprint(" KB)");
+        }
+        kprint(", "); kprint_int((after.cached_bytes - before.cached_bytes) / 1024);
+        kprint(" KB from the buffer cache\n");
+    }
+    kfree(buf);
+    vfs_close(fd);
+}
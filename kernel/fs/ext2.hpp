@@ -0,0 +1,28 @@
+#ifndef EXT2_HPP
+#define EXT2_HPP
+
+#include "../lib/types.h"
+#include "../drivers/block.hpp"
+
+// Read-only ext2 (also ext3/ext4 images without journal replay or inline
+// data) on a block device. Metadata goes through the buffer cache; large
+// aligned file reads are issued straight to the device, one command per
+// physically contiguous run of blocks.
+int ext2_mount(const char* path, BlockDevice* dev);
+
+struct Ext2Stats {
+    uint64_t hashed_lookups;   // Resolved through a dir_index (htree)
+    uint64_t linear_lookups;
+    uint64_t dir_blocks;       // Directory blocks scanned by lookups
+    uint64_t run_reads;        // Multi-block device reads
+    uint64_t run_bytes;
+    uint64_t cached_bytes;     // File bytes copied out of the buffer cache
+};
+
+void ext2_stats(Ext2Stats* out);
+
+// Sequential read throughput of one file at several request sizes (the
+// `fsbench` command)
+void ext2_benchmark_command(const char* path);
+
+#endif
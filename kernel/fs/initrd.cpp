@@ -0,0 +1,129 @@
+#include "initrd.hpp"
+#include "tarfs.hpp"
+#include "../arch/x86_64/multiboot.hpp"
+#include "../drivers/console.hpp"
+#include "../mm/vmm.hpp"
+#include "../mm/pmm.hpp"
+#include "../mm/heap.hpp"
+#include "../lib/lz4.hpp"
+#include "cpu.hpp"
+#include "tsc.hpp"
+
+#ifdef INITRD_EMBED
+extern "C" uint8_t _binary_build_initrd_tar_start[];
+extern "C" uint8_t _binary_build_initrd_tar_end[];
+#endif
+
+static bool cmdline_is(const char* cmdline, const char* name) {
+    while (*cmdline == ' ') cmdline++;
+    while (*name && *cmdline == *name) {
+        cmdline++;
+        name++;
+    }
+    return *name == '\0' && (*cmdline == '\0' || *cmdline == ' ');
+}
+
+// Prefer a module tagged "initrd"; otherwise take the first module
+static multiboot_tag_module* find_module(void* mbi) {
+    multiboot_tag_module* first = nullptr;
+    for (multiboot_tag* t = multiboot_find_tag(mbi, MULTIBOOT_TAG_TYPE_MODULE, nullptr);
+         t; t = multiboot_find_tag(mbi, MULTIBOOT_TAG_TYPE_MODULE, t)) {
+        multiboot_tag_module* mod = (multiboot_tag_module*)t;
+        if (cmdline_is(mod->cmdline, "initrd")) return mod;
+        if (!first) first = mod;
+    }
+    return first;
+}
+
+// Inflate an LZ4 frame into heap frames. The result is never freed: tarfs
+// and zero-copy VFS views point into it for the life of the kernel.
+static const uint8_t* decompress_lz4(const uint8_t* src, size_t len, size_t* out_size) {
+    uint64_t start = rdtsc();
+    int64_t size = lz4_frame_content_size(src, len);
+    if (size <= 0) {
+        kprint("[INITRD] Corrupt LZ4 frame.\n");
+        return nullptr;
+    }
+
+    uint8_t* dst = (uint8_t*)kmalloc((size_t)size);
+    if (!dst) {
+        kprint("[INITRD] Out of memory for the decompressed initrd.\n");
+        return nullptr;
+    }
+    int64_t written = lz4_frame_decompress(src, len, dst, (size_t)size);
+    uint64_t cycles = rdtsc() - start;
+    if (written != size) {
+        kfree(dst);
+        kprint("[INITRD] Corrupt LZ4 frame.\n");
+        return nullptr;
+    }
+
+    kprint("[INITRD] LZ4 ");
+    kprint_int(len);
+    kprint(" -> ");
+    kprint_int(size);
+    kprint(" bytes in ");
+    kprint_int(tsc_cycles_to_ns(cycles) / 1000);
+    kprint(" us (");
+    kprint_int(tsc_mb_per_sec((uint64_t)size, cycles));
+    kprint(" MB/s)\n");
+
+    *out_size = (size_t)size;
+    return dst;
+}
+
+// Give the compressed module back to the PMM once it has been inflated.
+// Only whole pages inside the module are released.
+static void release_module(const multiboot_tag_module* mod) {
+    uint64_t first = (mod->mod_start + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint64_t last = mod->mod_end / PAGE_SIZE;
+    if (last > first) {
+        pmm.free_frames((void*)(first * PAGE_SIZE), last - first);
+    }
+}
+
+bool initrd_mount(void* multiboot_info) {
+    const uint8_t* archive = nullptr;
+    size_t size = 0;
+
+    multiboot_tag_module* mod = find_module(multiboot_info);
+    if (mod && mod->mod_end > mod->mod_start && mod->mod_end <= DIRECT_MAP_SIZE) {
+        // The PMM reserved [mod_start, mod_end); it stays mapped through
+        // the direct map for the lifetime of the kernel.
+        archive = (const uint8_t*)phys_to_virt(mod->mod_start);
+        size = mod->mod_end - mod->mod_start;
+        kprint("[INITRD] Module at ");
+        kprint_hex(mod->mod_start);
+        kprint(", ");
+        kprint_int(size);
+        kprint(" bytes\n");
+    } else if (mod) {
+        kprint("[INITRD] Module outside the direct map, ignored.\n");
+    }
+
+#ifdef INITRD_EMBED
+    if (!archive) {
+        archive = _binary_build_initrd_tar_start;
+        size = (size_t)(_binary_build_initrd_tar_end - _binary_build_initrd_tar_start);
+        kprint("[INITRD] Using the archive linked into the kernel.\n");
+    }
+#endif
+
+    if (!archive) {
+        kprint("[INITRD] No initrd module found.\n");
+        return false;
+    }
+
+    if (lz4_is_frame(archive, size)) {
+        const uint8_t* compressed = archive;
+        archive = decompress_lz4(compressed, size, &size);
+        if (!archive) return false;
+        if (mod && compressed == phys_to_virt(mod->mod_start)) {
+            release_module(mod);
+        }
+    }
+    if (!tarfs_init(archive, size)) {
+        return false;
+    }
+    return tarfs_mount("/") == 0;
+}
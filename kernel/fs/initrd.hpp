@@ -0,0 +1,12 @@
+#ifndef INITRD_HPP
+#define INITRD_HPP
+
+#include "../lib/types.h"
+
+// Find the initrd and mount it at / through tarfs. GRUB passes it as a
+// multiboot2 module (`module2 /boot/initrd initrd`); kernels built with
+// INITRD_EMBED=1 fall back to the archive linked into the image.
+// An LZ4-framed archive is decompressed into kernel heap memory first.
+bool initrd_mount(void* multiboot_info);
+
+#endif
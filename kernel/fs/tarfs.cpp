@@ -1,6 +1,12 @@
 #include "tarfs.hpp"
+#include "vfs.hpp"
 #include "../drivers/console.hpp"
-#include "../drivers/serial.hpp"
+#include "../lib/spinlock.hpp"
+#include "../lib/rcu.hpp"
+#include "../lib/string.hpp"
+#include "../mm/heap.hpp"
+#include "cpu.hpp"
+#include "tsc.hpp"
 
 struct TarHeader {
     char name[100];
@@ -22,9 +28,73 @@ struct TarHeader {
     char padding[12];
 };
 
-static const uint8_t* g_archive = nullptr;
-static size_t g_archive_size = 0;
-static bool g_ready = false;
+// One archive member, with its path already normalized (no leading "./",
+// no trailing '/') and NUL-terminated in the index string pool.
+struct TarfsEntry {
+    const char* path;
+    uint32_t path_len;
+    uint32_t hash;
+    const TarHeader* hdr;
+    const uint8_t* data;
+    size_t size;
+    char type; // USTAR typeflag: '0' file, '5' directory, ...
+    uint32_t node; // Tree node for this path
+};
+
+// Open-addressing slot: the hash is kept inline so probes rarely touch
+// the entry itself. index is entry + 1; 0 marks an empty slot.
+struct TarfsSlot {
+    uint32_t hash;
+    uint32_t index;
+};
+
+#define TARFS_NO_NODE 0xFFFFFFFFu
+#define TARFS_ROOT    0
+
+// Directory tree node. Children are a singly linked sibling list in
+// archive order, so listing a directory touches only its children.
+struct TarfsNode {
+    const char* name;      // Interned component; "" for the root
+    uint32_t name_len;
+    uint32_t name_hash;
+    uint32_t parent;       // The root is its own parent
+    uint32_t first_child;
+    uint32_t last_child;
+    uint32_t next_sibling;
+    const TarfsEntry* entry; // nullptr for directories implied by a prefix
+    bool is_dir;
+};
+
+struct TarfsIndex {
+    TarfsEntry* entries;  // Archive order
+    size_t count;
+    TarfsSlot* slots;
+    size_t slot_mask;     // slot count - 1 (power of two)
+    char* strings;
+
+    // Directory tree: nodes[0] is the root. Path components are interned
+    // in `names`, so a child lookup compares name pointers, not bytes.
+    TarfsNode* nodes;
+    size_t node_count;
+    TarfsSlot* child_slots; // (parent, name) -> node + 1
+    size_t child_mask;
+    char* names;
+    size_t names_used;
+    TarfsSlot* name_slots;  // component hash -> offset in names + 1
+    size_t name_mask;
+};
+
+// Immutable snapshot of the mounted archive. Lookups read it under RCU
+// without taking a lock; tarfs_init publishes a new one and frees the old
+// one after a grace period.
+struct TarfsState {
+    const uint8_t* archive;
+    size_t size;
+    TarfsIndex index;
+};
+
+static TarfsState* g_state = nullptr;  // nullptr until a valid archive is mounted
+static Spinlock tarfs_lock("tarfs");   // Serializes tarfs_init writers
 
 static size_t align_up_512(size_t n) {
     return (n + 511) & ~((size_t)511);
@@ -46,11 +116,9 @@ static size_t octal_to_size(const char* s, size_t len) {
     return value;
 }
 
+// Every byte equals its predecessor and the first one is zero
 static bool is_zero_block(const uint8_t* p) {
-    for (size_t i = 0; i < 512; i++) {
-        if (p[i] != 0) return false;
-    }
-    return true;
+    return p[0] == 0 && memcmp(p, p + 1, 511) == 0;
 }
 
 static const char* skip_dot_slash(const char* s) {
@@ -58,15 +126,9 @@ static const char* skip_dot_slash(const char* s) {
     return s;
 }
 
-static size_t str_len(const char* s) {
-    size_t n = 0;
-    while (s[n]) n++;
-    return n;
-}
-
 static size_t trimmed_len_no_trailing_slash(const char* s) {
     const char* t = skip_dot_slash(s);
-    size_t n = str_len(t);
+    size_t n = strlen(t);
     while (n > 0 && t[n - 1] == '/') n--;
     return n;
 }
@@ -101,9 +163,9 @@ static void tar_build_path(const TarHeader* hdr, char* out, size_t out_size) {
     out[p] = '\0';
 }
 
-static bool tar_walk_next(size_t* offset, const TarHeader** hdr_out, const uint8_t** data_out, size_t* size_out) {
-    if (*offset + 512 > g_archive_size) return false;
-    const TarHeader* hdr = (const TarHeader*)(g_archive + *offset);
+static bool tar_walk_next(const TarfsState* st, size_t* offset, const TarHeader** hdr_out, const uint8_t** data_out, size_t* size_out) {
+    if (*offset + 512 > st->size) return false;
+    const TarHeader* hdr = (const TarHeader*)(st->archive + *offset);
 
     if (is_zero_block((const uint8_t*)hdr)) {
         return false;
@@ -112,139 +174,596 @@ static bool tar_walk_next(size_t* offset, const TarHeader** hdr_out, const uint8
     size_t file_size = octal_to_size(hdr->size, sizeof(hdr->size));
     size_t data_off = *offset + 512;
     size_t next_off = data_off + align_up_512(file_size);
-    if (next_off > g_archive_size) return false;
+    if (next_off > st->size) return false;
 
     *hdr_out = hdr;
-    *data_out = g_archive + data_off;
+    *data_out = st->archive + data_off;
     *size_out = file_size;
     *offset = next_off;
     return true;
 }
 
+// Longest path tar_build_path can produce: prefix + '/' + name + NUL
+#define TAR_PATH_MAX 257
+
+// FNV-1a
+static uint32_t path_hash(const char* s, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (uint8_t)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static bool path_equal(const TarfsEntry* e, const char* s, size_t len) {
+    if (e->path_len != len) return false;
+    for (size_t i = 0; i < len; i++) {
+        if (e->path[i] != s[i]) return false;
+    }
+    return true;
+}
+
+static size_t table_size_for(size_t n) {
+    size_t slots = 16;
+    while (slots < n * 2) slots <<= 1; // Load factor <= 0.5
+    return slots;
+}
+
+static void free_index(TarfsIndex* idx) {
+    kfree(idx->entries);
+    kfree(idx->slots);
+    kfree(idx->strings);
+    kfree(idx->nodes);
+    kfree(idx->child_slots);
+    kfree(idx->names);
+    kfree(idx->name_slots);
+    *idx = TarfsIndex{};
+}
+
+// --- Name interning ---
+
+static const char* intern_find(const TarfsIndex* idx, const char* s, size_t len, uint32_t h) {
+    size_t i = h & idx->name_mask;
+    while (idx->name_slots[i].index != 0) {
+        if (idx->name_slots[i].hash == h) {
+            const char* name = idx->names + idx->name_slots[i].index - 1;
+            size_t k = 0;
+            while (k < len && name[k] == s[k]) k++;
+            if (k == len && name[len] == '\0') return name;
+        }
+        i = (i + 1) & idx->name_mask;
+    }
+    return nullptr;
+}
+
+static const char* intern(TarfsIndex* idx, const char* s, size_t len, uint32_t h) {
+    const char* found = intern_find(idx, s, len, h);
+    if (found) return found;
+
+    char* name = idx->names + idx->names_used;
+    for (size_t k = 0; k < len; k++) name[k] = s[k];
+    name[len] = '\0';
+
+    size_t i = h & idx->name_mask;
+    while (idx->name_slots[i].index != 0) i = (i + 1) & idx->name_mask;
+    idx->name_slots[i].hash = h;
+    idx->name_slots[i].index = (uint32_t)(idx->names_used + 1);
+    idx->names_used += len + 1;
+    return name;
+}
+
+// --- Directory tree ---
+
+static uint32_t child_hash(uint32_t parent, uint32_t name_hash) {
+    return (parent * 0x9E3779B1u) ^ name_hash;
+}
+
+static uint32_t find_child(const TarfsIndex* idx, uint32_t parent, const char* name, uint32_t name_hash) {
+    uint32_t h = child_hash(parent, name_hash);
+    size_t i = h & idx->child_mask;
+    while (idx->child_slots[i].index != 0) {
+        if (idx->child_slots[i].hash == h) {
+            uint32_t n = idx->child_slots[i].index - 1;
+            if (idx->nodes[n].parent == parent && idx->nodes[n].name == name) return n;
+        }
+        i = (i + 1) & idx->child_mask;
+    }
+    return TARFS_NO_NODE;
+}
+
+static uint32_t find_or_add_child(TarfsIndex* idx, uint32_t parent, const char* comp, size_t len) {
+    uint32_t name_hash = path_hash(comp, len);
+    const char* name = intern(idx, comp, len, name_hash);
+    uint32_t n = find_child(idx, parent, name, name_hash);
+    if (n != TARFS_NO_NODE) return n;
+
+    n = (uint32_t)idx->node_count++;
+    TarfsNode* node = &idx->nodes[n];
+    node->name = name;
+    node->name_len = (uint32_t)len;
+    node->name_hash = name_hash;
+    node->parent = parent;
+    node->first_child = TARFS_NO_NODE;
+    node->last_child = TARFS_NO_NODE;
+    node->next_sibling = TARFS_NO_NODE;
+    node->entry = nullptr;
+    node->is_dir = false;
+
+    TarfsNode* p = &idx->nodes[parent];
+    if (p->last_child == TARFS_NO_NODE) {
+        p->first_child = n;
+    } else {
+        idx->nodes[p->last_child].next_sibling = n;
+    }
+    p->last_child = n;
+    p->is_dir = true;
+
+    uint32_t h = child_hash(parent, name_hash);
+    size_t i = h & idx->child_mask;
+    while (idx->child_slots[i].index != 0) i = (i + 1) & idx->child_mask;
+    idx->child_slots[i].hash = h;
+    idx->child_slots[i].index = n + 1;
+    return n;
+}
+
+// Number of '/'-separated components in a normalized path
+static size_t count_components(const char* path, size_t len) {
+    size_t n = 1;
+    for (size_t i = 0; i < len; i++) {
+        if (path[i] == '/') n++;
+    }
+    return n;
+}
+
+// Hang an entry under the tree, creating any directory that the archive
+// only implies through a path prefix (e.g. "a/b/" for "a/b/c.txt").
+static void tree_insert(TarfsIndex* idx, TarfsEntry* e) {
+    uint32_t node = TARFS_ROOT;
+    size_t pos = 0;
+    while (pos < e->path_len) {
+        size_t end = pos;
+        while (end < e->path_len && e->path[end] != '/') end++;
+        if (end > pos) { // Skip empty components from "a//b"
+            node = find_or_add_child(idx, node, e->path + pos, end - pos);
+        }
+        pos = end + 1;
+    }
+    e->node = node;
+    if (node == TARFS_ROOT) return;
+
+    idx->nodes[node].entry = e; // Later duplicates win, as in the hash table
+    if (e->type == '5') idx->nodes[node].is_dir = true;
+}
+
+// Resolve a path through the tree. Accepts "", "/", ".", "./x", "x/" and
+// ".." components. Returns TARFS_NO_NODE if any component is missing.
+static uint32_t tree_lookup(const TarfsIndex* idx, const char* path) {
+    uint32_t node = TARFS_ROOT;
+    const char* p = path;
+    while (*p) {
+        while (*p == '/') p++;
+        const char* comp = p;
+        while (*p && *p != '/') p++;
+        size_t len = (size_t)(p - comp);
+
+        if (len == 0 || (len == 1 && comp[0] == '.')) continue;
+        if (len == 2 && comp[0] == '.' && comp[1] == '.') {
+            node = idx->nodes[node].parent;
+            continue;
+        }
+
+        uint32_t name_hash = path_hash(comp, len);
+        const char* name = intern_find(idx, comp, len, name_hash);
+        if (!name) return TARFS_NO_NODE; // No node anywhere has this name
+        node = find_child(idx, node, name, name_hash);
+        if (node == TARFS_NO_NODE) return TARFS_NO_NODE;
+    }
+    return node;
+}
+
+// Walk the archive once, twice really: size everything, then fill the
+// entry array, hash table and directory tree. Later members override
+// earlier ones with the same path, as tar extraction would.
+static bool build_index(TarfsState* st) {
+    TarfsIndex* idx = &st->index;
+    size_t count = 0;
+    size_t string_bytes = 0;
+    size_t components = 0;
+    char path[TAR_PATH_MAX];
+
+    size_t off = 0;
+    const TarHeader* hdr;
+    const uint8_t* data;
+    size_t size;
+    while (tar_walk_next(st, &off, &hdr, &data, &size)) {
+        tar_build_path(hdr, path, sizeof(path));
+        size_t len = trimmed_len_no_trailing_slash(path);
+        if (len == 0) continue; // "./" itself
+        count++;
+        string_bytes += len + 1;
+        components += count_components(skip_dot_slash(path), len);
+    }
+
+    // Upper bounds: every component could be a distinct node and name
+    size_t slots = table_size_for(count);
+    size_t max_nodes = components + 1;
+    size_t child_slots = table_size_for(max_nodes);
+
+    *idx = TarfsIndex{};
+    idx->slot_mask = slots - 1;
+    idx->child_mask = child_slots - 1;
+    idx->name_mask = child_slots - 1;
+    idx->entries = (TarfsEntry*)kmalloc((count ? count : 1) * sizeof(TarfsEntry));
+    idx->slots = (TarfsSlot*)kzalloc(slots * sizeof(TarfsSlot));
+    idx->strings = (char*)kmalloc(string_bytes ? string_bytes : 1);
+    idx->nodes = (TarfsNode*)kmalloc(max_nodes * sizeof(TarfsNode));
+    idx->child_slots = (TarfsSlot*)kzalloc(child_slots * sizeof(TarfsSlot));
+    idx->names = (char*)kmalloc(string_bytes + 1);
+    idx->name_slots = (TarfsSlot*)kzalloc(child_slots * sizeof(TarfsSlot));
+    if (!idx->entries || !idx->slots || !idx->strings || !idx->nodes ||
+        !idx->child_slots || !idx->names || !idx->name_slots) {
+        free_index(idx);
+        return false;
+    }
+
+    TarfsNode* root = &idx->nodes[TARFS_ROOT];
+    root->name = intern(idx, "", 0, path_hash("", 0));
+    root->name_len = 0;
+    root->name_hash = 0;
+    root->parent = TARFS_ROOT;
+    root->first_child = TARFS_NO_NODE;
+    root->last_child = TARFS_NO_NODE;
+    root->next_sibling = TARFS_NO_NODE;
+    root->entry = nullptr;
+    root->is_dir = true;
+    idx->node_count = 1;
+
+    char* str = idx->strings;
+    off = 0;
+    while (tar_walk_next(st, &off, &hdr, &data, &size)) {
+        tar_build_path(hdr, path, sizeof(path));
+        const char* norm = skip_dot_slash(path);
+        size_t len = trimmed_len_no_trailing_slash(path);
+        if (len == 0) continue;
+
+        TarfsEntry* e = &idx->entries[idx->count];
+        for (size_t i = 0; i < len; i++) str[i] = norm[i];
+        str[len] = '\0';
+        e->path = str;
+        e->path_len = (uint32_t)len;
+        e->hash = path_hash(str, len);
+        e->hdr = hdr;
+        e->data = data;
+        e->size = size;
+        e->type = hdr->typeflag;
+        str += len + 1;
+
+        size_t i = e->hash & idx->slot_mask;
+        while (idx->slots[i].index != 0) {
+            const TarfsEntry* other = &idx->entries[idx->slots[i].index - 1];
+            if (idx->slots[i].hash == e->hash && path_equal(other, e->path, len)) break;
+            i = (i + 1) & idx->slot_mask;
+        }
+        idx->slots[i].hash = e->hash;
+        idx->slots[i].index = (uint32_t)(idx->count + 1);
+        idx->count++;
+
+        tree_insert(idx, e);
+    }
+    return true;
+}
+
+static const TarfsEntry* index_lookup(const TarfsIndex* idx, const char* path) {
+    const char* norm = skip_dot_slash(path);
+    size_t len = trimmed_len_no_trailing_slash(path);
+    uint32_t h = path_hash(norm, len);
+
+    size_t i = h & idx->slot_mask;
+    while (idx->slots[i].index != 0) {
+        if (idx->slots[i].hash == h) {
+            const TarfsEntry* e = &idx->entries[idx->slots[i].index - 1];
+            if (path_equal(e, norm, len)) return e;
+        }
+        i = (i + 1) & idx->slot_mask;
+    }
+    return nullptr;
+}
+
+static bool valid_archive(const uint8_t* archive, size_t size) {
+    if (!archive || size < 1024) return false;
+    const TarHeader* hdr = (const TarHeader*)archive;
+    return hdr->magic[0] == 'u' && hdr->magic[1] == 's' && hdr->magic[2] == 't' &&
+           hdr->magic[3] == 'a' && hdr->magic[4] == 'r';
+}
+
+static void tarfs_publish(TarfsState* next) {
+    TarfsState* old = g_state;
+    rcu_assign_pointer(g_state, next);
+    synchronize_rcu(); // Readers of the previous snapshot are gone
+    vfs_dcache_invalidate();
+    if (old) {
+        free_index(&old->index);
+        kfree(old);
+    }
+}
+
 bool tarfs_init(const uint8_t* archive, size_t size) {
-    g_archive = archive;
-    g_archive_size = size;
-    g_ready = false;
+    ScopedIrqLock guard(tarfs_lock);
 
     if (!archive || size < 1024) {
+        tarfs_publish(nullptr);
         kprint("[TARFS] Archive missing or too small.\n");
         return false;
     }
 
-    const TarHeader* hdr = (const TarHeader*)archive;
-    if (!(hdr->magic[0] == 'u' && hdr->magic[1] == 's' && hdr->magic[2] == 't' &&
-          hdr->magic[3] == 'a' && hdr->magic[4] == 'r')) {
+    if (!valid_archive(archive, size)) {
+        tarfs_publish(nullptr);
         kprint("[TARFS] Invalid archive header.\n");
         return false;
     }
 
-    g_ready = true;
-    kprint("[TARFS] Initialized.\n");
+    TarfsState* next = (TarfsState*)kzalloc(sizeof(TarfsState));
+    if (!next) {
+        kprint("[TARFS] Out of memory.\n");
+        return false;
+    }
+    next->archive = archive;
+    next->size = size;
+    if (!build_index(next)) {
+        kfree(next);
+        kprint("[TARFS] Out of memory building the path index.\n");
+        return false;
+    }
+    tarfs_publish(next);
+
+    kprint("[TARFS] Initialized, ");
+    kprint_int(next->index.count);
+    kprint(" entries, ");
+    kprint_int(next->index.node_count - 1);
+    kprint(" tree nodes.\n");
     return true;
 }
 
 bool tarfs_is_ready() {
-    return g_ready;
+    return rcu_dereference(g_state) != nullptr;
 }
 
-void tarfs_ls() {
-    if (!g_ready) {
-        kprint("ls: filesystem not ready\n");
-        return;
+// --- VFS glue ---
+// Vnodes point straight at the archive bytes, which are never freed, so
+// they stay valid across a tarfs_init that swaps the index underneath.
+
+static int tarfs_vfs_lookup(Mount* mnt, const char* path, Vnode* out) {
+    RcuReadGuard rcu;
+    const TarfsState* st = rcu_dereference(g_state);
+    if (!st) return VFS_ENOENT;
+
+    // Plain file paths hit the hash index; directories, implied
+    // directories and "." / ".." paths go through the tree.
+    const TarfsIndex* idx = &st->index;
+    const TarfsEntry* e = index_lookup(idx, path);
+    if (e && e->type != '5') {
+        out->mount = mnt;
+        out->ino = e->node + 1;
+        out->type = VnodeType::File;
+        out->size = e->size;
+        out->priv = e->data;
+        return 0;
     }
 
-    size_t off = 0;
-    size_t count = 0;
-    while (true) {
-        const TarHeader* hdr = nullptr;
-        const uint8_t* data = nullptr;
-        size_t size = 0;
-        if (!tar_walk_next(&off, &hdr, &data, &size)) break;
-        (void)data;
-        (void)size;
-
-        char path[256];
-        tar_build_path(hdr, path, sizeof(path));
-        const char* shown = skip_dot_slash(path);
-        if (shown[0] == '\0') continue;
-
-        kprint(shown);
-        if (hdr->typeflag == '5') {
-            size_t shown_len = str_len(shown);
-            if (shown_len == 0 || shown[shown_len - 1] != '/') {
-                kprint("/");
-            }
-        }
-        kprint("\n");
-        count++;
+    uint32_t n = tree_lookup(idx, path);
+    if (n == TARFS_NO_NODE) return VFS_ENOENT;
+
+    const TarfsNode* node = &idx->nodes[n];
+    out->mount = mnt;
+    out->ino = n + 1;
+    if (node->is_dir) {
+        out->type = VnodeType::Directory;
+        out->size = 0;
+        out->priv = nullptr;
+    } else {
+        out->type = VnodeType::File;
+        out->size = node->entry->size;
+        out->priv = node->entry->data;
     }
+    return 0;
+}
 
-    if (count == 0) {
-        kprint("(empty)\n");
-    }
+bool tarfs_lookup(const char* path, size_t* size_out) {
+    Vnode vn;
+    if (tarfs_vfs_lookup(nullptr, path, &vn) < 0) return false;
+    *size_out = (size_t)vn.size;
+    return true;
 }
 
-bool tarfs_cat(const char* path) {
-    if (!g_ready) {
-        kprint("cat: filesystem not ready\n");
-        return false;
+static int64_t tarfs_vfs_read(const Vnode* vn, void* buf, size_t len, uint64_t offset) {
+    if (offset >= vn->size) return 0;
+    if (len > vn->size - offset) len = (size_t)(vn->size - offset);
+    const uint8_t* src = (const uint8_t*)vn->priv + offset;
+    memcpy(buf, src, len);
+    return (int64_t)len;
+}
+
+static int tarfs_vfs_map_view(const Vnode* vn, VfsView* out) {
+    out->data = (const uint8_t*)vn->priv;
+    out->size = (size_t)vn->size;
+    return 0;
+}
+
+// Directory vnodes carry their tree node as ino - 1; the cookie is the
+// next child's node + 1.
+static int tarfs_vfs_readdir(const Vnode* vn, uint64_t* cookie, VfsDirent* out) {
+    RcuReadGuard rcu;
+    const TarfsState* st = rcu_dereference(g_state);
+    if (!st) return VFS_ENOENT;
+
+    const TarfsIndex* idx = &st->index;
+    uint64_t dir = vn->ino - 1;
+    if (dir >= idx->node_count) return VFS_ENOENT;
+
+    uint64_t n = *cookie ? *cookie - 1 : idx->nodes[dir].first_child;
+    if (n >= idx->node_count) return 0; // TARFS_NO_NODE: end of list
+
+    const TarfsNode* node = &idx->nodes[n];
+    size_t len = node->name_len < VFS_NAME_MAX - 1 ? node->name_len : VFS_NAME_MAX - 1;
+    for (size_t i = 0; i < len; i++) out->name[i] = node->name[i];
+    out->name[len] = '\0';
+    out->type = node->is_dir ? VnodeType::Directory : VnodeType::File;
+    *cookie = (uint64_t)node->next_sibling + 1;
+    return 1;
+}
+
+static const VfsOps tarfs_vfs_ops = {
+    "tarfs",
+    tarfs_vfs_lookup,
+    tarfs_vfs_read,
+    tarfs_vfs_map_view,
+    nullptr,           // getattr: vnodes never change
+    tarfs_vfs_readdir,
+    nullptr,           // Read-only from here on
+    nullptr,
+    nullptr,
+    nullptr,
+};
+
+int tarfs_mount(const char* path) {
+    return vfs_mount(path, &tarfs_vfs_ops, nullptr);
+}
+
+// --- Lookup benchmark over a generated archive ---
+
+#define BENCH_HASH_LOOKUPS   10000
+#define BENCH_LINEAR_LOOKUPS 50
+
+static char* put_uint(char* out, size_t value, int width) {
+    for (int i = width - 1; i >= 0; i--) {
+        out[i] = (char)('0' + value % 10);
+        value /= 10;
     }
-    if (!path || path[0] == '\0') {
-        kprint("cat: missing file operand\n");
-        return false;
+    return out + width;
+}
+
+// "bench/dNNN/fileNNNNNN.txt", 100 files per directory
+static size_t bench_path(char* out, size_t n) {
+    const char* p1 = "bench/d";
+    const char* p2 = "/file";
+    const char* p3 = ".txt";
+    char* o = out;
+    while (*p1) *o++ = *p1++;
+    o = put_uint(o, n / 100, 3);
+    while (*p2) *o++ = *p2++;
+    o = put_uint(o, n, 6);
+    while (*p3) *o++ = *p3++;
+    *o = '\0';
+    return (size_t)(o - out);
+}
+
+static uint8_t* make_bench_archive(size_t entries, size_t* size_out) {
+    size_t size = (entries + 2) * 512; // Headers + two zero end blocks
+    uint8_t* buf = (uint8_t*)kzalloc(size);
+    if (!buf) return nullptr;
+
+    for (size_t n = 0; n < entries; n++) {
+        TarHeader* hdr = (TarHeader*)(buf + n * 512);
+        bench_path(hdr->name, n);
+        for (int i = 0; i < 11; i++) hdr->size[i] = '0'; // Empty file
+        hdr->typeflag = '0';
+        hdr->magic[0] = 'u'; hdr->magic[1] = 's'; hdr->magic[2] = 't';
+        hdr->magic[3] = 'a'; hdr->magic[4] = 'r';
+        hdr->version[0] = '0'; hdr->version[1] = '0';
     }
+    *size_out = size;
+    return buf;
+}
 
-    const char* wanted = skip_dot_slash(path);
+// What tarfs_cat used to do: rebuild and compare every path from offset 0
+static const TarHeader* linear_lookup(const TarfsState* st, const char* wanted) {
     size_t off = 0;
-    while (true) {
-        const TarHeader* hdr = nullptr;
-        const uint8_t* data = nullptr;
-        size_t size = 0;
-        if (!tar_walk_next(&off, &hdr, &data, &size)) break;
-
-        char full_path[256];
+    const TarHeader* hdr;
+    const uint8_t* data;
+    size_t size;
+    while (tar_walk_next(st, &off, &hdr, &data, &size)) {
+        char full_path[TAR_PATH_MAX];
         tar_build_path(hdr, full_path, sizeof(full_path));
-        const char* current = skip_dot_slash(full_path);
+        if (path_eq_normalized(skip_dot_slash(full_path), wanted)) return hdr;
+    }
+    return nullptr;
+}
 
-        if (!path_eq_normalized(current, wanted)) continue;
+static void print_latency(const char* label, uint64_t total, uint64_t n, uint64_t max) {
+    kprint("  "); kprint(label); kprint(": avg ");
+    kprint_int(total / n); kprint(" cycles (");
+    kprint_int(tsc_cycles_to_ns(total / n)); kprint(" ns), max ");
+    kprint_int(max); kprint(" cycles\n");
+}
 
-        if (hdr->typeflag == '5') {
-            kprint("cat: ");
-            kprint(path);
-            kprint(": is a directory\n");
-            return false;
-        }
+void tarfs_bench(size_t entries) {
+    if (entries == 0) entries = 1;
+    if (entries > 999999) entries = 999999;
 
-        for (size_t i = 0; i < size; i++) {
-            char c = (char)data[i];
-            console.write_char(c);
-            Serial::write_char(c);
-        }
-        if (size == 0 || data[size - 1] != '\n') {
-            kprint("\n");
-        }
-        return true;
+    TarfsState st = {};
+    st.archive = make_bench_archive(entries, &st.size);
+    if (!st.archive) {
+        kprint("tarbench: out of memory for the archive\n");
+        return;
     }
 
-    kprint("cat: ");
-    kprint(path);
-    kprint(": no such file\n");
-    return false;
-}
-
-void tarfs_self_test() {
-    kprint("[TARFS TEST] ls\n");
-    tarfs_ls();
+    uint64_t start = rdtsc();
+    bool ok = build_index(&st);
+    uint64_t build_cycles = rdtsc() - start;
+    if (!ok) {
+        kfree((void*)st.archive);
+        kprint("tarbench: out of memory for the index\n");
+        return;
+    }
 
-    kprint("[TARFS TEST] cat hello.txt\n");
-    tarfs_cat("hello.txt");
+    char query[TAR_PATH_MAX];
+    uint64_t total = 0, max = 0;
+    size_t missed = 0;
+    for (size_t i = 0; i < BENCH_HASH_LOOKUPS; i++) {
+        bench_path(query, (i * 7919) % entries); // Scattered over the archive
+        uint64_t t0 = rdtsc();
+        const TarfsEntry* e = index_lookup(&st.index, query);
+        uint64_t dt = rdtsc() - t0;
+        total += dt;
+        if (dt > max) max = dt;
+        if (!e) missed++;
+    }
 
-    kprint("[TARFS TEST] cat docs/guide.txt\n");
-    tarfs_cat("docs/guide.txt");
+    uint64_t lin_total = 0, lin_max = 0;
+    for (size_t i = 0; i < BENCH_LINEAR_LOOKUPS; i++) {
+        bench_path(query, (i * 7919) % entries);
+        uint64_t t0 = rdtsc();
+        const TarHeader* hdr = linear_lookup(&st, query);
+        uint64_t dt = rdtsc() - t0;
+        lin_total += dt;
+        if (dt > lin_max) lin_max = dt;
+        if (!hdr) missed++;
+    }
 
-    kprint("[TARFS TEST] cat missing.txt\n");
-    tarfs_cat("missing.txt");
+    // Enumerate one directory through the tree (100 children)
+    uint64_t t0 = rdtsc();
+    size_t children = 0;
+    uint32_t dir = tree_lookup(&st.index, "bench/d000");
+    if (dir != TARFS_NO_NODE) {
+        for (uint32_t c = st.index.nodes[dir].first_child; c != TARFS_NO_NODE;
+             c = st.index.nodes[c].next_sibling) {
+            children++;
+        }
+    }
+    uint64_t list_cycles = rdtsc() - t0;
+
+    kprint("\n--- tarfs lookup ("); kprint_int(entries); kprint(" entries) ---\n");
+    kprint("  index build  : "); kprint_int(build_cycles); kprint(" cycles (");
+    kprint_int(tsc_cycles_to_ns(build_cycles) / 1000); kprint(" us)\n");
+    print_latency("hashed lookup", total, BENCH_HASH_LOOKUPS, max);
+    print_latency("linear scan  ", lin_total, BENCH_LINEAR_LOOKUPS, lin_max);
+    kprint("  list bench/d000: "); kprint_int(children); kprint(" children in ");
+    kprint_int(list_cycles); kprint(" cycles\n");
+    if (missed != 0) {
+        kprint("  WARNING: "); kprint_int(missed); kprint(" lookups missed\n");
+    }
 
-    kprint("[TARFS TEST] cat docs\n");
-    tarfs_cat("docs");
+    free_index(&st.index);
+    kfree((void*)st.archive);
 }
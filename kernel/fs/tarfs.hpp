@@ -5,8 +5,16 @@
 
 bool tarfs_init(const uint8_t* archive, size_t size);
 bool tarfs_is_ready();
-void tarfs_ls();
-bool tarfs_cat(const char* path);
-void tarfs_self_test();
+
+// Resolve a path relative to the archive root straight from the index,
+// without the VFS (the `bench` suite); false if it does not exist
+bool tarfs_lookup(const char* path, size_t* size_out);
+
+// Make the archive reachable through the VFS (see vfs.hpp)
+int tarfs_mount(const char* path);
+
+// Build an index over a generated archive of `entries` members and compare
+// hashed lookup latency against the old linear scan.
+void tarfs_bench(size_t entries);
 
 #endif
@@ -0,0 +1,572 @@
+#include "tmpfs.hpp"
+#include "vfs.hpp"
+#include "../lib/spinlock.hpp"
+#include "../lib/string.hpp"
+#include "../mm/heap.hpp"
+#include "../mm/pmm.hpp"
+#include "../mm/vmm.hpp"
+
+#define RADIX_SHIFT 9                     // 512 eight-byte slots per frame
+#define RADIX_SLOTS (1u << RADIX_SHIFT)
+#define TMPFS_MAX_FILE_SIZE (1ULL << 30)  // Radix height <= 2
+
+struct TmpfsNode {
+    char name[VFS_NAME_MAX];
+    VnodeType type;
+    uint64_t ino;
+    uint64_t size;
+    TmpfsNode* parent;
+    TmpfsNode* first_child;
+    TmpfsNode* next_sibling;
+    uint64_t radix_root;   // Physical address of the top table, 0 if no data
+    uint32_t radix_height; // Table levels above the data pages
+};
+
+struct TmpfsFs {
+    TmpfsNode root;
+    bool has_lower;
+    Mount lower;           // What was mounted here before the overlay
+};
+
+static Spinlock tmpfs_lock("tmpfs"); // All trees and file data
+static uint64_t next_ino = 1;
+static TmpfsStats stats;
+static int tmpfs_mover;              // PMM mover id for data pages
+
+// --- Radix tree of data pages ---
+
+static uint64_t* table_of(uint64_t phys) {
+    return (uint64_t*)phys_to_virt(phys);
+}
+
+// Data pages are movable: `slot` is the radix table entry that will hold
+// the page (tables stay pinned, so the slot does not move). Tables pass nullptr.
+static uint64_t alloc_zeroed_frame(uint64_t* slot = nullptr) {
+    void* frame = slot ? pmm.allocate_movable_frame(tmpfs_mover, slot) : pmm.allocate_frame();
+    if (!frame) return 0;
+    uint64_t* p = table_of((uint64_t)frame);
+    memset(p, 0, PAGE_SIZE);
+    return (uint64_t)frame;
+}
+
+// PMM compaction moving a data page; the slot must still point at it
+static bool tmpfs_migrate(void* owner, uint64_t from, uint64_t to) {
+    uint64_t* slot = (uint64_t*)owner;
+    ScopedIrqLock guard(tmpfs_lock);
+    if (*slot != from) return false;
+    memcpy(phys_to_virt(to), phys_to_virt(from), PAGE_SIZE);
+    *slot = to;
+    return true;
+}
+
+static uint64_t radix_capacity(uint32_t height) {
+    return height == 0 ? 0 : 1ULL << (RADIX_SHIFT * height);
+}
+
+// Physical address of the data page holding page `index`, or 0. With
+// `alloc`, missing tables and pages are created (0 then means no memory).
+static uint64_t radix_get(TmpfsNode* node, uint64_t index, bool alloc) {
+    if (index >= radix_capacity(node->radix_height)) {
+        if (!alloc) return 0;
+        while (index >= radix_capacity(node->radix_height)) {
+            uint64_t top = alloc_zeroed_frame();
+            if (!top) return 0;
+            stats.radix_pages++;
+            table_of(top)[0] = node->radix_root; // Old tree becomes slot 0
+            node->radix_root = top;
+            node->radix_height++;
+        }
+    }
+
+    uint64_t phys = node->radix_root;
+    for (uint32_t level = node->radix_height; level > 0; level--) {
+        uint64_t* slots = table_of(phys);
+        uint64_t slot = (index >> (RADIX_SHIFT * (level - 1))) & (RADIX_SLOTS - 1);
+        if (!slots[slot]) {
+            if (!alloc) return 0;
+            slots[slot] = alloc_zeroed_frame(level == 1 ? &slots[slot] : nullptr);
+            if (!slots[slot]) return 0;
+            if (level > 1) {
+                stats.radix_pages++;
+            } else {
+                stats.data_pages++;
+            }
+        }
+        phys = slots[slot];
+    }
+    return phys;
+}
+
+// Free every data page with index >= from under the table at `level`
+// that covers pages [base, base + 512^level).
+static void radix_free_from(uint64_t table, uint32_t level, uint64_t base, uint64_t from) {
+    uint64_t* slots = table_of(table);
+    uint64_t span = 1ULL << (RADIX_SHIFT * (level - 1));
+    for (uint64_t s = 0; s < RADIX_SLOTS; s++) {
+        uint64_t child_base = base + s * span;
+        if (child_base + span <= from || !slots[s]) continue;
+
+        if (level > 1) {
+            radix_free_from(slots[s], level - 1, child_base, from);
+        }
+        if (child_base >= from) {
+            pmm.free_frame((void*)slots[s]);
+            if (level > 1) {
+                stats.radix_pages--;
+            } else {
+                stats.data_pages--;
+            }
+            slots[s] = 0;
+        }
+    }
+}
+
+static void radix_truncate(TmpfsNode* node, uint64_t first_page) {
+    if (!node->radix_root) return;
+    radix_free_from(node->radix_root, node->radix_height, 0, first_page);
+    if (first_page == 0) {
+        pmm.free_frame((void*)node->radix_root);
+        stats.radix_pages--;
+        node->radix_root = 0;
+        node->radix_height = 0;
+    }
+}
+
+// --- Namespace ---
+
+static TmpfsFs* fs_of(Mount* mnt) {
+    return (TmpfsFs*)mnt->fs_data;
+}
+
+static size_t component_len(const char* p) {
+    size_t n = 0;
+    while (p[n] && p[n] != '/') n++;
+    return n;
+}
+
+static TmpfsNode* find_child(TmpfsNode* dir, const char* name, size_t len) {
+    for (TmpfsNode* c = dir->first_child; c; c = c->next_sibling) {
+        size_t i = 0;
+        while (i < len && c->name[i] == name[i]) i++;
+        if (i == len && c->name[len] == '\0') return c;
+    }
+    return nullptr;
+}
+
+// Walk `len` bytes of a canonical path through the upper tree
+static TmpfsNode* walk(TmpfsFs* fs, const char* path, size_t len) {
+    TmpfsNode* node = &fs->root;
+    size_t pos = 0;
+    while (pos < len && node) {
+        size_t n = component_len(path + pos);
+        if (node->type != VnodeType::Directory) return nullptr;
+        node = find_child(node, path + pos, n);
+        pos += n + 1;
+    }
+    return node;
+}
+
+// Nodes are built unlinked without tmpfs_lock (kzalloc, file data) and
+// published with link_node() under it. Linked nodes are never freed, so a
+// pointer to one stays valid after the lock is dropped.
+static TmpfsNode* alloc_node(const char* name, size_t len, VnodeType type) {
+    TmpfsNode* node = (TmpfsNode*)kzalloc(sizeof(TmpfsNode));
+    if (!node) return nullptr;
+    for (size_t i = 0; i < len; i++) node->name[i] = name[i];
+    node->name[len] = '\0';
+    node->type = type;
+    return node;
+}
+
+// Caller holds tmpfs_lock
+static void link_node(TmpfsNode* parent, TmpfsNode* node) {
+    node->ino = next_ino++;
+    node->parent = parent;
+
+    // Append, so readdir returns creation order
+    TmpfsNode** link = &parent->first_child;
+    while (*link) link = &(*link)->next_sibling;
+    *link = node;
+    stats.nodes++;
+}
+
+// Drop a node that was never linked, with any data written to it
+static void free_node(TmpfsNode* node) {
+    {
+        ScopedIrqLock guard(tmpfs_lock);
+        radix_truncate(node, 0);
+    }
+    kfree(node);
+}
+
+static void to_vnode(Mount* mnt, TmpfsNode* node, Vnode* out) {
+    out->mount = mnt;
+    out->ino = node->ino;
+    out->type = node->type;
+    out->size = node->size;
+    out->priv = node;
+}
+
+// Lower-layer lookup of the first `len` bytes of a canonical path
+static int lower_lookup(TmpfsFs* fs, const char* path, size_t len, Vnode* out) {
+    if (!fs->has_lower || !fs->lower.ops->lookup) return VFS_ENOENT;
+    char buf[VFS_PATH_MAX];
+    if (len >= sizeof(buf)) return VFS_ENAMETOOLONG;
+    for (size_t i = 0; i < len; i++) buf[i] = path[i];
+    buf[len] = '\0';
+    return fs->lower.ops->lookup(&fs->lower, buf, out);
+}
+
+// Make sure the directory at path[0..len) exists in the upper tree,
+// mirroring directories that so far only exist in the lower layer. Called
+// without tmpfs_lock: lower lookups may wait for the disk.
+static int ensure_upper_dir(TmpfsFs* fs, const char* path, size_t len, TmpfsNode** out) {
+    TmpfsNode* node = &fs->root;
+    size_t pos = 0;
+    while (pos < len) {
+        size_t n = component_len(path + pos);
+        TmpfsNode* child;
+        {
+            ScopedIrqLock guard(tmpfs_lock);
+            child = find_child(node, path + pos, n);
+        }
+        if (!child) {
+            Vnode lower;
+            int err = lower_lookup(fs, path, pos + n, &lower);
+            if (err < 0) return err;
+            if (lower.type != VnodeType::Directory) return VFS_ENOTDIR;
+            TmpfsNode* fresh = alloc_node(path + pos, n, VnodeType::Directory);
+            if (!fresh) return VFS_ENOMEM;
+            {
+                ScopedIrqLock guard(tmpfs_lock);
+                child = find_child(node, path + pos, n); // Created meanwhile?
+                if (!child) {
+                    link_node(node, fresh);
+                    child = fresh;
+                    fresh = nullptr;
+                }
+            }
+            if (fresh) kfree(fresh);
+        }
+        if (child->type != VnodeType::Directory) return VFS_ENOTDIR;
+        node = child;
+        pos += n + 1;
+    }
+    *out = node;
+    return 0;
+}
+
+// Split "a/b/c" into parent length 3 and leaf "c"
+static size_t parent_len(const char* path, size_t len) {
+    size_t i = len;
+    while (i > 0 && path[i - 1] != '/') i--;
+    return i > 0 ? i - 1 : 0;
+}
+
+// Publish `node` (built by the caller) at `path`. If the name is taken the
+// node is not linked and *existing gets the node that holds it.
+static int publish_node(TmpfsFs* fs, const char* path, TmpfsNode* node, TmpfsNode** existing) {
+    size_t len = 0;
+    while (path[len]) len++;
+    if (len == 0) return VFS_EEXIST; // The root
+
+    size_t plen = parent_len(path, len);
+    const char* leaf = path + (plen ? plen + 1 : 0);
+    TmpfsNode* dir;
+    int err = ensure_upper_dir(fs, path, plen, &dir);
+    if (err < 0) return err;
+
+    ScopedIrqLock guard(tmpfs_lock);
+    *existing = find_child(dir, leaf, len - (size_t)(leaf - path));
+    if (*existing) return VFS_EEXIST;
+    link_node(dir, node);
+    return 0;
+}
+
+static const char* leaf_of(const char* path, size_t* len) {
+    const char* leaf = path;
+    for (const char* p = path; *p; p++) {
+        if (*p == '/') leaf = p + 1;
+    }
+    *len = strlen(leaf);
+    return leaf;
+}
+
+// --- File data ---
+
+// Takes tmpfs_lock for one page at a time, so interrupts stay off for at
+// most one page copy however large the write is
+static int64_t write_node(TmpfsNode* node, const uint8_t* src, size_t len, uint64_t offset) {
+    if (offset >= TMPFS_MAX_FILE_SIZE || len > TMPFS_MAX_FILE_SIZE - offset) return VFS_EFBIG;
+
+    size_t done = 0;
+    while (done < len) {
+        uint64_t pos = offset + done;
+        size_t in_page = (size_t)(pos % PAGE_SIZE);
+        size_t chunk = PAGE_SIZE - in_page;
+        if (chunk > len - done) chunk = len - done;
+
+        ScopedIrqLock guard(tmpfs_lock);
+        uint64_t page = radix_get(node, pos / PAGE_SIZE, true);
+        if (!page) break;
+        uint8_t* dst = (uint8_t*)phys_to_virt(page) + in_page;
+        memcpy(dst, src + done, chunk);
+        done += chunk;
+        if (offset + done > node->size) node->size = offset + done;
+    }
+    if (done == 0) return VFS_ENOMEM;
+    return (int64_t)done;
+}
+
+// Copy a lower file into a new upper node. The copy is made into an
+// unlinked node without tmpfs_lock (lower reads may wait for the disk) and
+// published afterwards; a failed copy never hides the lower file. If a
+// racing copy-up published first, its node is used and ours is freed.
+static int copy_up(TmpfsFs* fs, const char* path, const Vnode* lower, TmpfsNode** out) {
+    size_t name_len;
+    const char* name = leaf_of(path, &name_len);
+    TmpfsNode* node = alloc_node(name, name_len, VnodeType::File);
+    if (!node) return VFS_ENOMEM;
+
+    int err = 0;
+    const VfsOps* ops = lower->mount->ops;
+    VfsView view;
+    if (ops->map_view && ops->map_view(lower, &view) == 0) {
+        if (view.size && write_node(node, view.data, view.size, 0) != (int64_t)view.size) {
+            err = VFS_ENOMEM;
+        }
+    } else if (ops->read) {
+        uint8_t buf[512];
+        uint64_t off = 0;
+        int64_t n;
+        while ((n = ops->read(lower, buf, sizeof(buf), off)) > 0) {
+            if (write_node(node, buf, (size_t)n, off) != n) {
+                n = VFS_ENOMEM;
+                break;
+            }
+            off += (uint64_t)n;
+        }
+        if (n < 0) err = (int)n;
+    }
+
+    TmpfsNode* existing = nullptr;
+    if (err == 0) err = publish_node(fs, path, node, &existing);
+    if (err < 0) {
+        free_node(node);
+        if (!existing) return err;
+        if (existing->type != VnodeType::File) return VFS_EEXIST;
+        *out = existing;
+        return 0;
+    }
+    {
+        ScopedIrqLock guard(tmpfs_lock);
+        stats.copy_ups++;
+    }
+    *out = node;
+    return 0;
+}
+
+// --- VfsOps ---
+
+static int tmpfs_lookup(Mount* mnt, const char* path, Vnode* out) {
+    TmpfsFs* fs = fs_of(mnt);
+    size_t len = 0;
+    while (path[len]) len++;
+    {
+        ScopedIrqLock guard(tmpfs_lock);
+        TmpfsNode* node = walk(fs, path, len);
+        if (node) {
+            to_vnode(mnt, node, out);
+            return 0;
+        }
+    }
+    return lower_lookup(fs, path, len, out);
+}
+
+static int64_t tmpfs_read(const Vnode* vn, void* buf, size_t len, uint64_t offset) {
+    TmpfsNode* node = (TmpfsNode*)vn->priv;
+    uint8_t* dst = (uint8_t*)buf;
+    size_t done = 0;
+    while (done < len) {
+        uint64_t pos = offset + done;
+        size_t in_page = (size_t)(pos % PAGE_SIZE);
+        size_t chunk = PAGE_SIZE - in_page;
+        if (chunk > len - done) chunk = len - done;
+
+        // One page per lock hold, like write_node()
+        ScopedIrqLock guard(tmpfs_lock);
+        if (pos >= node->size) break;
+        if (chunk > node->size - pos) chunk = (size_t)(node->size - pos);
+        uint64_t page = radix_get(node, pos / PAGE_SIZE, false);
+        if (page) {
+            const uint8_t* src = (const uint8_t*)phys_to_virt(page) + in_page;
+            memcpy(dst + done, src, chunk);
+        } else {
+            memset(dst + done, 0, chunk); // Hole
+        }
+        done += chunk;
+    }
+    return (int64_t)done;
+}
+
+static int tmpfs_getattr(const Vnode* vn, VfsStat* out) {
+    const TmpfsNode* node = (const TmpfsNode*)vn->priv;
+    ScopedIrqLock guard(tmpfs_lock);
+    out->ino = node->ino;
+    out->type = node->type;
+    out->size = node->size;
+    return 0;
+}
+
+// Path of an upper node relative to the mount, for merging with the lower
+static size_t node_path(const TmpfsNode* node, char* buf, size_t cap) {
+    const TmpfsNode* chain[VFS_PATH_MAX / 2];
+    size_t depth = 0;
+    for (const TmpfsNode* n = node; n->parent && depth < VFS_PATH_MAX / 2; n = n->parent) {
+        chain[depth++] = n;
+    }
+    size_t len = 0;
+    while (depth > 0) {
+        const char* name = chain[--depth]->name;
+        if (len && len + 1 < cap) buf[len++] = '/';
+        for (size_t i = 0; name[i] && len + 1 < cap; i++) buf[len++] = name[i];
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+#define COOKIE_LOWER (1ULL << 63)
+
+// Upper children first (cookie = how many were returned), then the lower
+// directory's entries that the upper layer does not shadow (cookie =
+// COOKIE_LOWER | lower cookie).
+static int tmpfs_readdir(const Vnode* vn, uint64_t* cookie, VfsDirent* out) {
+    Mount* mnt = vn->mount;
+    TmpfsFs* fs = fs_of(mnt);
+    TmpfsNode* dir = (TmpfsNode*)vn->priv;
+    char path[VFS_PATH_MAX];
+    size_t len;
+
+    {
+        ScopedIrqLock guard(tmpfs_lock);
+        if (!(*cookie & COOKIE_LOWER)) {
+            TmpfsNode* c = dir->first_child;
+            for (uint64_t i = 0; c && i < *cookie; i++) c = c->next_sibling;
+            if (c) {
+                size_t i = 0;
+                for (; c->name[i]; i++) out->name[i] = c->name[i];
+                out->name[i] = '\0';
+                out->type = c->type;
+                (*cookie)++;
+                return 1;
+            }
+            *cookie = COOKIE_LOWER;
+        }
+        len = node_path(dir, path, sizeof(path));
+    }
+
+    Vnode lower_dir;
+    if (lower_lookup(fs, path, len, &lower_dir) < 0 || lower_dir.type != VnodeType::Directory ||
+        !lower_dir.mount->ops->readdir) {
+        return 0;
+    }
+    while (true) {
+        uint64_t lower_cookie = *cookie & ~COOKIE_LOWER;
+        int ret = lower_dir.mount->ops->readdir(&lower_dir, &lower_cookie, out);
+        if (ret <= 0) return ret;
+        *cookie = COOKIE_LOWER | lower_cookie;
+
+        size_t n = 0;
+        while (out->name[n]) n++;
+        ScopedIrqLock guard(tmpfs_lock);
+        if (!find_child(dir, out->name, n)) return 1;
+    }
+}
+
+static int tmpfs_create(Mount* mnt, const char* path, VnodeType type, Vnode* out) {
+    size_t name_len;
+    const char* name = leaf_of(path, &name_len);
+    TmpfsNode* node = alloc_node(name, name_len, type);
+    if (!node) return VFS_ENOMEM;
+    TmpfsNode* existing = nullptr;
+    int err = publish_node(fs_of(mnt), path, node, &existing);
+    if (err < 0) {
+        kfree(node);
+        return err;
+    }
+    ScopedIrqLock guard(tmpfs_lock);
+    to_vnode(mnt, node, out);
+    return 0;
+}
+
+static int tmpfs_open_write(Mount* mnt, const char* path, Vnode* vn) {
+    if (vn->mount == mnt) return 0; // Already in the upper layer
+
+    TmpfsNode* node;
+    int err = copy_up(fs_of(mnt), path, vn, &node);
+    if (err < 0) return err;
+    ScopedIrqLock guard(tmpfs_lock);
+    to_vnode(mnt, node, vn);
+    return 0;
+}
+
+static int64_t tmpfs_write(const Vnode* vn, const void* buf, size_t len, uint64_t offset) {
+    return write_node((TmpfsNode*)vn->priv, (const uint8_t*)buf, len, offset);
+}
+
+static int tmpfs_truncate(const Vnode* vn, uint64_t size) {
+    TmpfsNode* node = (TmpfsNode*)vn->priv;
+    if (size > TMPFS_MAX_FILE_SIZE) return VFS_EFBIG;
+
+    ScopedIrqLock guard(tmpfs_lock);
+    if (size < node->size) {
+        radix_truncate(node, (size + PAGE_SIZE - 1) / PAGE_SIZE);
+        // Zero the kept page's tail so growing again reads zeros
+        uint64_t page = size % PAGE_SIZE ? radix_get(node, size / PAGE_SIZE, false) : 0;
+        if (page) {
+            uint8_t* p = (uint8_t*)phys_to_virt(page);
+            memset(p + size % PAGE_SIZE, 0, PAGE_SIZE - size % PAGE_SIZE);
+        }
+    }
+    node->size = size;
+    return 0;
+}
+
+static const VfsOps tmpfs_ops = {
+    "tmpfs",
+    tmpfs_lookup,
+    tmpfs_read,
+    nullptr,           // map_view: pages are not contiguous
+    tmpfs_getattr,
+    tmpfs_readdir,
+    tmpfs_create,
+    tmpfs_open_write,
+    tmpfs_write,
+    tmpfs_truncate,
+};
+
+int tmpfs_mount(const char* path, bool overlay) {
+    TmpfsFs* fs = (TmpfsFs*)kzalloc(sizeof(TmpfsFs));
+    if (!fs) return VFS_ENOMEM;
+    fs->root.type = VnodeType::Directory;
+    {
+        ScopedIrqLock guard(tmpfs_lock);
+        fs->root.ino = next_ino++;
+    }
+    if (!tmpfs_mover) tmpfs_mover = pmm.register_mover(tmpfs_migrate);
+
+    int err;
+    if (overlay) {
+        fs->has_lower = true; // Before lookups can reach the new ops
+        err = vfs_overlay(path, &tmpfs_ops, fs, &fs->lower);
+    } else {
+        err = vfs_mount(path, &tmpfs_ops, fs);
+    }
+    if (err < 0) kfree(fs);
+    return err;
+}
+
+void tmpfs_stats(TmpfsStats* out) {
+    ScopedIrqLock guard(tmpfs_lock);
+    *out = stats;
+}
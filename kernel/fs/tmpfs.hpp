@@ -0,0 +1,24 @@
+#ifndef TMPFS_HPP
+#define TMPFS_HPP
+
+#include "../lib/types.h"
+
+// RAM-backed writable filesystem. File data lives in PMM frames indexed by
+// a per-file radix tree (512 slots per level, one frame per node).
+//
+// Mounted with overlay = true on top of an existing mount, tmpfs becomes
+// the upper layer: lookups fall through to the lower filesystem until a
+// file is opened for writing, at which point it is copied up. Unmodified
+// files keep their lower (e.g. zero-copy tarfs) vnodes.
+int tmpfs_mount(const char* path, bool overlay);
+
+struct TmpfsStats {
+    uint64_t nodes;
+    uint64_t data_pages;
+    uint64_t radix_pages;
+    uint64_t copy_ups;
+};
+
+void tmpfs_stats(TmpfsStats* out);
+
+#endif
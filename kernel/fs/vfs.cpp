@@ -0,0 +1,511 @@
+#include "vfs.hpp"
+#include "../drivers/console.hpp"
+#include "../lib/spinlock.hpp"
+#include "../lib/string.hpp"
+
+struct OpenFile {
+    bool used;
+    int flags;
+    Vnode vnode;
+    uint64_t pos;     // Byte offset, or the readdir cookie for directories
+};
+
+static Mount mounts[VFS_MAX_MOUNTS];
+static size_t mount_count = 0;
+static Spinlock mount_lock("vfs_mount");
+
+static OpenFile files[VFS_MAX_FDS];
+static Spinlock fd_lock("vfs_fd");
+
+// Direct-mapped dentry cache. Bumping dcache_gen empties it in O(1).
+#define DCACHE_SIZE    128
+#define DCACHE_KEY_MAX 96
+
+struct DcacheEntry {
+    uint64_t gen;      // 0 = never filled
+    uint32_t hash;
+    uint32_t len;
+    char path[DCACHE_KEY_MAX];
+    Vnode vnode;
+};
+
+static DcacheEntry dcache[DCACHE_SIZE];
+static uint64_t dcache_gen = 1;
+static DcacheStats dcache_counters;
+static Spinlock dcache_lock("dcache");
+
+// A path after canonicalization and mount lookup
+struct Resolved {
+    char canon[VFS_PATH_MAX];
+    Mount* mount;
+    const char* rest;  // Points into canon
+};
+
+static bool bytes_eq(const char* a, const char* b, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (a[i] != b[i]) return false;
+    }
+    return true;
+}
+
+// FNV-1a
+static uint32_t path_hash(const char* s, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (uint8_t)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Rewrite `in` as "a/b/c": drops leading, repeated and trailing '/',
+// "." components, and resolves ".." lexically (never above the root).
+static int canonicalize(const char* in, char* out, size_t cap) {
+    size_t len = 0;
+    const char* p = in;
+    while (*p) {
+        while (*p == '/') p++;
+        const char* comp = p;
+        while (*p && *p != '/') p++;
+        size_t n = (size_t)(p - comp);
+
+        if (n == 0 || (n == 1 && comp[0] == '.')) continue;
+        if (n == 2 && comp[0] == '.' && comp[1] == '.') {
+            while (len > 0 && out[len - 1] != '/') len--;
+            if (len > 0) len--; // The separator
+            continue;
+        }
+        if (n >= VFS_NAME_MAX) return VFS_ENAMETOOLONG;
+        if (len + (len ? 1 : 0) + n + 1 > cap) return VFS_ENAMETOOLONG;
+        if (len) out[len++] = '/';
+        for (size_t i = 0; i < n; i++) out[len++] = comp[i];
+    }
+    out[len] = '\0';
+    return 0;
+}
+
+// Does the canonical path start with the mount point?
+static bool mount_matches(const Mount* m, const char* canon) {
+    if (m->path_len == 1) return true; // "/" matches everything
+    const char* mp = m->path + 1;
+    size_t len = m->path_len - 1;
+    return bytes_eq(canon, mp, len) && (canon[len] == '\0' || canon[len] == '/');
+}
+
+// Longest matching mount point wins. Mounts are never removed, so the
+// pointer stays valid without the lock.
+static int resolve_mount(const char* path, Resolved* r) {
+    r->mount = nullptr;
+    if (!path) return VFS_EINVAL;
+    int err = canonicalize(path, r->canon, sizeof(r->canon));
+    if (err < 0) return err;
+
+    ScopedIrqLock guard(mount_lock);
+    Mount* best = nullptr;
+    for (size_t i = 0; i < mount_count; i++) {
+        Mount* m = &mounts[i];
+        if (mount_matches(m, r->canon) && (!best || m->path_len > best->path_len)) {
+            best = m;
+        }
+    }
+    if (!best) return VFS_ENOENT;
+
+    const char* rest = r->canon + (best->path_len == 1 ? 0 : best->path_len - 1);
+    if (*rest == '/') rest++;
+    r->mount = best;
+    r->rest = rest;
+    return 0;
+}
+
+static bool dcache_get(const char* canon, Vnode* out) {
+    size_t len = strlen(canon);
+    if (len >= DCACHE_KEY_MAX) return false;
+    uint32_t h = path_hash(canon, len);
+
+    ScopedIrqLock guard(dcache_lock);
+    const DcacheEntry* e = &dcache[h % DCACHE_SIZE];
+    if (e->gen == dcache_gen && e->hash == h && e->len == len && bytes_eq(e->path, canon, len)) {
+        *out = e->vnode;
+        dcache_counters.hits++;
+        return true;
+    }
+    dcache_counters.misses++;
+    return false;
+}
+
+static void dcache_put(const char* canon, const Vnode* vn, uint64_t gen) {
+    size_t len = strlen(canon);
+    if (len >= DCACHE_KEY_MAX) return;
+    uint32_t h = path_hash(canon, len);
+
+    ScopedIrqLock guard(dcache_lock);
+    if (gen != dcache_gen) return; // Invalidated while we were looking up
+    DcacheEntry* e = &dcache[h % DCACHE_SIZE];
+    e->gen = gen;
+    e->hash = h;
+    e->len = (uint32_t)len;
+    for (size_t i = 0; i < len; i++) e->path[i] = canon[i];
+    e->vnode = *vn;
+}
+
+void vfs_dcache_invalidate() {
+    ScopedIrqLock guard(dcache_lock);
+    dcache_gen++;
+    dcache_counters.invalidations++;
+}
+
+void vfs_dcache_stats(DcacheStats* out) {
+    ScopedIrqLock guard(dcache_lock);
+    *out = dcache_counters;
+}
+
+static int resolve(const char* path, Resolved* r, Vnode* out) {
+    int err = resolve_mount(path, r);
+    if (err < 0) return err;
+    if (dcache_get(r->canon, out)) return 0;
+
+    uint64_t gen;
+    {
+        ScopedIrqLock guard(dcache_lock);
+        gen = dcache_gen;
+    }
+    if (!r->mount->ops->lookup) return VFS_ENOTSUP;
+    err = r->mount->ops->lookup(r->mount, r->rest, out);
+    if (err == 0) dcache_put(r->canon, out, gen);
+    return err;
+}
+
+int vfs_mount(const char* path, const VfsOps* ops, void* fs_data) {
+    if (!path || path[0] != '/' || !ops) return VFS_EINVAL;
+
+    ScopedIrqLock guard(mount_lock);
+    size_t len = strlen(path);
+    while (len > 1 && path[len - 1] == '/') len--;
+    for (size_t i = 0; i < mount_count; i++) {
+        if (mounts[i].path_len == len && bytes_eq(mounts[i].path, path, len)) {
+            return VFS_EBUSY;
+        }
+    }
+    if (mount_count >= VFS_MAX_MOUNTS) return VFS_ENOMEM;
+
+    Mount* m = &mounts[mount_count];
+    m->path = path;
+    m->path_len = len;
+    m->ops = ops;
+    m->fs_data = fs_data;
+    mount_count++;
+    return 0;
+}
+
+int vfs_overlay(const char* path, const VfsOps* ops, void* fs_data, Mount* lower) {
+    if (!path || path[0] != '/' || !ops || !lower) return VFS_EINVAL;
+
+    {
+        ScopedIrqLock guard(mount_lock);
+        size_t len = strlen(path);
+        while (len > 1 && path[len - 1] == '/') len--;
+        Mount* m = nullptr;
+        for (size_t i = 0; i < mount_count; i++) {
+            if (mounts[i].path_len == len && bytes_eq(mounts[i].path, path, len)) {
+                m = &mounts[i];
+            }
+        }
+        if (!m) return VFS_ENOENT;
+
+        *lower = *m;
+        m->ops = ops;
+        m->fs_data = fs_data;
+    }
+    vfs_dcache_invalidate();
+    return 0;
+}
+
+static int alloc_fd(const Vnode* vn, int flags) {
+    ScopedIrqLock guard(fd_lock);
+    for (int fd = 0; fd < VFS_MAX_FDS; fd++) {
+        if (!files[fd].used) {
+            files[fd].used = true;
+            files[fd].flags = flags;
+            files[fd].vnode = *vn;
+            files[fd].pos = 0;
+            return fd;
+        }
+    }
+    return VFS_EMFILE;
+}
+
+static bool writable(int flags) {
+    return (flags & VFS_O_ACCMODE) != VFS_O_RDONLY;
+}
+
+int vfs_open(const char* path, int flags) {
+    Resolved r;
+    Vnode vn;
+    int err = resolve(path, &r, &vn);
+
+    if (err == VFS_ENOENT && (flags & VFS_O_CREAT) && r.mount) {
+        if (!r.mount->ops->create) return VFS_EROFS;
+        err = r.mount->ops->create(r.mount, r.rest, VnodeType::File, &vn);
+        if (err == 0) vfs_dcache_invalidate();
+    }
+    if (err < 0) return err;
+
+    if (writable(flags)) {
+        if (vn.type == VnodeType::Directory) return VFS_EISDIR;
+        if (!r.mount->ops->open_write) return VFS_EROFS;
+        Vnode before = vn;
+        err = r.mount->ops->open_write(r.mount, r.rest, &vn);
+        if (err < 0) return err;
+        if (vn.priv != before.priv || vn.mount != before.mount) {
+            vfs_dcache_invalidate(); // Copied up: the name has a new vnode
+        }
+        if (flags & VFS_O_TRUNC) {
+            if (!vn.mount->ops->truncate) return VFS_EROFS;
+            err = vn.mount->ops->truncate(&vn, 0);
+            if (err < 0) return err;
+        }
+    }
+    return alloc_fd(&vn, flags);
+}
+
+// Snapshot an open file without holding the lock across filesystem calls
+static int get_file(int fd, OpenFile* out) {
+    if (fd < 0 || fd >= VFS_MAX_FDS) return VFS_EBADF;
+    ScopedIrqLock guard(fd_lock);
+    if (!files[fd].used) return VFS_EBADF;
+    *out = files[fd];
+    return 0;
+}
+
+static void set_pos(int fd, uint64_t pos) {
+    ScopedIrqLock guard(fd_lock);
+    if (files[fd].used) files[fd].pos = pos;
+}
+
+static void fill_stat(const Vnode* vn, VfsStat* out) {
+    if (vn->mount->ops->getattr && vn->mount->ops->getattr(vn, out) == 0) {
+        return;
+    }
+    out->ino = vn->ino;
+    out->type = vn->type;
+    out->size = vn->size;
+}
+
+static int64_t read_at(const OpenFile* f, void* buf, size_t len, uint64_t offset) {
+    if ((f->flags & VFS_O_ACCMODE) == VFS_O_WRONLY) return VFS_EBADF;
+    if (f->vnode.type == VnodeType::Directory) return VFS_EISDIR;
+    if (!f->vnode.mount->ops->read) return VFS_ENOTSUP;
+    if (len == 0) return 0;
+    return f->vnode.mount->ops->read(&f->vnode, buf, len, offset);
+}
+
+static int64_t write_at(const OpenFile* f, const void* buf, size_t len, uint64_t offset) {
+    if (!writable(f->flags)) return VFS_EBADF;
+    if (!f->vnode.mount->ops->write) return VFS_EROFS;
+    if (len == 0) return 0;
+    return f->vnode.mount->ops->write(&f->vnode, buf, len, offset);
+}
+
+int64_t vfs_read(int fd, void* buf, size_t len) {
+    OpenFile f;
+    int err = get_file(fd, &f);
+    if (err < 0) return err;
+
+    int64_t n = read_at(&f, buf, len, f.pos);
+    if (n > 0) set_pos(fd, f.pos + (uint64_t)n);
+    return n;
+}
+
+int64_t vfs_pread(int fd, void* buf, size_t len, uint64_t offset) {
+    OpenFile f;
+    int err = get_file(fd, &f);
+    if (err < 0) return err;
+    return read_at(&f, buf, len, offset);
+}
+
+int64_t vfs_write(int fd, const void* buf, size_t len) {
+    OpenFile f;
+    int err = get_file(fd, &f);
+    if (err < 0) return err;
+
+    uint64_t pos = f.pos;
+    if (f.flags & VFS_O_APPEND) {
+        VfsStat st;
+        fill_stat(&f.vnode, &st);
+        pos = st.size;
+    }
+    int64_t n = write_at(&f, buf, len, pos);
+    if (n > 0) set_pos(fd, pos + (uint64_t)n);
+    return n;
+}
+
+int64_t vfs_pwrite(int fd, const void* buf, size_t len, uint64_t offset) {
+    OpenFile f;
+    int err = get_file(fd, &f);
+    if (err < 0) return err;
+    return write_at(&f, buf, len, offset);
+}
+
+int vfs_readdir(int fd, VfsDirent* out) {
+    OpenFile f;
+    int err = get_file(fd, &f);
+    if (err < 0) return err;
+    if (f.vnode.type != VnodeType::Directory) return VFS_ENOTDIR;
+    if (!f.vnode.mount->ops->readdir) return VFS_ENOTSUP;
+
+    uint64_t cookie = f.pos;
+    int ret = f.vnode.mount->ops->readdir(&f.vnode, &cookie, out);
+    if (ret > 0) set_pos(fd, cookie);
+    return ret;
+}
+
+int vfs_mkdir(const char* path) {
+    Resolved r;
+    Vnode vn;
+    int err = resolve(path, &r, &vn);
+    if (err == 0) return VFS_EEXIST;
+    if (err != VFS_ENOENT || !r.mount) return err;
+    if (!r.mount->ops->create) return VFS_EROFS;
+
+    err = r.mount->ops->create(r.mount, r.rest, VnodeType::Directory, &vn);
+    if (err == 0) vfs_dcache_invalidate();
+    return err;
+}
+
+int vfs_stat(const char* path, VfsStat* out) {
+    Resolved r;
+    Vnode vn;
+    int err = resolve(path, &r, &vn);
+    if (err < 0) return err;
+    fill_stat(&vn, out);
+    return 0;
+}
+
+int vfs_fstat(int fd, VfsStat* out) {
+    OpenFile f;
+    int err = get_file(fd, &f);
+    if (err < 0) return err;
+    fill_stat(&f.vnode, out);
+    return 0;
+}
+
+int vfs_close(int fd) {
+    if (fd < 0 || fd >= VFS_MAX_FDS) return VFS_EBADF;
+    ScopedIrqLock guard(fd_lock);
+    if (!files[fd].used) return VFS_EBADF;
+    files[fd].used = false;
+    return 0;
+}
+
+int vfs_map_view(int fd, VfsView* out) {
+    OpenFile f;
+    int err = get_file(fd, &f);
+    if (err < 0) return err;
+    if (f.vnode.type == VnodeType::Directory) return VFS_EISDIR;
+    if (!f.vnode.mount->ops->map_view) return VFS_ENOTSUP;
+    return f.vnode.mount->ops->map_view(&f.vnode, out);
+}
+
+const char* vfs_strerror(int err) {
+    switch (err) {
+        case VFS_ENOENT:  return "no such file or directory";
+        case VFS_EIO:     return "I/O error";
+        case VFS_ENOEXEC: return "exec format error";
+        case VFS_EBADF:   return "bad file descriptor";
+        case VFS_ENOMEM:  return "out of memory";
+        case VFS_EFAULT:  return "bad address";
+        case VFS_EBUSY:   return "already mounted";
+        case VFS_EEXIST:  return "file exists";
+        case VFS_ENOTDIR: return "not a directory";
+        case VFS_EISDIR:  return "is a directory";
+        case VFS_EINVAL:  return "invalid argument";
+        case VFS_EMFILE:  return "too many open files";
+        case VFS_EFBIG:   return "file too large";
+        case VFS_EROFS:   return "read-only file system";
+        case VFS_ENAMETOOLONG: return "file name too long";
+        case VFS_ENOSYS:  return "function not implemented";
+        case VFS_ENOTSUP: return "operation not supported";
+        default:          return "unknown error";
+    }
+}
+
+static void report(const char* what, bool ok) {
+    kprint("[VFS TEST] ");
+    kprint(what);
+    kprint(ok ? ": ok\n" : ": FAILED\n");
+}
+
+void vfs_self_test() {
+    VfsStat st;
+    report("stat /hello.txt", vfs_stat("/hello.txt", &st) == 0 && st.type == VnodeType::File);
+    report("stat /docs is a directory", vfs_stat("/docs", &st) == 0 && st.type == VnodeType::Directory);
+    report("stat /missing.txt", vfs_stat("/missing.txt", &st) == VFS_ENOENT);
+
+    int fd = vfs_open("/docs/guide.txt", VFS_O_RDONLY);
+    report("open /docs/guide.txt", fd >= 0);
+    if (fd < 0) return;
+
+    VfsView view;
+    bool mapped = vfs_map_view(fd, &view) == 0;
+    report("map_view", mapped && vfs_fstat(fd, &st) == 0 && view.size == st.size);
+
+    // read() in small chunks must reproduce the mapped bytes exactly
+    uint8_t buf[16];
+    size_t total = 0;
+    bool same = mapped;
+    int64_t n;
+    while ((n = vfs_read(fd, buf, sizeof(buf))) > 0) {
+        for (int64_t i = 0; i < n && same; i++) {
+            same = buf[i] == view.data[total + (size_t)i];
+        }
+        total += (size_t)n;
+    }
+    report("read matches view", same && n == 0 && total == view.size);
+
+    bool pread_ok = true;
+    if (view.size > 1) {
+        pread_ok = vfs_pread(fd, buf, 1, view.size - 1) == 1 && buf[0] == view.data[view.size - 1];
+    }
+    report("pread at end", pread_ok && vfs_pread(fd, buf, 1, view.size) == 0);
+
+    report("close", vfs_close(fd) == 0 && vfs_close(fd) == VFS_EBADF);
+
+    fd = vfs_open("/docs", VFS_O_RDONLY);
+    VfsDirent de;
+    report("read directory", fd >= 0 && vfs_read(fd, buf, 1) == VFS_EISDIR);
+    report("readdir /docs", fd >= 0 && vfs_readdir(fd, &de) == 1 && vfs_readdir(fd, &de) == 0);
+    if (fd >= 0) vfs_close(fd);
+}
+
+// Needs a writable root (the tmpfs overlay)
+void vfs_write_self_test() {
+    const char msg[] = "scratch";
+    uint8_t buf[16];
+
+    int fd = vfs_open("/tmp/self-test.txt", VFS_O_RDWR | VFS_O_CREAT);
+    if (fd == VFS_ENOENT) {
+        vfs_mkdir("/tmp");
+        fd = vfs_open("/tmp/self-test.txt", VFS_O_RDWR | VFS_O_CREAT);
+    }
+    report("create /tmp/self-test.txt", fd >= 0);
+    if (fd < 0) return;
+
+    bool ok = vfs_write(fd, msg, sizeof(msg) - 1) == (int64_t)(sizeof(msg) - 1) &&
+              vfs_pread(fd, buf, sizeof(buf), 0) == (int64_t)(sizeof(msg) - 1);
+    for (size_t i = 0; ok && i < sizeof(msg) - 1; i++) ok = buf[i] == (uint8_t)msg[i];
+    report("write then pread", ok);
+
+    // A write far past the end leaves a hole that reads as zeros
+    ok = vfs_pwrite(fd, "!", 1, 3 * 4096 + 10) == 1 && vfs_pread(fd, buf, 1, 4096) == 1 && buf[0] == 0;
+    VfsStat st;
+    report("sparse write", ok && vfs_fstat(fd, &st) == 0 && st.size == 3 * 4096 + 11);
+
+    VfsView view;
+    report("map_view of tmpfs file", vfs_map_view(fd, &view) == VFS_ENOTSUP);
+    vfs_close(fd);
+
+    // Truncating open drops the pages again
+    fd = vfs_open("/tmp/self-test.txt", VFS_O_WRONLY | VFS_O_TRUNC);
+    report("truncate", fd >= 0 && vfs_fstat(fd, &st) == 0 && st.size == 0);
+    if (fd >= 0) vfs_close(fd);
+}
@@ -0,0 +1,144 @@
+#ifndef VFS_HPP
+#define VFS_HPP
+
+#include "../lib/types.h"
+
+#define VFS_MAX_MOUNTS 8
+#define VFS_MAX_FDS    32
+#define VFS_PATH_MAX   256
+#define VFS_NAME_MAX   256     // Component bytes + NUL (ext2 allows 255)
+
+// Negative return values of the fd API (errno numbering)
+#define VFS_ENOENT   -2
+#define VFS_EIO      -5
+#define VFS_ENOEXEC  -8
+#define VFS_EBADF    -9
+#define VFS_ENOMEM  -12
+#define VFS_EFAULT  -14
+#define VFS_EBUSY   -16
+#define VFS_EEXIST  -17
+#define VFS_ENOTDIR -20
+#define VFS_EISDIR  -21
+#define VFS_EINVAL  -22
+#define VFS_EMFILE  -24
+#define VFS_EFBIG   -27
+#define VFS_EROFS   -30
+#define VFS_ENAMETOOLONG -36
+#define VFS_ENOSYS  -38
+#define VFS_ENOTSUP -95
+
+// vfs_open flags (Linux values)
+#define VFS_O_RDONLY 0x000
+#define VFS_O_WRONLY 0x001
+#define VFS_O_RDWR   0x002
+#define VFS_O_ACCMODE 0x003
+#define VFS_O_CREAT  0x040
+#define VFS_O_TRUNC  0x200
+#define VFS_O_APPEND 0x400
+
+enum class VnodeType : uint8_t {
+    File,
+    Directory
+};
+
+struct Mount;
+
+// A resolved file. Vnodes are small values copied into the fd table and
+// the dentry cache, so a filesystem must keep whatever `priv` points at
+// alive while it is mounted. `size` is a snapshot; writable filesystems
+// report the current one through getattr.
+struct Vnode {
+    Mount* mount;
+    uint64_t ino;
+    VnodeType type;
+    uint64_t size;
+    const void* priv;  // Filesystem-specific
+};
+
+struct VfsStat {
+    uint64_t ino;
+    VnodeType type;
+    uint64_t size;
+};
+
+struct VfsDirent {
+    char name[VFS_NAME_MAX];
+    VnodeType type;
+};
+
+// Read-only window onto file bytes that are already resident
+struct VfsView {
+    const uint8_t* data;
+    size_t size;
+};
+
+// Filesystem driver entry points. `path` is relative to the mount point
+// and canonical: no leading '/', no "." or ".." and no empty components
+// ("" is the mount root). Any op may be nullptr if unsupported.
+struct VfsOps {
+    const char* name;
+    int (*lookup)(Mount* mnt, const char* path, Vnode* out);
+    // Reads stop at end of file; the VFS does not clamp
+    int64_t (*read)(const Vnode* vn, void* buf, size_t len, uint64_t offset);
+    int (*map_view)(const Vnode* vn, VfsView* out);
+    int (*getattr)(const Vnode* vn, VfsStat* out);
+    // *cookie starts at 0; returns 1 with an entry, 0 at the end
+    int (*readdir)(const Vnode* vn, uint64_t* cookie, VfsDirent* out);
+
+    // Writable filesystems only
+    int (*create)(Mount* mnt, const char* path, VnodeType type, Vnode* out);
+    // Called by vfs_open before a file is opened for writing; may replace
+    // *vn (an overlay copies the file up here)
+    int (*open_write)(Mount* mnt, const char* path, Vnode* vn);
+    int64_t (*write)(const Vnode* vn, const void* buf, size_t len, uint64_t offset);
+    int (*truncate)(const Vnode* vn, uint64_t size);
+};
+
+struct Mount {
+    const char* path;  // Absolute, no trailing '/' except for "/"
+    size_t path_len;
+    const VfsOps* ops;
+    void* fs_data;
+};
+
+// Attach a filesystem at `path` (which must stay valid while mounted)
+int vfs_mount(const char* path, const VfsOps* ops, void* fs_data);
+
+// Stack a filesystem on top of the one mounted at `path`. The previous
+// mount is copied to *lower so the new filesystem can keep using it.
+// Boot-time only: vnodes already handed out keep the old ops.
+int vfs_overlay(const char* path, const VfsOps* ops, void* fs_data, Mount* lower);
+
+int vfs_open(const char* path, int flags);                // fd >= 0 or error
+int64_t vfs_read(int fd, void* buf, size_t len);          // Advances the position
+int64_t vfs_pread(int fd, void* buf, size_t len, uint64_t offset);
+int64_t vfs_write(int fd, const void* buf, size_t len);   // Advances the position
+int64_t vfs_pwrite(int fd, const void* buf, size_t len, uint64_t offset);
+int vfs_readdir(int fd, VfsDirent* out);                  // 1 entry, 0 end
+int vfs_mkdir(const char* path);
+int vfs_stat(const char* path, VfsStat* out);
+int vfs_fstat(int fd, VfsStat* out);
+int vfs_close(int fd);
+
+// Zero-copy access: the view stays valid for as long as the mount does,
+// even after the fd is closed.
+int vfs_map_view(int fd, VfsView* out);
+
+// Dentry cache: canonical path -> vnode, shared by all mounts. Filesystems
+// call vfs_dcache_invalidate() whenever a name starts resolving to a
+// different vnode (create, copy-up, remount).
+struct DcacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t invalidations;
+};
+
+void vfs_dcache_invalidate();
+void vfs_dcache_stats(DcacheStats* out);
+
+const char* vfs_strerror(int err);
+
+void vfs_self_test();
+void vfs_write_self_test();
+
+#endif
@@ -1,69 +1,185 @@
 #include "drivers/console.hpp"
 #include "arch/x86_64/interrupts.hpp"
 #include "drivers/keyboard.hpp"
+#include "drivers/tty.hpp"
+#include "drivers/ata.hpp"
 #include "mm/pmm.hpp"
+#include "mm/vmm.hpp"
+#include "arch/x86_64/tsc.hpp"
+#include "arch/x86_64/fpu.hpp"
+#include "arch/x86_64/gdt.hpp"
 #include "drivers/serial.hpp"
 #include "lib/helpers.hpp"
 #include "fs/tarfs.hpp"
+#include "fs/vfs.hpp"
+#include "fs/initrd.hpp"
+#include "fs/tmpfs.hpp"
+#include "fs/bcache.hpp"
+#include "fs/ext2.hpp"
+#include "lib/rcu.hpp"
+#include "lib/shell.hpp"
+#include "lib/string.hpp"
+#include "lib/cmdline.hpp"
+#include "lib/bench.hpp"
+#include "lib/trace.hpp"
+#include "lib/boottime.hpp"
+#include "proc/syscall.hpp"
 
-extern "C" uint8_t _binary_build_initrd_tar_start[];
-extern "C" uint8_t _binary_build_initrd_tar_end[];
+extern "C" void kernel_main(uint64_t multiboot_info_phys) {
+    boot_phase("boot.asm (paging, long mode)");
 
-extern "C" void kernel_main(void* multiboot_info) {
     // Initialize the console driver
     console.init();
     Serial::init();
+    tsc_calibrate();
+    rcu_init();
+    boot_phase("console, serial, TSC calibration");
     
     // Print welcome messages 
     kprint("=== MyOS Kernel v0.1 ===\n");
     console.set_color(Color::LightBlue, Color::Black);
     kprint("Platform: x86_64 Long Mode\n");
+
+    // AVX state, then the CPUID-selected memcpy/memset/memcmp variants
+    fpu_init();
+    string_init();
+    boot_phase("FPU, string routines");
+
+    // Leave the boot identity map behind and turn on global pages / PCID
+    vmm.init();
+    console.enable_write_combining();
+    void* multiboot_info = phys_to_virt(multiboot_info_phys);
+    cmdline_init(multiboot_info);
+    if (cmdline_get_raw()[0] != '\0') {
+        kprint("Command line: "); kprint(cmdline_get_raw()); kprint("\n");
+    }
+
+    // trace=<categories> turns tracepoints on from the first event
+    char trace_list[64];
+    if (cmdline_get("trace", trace_list, sizeof(trace_list))) {
+        uint32_t mask;
+        if (trace_parse_mask(trace_list, &mask)) {
+            trace_set_mask(mask);
+        } else {
+            kprint("trace: unknown category in "); kprint(trace_list); kprint("\n");
+        }
+    }
+
+    // diag=1 runs the allocation smoke test, meminfo and the VFS self-tests;
+    // normal boots skip them
+    char diag_value[4];
+    bool diag = cmdline_get("diag", diag_value, sizeof(diag_value)) && strcmp(diag_value, "0") != 0;
+    boot_phase("VMM, command line");
     
     // Initialize Memory Manager
+    TRACE_BEGIN(TRACE_MM, "pmm_init", 0);
     pmm.init(multiboot_info);
+    TRACE_END(TRACE_MM, "pmm_init", 0);
+    boot_phase("PMM");
     
-    // Test Allocation
-    void* p1 = pmm.allocate_frame();
-    void* p2 = pmm.allocate_frame();
-    void* p3 = pmm.allocate_frame();
-    
-    kprint("Allocated Frames at: ");
-    kprint_hex((uint64_t)p1); kprint(", ");
-    kprint_hex((uint64_t)p2); kprint(", ");
-    kprint_hex((uint64_t)p3); kprint("\n");
-    
-    
-    pmm.free_frame(p2);
-    kprint("Freed frame 2\n");
-    
-    void* p4 = pmm.allocate_frame();
-    kprint("Allocated new frame at: ");
-    kprint_hex((uint64_t)p4); kprint("\n");
+    if (diag) {
+        // Test Allocation
+        void* p1 = pmm.allocate_frame();
+        void* p2 = pmm.allocate_frame();
+        void* p3 = pmm.allocate_frame();
+
+        kprint("Allocated Frames at: ");
+        kprint_hex((uint64_t)p1); kprint(", ");
+        kprint_hex((uint64_t)p2); kprint(", ");
+        kprint_hex((uint64_t)p3); kprint("\n");
 
-    // Auto-run meminfo for verification
-    meminfo_command();
+        pmm.free_frame(p2);
+        kprint("Freed frame 2\n");
 
-    size_t initrd_size = (size_t)(_binary_build_initrd_tar_end - _binary_build_initrd_tar_start);
-    tarfs_init(_binary_build_initrd_tar_start, initrd_size);
-    tarfs_self_test();
+        void* p4 = pmm.allocate_frame();
+        kprint("Allocated new frame at: ");
+        kprint_hex((uint64_t)p4); kprint("\n");
+
+        // meminfo for verification
+        meminfo_command();
+        boot_phase("diagnostics: allocations, meminfo");
+    }
+
+    // Writable tmpfs on top of the initrd (or on its own without one)
+    bool have_initrd = initrd_mount(multiboot_info);
+    if (tmpfs_mount("/", have_initrd) < 0) {
+        kprint("[TMPFS] Mount failed.\n");
+    }
+    boot_phase("initrd, tmpfs");
+    if (diag) {
+        if (have_initrd) {
+            vfs_self_test();
+        }
+        vfs_write_self_test();
+        boot_phase("diagnostics: VFS self-tests");
+    }
 
     console.set_color(Color::LightGray, Color::Black);
     kprint("[Press Ctrl+A X to exit QEMU]\n\n");
 
     // Initialize Interrupts and Keyboard
+    shell_init();
+    bench_init();
+    boot_phase("shell, benchmarks");
+
+    klog("Loading GDT, TSS and SYSCALL entry...");
+    gdt_init();
+    syscall_init();
+
     klog("Initializing Interrupts...");
     init_interrupts();
     
     klog("Initializing Keyboard...");
     init_keyboard();  //IRQ 1 init   
+    boot_phase("GDT, SYSCALL, interrupts, keyboard");
+
+    klog("Probing IDE disks...");
+    ata_init();
+    bcache_init();
+
+    // The primary master carries the ext2 image built by `make disk`
+    BlockDevice* disk = block_find("hda");
+    if (disk) {
+        vfs_mkdir("/disk");
+        int err = ext2_mount("/disk", disk);
+        if (err < 0) {
+            kprint("[EXT2] hda: "); kprint(vfs_strerror(err)); kprint("\n");
+        } else {
+            klog("Mounted hda (ext2) at /disk");
+        }
+    }
+    boot_phase("IDE probe, buffer cache, ext2");
 
     klog("Enabling Interrupts...");
     asm volatile("sti"); // enable interrupts for keyboard (IRQ 1)
     
-    klog("System Ready. Commands: meminfo, ls, cat <file>");
-    kprint("> ");
+    klog("System Ready. Type 'help' for a list of commands.");
+    boot_phase("enable interrupts");
+    boot_summary();
+
+    // autorun=<script> on the GRUB command line runs a script before the
+    // first prompt (keys typed meanwhile are queued)
+    char autorun[VFS_PATH_MAX];
+    if (cmdline_get("autorun", autorun, sizeof(autorun))) {
+        shell_run_script(autorun);
+    }
+    tty_prompt();
 
     while (1) {
-        asm volatile("hlt"); // for power saving by stop CPU Execution
+        // Check for input with interrupts off: "sti; hlt" cannot miss a
+        // wakeup because sti only takes effect after the hlt
+        asm volatile("cli");
+        if (keyboard_has_input()) {
+            asm volatile("sti");
+        } else if (pmm.compaction_wanted()) {
+            // A 2MB allocation failed: rebuild one free block before sleeping,
+            // a block at a time so typed keys are not held up for long
+            asm volatile("sti");
+            pmm.compact(1);
+        } else {
+            asm volatile("sti; hlt"); // for power saving by stop CPU Execution
+        }
+        rcu_poll(); // Idle is a quiescent state; run expired RCU callbacks
+        tty_process_input(); // Line editing and commands run with interrupts enabled
     }
 }
@@ -0,0 +1,217 @@
+#include "bench.hpp"
+#include "spinlock.hpp"
+#include "rcu.hpp"
+#include "string.hpp"
+#include "cpu.hpp"
+#include "tsc.hpp"
+#include "interrupts.hpp"
+#include "../drivers/console.hpp"
+#include "../drivers/serial.hpp"
+#include "../fs/tarfs.hpp"
+#include "../mm/pmm.hpp"
+
+// Registration only appends: an entry is filled in before the count that
+// makes it visible is bumped, so the runner reads the table unlocked.
+static const Benchmark* benchmarks[BENCH_MAX];
+static volatile size_t bench_count = 0;
+static Spinlock bench_lock("bench");
+
+static uint64_t samples[BENCH_MAX_ITERATIONS];
+
+bool bench_register(const Benchmark* bench) {
+    ScopedIrqLock guard(bench_lock);
+    if (bench_count >= BENCH_MAX || bench->iterations == 0 ||
+        bench->iterations > BENCH_MAX_ITERATIONS) {
+        return false;
+    }
+    benchmarks[bench_count] = bench;
+    __atomic_store_n(&bench_count, bench_count + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+static void sort_samples(uint64_t* a, size_t n) {
+    // Shell sort with Ciura's gaps: fast enough for 4096 samples at -O0
+    static const size_t gaps[] = {1750, 701, 301, 132, 57, 23, 10, 4, 1};
+    for (size_t g = 0; g < sizeof(gaps) / sizeof(gaps[0]); g++) {
+        size_t gap = gaps[g];
+        for (size_t i = gap; i < n; i++) {
+            uint64_t v = a[i];
+            size_t j = i;
+            while (j >= gap && a[j - gap] > v) {
+                a[j] = a[j - gap];
+                j -= gap;
+            }
+            a[j] = v;
+        }
+    }
+}
+
+// Time `n` calls of `op` into samples[], sorted
+static void measure(BenchOp op, size_t n, uint64_t overhead) {
+    for (size_t i = 0; i < n; i++) {
+        uint64_t start = rdtsc_ordered();
+        op(i);
+        uint64_t cycles = rdtsc_ordered() - start;
+        samples[i] = cycles > overhead ? cycles - overhead : 0;
+    }
+    sort_samples(samples, n);
+}
+
+static void empty_op(uint64_t i) {
+    (void)i;
+}
+
+// Median cost of timing an op that does nothing
+static uint64_t timing_overhead() {
+    measure(empty_op, 1024, 0);
+    return samples[512];
+}
+
+static void run_one(const Benchmark* b, uint64_t overhead) {
+    if (b->setup && !b->setup()) {
+        kprint("BENCH "); kprint(b->name); kprint(" skipped\n");
+        return;
+    }
+    measure(b->op, b->iterations, overhead);
+    if (b->teardown) b->teardown();
+
+    size_t n = b->iterations;
+    uint64_t total = 0;
+    for (size_t i = 0; i < n; i++) total += samples[i];
+    uint64_t ops_per_sec = total ? (uint64_t)n * tsc_hz() / total : 0;
+
+    kprint("BENCH ");
+    kprint(b->name);
+    kprint(" n="); kprint_int((int64_t)n);
+    kprint(" ops/s="); kprint_int((int64_t)ops_per_sec);
+    kprint(" p50="); kprint_int((int64_t)samples[n / 2]);
+    kprint(" p99="); kprint_int((int64_t)samples[n * 99 / 100]);
+    kprint(" max="); kprint_int((int64_t)samples[n - 1]);
+    kprint("\n");
+}
+
+bool bench_run(const char* name) {
+    size_t count = __atomic_load_n(&bench_count, __ATOMIC_ACQUIRE);
+    bool found = false;
+    for (size_t i = 0; i < count; i++) {
+        if (!name || strcmp(benchmarks[i]->name, name) == 0) found = true;
+    }
+    if (!found) return false;
+
+    uint64_t overhead = timing_overhead();
+    kprint("BENCH_BEGIN tsc_hz="); kprint_int((int64_t)tsc_hz());
+    kprint(" overhead="); kprint_int((int64_t)overhead); kprint("\n");
+    size_t ran = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (name && strcmp(benchmarks[i]->name, name) != 0) continue;
+        run_one(benchmarks[i], overhead);
+        ran++;
+    }
+    kprint("BENCH_END count="); kprint_int((int64_t)ran); kprint("\n");
+    return true;
+}
+
+void bench_list() {
+    size_t count = __atomic_load_n(&bench_count, __ATOMIC_ACQUIRE);
+    for (size_t i = 0; i < count; i++) {
+        kprint(benchmarks[i]->name);
+        kprint(" ("); kprint_int(benchmarks[i]->iterations); kprint(" iterations)\n");
+    }
+}
+
+// --- Built-in benchmarks ---
+
+// One frame allocated and freed again
+static void pmm_op(uint64_t i) {
+    (void)i;
+    void* frame = pmm.allocate_frame();
+    if (frame) pmm.free_frame(frame);
+}
+
+static bool pmm_setup() {
+    void* frame = pmm.allocate_frame();
+    if (!frame) return false;
+    pmm.free_frame(frame);
+    return true;
+}
+
+// A full 80-column line, so every op also scrolls the screen
+static void console_op(uint64_t i) {
+    (void)i;
+    console.write_string("console bench: 0123456789abcdefghijklmnopqrstuvwxyz0123456789abcdefghijklm\n");
+}
+
+// 16 bytes; lines not starting with BENCH are ignored by `make bench`
+static void serial_op(uint64_t i) {
+    (void)i;
+    Serial::write_string("serial bench 16\n");
+}
+
+// Alternate a top-level file and a nested one
+static void tarfs_op(uint64_t i) {
+    size_t size;
+    tarfs_lookup((i & 1) ? "docs/guide.txt" : "hello.txt", &size);
+}
+
+static bool tarfs_setup() {
+    size_t size;
+    return tarfs_is_ready() && tarfs_lookup("hello.txt", &size);
+}
+
+// IRQ 2 is the PIC cascade and is never raised by hardware, so its vector
+// can be triggered with `int` to time the IRQ stub, dispatch and EOI path
+#define BENCH_IRQ 2
+static volatile uint64_t bench_irqs = 0;
+
+static void bench_irq_handler(IrqFrame* frame) {
+    (void)frame;
+    bench_irqs++;
+}
+
+static void irq_op(uint64_t i) {
+    (void)i;
+    asm volatile("int %0" : : "i"(32 + BENCH_IRQ) : "memory");
+}
+
+static bool irq_setup() {
+    irq_install_handler(BENCH_IRQ, bench_irq_handler);
+    return true;
+}
+
+static void irq_teardown() {
+    irq_uninstall_handler(BENCH_IRQ);
+}
+
+// A vector the PIC never raises: the same path without EOI port writes,
+// i.e. the cost of the entry stub, dispatch and iretq
+#define BENCH_VECTOR 0xF0
+
+static void vector_op(uint64_t i) {
+    (void)i;
+    asm volatile("int %0" : : "i"(BENCH_VECTOR) : "memory");
+}
+
+static bool vector_setup() {
+    register_interrupt_handler(BENCH_VECTOR, bench_irq_handler);
+    return true;
+}
+
+static void vector_teardown() {
+    register_interrupt_handler(BENCH_VECTOR, nullptr);
+    synchronize_rcu();
+}
+
+static const Benchmark builtin[] = {
+    {"pmm_alloc_free", pmm_op, pmm_setup, nullptr, 4096},
+    {"console_write", console_op, nullptr, nullptr, 256},
+    {"serial_write", serial_op, nullptr, nullptr, 256},
+    {"tarfs_lookup", tarfs_op, tarfs_setup, nullptr, 4096},
+    {"irq_roundtrip", irq_op, irq_setup, irq_teardown, 4096},
+    {"vector_roundtrip", vector_op, vector_setup, vector_teardown, 4096},
+};
+
+void bench_init() {
+    for (size_t i = 0; i < sizeof(builtin) / sizeof(builtin[0]); i++) {
+        bench_register(&builtin[i]);
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include "types.h"
+
+// Microbenchmark suite. Each call of a benchmark's op is timed on its own
+// (rdtsc_ordered, minus the measured cost of timing an empty op), and the
+// suite reports ops/sec and p50/p99 cycles per benchmark as one line:
+//   BENCH <name> n=<iterations> ops/s=<n> p50=<cycles> p99=<cycles> max=<cycles>
+// framed by BENCH_BEGIN / BENCH_END lines. kprint mirrors it to serial,
+// where `make bench` collects it.
+#define BENCH_MAX            16
+#define BENCH_MAX_ITERATIONS 4096
+
+typedef void (*BenchOp)(uint64_t i);   // i counts calls from 0
+typedef bool (*BenchSetup)();          // false: skip (e.g. no initrd)
+typedef void (*BenchTeardown)();
+
+struct Benchmark {
+    const char* name;
+    BenchOp op;
+    BenchSetup setup;        // Optional
+    BenchTeardown teardown;  // Optional
+    uint32_t iterations;     // At most BENCH_MAX_ITERATIONS
+};
+
+void bench_init(); // Register the built-in benchmarks
+
+// `bench` must stay valid for the life of the kernel
+bool bench_register(const Benchmark* bench);
+
+// Run every benchmark, or only the one called `name`; false if there is no such benchmark
+bool bench_run(const char* name);
+void bench_list();
+
+#endif
@@ -0,0 +1,60 @@
+#include "boottime.hpp"
+#include "cpu.hpp"
+#include "tsc.hpp"
+#include "../drivers/console.hpp"
+
+struct BootPhase {
+    const char* name;
+    uint64_t end_tsc;
+};
+
+static BootPhase phases[BOOT_MAX_PHASES];
+static int phase_count = 0;
+
+void boot_phase(const char* name) {
+    if (phase_count == BOOT_MAX_PHASES) return;
+    phases[phase_count].name = name;
+    phases[phase_count].end_tsc = rdtsc();
+    phase_count++;
+}
+
+uint64_t boot_total_cycles() {
+    if (phase_count == 0) return 0;
+    return phases[phase_count - 1].end_tsc - boot_start_tsc;
+}
+
+// Microseconds with one decimal
+static void print_us(uint64_t cycles) {
+    uint64_t ns = tsc_cycles_to_ns(cycles);
+    kprint_int((int64_t)(ns / 1000)); kprint("."); kprint_int((int64_t)(ns % 1000 / 100));
+    kprint(" us");
+}
+
+void boot_summary() {
+    kprint("Boot: "); print_us(boot_total_cycles());
+    kprint(" from _start to prompt, "); print_us(boot_start_tsc);
+    kprint(" before _start (firmware, loader)\n");
+}
+
+void boottime_command() {
+    kprint("\n--- Boot Phases ---\n");
+    uint64_t total = boot_total_cycles();
+    uint64_t start = boot_start_tsc;
+    for (int i = 0; i < phase_count; i++) {
+        uint64_t cycles = phases[i].end_tsc - start;
+        start = phases[i].end_tsc;
+
+        kprint(phases[i].name);
+        kprint(": cycles="); kprint_int((int64_t)cycles);
+        kprint(" time="); print_us(cycles);
+        if (total > 0) {
+            kprint(" ("); kprint_int((int64_t)(cycles * 100 / total)); kprint("%)");
+        }
+        kprint("\n");
+    }
+    kprint("total: cycles="); kprint_int((int64_t)total);
+    kprint(" time="); print_us(total); kprint("\n");
+    kprint("before _start: cycles="); kprint_int((int64_t)boot_start_tsc);
+    kprint(" (TSC at kernel entry; firmware and loader on a fresh VM)\n");
+    kprint("-------------------\n");
+}
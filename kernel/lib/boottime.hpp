@@ -0,0 +1,26 @@
+#ifndef BOOTTIME_HPP
+#define BOOTTIME_HPP
+
+#include "types.h"
+
+// Boot phase timestamps. boot.asm reads the TSC first thing at _start,
+// before paging; kernel_main then closes each phase with boot_phase().
+// Cycles are converted to time only when reported, since the TSC is
+// calibrated a few phases in.
+#define BOOT_MAX_PHASES 16
+
+extern "C" uint64_t boot_start_tsc;  // Written by boot.asm
+
+// End the current phase (started by the previous call, or at _start)
+void boot_phase(const char* name);
+
+// Cycles from _start to the last boot_phase()
+uint64_t boot_total_cycles();
+
+// One-line summary printed before the first prompt
+void boot_summary();
+
+// Per-phase table (the `boottime` command)
+void boottime_command();
+
+#endif
@@ -0,0 +1,40 @@
+#include "cmdline.hpp"
+#include "string.hpp"
+#include "../arch/x86_64/multiboot.hpp"
+
+static char cmdline[CMDLINE_MAX];
+
+void cmdline_init(void* mbi) {
+    multiboot_tag* t = multiboot_find_tag(mbi, MULTIBOOT_TAG_TYPE_CMDLINE, nullptr);
+    if (!t) return;
+
+    const char* src = ((multiboot_tag_string*)t)->string;
+    size_t len = strlen(src);
+    if (len >= CMDLINE_MAX) len = CMDLINE_MAX - 1;
+    memcpy(cmdline, src, len);
+    cmdline[len] = '\0';
+}
+
+const char* cmdline_get_raw() {
+    return cmdline;
+}
+
+bool cmdline_get(const char* key, char* out, size_t len) {
+    size_t key_len = strlen(key);
+    const char* p = cmdline;
+    while (*p) {
+        while (*p == ' ') p++;
+        const char* word = p;
+        while (*p && *p != ' ') p++;
+
+        if ((size_t)(p - word) > key_len && memcmp(word, key, key_len) == 0 && word[key_len] == '=') {
+            const char* value = word + key_len + 1;
+            size_t n = (size_t)(p - value);
+            if (n >= len) n = len - 1;
+            memcpy(out, value, n);
+            out[n] = '\0';
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,17 @@
+#ifndef CMDLINE_HPP
+#define CMDLINE_HPP
+
+#include "types.h"
+
+// Kernel command line: the words after the kernel path on GRUB's
+// multiboot2 line, e.g. `multiboot2 /boot/kernel.elf autorun=/scripts/bench.sh`
+#define CMDLINE_MAX 256
+
+void cmdline_init(void* mbi); // Copy it out of the multiboot2 info
+const char* cmdline_get_raw(); // Empty string when there is none
+
+// Value of the first `key=value` word, NUL-terminated and cut to len - 1
+// bytes; false when the key is absent
+bool cmdline_get(const char* key, char* out, size_t len);
+
+#endif
@@ -1,6 +1,7 @@
 #include "helpers.hpp"
 #include "../mm/pmm.hpp"
 #include "../drivers/console.hpp"
+#include "../arch/x86_64/tsc.hpp"
 
 void meminfo_command() {
     uint64_t total = pmm.get_total_memory();
@@ -11,6 +12,27 @@ void meminfo_command() {
     kprint("Total Memory: "); kprint_int(total / 1024 / 1024); kprint(" MB ("); kprint_int(total); kprint(" bytes)\n");
     kprint("Used Memory:  "); kprint_int(used / 1024 / 1024); kprint(" MB ("); kprint_int(used); kprint(" bytes)\n");
     kprint("Free Memory:  "); kprint_int(free / 1024 / 1024); kprint(" MB ("); kprint_int(free); kprint(" bytes)\n");
+
+    PmmHugeStats hs;
+    pmm.get_huge_stats(&hs);
+    uint64_t attempts = hs.allocs + hs.failures;
+    kprint("Free 2MB blocks: "); kprint_int(hs.free_blocks);
+    kprint(", movable frames: "); kprint_int(hs.movable_frames); kprint("\n");
+    kprint("Huge frames: "); kprint_int(hs.allocs); kprint(" allocated, ");
+    kprint_int(hs.failures); kprint(" failed");
+    if (attempts > 0) {
+        kprint(" ("); kprint_int(hs.allocs * 100 / attempts); kprint("% success)");
+    }
+    kprint("\n");
+    kprint("Compaction: "); kprint_int(hs.compactions); kprint(" passes, ");
+    kprint_int(hs.blocks_freed); kprint(" blocks freed, ");
+    kprint_int(hs.pages_moved); kprint(" pages moved (");
+    kprint_int(hs.moves_refused); kprint(" refused), ");
+    kprint_int(tsc_cycles_to_ns(hs.compact_cycles) / 1000); kprint(" us");
+    if (hs.pages_moved > 0) {
+        kprint(", "); kprint_int(hs.compact_cycles / hs.pages_moved); kprint(" cycles/page");
+    }
+    kprint("\n");
     
     kprint("\n[Leak Test] Allocating 5 frames...\n");
     void* frames[5];
@@ -0,0 +1,17 @@
+#include "ksyms.hpp"
+
+extern "C" char _etext[]; // linker.ld
+
+int64_t ksym_lookup(uint64_t addr) {
+    if (ksyms_count == 0 || addr < ksyms[0].addr || addr >= (uint64_t)_etext) {
+        return -1;
+    }
+    // Last symbol at or below addr
+    size_t lo = 0, hi = ksyms_count;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ksyms[mid].addr <= addr) lo = mid;
+        else hi = mid;
+    }
+    return (int64_t)lo;
+}
@@ -0,0 +1,20 @@
+#ifndef KSYMS_HPP
+#define KSYMS_HPP
+
+#include "types.h"
+
+// Kernel function symbols, sorted by address. The table is generated from
+// kernel.elf by scripts/gen-ksyms.sh during a second link (see Makefile);
+// C++ names are demangled without their parameter lists.
+struct KernelSymbol {
+    uint64_t addr;
+    const char* name;
+};
+
+extern const KernelSymbol ksyms[];
+extern const size_t ksyms_count;
+
+// Index of the function containing `addr`, or -1 outside kernel code
+int64_t ksym_lookup(uint64_t addr);
+
+#endif
@@ -0,0 +1,142 @@
+#include "lz4.hpp"
+
+#define FLG_VERSION_MASK   0xC0
+#define FLG_VERSION_01     0x40
+#define FLG_BLOCK_CHECKSUM 0x10
+#define FLG_CONTENT_SIZE   0x08
+#define FLG_CONTENT_CSUM   0x04
+#define FLG_DICT_ID        0x01
+#define BLOCK_UNCOMPRESSED 0x80000000u
+#define MIN_MATCH          4
+
+struct FrameHeader {
+    uint8_t flags;
+    uint64_t content_size; // 0 if not stored
+    size_t header_len;     // Bytes up to the first block
+};
+
+static uint32_t read_le32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t read_le64(const uint8_t* p) {
+    return (uint64_t)read_le32(p) | ((uint64_t)read_le32(p + 4) << 32);
+}
+
+bool lz4_is_frame(const uint8_t* src, size_t len) {
+    return src && len >= 4 && read_le32(src) == LZ4_FRAME_MAGIC;
+}
+
+static bool parse_header(const uint8_t* src, size_t len, FrameHeader* out) {
+    if (!lz4_is_frame(src, len) || len < 7) return false;
+    uint8_t flg = src[4];
+    if ((flg & FLG_VERSION_MASK) != FLG_VERSION_01) return false;
+
+    size_t pos = 6; // Magic, FLG, BD
+    out->flags = flg;
+    out->content_size = 0;
+    if (flg & FLG_CONTENT_SIZE) {
+        if (pos + 8 > len) return false;
+        out->content_size = read_le64(src + pos);
+        pos += 8;
+    }
+    if (flg & FLG_DICT_ID) pos += 4;
+    pos += 1; // Header checksum
+    if (pos > len) return false;
+    out->header_len = pos;
+    return true;
+}
+
+// Read an LZ4 length continuation: 255-bytes keep adding
+static bool read_extra_length(const uint8_t** ip, const uint8_t* end, size_t* length) {
+    uint8_t b;
+    do {
+        if (*ip >= end) return false;
+        b = *(*ip)++;
+        *length += b;
+    } while (b == 255);
+    return true;
+}
+
+// Decode one compressed block. With dst == nullptr only the output size
+// is computed. `out_pos` is the offset in the whole frame output, so
+// matches can reach back into earlier (linked) blocks.
+static bool decode_block(const uint8_t* ip, const uint8_t* end, uint8_t* dst, size_t capacity, size_t* out_pos) {
+    size_t op = *out_pos;
+    while (ip < end) {
+        uint8_t token = *ip++;
+
+        size_t lit = token >> 4;
+        if (lit == 15 && !read_extra_length(&ip, end, &lit)) return false;
+        if (lit > (size_t)(end - ip)) return false;
+        if (dst) {
+            if (lit > capacity - op) return false;
+            for (size_t i = 0; i < lit; i++) dst[op + i] = ip[i];
+        }
+        ip += lit;
+        op += lit;
+
+        if (ip == end) break; // The last sequence carries only literals
+
+        if (end - ip < 2) return false;
+        size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) return false;
+
+        size_t match = token & 15;
+        if (match == 15 && !read_extra_length(&ip, end, &match)) return false;
+        match += MIN_MATCH;
+        if (dst) {
+            if (match > capacity - op) return false;
+            // Byte by byte: the source may overlap what we are writing
+            uint8_t* d = dst + op;
+            const uint8_t* s = d - offset;
+            for (size_t i = 0; i < match; i++) d[i] = s[i];
+        }
+        op += match;
+    }
+    *out_pos = op;
+    return true;
+}
+
+static int64_t walk_frame(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity) {
+    FrameHeader hdr;
+    if (!parse_header(src, len, &hdr)) return -1;
+
+    const uint8_t* ip = src + hdr.header_len;
+    const uint8_t* end = src + len;
+    size_t op = 0;
+    while (true) {
+        if (end - ip < 4) return -1;
+        uint32_t block = read_le32(ip);
+        ip += 4;
+        if (block == 0) break; // EndMark
+
+        size_t size = block & ~BLOCK_UNCOMPRESSED;
+        if (size > (size_t)(end - ip)) return -1;
+        if (block & BLOCK_UNCOMPRESSED) {
+            if (dst) {
+                if (size > capacity - op) return -1;
+                for (size_t i = 0; i < size; i++) dst[op + i] = ip[i];
+            }
+            op += size;
+        } else if (!decode_block(ip, ip + size, dst, capacity, &op)) {
+            return -1;
+        }
+        ip += size;
+        if (hdr.flags & FLG_BLOCK_CHECKSUM) ip += 4;
+    }
+    return (int64_t)op;
+}
+
+int64_t lz4_frame_content_size(const uint8_t* src, size_t len) {
+    FrameHeader hdr;
+    if (!parse_header(src, len, &hdr)) return -1;
+    if (hdr.flags & FLG_CONTENT_SIZE) return (int64_t)hdr.content_size;
+    return walk_frame(src, len, nullptr, 0);
+}
+
+int64_t lz4_frame_decompress(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity) {
+    if (!dst) return -1;
+    return walk_frame(src, len, dst, capacity);
+}
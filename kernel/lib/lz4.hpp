@@ -0,0 +1,20 @@
+#ifndef LZ4_HPP
+#define LZ4_HPP
+
+#include "types.h"
+
+#define LZ4_FRAME_MAGIC 0x184D2204u
+
+// Decoder for the LZ4 frame format (what `lz4` writes). Checksums are
+// skipped, not verified. Errors are reported as -1.
+bool lz4_is_frame(const uint8_t* src, size_t len);
+
+// Decompressed size: from the frame header when the producer stored it
+// (`lz4 --content-size`), otherwise by walking the sequences without
+// copying anything.
+int64_t lz4_frame_content_size(const uint8_t* src, size_t len);
+
+// Decompress one frame into dst; returns the number of bytes written
+int64_t lz4_frame_decompress(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef PERCPU_HPP
+#define PERCPU_HPP
+
+#include "types.h"
+
+// Upper bound on CPUs we keep per-CPU slots for
+#define MAX_CPUS 8
+#define CACHE_LINE_SIZE 64
+
+// Index of the executing CPU. Only the BSP runs today; once APs are started
+// this should read the APIC ID (or a GS-based per-CPU block).
+static inline uint32_t cpu_id() {
+    return 0;
+}
+
+// One cache line per CPU so updates from different cores never share a line
+struct alignas(CACHE_LINE_SIZE) PerCpuSlot {
+    uint64_t value;
+};
+
+// Counter that each CPU bumps locally without atomics; readers sum all slots.
+class PerCpuCounter {
+public:
+    constexpr PerCpuCounter() : slots{} {}
+
+    void add(uint64_t n) { slots[cpu_id()].value += n; }
+    void inc() { add(1); }
+
+    uint64_t sum() const {
+        uint64_t total = 0;
+        for (int i = 0; i < MAX_CPUS; i++) {
+            total += __atomic_load_n(&slots[i].value, __ATOMIC_RELAXED);
+        }
+        return total;
+    }
+
+    void reset() {
+        for (int i = 0; i < MAX_CPUS; i++) {
+            __atomic_store_n(&slots[i].value, 0, __ATOMIC_RELAXED);
+        }
+    }
+
+private:
+    PerCpuSlot slots[MAX_CPUS];
+};
+
+#endif
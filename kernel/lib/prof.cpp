@@ -0,0 +1,321 @@
+#include "prof.hpp"
+#include "ksyms.hpp"
+#include "percpu.hpp"
+#include "spinlock.hpp"
+#include "cpu.hpp"
+#include "ports.hpp"
+#include "interrupts.hpp"
+#include "../drivers/console.hpp"
+#include "../drivers/serial.hpp"
+#include "../mm/pmm.hpp"
+#include "../mm/vmm.hpp"
+#include "../mm/heap.hpp"
+
+#define PIT_HZ       1193182
+#define PIT_CH0_DATA 0x40
+#define PIT_COMMAND  0x43
+#define PIT_CH0_RATE 0x34  // Channel 0, lo/hi byte, mode 2 (rate generator)
+#define PROF_IRQ     0
+
+#define PROF_USER       0x1  // Sampled in ring 3: pc[0] is a user RIP
+#define PROF_SYMBOLIZED 0x2  // pc[] holds symbol ids instead of addresses
+
+// Symbol ids of frames that are not kernel functions
+#define SYM_UNKNOWN ((uint64_t)-1)
+#define SYM_USER    ((uint64_t)-2)
+
+struct ProfSample {
+    uint16_t depth;
+    uint16_t flags;
+    uint32_t reserved;
+    uint64_t pc[PROF_MAX_DEPTH];
+};
+
+#define PROF_MAX_SAMPLES (PROF_BUFFER_PAGES * PAGE_SIZE / sizeof(ProfSample))
+
+struct alignas(CACHE_LINE_SIZE) ProfCpu {
+    ProfSample* samples;  // PROF_BUFFER_PAGES contiguous frames, kept once allocated
+    uint32_t count;
+    uint64_t dropped;     // Ticks that found the buffer full
+};
+
+static ProfCpu prof_cpus[MAX_CPUS];
+static bool running = false;
+static bool walk_stacks = true;
+static uint32_t sample_hz = 0;
+
+// Follow saved frame pointers through kernel memory. Every kernel
+// function keeps one (the kernel is built without optimization), and
+// boot.asm zeroes rbp before kernel_main, so the chain ends there. Return
+// addresses are stored minus one so a call at the end of a function is
+// attributed to that function.
+static uint16_t walk(uint64_t rbp, uint64_t* out, uint16_t max) {
+    const uint64_t lo = KERNEL_VMA;
+    const uint64_t hi = KERNEL_VMA + DIRECT_MAP_SIZE - 16;
+    uint16_t n = 0;
+    while (n < max && rbp >= lo && rbp <= hi && (rbp & 7) == 0) {
+        const uint64_t* frame = (const uint64_t*)rbp;
+        uint64_t ret = frame[1];
+        if (ret < KERNEL_VMA) break;
+        out[n++] = ret - 1;
+        if (frame[0] <= rbp) break; // Callers live higher on the stack
+        rbp = frame[0];
+    }
+    return n;
+}
+
+static void prof_tick(IrqFrame* frame) {
+    ProfCpu* pc = &prof_cpus[cpu_id()];
+    if (!pc->samples) return;
+    if (pc->count >= PROF_MAX_SAMPLES) {
+        pc->dropped++;
+        return;
+    }
+
+    ProfSample* s = &pc->samples[pc->count];
+    s->pc[0] = frame->rip;
+    s->depth = 1;
+    s->flags = 0;
+    if (frame->cs & 3) {
+        s->flags = PROF_USER;
+    } else if (walk_stacks) {
+        s->depth += walk(frame->rbp, &s->pc[1], PROF_MAX_DEPTH - 1);
+    }
+    pc->count++;
+}
+
+static void pit_set_divisor(uint16_t divisor) {
+    outb(PIT_COMMAND, PIT_CH0_RATE);
+    outb(PIT_CH0_DATA, divisor & 0xFF);
+    outb(PIT_CH0_DATA, divisor >> 8);
+}
+
+bool prof_start(uint32_t hz, bool stacks) {
+    if (running) return false;
+
+    // The PIT only interrupts the BSP; APs will need their local APIC
+    // timer and their own buffers
+    ProfCpu* pc = &prof_cpus[cpu_id()];
+    if (!pc->samples) {
+        void* frames = pmm.allocate_frames(PROF_BUFFER_PAGES);
+        if (!frames) return false;
+        pc->samples = (ProfSample*)phys_to_virt((uint64_t)frames);
+    }
+    for (int i = 0; i < MAX_CPUS; i++) {
+        prof_cpus[i].count = 0;
+        prof_cpus[i].dropped = 0;
+    }
+    walk_stacks = stacks;
+    sample_hz = hz;
+
+    irq_install_handler(PROF_IRQ, prof_tick);
+    uint64_t flags = irq_save();
+    pit_set_divisor((uint16_t)(PIT_HZ / hz));
+    irq_unmask(PROF_IRQ);
+    running = true;
+    irq_restore(flags);
+    return true;
+}
+
+bool prof_stop() {
+    if (!running) return false;
+    uint64_t flags = irq_save();
+    irq_mask(PROF_IRQ);
+    pit_set_divisor(0); // 65536: the power-on 18.2 Hz
+    running = false;
+    irq_restore(flags);
+    irq_uninstall_handler(PROF_IRQ); // Waits until no tick is still recording
+    return true;
+}
+
+bool prof_running() {
+    return running;
+}
+
+// --- Reports ---
+
+static uint32_t total_samples() {
+    uint32_t n = 0;
+    for (int i = 0; i < MAX_CPUS; i++) n += prof_cpus[i].count;
+    return n;
+}
+
+static uint64_t total_dropped() {
+    uint64_t n = 0;
+    for (int i = 0; i < MAX_CPUS; i++) n += prof_cpus[i].dropped;
+    return n;
+}
+
+// Sample references are (cpu << 16) | index
+static ProfSample* sample_at(uint32_t ref) {
+    return &prof_cpus[ref >> 16].samples[ref & 0xFFFF];
+}
+
+// Replace addresses by symbol ids once, so identical stacks compare equal
+static void symbolize(ProfSample* s) {
+    if (s->flags & PROF_SYMBOLIZED) return;
+    for (uint16_t i = 0; i < s->depth; i++) {
+        if (i == 0 && (s->flags & PROF_USER)) {
+            s->pc[i] = SYM_USER;
+        } else {
+            int64_t sym = ksym_lookup(s->pc[i]);
+            s->pc[i] = sym < 0 ? SYM_UNKNOWN : (uint64_t)sym;
+        }
+    }
+    s->flags |= PROF_SYMBOLIZED;
+}
+
+static const char* sym_name(uint64_t id) {
+    if (id == SYM_USER) return "[user]";
+    if (id == SYM_UNKNOWN) return "[unknown]";
+    return ksyms[id].name;
+}
+
+// Symbolized references to every sample, or nullptr (count in *n)
+static uint32_t* collect(uint32_t* n) {
+    *n = total_samples();
+    if (*n == 0) return nullptr;
+    uint32_t* refs = (uint32_t*)kmalloc(*n * sizeof(uint32_t));
+    if (!refs) return nullptr;
+    uint32_t k = 0;
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        for (uint32_t i = 0; i < prof_cpus[cpu].count; i++) {
+            refs[k] = (cpu << 16) | i;
+            symbolize(sample_at(refs[k]));
+            k++;
+        }
+    }
+    return refs;
+}
+
+typedef int (*SampleCompare)(const ProfSample* a, const ProfSample* b);
+
+// Whole stacks, outermost frame first
+static int compare_stacks(const ProfSample* a, const ProfSample* b) {
+    int i = a->depth - 1, j = b->depth - 1;
+    for (; i >= 0 && j >= 0; i--, j--) {
+        if (a->pc[i] != b->pc[j]) return a->pc[i] < b->pc[j] ? -1 : 1;
+    }
+    return (i < 0 ? 0 : 1) - (j < 0 ? 0 : 1);
+}
+
+static int compare_leaf(const ProfSample* a, const ProfSample* b) {
+    if (a->pc[0] == b->pc[0]) return 0;
+    return a->pc[0] < b->pc[0] ? -1 : 1;
+}
+
+static void sort_refs(uint32_t* refs, uint32_t n, SampleCompare cmp) {
+    for (uint32_t gap = n / 2; gap > 0; gap /= 2) {
+        for (uint32_t i = gap; i < n; i++) {
+            uint32_t r = refs[i];
+            uint32_t j = i;
+            for (; j >= gap && cmp(sample_at(refs[j - gap]), sample_at(r)) > 0; j -= gap) {
+                refs[j] = refs[j - gap];
+            }
+            refs[j] = r;
+        }
+    }
+}
+
+static void serial_uint(uint64_t n) {
+    char buf[21];
+    int i = sizeof(buf) - 1;
+    buf[i] = '\0';
+    do {
+        buf[--i] = (char)('0' + n % 10);
+        n /= 10;
+    } while (n > 0);
+    Serial::write_string(&buf[i]);
+}
+
+void prof_dump_folded() {
+    uint32_t n;
+    uint32_t* refs = collect(&n);
+    if (!refs) {
+        kprint(n ? "prof: out of memory\n" : "prof: no samples\n");
+        return;
+    }
+    sort_refs(refs, n, compare_stacks);
+
+    Serial::write_string("PROF_BEGIN samples="); serial_uint(n);
+    Serial::write_string(" dropped="); serial_uint(total_dropped());
+    Serial::write_string(" hz="); serial_uint(sample_hz);
+    Serial::write_string("\n");
+
+    uint32_t stacks = 0;
+    for (uint32_t i = 0; i < n;) {
+        ProfSample* s = sample_at(refs[i]);
+        uint32_t run = 1;
+        while (i + run < n && compare_stacks(s, sample_at(refs[i + run])) == 0) run++;
+
+        for (int f = s->depth - 1; f >= 0; f--) {
+            Serial::write_string(sym_name(s->pc[f]));
+            Serial::write_char(f > 0 ? ';' : ' ');
+        }
+        serial_uint(run);
+        Serial::write_char('\n');
+        stacks++;
+        i += run;
+    }
+    Serial::write_string("PROF_END stacks="); serial_uint(stacks); Serial::write_string("\n");
+    kfree(refs);
+
+    kprint("prof: "); kprint_int(stacks); kprint(" stacks from "); kprint_int(n);
+    kprint(" samples written to serial\n");
+}
+
+void prof_top(size_t count) {
+    uint32_t n;
+    uint32_t* refs = collect(&n);
+    if (!refs) {
+        kprint(n ? "prof: out of memory\n" : "prof: no samples\n");
+        return;
+    }
+    sort_refs(refs, n, compare_leaf);
+
+    // Keep the `count` largest runs, biggest first
+    uint64_t top_sym[PROF_TOP_DEFAULT * 2];
+    uint32_t top_hits[PROF_TOP_DEFAULT * 2];
+    size_t max = sizeof(top_hits) / sizeof(top_hits[0]);
+    if (count > max) count = max;
+    size_t kept = 0;
+    for (uint32_t i = 0; i < n;) {
+        ProfSample* s = sample_at(refs[i]);
+        uint32_t run = 1;
+        while (i + run < n && compare_leaf(s, sample_at(refs[i + run])) == 0) run++;
+        i += run;
+
+        size_t pos = kept;
+        while (pos > 0 && top_hits[pos - 1] < run) pos--;
+        if (pos >= count) continue;
+        size_t last = kept < count ? kept : count - 1;
+        for (size_t k = last; k > pos; k--) {
+            top_sym[k] = top_sym[k - 1];
+            top_hits[k] = top_hits[k - 1];
+        }
+        top_sym[pos] = s->pc[0];
+        top_hits[pos] = run;
+        if (kept < count) kept++;
+    }
+    kfree(refs);
+
+    kprint("\n--- Profile: "); kprint_int(n); kprint(" samples at "); kprint_int(sample_hz);
+    kprint(" Hz ---\n");
+    for (size_t k = 0; k < kept; k++) {
+        uint64_t permille = (uint64_t)top_hits[k] * 1000 / n;
+        kprint("  "); kprint_int(top_hits[k]);
+        kprint("  "); kprint_int((int64_t)(permille / 10)); kprint("."); kprint_int((int64_t)(permille % 10));
+        kprint("%  "); kprint(sym_name(top_sym[k])); kprint("\n");
+    }
+}
+
+void prof_status() {
+    kprint("prof: "); kprint(running ? "running" : "stopped");
+    if (sample_hz) {
+        kprint(", "); kprint_int(sample_hz); kprint(" Hz, ");
+        kprint_int(total_samples()); kprint(" samples, ");
+        kprint_int((int64_t)total_dropped()); kprint(" dropped");
+        kprint(walk_stacks ? ", with stacks" : ", RIP only");
+    }
+    kprint(", "); kprint_int((int64_t)ksyms_count); kprint(" symbols\n");
+}
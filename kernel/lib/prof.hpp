@@ -0,0 +1,32 @@
+#ifndef PROF_HPP
+#define PROF_HPP
+
+#include "types.h"
+
+// Sampling profiler. PIT channel 0 interrupts at the chosen rate and the
+// IRQ 0 handler records the interrupted RIP, plus the frame-pointer chain
+// of kernel callers, in the executing CPU's sample buffer.
+#define PROF_DEFAULT_HZ   1000
+#define PROF_MIN_HZ       19      // Slowest the 16-bit PIT divisor allows
+#define PROF_MAX_HZ       20000
+#define PROF_MAX_DEPTH    15      // Frames per sample, innermost first
+#define PROF_BUFFER_PAGES 256     // 1 MB per CPU: 8192 samples
+#define PROF_TOP_DEFAULT  20
+
+// Start sampling `hz` times a second (clears earlier samples). With
+// `stacks` false only the interrupted RIP is kept. False if already
+// running or the buffer cannot be allocated.
+bool prof_start(uint32_t hz, bool stacks);
+bool prof_stop();  // False if not running
+bool prof_running();
+
+// Folded stacks ("outer;...;inner count" per line) over serial between
+// PROF_BEGIN and PROF_END lines, for flamegraph.pl or speedscope
+void prof_dump_folded();
+
+// The functions with the most samples (innermost frame), on the console
+void prof_top(size_t n);
+
+void prof_status();
+
+#endif
@@ -0,0 +1,82 @@
+#include "rcu.hpp"
+#include "spinlock.hpp"
+#include "../drivers/console.hpp"
+
+RcuCpu rcu_cpus[MAX_CPUS];
+
+static uint64_t gp_seq = 0; // Most recently started grace period
+
+// Pending call_rcu callbacks, oldest first
+static RcuHead* cb_head = nullptr;
+static RcuHead** cb_tail = &cb_head;
+static Spinlock rcu_lock("rcu");
+
+void rcu_init() {
+    rcu_cpus[cpu_id()].online = 1;
+    rcu_quiescent();
+}
+
+void rcu_quiescent() {
+    RcuCpu* c = &rcu_cpus[cpu_id()];
+    if (c->nesting != 0) return; // Still inside a reader
+    uint64_t seq = __atomic_load_n(&gp_seq, __ATOMIC_ACQUIRE);
+    __atomic_store_n(&c->qs_seq, seq, __ATOMIC_RELEASE);
+}
+
+static bool grace_period_done(uint64_t seq) {
+    for (int i = 0; i < MAX_CPUS; i++) {
+        if (!__atomic_load_n(&rcu_cpus[i].online, __ATOMIC_RELAXED)) continue;
+        if (__atomic_load_n(&rcu_cpus[i].qs_seq, __ATOMIC_ACQUIRE) < seq) return false;
+    }
+    return true;
+}
+
+void synchronize_rcu() {
+    if (rcu_cpus[cpu_id()].nesting != 0) {
+        panic("synchronize_rcu called inside an RCU read-side section");
+    }
+
+    uint64_t seq = __atomic_add_fetch(&gp_seq, 1, __ATOMIC_ACQ_REL);
+    rcu_quiescent(); // The caller itself is not a reader
+    while (!grace_period_done(seq)) {
+        cpu_relax();
+    }
+}
+
+void call_rcu(RcuHead* head, void (*func)(RcuHead* head)) {
+    head->func = func;
+    head->next = nullptr;
+
+    uint64_t flags = rcu_lock.lock_irqsave();
+    head->gp_seq = __atomic_add_fetch(&gp_seq, 1, __ATOMIC_ACQ_REL);
+    *cb_tail = head;
+    cb_tail = &head->next;
+    rcu_lock.unlock_irqrestore(flags);
+}
+
+void rcu_poll() {
+    rcu_quiescent();
+
+    // Detach every callback whose grace period has completed. Sequence
+    // numbers are queued in increasing order, so stop at the first miss.
+    uint64_t flags = rcu_lock.lock_irqsave();
+    RcuHead* done = nullptr;
+    RcuHead** done_tail = &done;
+    while (cb_head && grace_period_done(cb_head->gp_seq)) {
+        RcuHead* h = cb_head;
+        cb_head = h->next;
+        h->next = nullptr;
+        *done_tail = h;
+        done_tail = &h->next;
+    }
+    if (!cb_head) {
+        cb_tail = &cb_head;
+    }
+    rcu_lock.unlock_irqrestore(flags);
+
+    while (done) {
+        RcuHead* next = done->next;
+        done->func(done);
+        done = next;
+    }
+}
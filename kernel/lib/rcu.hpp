@@ -0,0 +1,64 @@
+#ifndef RCU_HPP
+#define RCU_HPP
+
+#include "types.h"
+#include "percpu.hpp"
+
+// Quiescent-state based RCU for a non-preemptive kernel.
+//
+// Readers bracket their accesses with rcu_read_lock()/rcu_read_unlock(),
+// which only touch a counter in the CPU's own cache line: no atomics, no
+// shared writes, so the cost does not grow with the number of cores.
+// Writers publish a new version with rcu_assign_pointer() and either wait
+// with synchronize_rcu() or hand the old version to call_rcu().
+// A grace period ends once every online CPU has passed a quiescent state
+// (idle loop, or rcu_quiescent() outside any read-side section).
+
+struct alignas(CACHE_LINE_SIZE) RcuCpu {
+    uint32_t nesting;  // Read-side critical section depth
+    uint32_t online;
+    uint64_t qs_seq;   // Last grace period this CPU acknowledged
+};
+
+extern RcuCpu rcu_cpus[MAX_CPUS];
+
+static inline void rcu_read_lock() {
+    rcu_cpus[cpu_id()].nesting++;
+    asm volatile("" ::: "memory");
+}
+
+static inline void rcu_read_unlock() {
+    asm volatile("" ::: "memory");
+    rcu_cpus[cpu_id()].nesting--;
+}
+
+// Read-side critical section for the rest of the scope
+class RcuReadGuard {
+public:
+    RcuReadGuard() { rcu_read_lock(); }
+    ~RcuReadGuard() { rcu_read_unlock(); }
+
+    RcuReadGuard(const RcuReadGuard&) = delete;
+    RcuReadGuard& operator=(const RcuReadGuard&) = delete;
+};
+
+// Load a pointer published with rcu_assign_pointer (dependency ordered;
+// a plain load on x86-64)
+#define rcu_dereference(p) __atomic_load_n(&(p), __ATOMIC_CONSUME)
+
+// Publish a fully initialised object to readers
+#define rcu_assign_pointer(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+
+struct RcuHead {
+    RcuHead* next;
+    void (*func)(RcuHead* head);
+    uint64_t gp_seq; // Grace period that must complete before func runs
+};
+
+void rcu_init();
+void rcu_quiescent();        // Report a quiescent state for this CPU
+void synchronize_rcu();      // Block until all pre-existing readers are done
+void call_rcu(RcuHead* head, void (*func)(RcuHead* head));
+void rcu_poll();             // Run callbacks whose grace period has ended
+
+#endif
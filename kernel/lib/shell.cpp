@@ -0,0 +1,792 @@
+#include "shell.hpp"
+#include "helpers.hpp"
+#include "rcu.hpp"
+#include "spinlock.hpp"
+#include "irqstat.hpp"
+#include "string.hpp"
+#include "cpu.hpp"
+#include "tsc.hpp"
+#include "ports.hpp"
+#include "bench.hpp"
+#include "prof.hpp"
+#include "trace.hpp"
+#include "boottime.hpp"
+#include "../drivers/console.hpp"
+#include "../fs/tarfs.hpp"
+#include "../fs/vfs.hpp"
+#include "../fs/tmpfs.hpp"
+#include "../fs/bcache.hpp"
+#include "../fs/ext2.hpp"
+#include "../drivers/serial.hpp"
+#include "../drivers/block.hpp"
+#include "../drivers/ata.hpp"
+#include "../drivers/keyboard.hpp"
+#include "../drivers/tty.hpp"
+#include "../mm/pmm.hpp"
+#include "../mm/vmm.hpp"
+#include "../proc/process.hpp"
+
+// The command table is read on every command but only written when a
+// subsystem registers a command. Readers walk the published version under
+// RCU; a writer fills the spare copy, publishes it, then waits a grace
+// period before that old copy can be reused as the next spare.
+struct CommandTable {
+    size_t count;
+    ShellCommand entries[SHELL_MAX_COMMANDS];
+};
+
+static CommandTable tables[2];
+static CommandTable* current_table = nullptr;
+static Spinlock shell_lock("shell"); // Serializes writers only
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t';
+}
+
+// Split off the next blank-separated word of *arg (empty at the end)
+static char* next_word(char** arg) {
+    char* word = *arg;
+    char* p = word;
+    while (*p && !is_space(*p)) p++;
+    if (*p) *p++ = '\0';
+    while (is_space(*p)) p++;
+    *arg = p;
+    return word;
+}
+
+// Parse a decimal argument; false if it is empty or not a number
+static bool parse_uint(const char* s, size_t* out) {
+    if (*s == '\0') return false;
+    size_t value = 0;
+    for (; *s; s++) {
+        if (*s < '0' || *s > '9') return false;
+        value = value * 10 + (size_t)(*s - '0');
+    }
+    *out = value;
+    return true;
+}
+
+bool shell_register_command(const char* name, ShellHandler handler) {
+    uint64_t flags = shell_lock.lock_irqsave();
+
+    CommandTable* old = current_table;
+    CommandTable* next = (old == &tables[0]) ? &tables[1] : &tables[0];
+    size_t count = old ? old->count : 0;
+    if (count >= SHELL_MAX_COMMANDS) {
+        shell_lock.unlock_irqrestore(flags);
+        return false;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        next->entries[i] = old->entries[i];
+    }
+    next->entries[count].name = name;
+    next->entries[count].handler = handler;
+    next->count = count + 1;
+
+    rcu_assign_pointer(current_table, next);
+    synchronize_rcu(); // No reader can still see `old` after this
+
+    shell_lock.unlock_irqrestore(flags);
+    return true;
+}
+
+// `registered` gets the name the command was registered with, which
+// outlives the input line (tracepoints keep it)
+static ShellHandler find_command(const char* name, const char** registered) {
+    ShellHandler handler = nullptr;
+    rcu_read_lock();
+    const CommandTable* t = rcu_dereference(current_table);
+    for (size_t i = 0; t && i < t->count; i++) {
+        if (strcmp(t->entries[i].name, name) == 0) {
+            handler = t->entries[i].handler;
+            *registered = t->entries[i].name;
+            break;
+        }
+    }
+    rcu_read_unlock();
+    return handler;
+}
+
+static int script_depth = 0; // Nested `run` commands
+
+void execute_command(char* input) {
+    while (is_space(*input)) input++;
+
+    if (*input == '\0') {
+        return;
+    }
+
+    char* cmd = input;
+    char* arg = input;
+    while (*arg && !is_space(*arg)) arg++;
+    if (*arg) {
+        *arg++ = '\0';
+        while (is_space(*arg)) arg++;
+    }
+
+    const char* name = nullptr;
+    ShellHandler handler = find_command(cmd, &name);
+    if (handler) {
+        TraceScope span(TRACE_SHELL, name, script_depth);
+        handler(arg);
+        return;
+    }
+
+    kprint("Unknown command: ");
+    kprint(cmd);
+    kprint("\n");
+}
+
+// Scripts
+
+static void run_error(const char* path, const char* reason) {
+    kprint("run: ");
+    kprint(path);
+    kprint(": ");
+    kprint(reason);
+    kprint("\n");
+}
+
+// Trim and execute one script line, echoing it like a typed command
+static void run_script_line(char* line, size_t len) {
+    while (len > 0 && (is_space(line[len - 1]) || line[len - 1] == '\r')) len--;
+    line[len] = '\0';
+    while (is_space(*line)) line++;
+    if (*line == '\0' || *line == '#') return;
+
+    kprint("> ");
+    kprint(line);
+    kprint("\n");
+    execute_command(line);
+}
+
+bool shell_run_script(const char* path) {
+    if (script_depth >= SHELL_SCRIPT_DEPTH) {
+        run_error(path, "scripts nested too deeply");
+        return false;
+    }
+    int fd = vfs_open(path, VFS_O_RDONLY);
+    if (fd < 0) {
+        run_error(path, vfs_strerror(fd));
+        return false;
+    }
+    script_depth++;
+
+    char line[SHELL_LINE_MAX];
+    size_t len = 0;
+    size_t line_no = 1;
+    uint8_t buf[256];
+    int64_t n = 0;
+    bool ok = true;
+    while (ok && (n = vfs_read(fd, buf, sizeof(buf))) > 0) {
+        for (int64_t i = 0; i < n; i++) {
+            char c = (char)buf[i];
+            if (c == '\n') {
+                run_script_line(line, len);
+                len = 0;
+                line_no++;
+            } else if (len < SHELL_LINE_MAX - 1) {
+                line[len++] = c;
+            } else {
+                kprint("run: "); kprint(path); kprint(": line ");
+                kprint_int((int64_t)line_no); kprint(" is too long\n");
+                ok = false;
+                break;
+            }
+        }
+    }
+    if (ok && n < 0) {
+        run_error(path, vfs_strerror((int)n));
+        ok = false;
+    }
+    if (ok) {
+        run_script_line(line, len); // Last line without a newline
+    }
+
+    vfs_close(fd);
+    script_depth--;
+    return ok;
+}
+
+// Built-in commands
+
+static void cmd_meminfo(char* arg) {
+    if (*arg != '\0') {
+        kprint("meminfo: this command takes no arguments\n");
+        return;
+    }
+    meminfo_command();
+}
+
+static void print_entry(const char* name, VnodeType type) {
+    kprint(name);
+    if (type == VnodeType::Directory) {
+        kprint("/");
+    }
+    kprint("\n");
+}
+
+static void cmd_ls(char* arg) {
+    const char* path = *arg ? arg : "/";
+    int fd = vfs_open(path, VFS_O_RDONLY);
+    if (fd < 0) {
+        kprint("ls: ");
+        kprint(path);
+        kprint(": ");
+        kprint(vfs_strerror(fd));
+        kprint("\n");
+        return;
+    }
+
+    VfsStat st;
+    vfs_fstat(fd, &st);
+    if (st.type != VnodeType::Directory) {
+        print_entry(path, st.type); // Like ls(1), a file lists as itself
+        vfs_close(fd);
+        return;
+    }
+
+    VfsDirent de;
+    size_t count = 0;
+    while (vfs_readdir(fd, &de) == 1) {
+        print_entry(de.name, de.type);
+        count++;
+    }
+    vfs_close(fd);
+    if (count == 0) {
+        kprint("(empty)\n");
+    }
+}
+
+static void cat_error(const char* path, int err) {
+    kprint("cat: ");
+    kprint(path);
+    kprint(": ");
+    kprint(vfs_strerror(err));
+    kprint("\n");
+}
+
+static void cat_bytes(const uint8_t* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        console.write_char((char)data[i]);
+        Serial::write_char((char)data[i]);
+    }
+}
+
+static void cmd_cat(char* arg) {
+    if (*arg == '\0') {
+        kprint("cat: missing file operand\n");
+        return;
+    }
+
+    int fd = vfs_open(arg, VFS_O_RDONLY);
+    if (fd < 0) {
+        cat_error(arg, fd);
+        return;
+    }
+
+    // Resident files are printed straight from their view; anything else
+    // is streamed through a small buffer.
+    char last = '\n';
+    VfsView view;
+    int err = vfs_map_view(fd, &view);
+    if (err == 0) {
+        cat_bytes(view.data, view.size);
+        if (view.size > 0) last = (char)view.data[view.size - 1];
+    } else if (err == VFS_ENOTSUP) {
+        uint8_t buf[256];
+        int64_t n;
+        while ((n = vfs_read(fd, buf, sizeof(buf))) > 0) {
+            cat_bytes(buf, (size_t)n);
+            last = (char)buf[n - 1];
+        }
+        err = n < 0 ? (int)n : 0;
+    }
+    vfs_close(fd);
+
+    if (err < 0) {
+        cat_error(arg, err);
+        return;
+    }
+    if (last != '\n') {
+        kprint("\n");
+    }
+}
+
+static void cmd_irqstat(char* arg) {
+    if (strcmp(arg, "reset") == 0) {
+        irqstat_reset();
+        kprint("irqstat: counters cleared\n");
+        return;
+    }
+    if (*arg != '\0') {
+        kprint("irqstat: usage: irqstat [reset]\n");
+        return;
+    }
+    irqstat_command();
+}
+
+static void cmd_lockstat(char* arg) {
+    if (strcmp(arg, "reset") == 0) {
+        lockstat_reset();
+        kprint("lockstat: counters cleared\n");
+        return;
+    }
+    if (*arg != '\0') {
+        kprint("lockstat: usage: lockstat [reset]\n");
+        return;
+    }
+    lockstat_command();
+}
+
+static void cmd_cr3bench(char* arg) {
+    if (*arg != '\0') {
+        kprint("cr3bench: this command takes no arguments\n");
+        return;
+    }
+    cr3_benchmark_command();
+}
+
+static void cmd_fbbench(char* arg) {
+    if (*arg != '\0') {
+        kprint("fbbench: this command takes no arguments\n");
+        return;
+    }
+    console.benchmark_flush();
+}
+
+static void cmd_strbench(char* arg) {
+    if (*arg != '\0') {
+        kprint("strbench: this command takes no arguments\n");
+        return;
+    }
+    string_benchmark_command();
+}
+
+static void fs_error(const char* cmd, const char* path, int err) {
+    kprint(cmd);
+    kprint(": ");
+    kprint(path);
+    kprint(": ");
+    kprint(vfs_strerror(err));
+    kprint("\n");
+}
+
+// write <path> <text>: replace the file's contents with text + newline
+static void cmd_write(char* arg) {
+    char* text = arg;
+    while (*text && !is_space(*text)) text++;
+    if (*arg == '\0' || *text == '\0') {
+        kprint("write: usage: write <path> <text>\n");
+        return;
+    }
+    *text++ = '\0';
+    while (is_space(*text)) text++;
+
+    int fd = vfs_open(arg, VFS_O_WRONLY | VFS_O_CREAT | VFS_O_TRUNC);
+    if (fd < 0) {
+        fs_error("write", arg, fd);
+        return;
+    }
+    int64_t n = vfs_write(fd, text, strlen(text));
+    if (n >= 0) n = vfs_write(fd, "\n", 1);
+    vfs_close(fd);
+    if (n < 0) {
+        fs_error("write", arg, (int)n);
+    }
+}
+
+static void cmd_mkdir(char* arg) {
+    if (*arg == '\0') {
+        kprint("mkdir: missing operand\n");
+        return;
+    }
+    int err = vfs_mkdir(arg);
+    if (err < 0) {
+        fs_error("mkdir", arg, err);
+    }
+}
+
+static void cmd_vfsstat(char* arg) {
+    if (*arg != '\0') {
+        kprint("vfsstat: this command takes no arguments\n");
+        return;
+    }
+    DcacheStats dc;
+    TmpfsStats tm;
+    Ext2Stats ex;
+    vfs_dcache_stats(&dc);
+    tmpfs_stats(&tm);
+    ext2_stats(&ex);
+
+    kprint("\n--- VFS ---\n");
+    kprint("dcache: "); kprint_int(dc.hits); kprint(" hits, ");
+    kprint_int(dc.misses); kprint(" misses, ");
+    kprint_int(dc.invalidations); kprint(" invalidations\n");
+    kprint("tmpfs : "); kprint_int(tm.nodes); kprint(" nodes, ");
+    kprint_int(tm.data_pages); kprint(" data pages, ");
+    kprint_int(tm.radix_pages); kprint(" radix pages, ");
+    kprint_int(tm.copy_ups); kprint(" copy-ups\n");
+    kprint("ext2  : "); kprint_int(ex.hashed_lookups); kprint(" hashed + ");
+    kprint_int(ex.linear_lookups); kprint(" linear lookups, ");
+    kprint_int(ex.dir_blocks); kprint(" dir blocks scanned, ");
+    kprint_int(ex.run_reads); kprint(" multi-block reads\n");
+}
+
+static void cmd_fsbench(char* arg) {
+    if (*arg == '\0') {
+        kprint("fsbench: usage: fsbench <file>\n");
+        return;
+    }
+    ext2_benchmark_command(arg);
+}
+
+static void cmd_tarbench(char* arg) {
+    size_t entries = 10000;
+    if (*arg != '\0' && (!parse_uint(arg, &entries) || entries == 0 || entries > 100000)) {
+        kprint("tarbench: usage: tarbench [entries], 1..100000\n");
+        return;
+    }
+    tarfs_bench(entries);
+}
+
+// blkbench [device] [pio]
+static void cmd_blkbench(char* arg) {
+    char* device = nullptr;
+    bool pio = false;
+    while (*arg) {
+        char* word = arg;
+        while (*arg && !is_space(*arg)) arg++;
+        if (*arg) *arg++ = '\0';
+        while (is_space(*arg)) arg++;
+
+        if (strcmp(word, "pio") == 0) {
+            pio = true;
+        } else if (!device) {
+            device = word;
+        } else {
+            kprint("blkbench: usage: blkbench [device] [pio]\n");
+            return;
+        }
+    }
+
+    bool old = ata_set_dma(!pio);
+    block_benchmark_command(device);
+    ata_set_dma(old);
+}
+
+static void cmd_blkstat(char* arg) {
+    if (*arg != '\0') {
+        kprint("blkstat: this command takes no arguments\n");
+        return;
+    }
+    if (!block_device(0)) {
+        kprint("blkstat: no block devices\n");
+        return;
+    }
+    kprint("\n--- Block devices ---\n");
+    for (int i = 0; block_device(i); i++) {
+        BlockDevice* dev = block_device(i);
+        kprint(dev->name); kprint(": ");
+        kprint_int(dev->sectors * BLOCK_SECTOR_SIZE / (1024 * 1024)); kprint(" MB, ");
+        kprint_int(dev->stats.requests); kprint(" requests, ");
+        kprint_int(dev->stats.merges); kprint(" merged, ");
+        kprint_int(dev->stats.dispatches); kprint(" commands, ");
+        kprint_int(dev->stats.sectors); kprint(" sectors, ");
+        kprint_int(dev->stats.errors); kprint(" errors, ");
+        kprint_int(dev->stats.timeouts); kprint(" timeouts\n");
+    }
+}
+
+static void cmd_cachestat(char* arg) {
+    if (strcmp(arg, "reset") == 0) {
+        bcache_reset_stats();
+        kprint("cachestat: counters cleared\n");
+        return;
+    }
+    if (*arg != '\0') {
+        kprint("cachestat: usage: cachestat [reset]\n");
+        return;
+    }
+    BcacheStats st;
+    bcache_stats(&st);
+    uint64_t lookups = st.hits + st.misses;
+    kprint("\n--- Buffer cache ---\n");
+    kprint("buffers   : "); kprint_int(st.buffers); kprint(" ("); kprint_int(st.buffers * BCACHE_BLOCK_SIZE / 1024);
+    kprint(" KB), "); kprint_int(st.dirty); kprint(" dirty, max "); kprint_int(BCACHE_MAX_BUFFERS); kprint("\n");
+    kprint("lookups   : "); kprint_int(st.hits); kprint(" hits, "); kprint_int(st.misses); kprint(" misses, ");
+    kprint_int(lookups ? st.hits * 100 / lookups : 0); kprint("% hit rate\n");
+    kprint("read-ahead: "); kprint_int(st.readahead); kprint(" blocks, "); kprint_int(st.readahead_hits); kprint(" used (");
+    kprint_int(st.readahead ? st.readahead_hits * 100 / st.readahead : 0); kprint("%), ");
+    kprint_int(st.readahead_wasted); kprint(" evicted unread\n");
+    kprint("evictions : "); kprint_int(st.evictions); kprint(", "); kprint_int(st.reclaimed);
+    kprint(" frames reclaimed by the PMM, "); kprint_int(st.writebacks); kprint(" blocks written back\n");
+}
+
+static void cmd_run(char* arg) {
+    if (*arg == '\0') {
+        kprint("run: usage: run <script>\n");
+        return;
+    }
+    shell_run_script(arg);
+}
+
+// time <command>: TSC cycles and wall time of one command
+static void cmd_time(char* arg) {
+    if (*arg == '\0') {
+        kprint("time: usage: time <command>\n");
+        return;
+    }
+    uint64_t start = rdtsc_ordered();
+    execute_command(arg);
+    uint64_t cycles = rdtsc_ordered() - start;
+
+    kprint("time: ");
+    kprint_int((int64_t)cycles);
+    kprint(" cycles, ");
+    kprint_int((int64_t)tsc_cycles_to_ns(cycles));
+    kprint(" ns\n");
+}
+
+// bench [name|list]
+static void cmd_bench(char* arg) {
+    if (strcmp(arg, "list") == 0) {
+        bench_list();
+        return;
+    }
+    if (!bench_run(*arg ? arg : nullptr)) {
+        kprint("bench: no such benchmark (try bench list)\n");
+    }
+}
+
+// QEMU's isa-debug-exit device (see `make bench`) ends the emulator with
+// status (code << 1) | 1 when `code` is written to its port
+#define DEBUG_EXIT_PORT 0xF4
+
+static void cmd_exit(char* arg) {
+    size_t code = 0;
+    if (*arg != '\0' && (!parse_uint(arg, &code) || code > 127)) {
+        kprint("exit: usage: exit [code], 0..127\n");
+        return;
+    }
+    outb(DEBUG_EXIT_PORT, (uint8_t)code);
+    kprint("exit: no isa-debug-exit device\n"); // Still running
+}
+
+static void cmd_history(char* arg) {
+    if (*arg != '\0') {
+        kprint("history: this command takes no arguments\n");
+        return;
+    }
+    tty_history_command();
+}
+
+static void cmd_kbdstat(char* arg) {
+    if (*arg != '\0') {
+        kprint("kbdstat: this command takes no arguments\n");
+        return;
+    }
+    KeyboardStats st;
+    keyboard_stats(&st);
+    const IrqStat* irq = irqstat_get(33); // IRQ 1
+    kprint("\n--- Keyboard ---\n");
+    kprint("scancodes : "); kprint_int(st.scancodes); kprint(" received, "); kprint_int(st.dropped); kprint(" dropped\n");
+    kprint("ring      : "); kprint_int(st.queued); kprint(" queued, "); kprint_int(st.max_queued);
+    kprint(" max, "); kprint_int(KEYBOARD_RING_SIZE); kprint(" slots\n");
+    kprint("IRQ 1     : "); kprint_int(irq->count ? irq->total_cycles / irq->count : 0);
+    kprint(" cycles avg, "); kprint_int(irq->max_cycles); kprint(" max\n");
+}
+
+// exec <program> [args...]: run an ELF64 binary in ring 3 until it exits
+static void cmd_exec(char* arg) {
+    char* argv[PROCESS_MAX_ARGS];
+    int argc = 0;
+    while (*arg != '\0') {
+        if (argc == PROCESS_MAX_ARGS) {
+            kprint("exec: too many arguments\n");
+            return;
+        }
+        argv[argc++] = next_word(&arg);
+    }
+    if (argc == 0) {
+        kprint("exec: usage: exec <program> [args...]\n");
+        return;
+    }
+
+    int status;
+    int err = process_exec(argv[0], argc, argv, &status);
+    if (err < 0) {
+        kprint("exec: "); kprint(argv[0]); kprint(": "); kprint(vfs_strerror(err)); kprint("\n");
+    } else if (status == PROCESS_KILLED) {
+        kprint("exec: "); kprint(argv[0]); kprint(": killed\n");
+    } else if (status != 0) {
+        kprint("exec: "); kprint(argv[0]); kprint(": exit status "); kprint_int(status); kprint("\n");
+    }
+}
+
+// prof [start [hz] [flat] | stop | dump | top [n]]
+static void cmd_prof(char* arg) {
+    char* sub = next_word(&arg);
+    if (*sub == '\0') {
+        prof_status();
+    } else if (strcmp(sub, "start") == 0) {
+        size_t hz = PROF_DEFAULT_HZ;
+        bool stacks = true;
+        while (*arg) {
+            char* word = next_word(&arg);
+            if (strcmp(word, "flat") == 0) {
+                stacks = false;
+            } else if (!parse_uint(word, &hz) || hz < PROF_MIN_HZ || hz > PROF_MAX_HZ) {
+                kprint("prof: usage: prof start [hz] [flat], hz 19..20000\n");
+                return;
+            }
+        }
+        if (prof_running()) {
+            kprint("prof: already running\n");
+        } else if (!prof_start((uint32_t)hz, stacks)) {
+            kprint("prof: out of memory\n");
+        } else {
+            prof_status();
+        }
+    } else if (strcmp(sub, "stop") == 0 && *arg == '\0') {
+        if (!prof_stop()) {
+            kprint("prof: not running\n");
+            return;
+        }
+        prof_status();
+    } else if ((strcmp(sub, "dump") == 0 && *arg == '\0') || strcmp(sub, "top") == 0) {
+        size_t n = PROF_TOP_DEFAULT;
+        if (*sub == 't' && *arg != '\0' && (!parse_uint(arg, &n) || n == 0 || n > PROF_TOP_DEFAULT * 2)) {
+            kprint("prof: usage: prof top [n], n 1..40\n");
+            return;
+        }
+        if (prof_running()) {
+            kprint("prof: stop the profiler first\n");
+        } else if (*sub == 'd') {
+            prof_dump_folded();
+        } else {
+            prof_top(n);
+        }
+    } else {
+        kprint("prof: usage: prof [start [hz] [flat] | stop | dump | top [n]]\n");
+    }
+}
+
+// trace [on [categories] | off [categories] | clear | dump]
+static void cmd_trace(char* arg) {
+    char* sub = next_word(&arg);
+    if (*sub == '\0') {
+        trace_status();
+    } else if (strcmp(sub, "on") == 0 || strcmp(sub, "off") == 0) {
+        uint32_t mask = TRACE_ALL;
+        if (*arg != '\0' && !trace_parse_mask(arg, &mask)) {
+            kprint("trace: unknown category, expected irq,syscall,shell,block,mm,proc or all\n");
+            return;
+        }
+        trace_set_mask(sub[1] == 'n' ? (trace_mask | mask) : (trace_mask & ~mask));
+        trace_status();
+    } else if (strcmp(sub, "clear") == 0 && *arg == '\0') {
+        trace_clear();
+        trace_status();
+    } else if (strcmp(sub, "dump") == 0 && *arg == '\0') {
+        trace_dump();
+    } else {
+        kprint("trace: usage: trace [on [categories] | off [categories] | clear | dump]\n");
+    }
+}
+
+// compact [blocks]
+static void cmd_compact(char* arg) {
+    size_t want = (size_t)-1;
+    if (*arg != '\0' && (!parse_uint(arg, &want) || want == 0)) {
+        kprint("compact: usage: compact [blocks]\n");
+        return;
+    }
+    PmmHugeStats before, after;
+    pmm.get_huge_stats(&before);
+    uint64_t freed = pmm.compact(want);
+    pmm.get_huge_stats(&after);
+
+    kprint("compact: freed "); kprint_int(freed); kprint(" 2MB blocks, moved ");
+    kprint_int(after.pages_moved - before.pages_moved); kprint(" pages in ");
+    kprint_int(tsc_cycles_to_ns(after.compact_cycles - before.compact_cycles) / 1000);
+    kprint(" us; "); kprint_int(after.free_blocks); kprint(" free\n");
+}
+
+static void cmd_boottime(char* arg) {
+    if (*arg != '\0') {
+        kprint("boottime: this command takes no arguments\n");
+        return;
+    }
+    boottime_command();
+}
+
+// cachebench [device]
+static void cmd_cachebench(char* arg) {
+    bcache_benchmark_command(*arg ? arg : nullptr);
+}
+
+// Every registered command, in registration order
+static void cmd_help(char* arg) {
+    if (*arg != '\0') {
+        kprint("help: this command takes no arguments\n");
+        return;
+    }
+    rcu_read_lock();
+    const CommandTable* t = rcu_dereference(current_table);
+    for (size_t i = 0; t && i < t->count; i++) {
+        kprint(i == 0 ? "" : " ");
+        kprint(t->entries[i].name);
+    }
+    rcu_read_unlock();
+    kprint("\n");
+}
+
+static const ShellCommand builtin_commands[] = {
+    {"help", cmd_help},
+    {"meminfo", cmd_meminfo},
+    {"ls", cmd_ls},
+    {"cat", cmd_cat},
+    {"irqstat", cmd_irqstat},
+    {"lockstat", cmd_lockstat},
+    {"cr3bench", cmd_cr3bench},
+    {"fbbench", cmd_fbbench},
+    {"tarbench", cmd_tarbench},
+    {"strbench", cmd_strbench},
+    {"write", cmd_write},
+    {"mkdir", cmd_mkdir},
+    {"vfsstat", cmd_vfsstat},
+    {"blkbench", cmd_blkbench},
+    {"blkstat", cmd_blkstat},
+    {"cachestat", cmd_cachestat},
+    {"cachebench", cmd_cachebench},
+    {"fsbench", cmd_fsbench},
+    {"history", cmd_history},
+    {"run", cmd_run},
+    {"time", cmd_time},
+    {"bench", cmd_bench},
+    {"exit", cmd_exit},
+    {"kbdstat", cmd_kbdstat},
+    {"exec", cmd_exec},
+    {"prof", cmd_prof},
+    {"trace", cmd_trace},
+    {"boottime", cmd_boottime},
+    {"compact", cmd_compact},
+};
+
+void shell_init() {
+    for (size_t i = 0; i < sizeof(builtin_commands) / sizeof(builtin_commands[0]); i++) {
+        const ShellCommand* c = &builtin_commands[i];
+        if (!shell_register_command(c->name, c->handler)) {
+            static const char prefix[] = "Shell: command table full, dropped ";
+            char msg[sizeof(prefix) + 16];
+            size_t len = strlen(c->name);
+            if (len > sizeof(msg) - sizeof(prefix)) len = sizeof(msg) - sizeof(prefix);
+            memcpy(msg, prefix, sizeof(prefix) - 1);
+            memcpy(msg + sizeof(prefix) - 1, c->name, len);
+            msg[sizeof(prefix) - 1 + len] = '\0';
+            klog(msg);
+        }
+    }
+}
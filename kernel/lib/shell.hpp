@@ -0,0 +1,28 @@
+#ifndef SHELL_HPP
+#define SHELL_HPP
+
+#include "types.h"
+
+#define SHELL_MAX_COMMANDS 64
+#define SHELL_LINE_MAX     128  // Longest command line, including the NUL
+#define SHELL_SCRIPT_DEPTH 4    // `run` inside a script nests this deep
+
+// Handler receives the argument string with leading blanks skipped
+// (empty string when no argument was given).
+typedef void (*ShellHandler)(char* arg);
+
+struct ShellCommand {
+    const char* name;
+    ShellHandler handler;
+};
+
+void shell_init(); // Register the built-in commands
+bool shell_register_command(const char* name, ShellHandler handler);
+void execute_command(char* input);
+
+// Execute each line of a file as a command (the `run` command). Blank lines
+// and lines starting with '#' are skipped. Problems are reported as
+// "run: <path>: ..."; false if the script could not be read to the end.
+bool shell_run_script(const char* path);
+
+#endif
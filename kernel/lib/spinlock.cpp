@@ -0,0 +1,76 @@
+#include "spinlock.hpp"
+#include "irqstat.hpp"
+#include "../drivers/console.hpp"
+
+#define LOCKSTAT_TOP 10
+
+static LockStats* lock_list = nullptr;
+
+uint64_t Spinlock::lock_irqsave() {
+    uint64_t flags = irq_save();
+    lock();
+    irqs_off_tsc = (flags & (1 << 9)) ? rdtsc() : 0;
+    return flags;
+}
+
+void Spinlock::unlock_irqrestore(uint64_t flags) {
+    uint64_t off_since = irqs_off_tsc;
+    unlock();
+    if (off_since) {
+        irqstat_note_irqs_off(rdtsc() - off_since, IRQSTAT_NO_VECTOR);
+    }
+    irq_restore(flags);
+}
+
+void lockstat_register(LockStats* stats) {
+    uint32_t expected = 0;
+    if (!__atomic_compare_exchange_n(&stats->registered, &expected, 1, false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+        return; // Someone else registered it first
+    }
+
+    LockStats* head = __atomic_load_n(&lock_list, __ATOMIC_RELAXED);
+    do {
+        stats->next = head;
+    } while (!__atomic_compare_exchange_n(&lock_list, &head, stats, true,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+void lockstat_reset() {
+    for (LockStats* s = __atomic_load_n(&lock_list, __ATOMIC_ACQUIRE); s; s = s->next) {
+        s->acquisitions = 0;
+        s->contended = 0;
+        s->spin_cycles = 0;
+    }
+}
+
+void lockstat_command() {
+    // Selection sort the hottest locks (by spin cycles, then contention) into a small table
+    LockStats* top[LOCKSTAT_TOP];
+    int n = 0;
+    for (LockStats* s = __atomic_load_n(&lock_list, __ATOMIC_ACQUIRE); s; s = s->next) {
+        int pos = n < LOCKSTAT_TOP ? n : LOCKSTAT_TOP;
+        while (pos > 0 &&
+               (top[pos - 1]->spin_cycles < s->spin_cycles ||
+                (top[pos - 1]->spin_cycles == s->spin_cycles && top[pos - 1]->contended < s->contended))) {
+            if (pos < LOCKSTAT_TOP) top[pos] = top[pos - 1];
+            pos--;
+        }
+        if (pos < LOCKSTAT_TOP) top[pos] = s;
+        if (n < LOCKSTAT_TOP) n++;
+    }
+
+    kprint("\n--- Lock Stats (hottest first) ---\n");
+    if (n == 0) {
+        kprint("(no locks taken yet)\n");
+    }
+    for (int i = 0; i < n; i++) {
+        LockStats* s = top[i];
+        kprint(s->name);
+        kprint(": acq="); kprint_int(s->acquisitions);
+        kprint(" contended="); kprint_int(s->contended);
+        kprint(" spin="); kprint_int(s->spin_cycles);
+        kprint(" cycles\n");
+    }
+    kprint("----------------------------------\n");
+}
@@ -0,0 +1,192 @@
+#ifndef SPINLOCK_HPP
+#define SPINLOCK_HPP
+
+#include "types.h"
+#include "cpu.hpp"
+
+// Set to 0 to compile lock statistics out of the fast path entirely
+#ifndef LOCK_STATS
+#define LOCK_STATS 1
+#endif
+
+// Contention statistics kept inside each named lock. Locks register
+// themselves on first acquisition so `lockstat` can find them.
+struct LockStats {
+    const char* name;
+    uint64_t acquisitions;
+    uint64_t contended;    // Acquisitions that had to spin
+    uint64_t spin_cycles;  // TSC cycles spent spinning
+    LockStats* next;
+    uint32_t registered;
+
+    constexpr LockStats(const char* n)
+        : name(n), acquisitions(0), contended(0), spin_cycles(0), next(nullptr), registered(0) {}
+};
+
+void lockstat_register(LockStats* stats);
+void lockstat_reset();
+void lockstat_command();
+
+static inline void lock_stats_note(LockStats* s, uint64_t spin_start) {
+#if LOCK_STATS
+    if (!s->name) return;
+    if (!s->registered) lockstat_register(s);
+    s->acquisitions++;
+    if (spin_start) {
+        s->contended++;
+        s->spin_cycles += rdtsc() - spin_start;
+    }
+#else
+    (void)s; (void)spin_start;
+#endif
+}
+
+static inline void cpu_relax() {
+    asm volatile("pause" ::: "memory");
+}
+
+// Disable interrupts and return the previous RFLAGS
+static inline uint64_t irq_save() {
+    uint64_t flags = read_rflags();
+    asm volatile("cli" ::: "memory");
+    return flags;
+}
+
+static inline void irq_restore(uint64_t flags) {
+    if (flags & (1 << 9)) {
+        asm volatile("sti" ::: "memory");
+    }
+}
+
+// Test-and-test-and-set spinlock. Use the *_irqsave variants for anything
+// that is also touched from interrupt handlers.
+class Spinlock {
+public:
+    constexpr Spinlock(const char* name = nullptr) : locked(0), irqs_off_tsc(0), stats(name) {}
+
+    bool try_lock() {
+        return __atomic_exchange_n(&locked, 1, __ATOMIC_ACQUIRE) == 0;
+    }
+
+    void lock() {
+        uint64_t spin_start = 0;
+        while (!try_lock()) {
+            if (!spin_start) spin_start = rdtsc();
+            while (__atomic_load_n(&locked, __ATOMIC_RELAXED)) {
+                cpu_relax();
+            }
+        }
+        lock_stats_note(&stats, spin_start);
+    }
+
+    void unlock() {
+        __atomic_store_n(&locked, 0, __ATOMIC_RELEASE);
+    }
+
+    uint64_t lock_irqsave();
+    void unlock_irqrestore(uint64_t flags);
+
+    bool is_locked() const { return __atomic_load_n(&locked, __ATOMIC_RELAXED) != 0; }
+
+private:
+    volatile uint32_t locked;
+    uint64_t irqs_off_tsc; // When lock_irqsave disabled interrupts (for irqstat)
+
+public:
+    LockStats stats;
+};
+
+// FIFO ticket lock: waiters are served strictly in arrival order
+class TicketLock {
+public:
+    constexpr TicketLock(const char* name = nullptr) : next_ticket(0), now_serving(0), stats(name) {}
+
+    void lock() {
+        uint32_t ticket = __atomic_fetch_add(&next_ticket, 1, __ATOMIC_RELAXED);
+        uint64_t spin_start = 0;
+        while (__atomic_load_n(&now_serving, __ATOMIC_ACQUIRE) != ticket) {
+            if (!spin_start) spin_start = rdtsc();
+            cpu_relax();
+        }
+        lock_stats_note(&stats, spin_start);
+    }
+
+    void unlock() {
+        __atomic_store_n(&now_serving, now_serving + 1, __ATOMIC_RELEASE);
+    }
+
+    uint64_t lock_irqsave() { uint64_t f = irq_save(); lock(); return f; }
+    void unlock_irqrestore(uint64_t flags) { unlock(); irq_restore(flags); }
+
+private:
+    uint32_t next_ticket;
+    volatile uint32_t now_serving;
+
+public:
+    LockStats stats;
+};
+
+// MCS queue lock: each waiter spins on its own node, so handoff touches a
+// single remote cache line no matter how many CPUs are queued.
+struct McsNode {
+    McsNode* volatile next;
+    volatile uint32_t locked;
+};
+
+class McsLock {
+public:
+    constexpr McsLock(const char* name = nullptr) : tail(nullptr), stats(name) {}
+
+    void lock(McsNode* node) {
+        node->next = nullptr;
+        node->locked = 1;
+        McsNode* prev = __atomic_exchange_n(&tail, node, __ATOMIC_ACQ_REL);
+        uint64_t spin_start = 0;
+        if (prev) {
+            spin_start = rdtsc();
+            __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+            while (__atomic_load_n(&node->locked, __ATOMIC_ACQUIRE)) {
+                cpu_relax();
+            }
+        }
+        lock_stats_note(&stats, spin_start);
+    }
+
+    void unlock(McsNode* node) {
+        McsNode* succ = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+        if (!succ) {
+            McsNode* expected = node;
+            if (__atomic_compare_exchange_n(&tail, &expected, nullptr, false,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+                return; // No one queued behind us
+            }
+            // A successor swapped the tail but has not linked itself yet
+            while (!(succ = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE))) {
+                cpu_relax();
+            }
+        }
+        __atomic_store_n(&succ->locked, 0, __ATOMIC_RELEASE);
+    }
+
+private:
+    McsNode* tail;
+
+public:
+    LockStats stats;
+};
+
+// Holds a Spinlock with interrupts disabled for the rest of the scope
+class ScopedIrqLock {
+public:
+    explicit ScopedIrqLock(Spinlock& l) : lock(l), flags(l.lock_irqsave()) {}
+    ~ScopedIrqLock() { lock.unlock_irqrestore(flags); }
+
+    ScopedIrqLock(const ScopedIrqLock&) = delete;
+    ScopedIrqLock& operator=(const ScopedIrqLock&) = delete;
+
+private:
+    Spinlock& lock;
+    uint64_t flags;
+};
+
+#endif
@@ -0,0 +1,520 @@
+#include "string.hpp"
+#include "cpu.hpp"
+#include "fpu.hpp"
+#include "tsc.hpp"
+#include "console.hpp"
+#include "../mm/heap.hpp"
+
+// Below this the kernel_fpu_begin/end bracket costs more than it saves
+#define SIMD_MIN_BYTES 256
+
+typedef void (*CopyFn)(void* dst, const void* src, size_t n);
+typedef void (*SetFn)(void* dst, uint8_t c, size_t n);
+typedef int (*CmpFn)(const uint8_t* a, const uint8_t* b, size_t n);
+typedef size_t (*LenFn)(const char* s);
+
+// Unaligned 64-bit access that does not break strict aliasing
+typedef uint64_t __attribute__((may_alias, aligned(1))) unaligned_u64;
+
+#define ONES  0x0101010101010101ULL
+#define HIGHS 0x8080808080808080ULL
+
+// ---------------------------------------------------------------------------
+// memcpy variants. All of them copy forward and load each block before
+// storing it, which memmove relies on when dst < src.
+
+static void copy_bytes(void* dst, const void* src, size_t n) {
+    uint8_t* d = (uint8_t*)dst;
+    const uint8_t* s = (const uint8_t*)src;
+    for (size_t i = 0; i < n; i++) d[i] = s[i];
+}
+
+static void copy_movsq(void* dst, const void* src, size_t n) {
+    size_t qwords = n / 8;
+    size_t tail = n % 8;
+    asm volatile("rep movsq\n\t"
+                 "mov %3, %%rcx\n\t"
+                 "rep movsb"
+                 : "+D"(dst), "+S"(src), "+c"(qwords)
+                 : "r"(tail)
+                 : "memory");
+}
+
+// Byte-granular everywhere, and as fast as the vector loops on CPUs with
+// ERMS (Enhanced REP MOVSB/STOSB)
+static void copy_movsb(void* dst, const void* src, size_t n) {
+    asm volatile("rep movsb" : "+D"(dst), "+S"(src), "+c"(n) : : "memory");
+}
+
+// Callers hold kernel_fpu_begin()
+__attribute__((target("sse2")))
+static void copy_sse2(void* dst, const void* src, size_t n) {
+    uint8_t* d = (uint8_t*)dst;
+    const uint8_t* s = (const uint8_t*)src;
+
+    // Align the destination so no store splits a cache line
+    size_t head = (16 - ((uint64_t)d & 15)) & 15;
+    if (head > n) head = n;
+    copy_movsb(d, s, head);
+    d += head;
+    s += head;
+    n -= head;
+
+    size_t blocks = n / 64;
+    if (blocks) {
+        asm volatile("1:\n\t"
+                     "movdqu (%1), %%xmm0\n\t"
+                     "movdqu 16(%1), %%xmm1\n\t"
+                     "movdqu 32(%1), %%xmm2\n\t"
+                     "movdqu 48(%1), %%xmm3\n\t"
+                     "movdqa %%xmm0, (%0)\n\t"
+                     "movdqa %%xmm1, 16(%0)\n\t"
+                     "movdqa %%xmm2, 32(%0)\n\t"
+                     "movdqa %%xmm3, 48(%0)\n\t"
+                     "add $64, %0\n\t"
+                     "add $64, %1\n\t"
+                     "dec %2\n\t"
+                     "jnz 1b"
+                     : "+r"(d), "+r"(s), "+r"(blocks)
+                     :
+                     : "xmm0", "xmm1", "xmm2", "xmm3", "memory");
+    }
+    copy_movsb(d, s, n % 64);
+}
+
+__attribute__((target("avx")))
+static void copy_avx(void* dst, const void* src, size_t n) {
+    uint8_t* d = (uint8_t*)dst;
+    const uint8_t* s = (const uint8_t*)src;
+
+    size_t head = (32 - ((uint64_t)d & 31)) & 31;
+    if (head > n) head = n;
+    copy_movsb(d, s, head);
+    d += head;
+    s += head;
+    n -= head;
+
+    size_t blocks = n / 128;
+    if (blocks) {
+        asm volatile("1:\n\t"
+                     "vmovdqu (%1), %%ymm0\n\t"
+                     "vmovdqu 32(%1), %%ymm1\n\t"
+                     "vmovdqu 64(%1), %%ymm2\n\t"
+                     "vmovdqu 96(%1), %%ymm3\n\t"
+                     "vmovdqa %%ymm0, (%0)\n\t"
+                     "vmovdqa %%ymm1, 32(%0)\n\t"
+                     "vmovdqa %%ymm2, 64(%0)\n\t"
+                     "vmovdqa %%ymm3, 96(%0)\n\t"
+                     "add $128, %0\n\t"
+                     "add $128, %1\n\t"
+                     "dec %2\n\t"
+                     "jnz 1b\n\t"
+                     "vzeroupper" // Avoid the AVX-SSE transition penalty
+                     : "+r"(d), "+r"(s), "+r"(blocks)
+                     :
+                     : "xmm0", "xmm1", "xmm2", "xmm3", "memory");
+    }
+    copy_movsb(d, s, n % 128);
+}
+
+// ---------------------------------------------------------------------------
+// memset variants
+
+static void set_bytes(void* dst, uint8_t c, size_t n) {
+    uint8_t* d = (uint8_t*)dst;
+    for (size_t i = 0; i < n; i++) d[i] = c;
+}
+
+static void set_movsq(void* dst, uint8_t c, size_t n) {
+    size_t qwords = n / 8;
+    size_t tail = n % 8;
+    asm volatile("rep stosq\n\t"
+                 "mov %2, %%rcx\n\t"
+                 "rep stosb"
+                 : "+D"(dst), "+c"(qwords)
+                 : "r"(tail), "a"(c * ONES)
+                 : "memory");
+}
+
+static void set_movsb(void* dst, uint8_t c, size_t n) {
+    asm volatile("rep stosb" : "+D"(dst), "+c"(n) : "a"(c) : "memory");
+}
+
+__attribute__((target("sse2")))
+static void set_sse2(void* dst, uint8_t c, size_t n) {
+    uint8_t* d = (uint8_t*)dst;
+    size_t head = (16 - ((uint64_t)d & 15)) & 15;
+    if (head > n) head = n;
+    set_movsb(d, c, head);
+    d += head;
+    n -= head;
+
+    size_t blocks = n / 64;
+    if (blocks) {
+        asm volatile("movq %2, %%xmm0\n\t"
+                     "punpcklqdq %%xmm0, %%xmm0\n\t"
+                     "1:\n\t"
+                     "movdqa %%xmm0, (%0)\n\t"
+                     "movdqa %%xmm0, 16(%0)\n\t"
+                     "movdqa %%xmm0, 32(%0)\n\t"
+                     "movdqa %%xmm0, 48(%0)\n\t"
+                     "add $64, %0\n\t"
+                     "dec %1\n\t"
+                     "jnz 1b"
+                     : "+r"(d), "+r"(blocks)
+                     : "r"(c * ONES)
+                     : "xmm0", "memory");
+    }
+    set_movsb(d, c, n % 64);
+}
+
+__attribute__((target("avx")))
+static void set_avx(void* dst, uint8_t c, size_t n) {
+    uint8_t* d = (uint8_t*)dst;
+    size_t head = (32 - ((uint64_t)d & 31)) & 31;
+    if (head > n) head = n;
+    set_movsb(d, c, head);
+    d += head;
+    n -= head;
+
+    size_t blocks = n / 128;
+    if (blocks) {
+        asm volatile("vmovq %2, %%xmm0\n\t"
+                     "vpunpcklqdq %%xmm0, %%xmm0, %%xmm0\n\t"
+                     "vinsertf128 $1, %%xmm0, %%ymm0, %%ymm0\n\t"
+                     "1:\n\t"
+                     "vmovdqa %%ymm0, (%0)\n\t"
+                     "vmovdqa %%ymm0, 32(%0)\n\t"
+                     "vmovdqa %%ymm0, 64(%0)\n\t"
+                     "vmovdqa %%ymm0, 96(%0)\n\t"
+                     "add $128, %0\n\t"
+                     "dec %1\n\t"
+                     "jnz 1b\n\t"
+                     "vzeroupper"
+                     : "+r"(d), "+r"(blocks)
+                     : "r"(c * ONES)
+                     : "xmm0", "memory");
+    }
+    set_movsb(d, c, n % 128);
+}
+
+// ---------------------------------------------------------------------------
+// memcmp variants
+
+static int cmp_bytes(const uint8_t* a, const uint8_t* b, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (a[i] != b[i]) return a[i] - b[i];
+    }
+    return 0;
+}
+
+static int cmp_words(const uint8_t* a, const uint8_t* b, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        if (*(const unaligned_u64*)(a + i) != *(const unaligned_u64*)(b + i)) break;
+    }
+    return cmp_bytes(a + i, b + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static int cmp_sse2(const uint8_t* a, const uint8_t* b, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint32_t equal;
+        asm volatile("movdqu (%1), %%xmm0\n\t"
+                     "movdqu (%2), %%xmm1\n\t"
+                     "pcmpeqb %%xmm1, %%xmm0\n\t"
+                     "pmovmskb %%xmm0, %0"
+                     : "=r"(equal)
+                     : "r"(a + i), "r"(b + i)
+                     : "xmm0", "xmm1", "memory");
+        if (equal != 0xFFFF) {
+            size_t j = i + __builtin_ctz(~equal);
+            return a[j] - b[j];
+        }
+    }
+    return cmp_bytes(a + i, b + i, n - i);
+}
+
+// ---------------------------------------------------------------------------
+// strlen variants. The word and vector scans only ever load naturally
+// aligned blocks, so they cannot run into an unmapped page past the NUL.
+
+static size_t len_bytes(const char* s) {
+    size_t n = 0;
+    while (s[n]) n++;
+    return n;
+}
+
+static size_t len_words(const char* s) {
+    const char* p = s;
+    for (; (uint64_t)p & 7; p++) {
+        if (*p == '\0') return p - s;
+    }
+    const uint64_t* w = (const uint64_t*)p;
+    // Classic has-zero-byte test: only a 0x00 byte borrows into its own high bit
+    while (((*w - ONES) & ~*w & HIGHS) == 0) w++;
+    p = (const char*)w;
+    while (*p) p++;
+    return p - s;
+}
+
+__attribute__((target("sse2")))
+static size_t len_sse2(const char* s) {
+    const char* p = (const char*)((uint64_t)s & ~15ULL);
+    uint32_t zeros;
+    asm volatile("pxor %%xmm1, %%xmm1\n\t"
+                 "movdqa (%1), %%xmm0\n\t"
+                 "pcmpeqb %%xmm1, %%xmm0\n\t"
+                 "pmovmskb %%xmm0, %0"
+                 : "=r"(zeros) : "r"(p) : "xmm0", "xmm1", "memory");
+    zeros >>= (s - p); // Ignore bytes before the string
+    if (zeros) return __builtin_ctz(zeros);
+
+    for (;;) {
+        p += 16;
+        asm volatile("pxor %%xmm1, %%xmm1\n\t"
+                     "movdqa (%1), %%xmm0\n\t"
+                     "pcmpeqb %%xmm1, %%xmm0\n\t"
+                     "pmovmskb %%xmm0, %0"
+                     : "=r"(zeros) : "r"(p) : "xmm0", "xmm1", "memory");
+        if (zeros) return (size_t)(p - s) + __builtin_ctz(zeros);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Dispatch. The defaults need nothing beyond x86_64 itself, so the
+// compiler-emitted calls made before string_init() are safe.
+
+static CopyFn copy_small = copy_movsq;
+static CopyFn copy_simd = nullptr;   // Used under kernel_fpu_begin()
+static SetFn set_small = set_movsq;
+static SetFn set_simd = nullptr;
+static CmpFn cmp_small = cmp_words;
+static CmpFn cmp_simd = nullptr;
+static bool erms = false;
+
+extern "C" void* memcpy(void* dst, const void* src, size_t n) {
+    if (n >= SIMD_MIN_BYTES && copy_simd && kernel_fpu_begin()) {
+        copy_simd(dst, src, n);
+        kernel_fpu_end();
+    } else {
+        copy_small(dst, src, n);
+    }
+    return dst;
+}
+
+extern "C" void* memmove(void* dst, const void* src, size_t n) {
+    uint8_t* d = (uint8_t*)dst;
+    const uint8_t* s = (const uint8_t*)src;
+    if (d <= s || d >= s + n) {
+        return memcpy(dst, src, n); // Forward copies are safe here (see above)
+    }
+    // Overlapping with dst above src: copy from the end down. No std/rep:
+    // an interrupt inside that window would run its handler with DF=1.
+    while (n & 7) {
+        n--;
+        d[n] = s[n];
+    }
+    while (n != 0) {
+        n -= 8;
+        *(unaligned_u64*)(d + n) = *(const unaligned_u64*)(s + n);
+    }
+    return dst;
+}
+
+extern "C" void* memset(void* dst, int c, size_t n) {
+    if (n >= SIMD_MIN_BYTES && set_simd && kernel_fpu_begin()) {
+        set_simd(dst, (uint8_t)c, n);
+        kernel_fpu_end();
+    } else {
+        set_small(dst, (uint8_t)c, n);
+    }
+    return dst;
+}
+
+extern "C" int memcmp(const void* a, const void* b, size_t n) {
+    const uint8_t* pa = (const uint8_t*)a;
+    const uint8_t* pb = (const uint8_t*)b;
+    if (n >= SIMD_MIN_BYTES && cmp_simd && kernel_fpu_begin()) {
+        int r = cmp_simd(pa, pb, n);
+        kernel_fpu_end();
+        return r;
+    }
+    return cmp_small(pa, pb, n);
+}
+
+// Kernel strings are short: the length is unknown up front, so the vector
+// scan could never amortize the FPU bracket.
+extern "C" size_t strlen(const char* s) {
+    return len_words(s);
+}
+
+extern "C" int strcmp(const char* s1, const char* s2) {
+    while (*s1 && (*s1 == *s2)) {
+        s1++;
+        s2++;
+    }
+    return *(const unsigned char*)s1 - *(const unsigned char*)s2;
+}
+
+void memset16(uint16_t* dst, uint16_t value, size_t count) {
+    asm volatile("rep stosw" : "+D"(dst), "+c"(count) : "a"(value) : "memory");
+}
+
+void string_init() {
+    uint32_t max_leaf, b, c, d;
+    cpuid(0, 0, &max_leaf, &b, &c, &d);
+    if (max_leaf >= 7) {
+        uint32_t a;
+        cpuid(7, 0, &a, &b, &c, &d);
+        erms = (b & (1 << 9)) != 0;
+    }
+
+    // With ERMS the microcode moves whole cache lines and needs no FPU
+    // bracket, so the vector loops are only worth it on older CPUs.
+    if (erms) {
+        copy_small = copy_movsb;
+        set_small = set_movsb;
+    } else {
+        copy_simd = fpu_avx_enabled() ? copy_avx : copy_sse2;
+        set_simd = fpu_avx_enabled() ? set_avx : set_sse2;
+    }
+    cmp_simd = cmp_sse2;
+
+    kprint("STRING: memcpy/memset ");
+    if (erms) {
+        kprint("rep movsb (ERMS)");
+    } else {
+        kprint(fpu_avx_enabled() ? "AVX" : "SSE2");
+        kprint(" from "); kprint_int(SIMD_MIN_BYTES); kprint(" B");
+    }
+    kprint(", memcmp SSE2, strlen word-at-a-time\n");
+}
+
+// ---------------------------------------------------------------------------
+// Benchmark
+
+#define BENCH_BUF_SIZE    (64 * 1024)
+#define BENCH_TOTAL_BYTES (2 * 1024 * 1024) // Per variant and size
+
+enum BenchOp { OP_COPY, OP_SET, OP_CMP, OP_LEN };
+
+struct BenchVariant {
+    const char* name;
+    BenchOp op;
+    bool simd;  // Run inside one kernel_fpu_begin/end
+    CopyFn copy;
+    SetFn set;
+    CmpFn cmp;
+    LenFn len;
+};
+
+// The public entry points, dispatch and FPU bracket included
+static void dispatch_copy(void* dst, const void* src, size_t n) { memcpy(dst, src, n); }
+static void dispatch_set(void* dst, uint8_t c, size_t n) { memset(dst, c, n); }
+static int dispatch_cmp(const uint8_t* a, const uint8_t* b, size_t n) { return memcmp(a, b, n); }
+static size_t dispatch_len(const char* s) { return strlen(s); }
+
+static const BenchVariant bench_variants[] = {
+    {"memcpy  bytes    ", OP_COPY, false, copy_bytes, nullptr, nullptr, nullptr},
+    {"memcpy  rep movsq", OP_COPY, false, copy_movsq, nullptr, nullptr, nullptr},
+    {"memcpy  rep movsb", OP_COPY, false, copy_movsb, nullptr, nullptr, nullptr},
+    {"memcpy  SSE2     ", OP_COPY, true, copy_sse2, nullptr, nullptr, nullptr},
+    {"memcpy  AVX      ", OP_COPY, true, copy_avx, nullptr, nullptr, nullptr},
+    {"memcpy()         ", OP_COPY, false, dispatch_copy, nullptr, nullptr, nullptr},
+    {"memset  bytes    ", OP_SET, false, nullptr, set_bytes, nullptr, nullptr},
+    {"memset  rep stosq", OP_SET, false, nullptr, set_movsq, nullptr, nullptr},
+    {"memset  rep stosb", OP_SET, false, nullptr, set_movsb, nullptr, nullptr},
+    {"memset  SSE2     ", OP_SET, true, nullptr, set_sse2, nullptr, nullptr},
+    {"memset  AVX      ", OP_SET, true, nullptr, set_avx, nullptr, nullptr},
+    {"memset()         ", OP_SET, false, nullptr, dispatch_set, nullptr, nullptr},
+    {"memcmp  bytes    ", OP_CMP, false, nullptr, nullptr, cmp_bytes, nullptr},
+    {"memcmp  words    ", OP_CMP, false, nullptr, nullptr, cmp_words, nullptr},
+    {"memcmp  SSE2     ", OP_CMP, true, nullptr, nullptr, cmp_sse2, nullptr},
+    {"memcmp()         ", OP_CMP, false, nullptr, nullptr, dispatch_cmp, nullptr},
+    {"strlen  bytes    ", OP_LEN, false, nullptr, nullptr, nullptr, len_bytes},
+    {"strlen  words    ", OP_LEN, false, nullptr, nullptr, nullptr, len_words},
+    {"strlen  SSE2     ", OP_LEN, true, nullptr, nullptr, nullptr, len_sse2},
+    {"strlen()         ", OP_LEN, false, nullptr, nullptr, nullptr, dispatch_len},
+};
+
+static const size_t bench_sizes[] = {64, 4096, BENCH_BUF_SIZE};
+
+// Operands for each op: memcmp compares equal buffers (full scan) and
+// strlen scans a string of `size - 1` bytes
+static void bench_prepare(BenchOp op, uint8_t* a, uint8_t* b, size_t size) {
+    set_movsb(a, 'x', BENCH_BUF_SIZE);
+    set_movsb(b, 'x', BENCH_BUF_SIZE);
+    if (op == OP_LEN) a[size - 1] = '\0';
+}
+
+static uint64_t bench_run(const BenchVariant* v, uint8_t* a, uint8_t* b, size_t size) {
+    size_t rounds = BENCH_TOTAL_BYTES / size;
+    volatile uint64_t sink = 0;
+
+    if (v->simd && !kernel_fpu_begin()) return 0;
+    uint64_t start = rdtsc();
+    switch (v->op) {
+    case OP_COPY:
+        for (size_t r = 0; r < rounds; r++) v->copy(a, b, size);
+        break;
+    case OP_SET:
+        for (size_t r = 0; r < rounds; r++) v->set(a, (uint8_t)r, size);
+        break;
+    case OP_CMP:
+        for (size_t r = 0; r < rounds; r++) sink += v->cmp(a, b, size);
+        break;
+    case OP_LEN:
+        for (size_t r = 0; r < rounds; r++) sink += v->len((const char*)a);
+        break;
+    }
+    uint64_t cycles = rdtsc() - start;
+    if (v->simd) kernel_fpu_end();
+    (void)sink;
+    return cycles;
+}
+
+static void print_column(uint64_t value) {
+    int digits = 1;
+    for (uint64_t v = value; v >= 10; v /= 10) digits++;
+    for (int i = digits; i < 9; i++) kprint(" ");
+    kprint_int(value);
+}
+
+void string_benchmark_command() {
+    uint8_t* a = (uint8_t*)kmalloc(BENCH_BUF_SIZE);
+    uint8_t* b = (uint8_t*)kmalloc(BENCH_BUF_SIZE);
+    if (!a || !b) {
+        kprint("strbench: out of memory\n");
+        kfree(a);
+        kfree(b);
+        return;
+    }
+
+    kprint("\n--- String routines, MB/s (");
+    kprint_int(BENCH_TOTAL_BYTES / 1024); kprint(" KB per cell) ---\n");
+    kprint("                         64 B     4 KB    64 KB\n");
+    for (size_t i = 0; i < sizeof(bench_variants) / sizeof(bench_variants[0]); i++) {
+        const BenchVariant* v = &bench_variants[i];
+        kprint("  "); kprint(v->name);
+        if (v->copy == copy_avx || v->set == set_avx) {
+            if (!fpu_avx_enabled()) {
+                kprint("   (AVX not enabled)\n");
+                continue;
+            }
+        }
+        for (size_t s = 0; s < sizeof(bench_sizes) / sizeof(bench_sizes[0]); s++) {
+            bench_prepare(v->op, a, b, bench_sizes[s]);
+            uint64_t cycles = bench_run(v, a, b, bench_sizes[s]);
+            uint64_t bytes = (BENCH_TOTAL_BYTES / bench_sizes[s]) * bench_sizes[s];
+            print_column(tsc_mb_per_sec(bytes, cycles));
+        }
+        kprint("\n");
+    }
+    kprint("  rep movsb/stosb fast path (ERMS): "); kprint(erms ? "yes" : "no");
+    kprint(", AVX: "); kprint(fpu_avx_enabled() ? "yes" : "no"); kprint("\n");
+
+    kfree(a);
+    kfree(b);
+}
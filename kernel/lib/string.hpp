@@ -0,0 +1,28 @@
+#ifndef STRING_HPP
+#define STRING_HPP
+
+#include "types.h"
+
+// Freestanding mem*/str* routines. The compiler may also emit calls to
+// memcpy/memset/memmove/memcmp for struct copies and large initializers,
+// so these use C linkage and are usable from the first instruction of
+// kernel_main (the integer variants are selected until string_init()).
+extern "C" {
+void* memcpy(void* dst, const void* src, size_t n);
+void* memmove(void* dst, const void* src, size_t n);
+void* memset(void* dst, int c, size_t n);
+int memcmp(const void* a, const void* b, size_t n);
+size_t strlen(const char* s);
+int strcmp(const char* s1, const char* s2);
+}
+
+// Fill `count` 16-bit cells (VGA text entries)
+void memset16(uint16_t* dst, uint16_t value, size_t count);
+
+// Pick variants from CPUID (ERMS, AVX). Call after fpu_init().
+void string_init();
+
+// Per-variant throughput at a few sizes (the `strbench` command)
+void string_benchmark_command();
+
+#endif
@@ -0,0 +1,170 @@
+#include "trace.hpp"
+#include "percpu.hpp"
+#include "string.hpp"
+#include "tsc.hpp"
+#include "../drivers/console.hpp"
+#include "../drivers/serial.hpp"
+
+struct TraceEvent {
+    uint64_t tsc;
+    const char* name;
+    uint32_t arg;
+    uint8_t category;  // Bit index
+    char phase;
+    uint16_t reserved;
+};
+
+// `head` counts every event ever recorded; the ring keeps the last
+// TRACE_RING_SIZE. A slot is claimed with an atomic add so an interrupt
+// handler tracing in the middle of another event takes the next slot.
+struct alignas(CACHE_LINE_SIZE) TraceRing {
+    uint64_t head;
+    TraceEvent events[TRACE_RING_SIZE];
+};
+
+uint32_t trace_mask = 0;
+static TraceRing rings[MAX_CPUS];
+
+static const char* const category_names[TRACE_CATEGORIES] = {
+    "irq", "syscall", "shell", "block", "mm", "proc"
+};
+
+void trace_record(uint32_t category, const char* name, char phase, uint64_t arg, uint64_t tsc) {
+    TraceRing* r = &rings[cpu_id()];
+    uint64_t slot = __atomic_fetch_add(&r->head, 1, __ATOMIC_RELAXED);
+    TraceEvent* e = &r->events[slot & (TRACE_RING_SIZE - 1)];
+    e->tsc = tsc;
+    e->name = name;
+    e->arg = (uint32_t)arg;
+    e->category = (uint8_t)__builtin_ctz(category);
+    e->phase = phase;
+}
+
+bool trace_parse_mask(const char* list, uint32_t* out) {
+    uint32_t mask = 0;
+    while (*list) {
+        const char* end = list;
+        while (*end && *end != ',') end++;
+        size_t len = end - list;
+
+        if (len == 3 && memcmp(list, "all", 3) == 0) {
+            mask |= TRACE_ALL;
+        } else if (len == 4 && memcmp(list, "none", 4) == 0) {
+            // Nothing
+        } else {
+            int i = 0;
+            for (; i < TRACE_CATEGORIES; i++) {
+                if (strlen(category_names[i]) == len && memcmp(list, category_names[i], len) == 0) break;
+            }
+            if (i == TRACE_CATEGORIES) return false;
+            mask |= 1u << i;
+        }
+        list = *end ? end + 1 : end;
+    }
+    *out = mask;
+    return true;
+}
+
+void trace_set_mask(uint32_t mask) {
+    __atomic_store_n(&trace_mask, mask & TRACE_ALL, __ATOMIC_RELAXED);
+}
+
+void trace_clear() {
+    for (int i = 0; i < MAX_CPUS; i++) {
+        __atomic_store_n(&rings[i].head, 0, __ATOMIC_RELAXED);
+    }
+}
+
+static void serial_uint(uint64_t n, int min_digits) {
+    char buf[21];
+    int i = sizeof(buf) - 1;
+    buf[i] = '\0';
+    do {
+        buf[--i] = (char)('0' + n % 10);
+        n /= 10;
+        min_digits--;
+    } while (n > 0 || min_digits > 0);
+    Serial::write_string(&buf[i]);
+}
+
+static void print_mask(uint32_t mask) {
+    if (mask == 0) {
+        kprint("none");
+        return;
+    }
+    bool first = true;
+    for (int i = 0; i < TRACE_CATEGORIES; i++) {
+        if (mask & (1u << i)) {
+            if (!first) kprint(",");
+            kprint(category_names[i]);
+            first = false;
+        }
+    }
+}
+
+// Microseconds since TSC reset with nanosecond decimals, as "ts" wants
+static void write_ts(uint64_t tsc) {
+    uint64_t ns = tsc_cycles_to_ns(tsc);
+    serial_uint(ns / 1000, 1);
+    Serial::write_char('.');
+    serial_uint(ns % 1000, 3);
+}
+
+void trace_dump() {
+    // Tracepoints would race with the reader; stop them while we stream
+    uint32_t saved = trace_mask;
+    trace_set_mask(0);
+
+    uint64_t written = 0;
+    Serial::write_string("TRACE_BEGIN\n{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        TraceRing* r = &rings[cpu];
+        uint64_t head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+        if (head == 0) continue;
+
+        if (written) Serial::write_string(",\n");
+        Serial::write_string("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":");
+        serial_uint(cpu, 1);
+        Serial::write_string(",\"args\":{\"name\":\"cpu");
+        serial_uint(cpu, 1);
+        Serial::write_string("\"}}");
+
+        uint64_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+        for (uint64_t i = first; i < head; i++) {
+            const TraceEvent* e = &r->events[i & (TRACE_RING_SIZE - 1)];
+            Serial::write_string(",\n{\"name\":\"");
+            Serial::write_string(e->name);
+            Serial::write_string("\",\"cat\":\"");
+            Serial::write_string(category_names[e->category]);
+            Serial::write_string("\",\"ph\":\"");
+            Serial::write_char(e->phase);
+            Serial::write_string("\",\"ts\":");
+            write_ts(e->tsc);
+            Serial::write_string(",\"pid\":0,\"tid\":");
+            serial_uint(cpu, 1);
+            if (e->phase == TRACE_PH_INSTANT) Serial::write_string(",\"s\":\"t\"");
+            Serial::write_string(",\"args\":{\"arg\":");
+            serial_uint(e->arg, 1);
+            Serial::write_string("}}");
+            written++;
+        }
+    }
+    Serial::write_string("\n]}\nTRACE_END\n");
+    trace_set_mask(saved);
+
+    kprint("trace: "); kprint_int((int64_t)written); kprint(" events written to serial\n");
+}
+
+void trace_status() {
+    kprint("trace: mask "); print_mask(trace_mask);
+    for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        uint64_t head = rings[cpu].head;
+        if (head == 0) continue;
+        kprint(", cpu"); kprint_int(cpu); kprint(" ");
+        kprint_int((int64_t)head); kprint(" events");
+        if (head > TRACE_RING_SIZE) {
+            kprint(" ("); kprint_int((int64_t)(head - TRACE_RING_SIZE)); kprint(" overwritten)");
+        }
+    }
+    kprint("\n");
+}
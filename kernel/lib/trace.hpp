@@ -0,0 +1,81 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include "types.h"
+#include "cpu.hpp"
+
+// Static tracepoints. Each records (TSC, name, phase, argument) into the
+// executing CPU's ring of the last TRACE_RING_SIZE events, but only while
+// its category is set in trace_mask; otherwise a tracepoint costs one load
+// and a not-taken branch. `trace dump` exports the rings as Chrome
+// trace-event JSON (Perfetto, chrome://tracing).
+#define TRACE_RING_SIZE 4096  // Events per CPU, a power of two
+
+// Categories (bits of trace_mask)
+#define TRACE_IRQ     (1u << 0)  // Hardware interrupt handlers
+#define TRACE_SYSCALL (1u << 1)
+#define TRACE_SHELL   (1u << 2)  // One span per shell command
+#define TRACE_BLOCK   (1u << 3)  // Block request submission and completion
+#define TRACE_MM      (1u << 4)
+#define TRACE_PROC    (1u << 5)  // Process lifetimes
+#define TRACE_CATEGORIES 6
+#define TRACE_ALL     ((1u << TRACE_CATEGORIES) - 1)
+
+// Event phases, as in the Chrome format
+#define TRACE_PH_BEGIN   'B'
+#define TRACE_PH_END     'E'
+#define TRACE_PH_INSTANT 'i'
+
+extern uint32_t trace_mask;
+
+// `name` must be a string that lives forever (a literal)
+void trace_record(uint32_t category, const char* name, char phase, uint64_t arg, uint64_t tsc);
+
+#define TRACE_ENABLED(category) \
+    __builtin_expect((__atomic_load_n(&trace_mask, __ATOMIC_RELAXED) & (category)) != 0, 0)
+
+#define TRACE_BEGIN(category, name, arg) do { \
+    if (TRACE_ENABLED(category)) trace_record((category), (name), TRACE_PH_BEGIN, (arg), rdtsc()); \
+} while (0)
+
+#define TRACE_END(category, name, arg) do { \
+    if (TRACE_ENABLED(category)) trace_record((category), (name), TRACE_PH_END, (arg), rdtsc()); \
+} while (0)
+
+#define TRACE_INSTANT(category, name, arg) do { \
+    if (TRACE_ENABLED(category)) trace_record((category), (name), TRACE_PH_INSTANT, (arg), rdtsc()); \
+} while (0)
+
+// Span over the rest of the enclosing block. The end is recorded if the
+// begin was, even if the mask changes in between.
+class TraceScope {
+public:
+    TraceScope(uint32_t category, const char* name, uint64_t arg = 0)
+        : category(category), name(name), arg(arg), on(TRACE_ENABLED(category)) {
+        if (on) trace_record(category, name, TRACE_PH_BEGIN, arg, rdtsc());
+    }
+    ~TraceScope() {
+        if (on) trace_record(category, name, TRACE_PH_END, arg, rdtsc());
+    }
+
+private:
+    uint32_t category;
+    const char* name;
+    uint64_t arg;
+    bool on;
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SCOPE(category, name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)((category), (name))
+
+// Parse "irq,shell", "all" or "none" into a mask; false on an unknown name
+bool trace_parse_mask(const char* list, uint32_t* out);
+void trace_set_mask(uint32_t mask);
+void trace_clear();
+
+// The rings as JSON over serial between TRACE_BEGIN and TRACE_END lines
+void trace_dump();
+void trace_status();
+
+#endif
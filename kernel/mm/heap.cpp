@@ -0,0 +1,115 @@
+#include "heap.hpp"
+#include "pmm.hpp"
+#include "vmm.hpp"
+#include "../lib/spinlock.hpp"
+#include "../lib/string.hpp"
+#include "../drivers/console.hpp"
+
+#define HEAP_MIN_SHIFT 4                    // Smallest class: 16 bytes
+#define HEAP_CLASSES   8                    // 16, 32, ..., 2048
+#define HEAP_MAX_SMALL (16 << (HEAP_CLASSES - 1))
+#define FRAME_LARGE    0xFF
+
+// What each physical frame is used for by the heap:
+// 0 = not ours, 1..HEAP_CLASSES = slab of that class, FRAME_LARGE = first
+// frame of a large block.
+static uint8_t frame_class[FRAMES_COUNT];
+
+struct FreeObject {
+    FreeObject* next;
+};
+
+// Large blocks start with this header; the caller gets the bytes after it
+struct LargeHeader {
+    uint64_t pages;
+    uint64_t reserved; // Keeps the payload 16-byte aligned
+};
+
+static FreeObject* free_lists[HEAP_CLASSES];
+static Spinlock heap_lock("heap");
+
+static int class_for(size_t size) {
+    int c = 0;
+    size_t class_size = (size_t)1 << HEAP_MIN_SHIFT;
+    while (class_size < size) {
+        class_size <<= 1;
+        c++;
+    }
+    return c;
+}
+
+// Carve a fresh frame into objects of class c. Caller holds heap_lock.
+static bool refill(int c) {
+    void* frame = pmm.allocate_frame();
+    if (!frame) return false;
+
+    uint64_t phys = (uint64_t)frame;
+    frame_class[phys / PAGE_SIZE] = (uint8_t)(c + 1);
+
+    size_t obj_size = (size_t)1 << (c + HEAP_MIN_SHIFT);
+    uint8_t* base = (uint8_t*)phys_to_virt(phys);
+    for (size_t off = 0; off + obj_size <= PAGE_SIZE; off += obj_size) {
+        FreeObject* obj = (FreeObject*)(base + off);
+        obj->next = free_lists[c];
+        free_lists[c] = obj;
+    }
+    return true;
+}
+
+void* kmalloc(size_t size) {
+    if (size == 0) return nullptr;
+
+    if (size > HEAP_MAX_SMALL) {
+        uint64_t pages = (size + sizeof(LargeHeader) + PAGE_SIZE - 1) / PAGE_SIZE;
+        void* frames = pmm.allocate_frames(pages);
+        if (!frames) return nullptr;
+
+        uint64_t phys = (uint64_t)frames;
+        LargeHeader* hdr = (LargeHeader*)phys_to_virt(phys);
+        hdr->pages = pages;
+        {
+            ScopedIrqLock guard(heap_lock);
+            frame_class[phys / PAGE_SIZE] = FRAME_LARGE;
+        }
+        return hdr + 1;
+    }
+
+    int c = class_for(size);
+    ScopedIrqLock guard(heap_lock);
+    if (!free_lists[c] && !refill(c)) {
+        return nullptr;
+    }
+    FreeObject* obj = free_lists[c];
+    free_lists[c] = obj->next;
+    return obj;
+}
+
+void* kzalloc(size_t size) {
+    uint8_t* p = (uint8_t*)kmalloc(size);
+    if (p) memset(p, 0, size);
+    return p;
+}
+
+void kfree(void* ptr) {
+    if (!ptr) return;
+
+    uint64_t phys = virt_to_phys(ptr);
+    uint64_t frame = phys / PAGE_SIZE;
+
+    ScopedIrqLock guard(heap_lock);
+    uint8_t cls = frame_class[frame];
+    if (cls == FRAME_LARGE) {
+        LargeHeader* hdr = (LargeHeader*)ptr - 1;
+        frame_class[frame] = 0;
+        pmm.free_frames((void*)virt_to_phys(hdr), hdr->pages);
+        return;
+    }
+    if (cls == 0 || cls > HEAP_CLASSES) {
+        panic("kfree: pointer not from kmalloc");
+    }
+
+    // Slab frames stay with their size class once carved
+    FreeObject* obj = (FreeObject*)ptr;
+    obj->next = free_lists[cls - 1];
+    free_lists[cls - 1] = obj;
+}
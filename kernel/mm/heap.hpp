@@ -0,0 +1,14 @@
+#ifndef HEAP_HPP
+#define HEAP_HPP
+
+#include "../lib/types.h"
+
+// Kernel heap on top of the PMM. Small requests (<= 2KB) come from
+// per-size-class slabs carved out of single frames; larger ones get a
+// physically contiguous run of frames. All pointers are direct-map
+// (higher-half) addresses.
+void* kmalloc(size_t size);
+void* kzalloc(size_t size); // Zero-filled
+void kfree(void* ptr);
+
+#endif
@@ -1,15 +1,38 @@
 #include "pmm.hpp"
 #include "../arch/x86_64/multiboot.hpp"
+#include "../arch/x86_64/cpu.hpp"
 #include "../drivers/console.hpp"
+#include "../lib/spinlock.hpp"
+#include "vmm.hpp"
+
+extern "C" uint8_t _kernel_end[]; // From scripts/linker.ld
 
 // Define static members
 uint8_t PhysicalMemoryManager::bitmap[BITMAP_SIZE];
 uint64_t PhysicalMemoryManager::total_memory = 0;
 uint64_t PhysicalMemoryManager::used_frames = 0;
 uint64_t PhysicalMemoryManager::total_frames = 0;
+uint8_t PhysicalMemoryManager::frame_mover[FRAMES_COUNT];
+void* PhysicalMemoryManager::frame_owner[FRAMES_COUNT];
+uint16_t PhysicalMemoryManager::block_used[HUGE_BLOCKS];
 
 PhysicalMemoryManager pmm;
 
+// Guards the bitmap and used_frames once we are past single-threaded init
+static Spinlock pmm_lock("pmm");
+
+// Caches that can shrink on demand; called without pmm_lock held
+static PmmReclaimFn reclaim_hook = nullptr;
+
+#define NO_BLOCK ((uint64_t)-1)
+#define NO_FRAME ((uint64_t)-1)
+
+// Index 0 stands for "pinned"
+static PmmMigrateFn movers[PMM_MAX_MOVERS + 1];
+static int mover_count = 0;
+static PmmHugeStats huge_stats;
+static bool compact_wanted = false;
+
 void PhysicalMemoryManager::init(void* multiboot_info_addr) {
     total_memory = 0;
     total_frames = FRAMES_COUNT;
@@ -20,6 +43,15 @@ void PhysicalMemoryManager::init(void* multiboot_info_addr) {
     for (size_t i = 0; i < BITMAP_SIZE; i++) {  // loop all slots in the bitmap (each slot is 8 bytes) 
         bitmap[i] = 0xFF; 
     }
+    for (size_t i = 0; i < FRAMES_COUNT; i++) {
+        frame_mover[i] = 0;
+        frame_owner[i] = nullptr;
+    }
+    for (size_t b = 0; b < HUGE_BLOCKS; b++) {
+        block_used[b] = HUGE_FRAME_PAGES;
+    }
+    huge_stats = PmmHugeStats();
+    compact_wanted = false;
     
     // Cast to uint8_t* for byte arithmetic
     uint8_t* base = (uint8_t*)multiboot_info_addr;
@@ -67,30 +99,56 @@ void PhysicalMemoryManager::init(void* multiboot_info_addr) {
     
     // Critical: Mark Kernel memory and Multiboot info as USED!
     // We don't want to allocate over our own code.
-    // Assuming Kernel starts at 1MB (0x100000) and ends around 2MB-ish?
-    // Let's reserve 0-2MB safely.
-    reserve_region(0x0, 0x200000); 
+    // Reserve the low 1MB (BIOS/VGA) and the kernel image up to _kernel_end.
+    reserve_region(0x0, virt_to_phys(_kernel_end));
     
     // Also reserve the Multiboot info structure itself
-    reserve_region((uint64_t)multiboot_info_addr, total_size);
+    reserve_region(virt_to_phys(multiboot_info_addr), total_size);
+
+    // And every boot module (the initrd): GRUB puts them in available RAM
+    for (multiboot_tag* t = multiboot_find_tag(multiboot_info_addr, MULTIBOOT_TAG_TYPE_MODULE, nullptr);
+         t; t = multiboot_find_tag(multiboot_info_addr, MULTIBOOT_TAG_TYPE_MODULE, t)) {
+        multiboot_tag_module* mod = (multiboot_tag_module*)t;
+        reserve_region(mod->mod_start, mod->mod_end - mod->mod_start);
+    }
 
     if (total_memory == 0 || total_memory > MAX_PHYSICAL_MEMORY) {
         total_memory = MAX_PHYSICAL_MEMORY;
     }
     total_frames = total_memory / PAGE_SIZE;
 
-    // Recount used frames from bitmap to avoid counter drift.
+    // Recount used frames from bitmap to avoid counter drift. Frames past
+    // the end of memory count as used in their block, so a partial block
+    // at the top never passes for a free 2MB frame.
     used_frames = 0;
+    for (size_t b = 0; b < HUGE_BLOCKS; b++) {
+        block_used[b] = HUGE_FRAME_PAGES;
+    }
     for (uint64_t i = 0; i < total_frames; i++) {
         if (!is_frame_free(i)) {
             used_frames++;
+        } else {
+            block_used[i / HUGE_FRAME_PAGES]--;
         }
     }
 
     kprint("PMM Initialized.\n");
 }
 
+void PhysicalMemoryManager::set_reclaim_hook(PmmReclaimFn fn) {
+    reclaim_hook = fn;
+}
+
 void* PhysicalMemoryManager::allocate_frame() {
+    void* frame = try_allocate_frame();
+    if (!frame && reclaim_hook && reclaim_hook(1)) {
+        frame = try_allocate_frame();
+    }
+    return frame;
+}
+
+void* PhysicalMemoryManager::try_allocate_frame() {
+    ScopedIrqLock guard(pmm_lock);
     for (uint64_t i = 0; i < total_frames; i++) {
         if (is_frame_free(i)) {
             mark_frame_used(i);
@@ -104,15 +162,57 @@ void PhysicalMemoryManager::free_frame(void* ptr) {
     if (!ptr) return;
     uint64_t addr = (uint64_t)ptr;
     uint64_t frame_index = addr / PAGE_SIZE;
+    ScopedIrqLock guard(pmm_lock);
     mark_frame_free(frame_index);
 }
 
+void* PhysicalMemoryManager::allocate_frames(uint64_t count) {
+    if (count == 0) return nullptr;
+    if (count == 1) return allocate_frame();
+
+    void* frames = try_allocate_frames(count);
+    if (!frames && reclaim_hook && reclaim_hook(count)) {
+        frames = try_allocate_frames(count); // Reclaim frees frames, not runs: may still fail
+    }
+    return frames;
+}
+
+void* PhysicalMemoryManager::try_allocate_frames(uint64_t count) {
+    ScopedIrqLock guard(pmm_lock);
+    uint64_t run_start = 0;
+    uint64_t run_len = 0;
+    for (uint64_t i = 0; i < total_frames; i++) {
+        if (!is_frame_free(i)) {
+            run_len = 0;
+            continue;
+        }
+        if (run_len == 0) run_start = i;
+        if (++run_len == count) {
+            for (uint64_t f = run_start; f < run_start + count; f++) {
+                mark_frame_used(f);
+            }
+            return (void*)(run_start * PAGE_SIZE);
+        }
+    }
+    return nullptr; // No run long enough
+}
+
+void PhysicalMemoryManager::free_frames(void* ptr, uint64_t count) {
+    if (!ptr) return;
+    uint64_t first = (uint64_t)ptr / PAGE_SIZE;
+    ScopedIrqLock guard(pmm_lock);
+    for (uint64_t i = 0; i < count; i++) {
+        mark_frame_free(first + i);
+    }
+}
+
 void PhysicalMemoryManager::mark_frame_used(uint64_t frame_index) {
     if (frame_index >= total_frames) return;
     uint8_t mask = (uint8_t)(1u << (frame_index % 8));
     if (bitmap[frame_index / 8] & mask) return;
     bitmap[frame_index / 8] |= mask;
     used_frames++;
+    block_used[frame_index / HUGE_FRAME_PAGES]++;
 }
 
 void PhysicalMemoryManager::mark_frame_free(uint64_t frame_index) {
@@ -121,6 +221,12 @@ void PhysicalMemoryManager::mark_frame_free(uint64_t frame_index) {
     if (!(bitmap[frame_index / 8] & mask)) return;
     bitmap[frame_index / 8] &= (uint8_t)~mask;
     used_frames--;
+    block_used[frame_index / HUGE_FRAME_PAGES]--;
+    if (frame_mover[frame_index]) {
+        frame_mover[frame_index] = 0;
+        frame_owner[frame_index] = nullptr;
+        huge_stats.movable_frames--;
+    }
 }
 
 bool PhysicalMemoryManager::is_frame_free(uint64_t frame_index) {
@@ -140,14 +246,172 @@ void PhysicalMemoryManager::reserve_region(uint64_t base, uint64_t length) {
 }
 
 void PhysicalMemoryManager::unreserve_region(uint64_t base, uint64_t length) {
-    uint64_t start_frame = base / PAGE_SIZE;
-    uint64_t end_frame = (base + length) / PAGE_SIZE; // Round down for safety (don't partial free)
+    // Only frames wholly inside the range: round the start up and the end down
+    uint64_t start_frame = (base + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint64_t end_frame = (base + length) / PAGE_SIZE;
     
     for (uint64_t i = start_frame; i < end_frame; i++) {
         mark_frame_free(i);
     }
 }
 
+// --- Movable frames, 2MB frames and compaction ---
+
+int PhysicalMemoryManager::register_mover(PmmMigrateFn fn) {
+    ScopedIrqLock guard(pmm_lock);
+    if (mover_count == PMM_MAX_MOVERS) return 0;
+    movers[++mover_count] = fn;
+    return mover_count;
+}
+
+void* PhysicalMemoryManager::allocate_movable_frame(int mover, void* owner) {
+    void* frame = allocate_frame();
+    if (frame && mover > 0 && mover <= mover_count) {
+        ScopedIrqLock guard(pmm_lock);
+        uint64_t index = (uint64_t)frame / PAGE_SIZE;
+        frame_mover[index] = (uint8_t)mover;
+        frame_owner[index] = owner;
+        huge_stats.movable_frames++;
+    }
+    return frame;
+}
+
+uint64_t PhysicalMemoryManager::block_count() {
+    return (total_frames + HUGE_FRAME_PAGES - 1) / HUGE_FRAME_PAGES;
+}
+
+// Top down, away from the first-fit 4KB allocations at the bottom
+void* PhysicalMemoryManager::allocate_huge_frame() {
+    ScopedIrqLock guard(pmm_lock);
+    for (uint64_t b = block_count(); b-- > 0;) {
+        if (block_used[b] != 0) continue;
+        uint64_t first = b * HUGE_FRAME_PAGES;
+        for (uint64_t f = first; f < first + HUGE_FRAME_PAGES; f++) {
+            mark_frame_used(f);
+        }
+        huge_stats.allocs++;
+        return (void*)(first * PAGE_SIZE);
+    }
+    huge_stats.failures++;
+    compact_wanted = true;
+    return nullptr;
+}
+
+void PhysicalMemoryManager::free_huge_frame(void* ptr) {
+    free_frames(ptr, HUGE_FRAME_PAGES);
+}
+
+// The block with the fewest used frames, all of them movable, whose frames
+// fit into the free space of the other partly used blocks (moving them must
+// not break up a block that is already free). Caller holds pmm_lock.
+uint64_t PhysicalMemoryManager::pick_compaction_block() {
+    uint64_t blocks = block_count();
+    uint64_t spare = 0;
+    for (uint64_t b = 0; b < blocks; b++) {
+        if (block_used[b] != 0) spare += HUGE_FRAME_PAGES - block_used[b];
+    }
+
+    uint64_t best = NO_BLOCK;
+    uint64_t best_used = HUGE_FRAME_PAGES;
+    for (uint64_t b = 0; b < blocks; b++) {
+        uint64_t used = block_used[b];
+        if (used == 0 || used >= best_used) continue;
+        if (used > spare - (HUGE_FRAME_PAGES - used)) continue;
+
+        bool movable = true;
+        uint64_t first = b * HUGE_FRAME_PAGES;
+        for (uint64_t f = first; f < first + HUGE_FRAME_PAGES && movable; f++) {
+            movable = is_frame_free(f) || (f < total_frames && frame_mover[f] != 0);
+        }
+        if (movable) {
+            best = b;
+            best_used = used;
+        }
+    }
+    return best;
+}
+
+// A free frame in a partly used block other than `block`. Caller holds pmm_lock.
+uint64_t PhysicalMemoryManager::find_destination(uint64_t block) {
+    for (uint64_t b = 0; b < block_count(); b++) {
+        if (b == block || block_used[b] == 0 || block_used[b] == HUGE_FRAME_PAGES) continue;
+        for (uint64_t f = b * HUGE_FRAME_PAGES; f < (b + 1) * HUGE_FRAME_PAGES; f++) {
+            if (is_frame_free(f)) return f;
+        }
+    }
+    return NO_FRAME;
+}
+
+// Move every used frame out of `block`; false if a frame turned out to be
+// pinned or busy, or there was nowhere to put it
+bool PhysicalMemoryManager::evacuate_block(uint64_t block) {
+    uint64_t first = block * HUGE_FRAME_PAGES;
+    for (uint64_t f = first; f < first + HUGE_FRAME_PAGES; f++) {
+        int mover;
+        void* owner;
+        uint64_t dest;
+        {
+            ScopedIrqLock guard(pmm_lock);
+            if (is_frame_free(f)) continue;
+            mover = frame_mover[f];
+            owner = frame_owner[f];
+            if (!mover) return false;
+            dest = find_destination(block);
+            if (dest == NO_FRAME) return false;
+            mark_frame_used(dest);
+        }
+
+        if (!movers[mover](owner, f * PAGE_SIZE, dest * PAGE_SIZE)) {
+            ScopedIrqLock guard(pmm_lock);
+            mark_frame_free(dest);
+            huge_stats.moves_refused++;
+            return false;
+        }
+
+        ScopedIrqLock guard(pmm_lock);
+        frame_mover[dest] = (uint8_t)mover;
+        frame_owner[dest] = owner;
+        huge_stats.movable_frames++;
+        mark_frame_free(f);
+        huge_stats.pages_moved++;
+    }
+    return true;
+}
+
+uint64_t PhysicalMemoryManager::compact(uint64_t max_blocks) {
+    uint64_t start = rdtsc();
+    uint64_t freed = 0;
+    while (freed < max_blocks) {
+        uint64_t block;
+        {
+            ScopedIrqLock guard(pmm_lock);
+            block = pick_compaction_block();
+        }
+        if (block == NO_BLOCK || !evacuate_block(block)) break;
+        freed++;
+    }
+
+    ScopedIrqLock guard(pmm_lock);
+    huge_stats.compactions++;
+    huge_stats.blocks_freed += freed;
+    huge_stats.compact_cycles += rdtsc() - start;
+    compact_wanted = false; // Served, or nothing to gain until frames are freed
+    return freed;
+}
+
+bool PhysicalMemoryManager::compaction_wanted() {
+    return __atomic_load_n(&compact_wanted, __ATOMIC_RELAXED);
+}
+
+void PhysicalMemoryManager::get_huge_stats(PmmHugeStats* out) {
+    ScopedIrqLock guard(pmm_lock);
+    *out = huge_stats;
+    out->free_blocks = 0;
+    for (uint64_t b = 0; b < block_count(); b++) {
+        if (block_used[b] == 0) out->free_blocks++;
+    }
+}
+
 uint64_t PhysicalMemoryManager::get_total_memory() {
     return total_memory;
 }
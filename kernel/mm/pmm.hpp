@@ -13,11 +13,63 @@
 #define FRAMES_COUNT (MAX_PHYSICAL_MEMORY / PAGE_SIZE)
 #define BITMAP_SIZE (FRAMES_COUNT / 8)
 
+// 2MB frames for huge-page mappings: HUGE_FRAME_PAGES frames aligned to
+// their size. Memory is tracked in blocks of that size to find them.
+#define HUGE_FRAME_SIZE  (2ULL * 1024 * 1024)
+#define HUGE_FRAME_PAGES (HUGE_FRAME_SIZE / PAGE_SIZE)
+#define HUGE_BLOCKS      (FRAMES_COUNT / HUGE_FRAME_PAGES)
+
+#define PMM_MAX_MOVERS 4
+
+// Asked to give back up to `wanted` frames when an allocation finds none
+// free; returns how many it released. May run in any context.
+typedef uint64_t (*PmmReclaimFn)(uint64_t wanted);
+
+// Owner of movable frames, asked by compaction to move `owner`'s frame at
+// physical address `from` to the free frame `to`: copy the data and
+// repoint every reference, or return false if the frame is busy right now.
+// Called without the PMM lock.
+typedef bool (*PmmMigrateFn)(void* owner, uint64_t from, uint64_t to);
+
+struct PmmHugeStats {
+    uint64_t free_blocks;       // 2MB-aligned blocks that are entirely free
+    uint64_t movable_frames;
+    uint64_t allocs;            // allocate_huge_frame() successes
+    uint64_t failures;          // ...and failures (callers fall back to 4KB)
+    uint64_t compactions;       // compact() passes
+    uint64_t blocks_freed;      // Blocks compaction emptied
+    uint64_t pages_moved;
+    uint64_t moves_refused;     // Owner said busy; the block was left alone
+    uint64_t compact_cycles;    // Total time spent in compact()
+};
+
 class PhysicalMemoryManager {
 public:
-    static void init(void* multiboot_info_addr); // Initialize PMM with Multiboot info
-    static void* allocate_frame(); // Allocate a free frame
+    static void init(void* multiboot_info_addr); // Initialize PMM with Multiboot info (higher-half pointer)
+    static void* allocate_frame(); // Allocate a free frame (returns a PHYSICAL address, see phys_to_virt)
     static void free_frame(void* ptr); // Free a frame
+    static void* allocate_frames(uint64_t count); // Physically contiguous run of frames
+    static void free_frames(void* ptr, uint64_t count);
+    static void set_reclaim_hook(PmmReclaimFn fn); // e.g. the buffer cache
+
+    // Frames from allocate_frame() are pinned. A movable frame names the
+    // mover (an id from register_mover, 0 when the table is full) and an
+    // owner cookie passed back to it; compaction may relocate it.
+    static int register_mover(PmmMigrateFn fn);
+    static void* allocate_movable_frame(int mover, void* owner);
+
+    // One 2MB-aligned run of HUGE_FRAME_PAGES frames. Never waits for
+    // compaction: on failure the next idle pass (or `compact`) makes room.
+    static void* allocate_huge_frame();
+    static void free_huge_frame(void* ptr);
+
+    // Migrate movable frames out of mostly free blocks until `max_blocks`
+    // more 2MB blocks are free or no block can be emptied; returns how many
+    // were freed. compaction_wanted() is set by a failed huge allocation
+    // and cleared by the pass that serves it.
+    static uint64_t compact(uint64_t max_blocks);
+    static bool compaction_wanted();
+    static void get_huge_stats(PmmHugeStats* out);
     
     // Debug info
     static uint64_t get_total_memory(); // Get total memory size
@@ -25,17 +77,29 @@ public:
     static uint64_t get_used_memory(); // Get used memory size
 
 private:
+    static void* try_allocate_frame();
+    static void* try_allocate_frames(uint64_t count);
     static void mark_frame_used(uint64_t frame_index); // Mark a frame as used
     static void mark_frame_free(uint64_t frame_index); // Mark a frame as free
     static bool is_frame_free(uint64_t frame_index);
     static void reserve_region(uint64_t base, uint64_t length);
     static void unreserve_region(uint64_t base, uint64_t length);
+    static uint64_t block_count();
+    static uint64_t pick_compaction_block();
+    static uint64_t find_destination(uint64_t block);
+    static bool evacuate_block(uint64_t block);
 
     // The bitmap: 1 bit per page. 0 = free, 1 = used.
     static uint8_t bitmap[BITMAP_SIZE];
     static uint64_t total_memory;
     static uint64_t used_frames;
     static uint64_t total_frames;
+
+    // Per frame: mover id (0 = pinned) and owner cookie, for compaction
+    static uint8_t frame_mover[FRAMES_COUNT];
+    static void* frame_owner[FRAMES_COUNT];
+    // Per 2MB block: frames that are used or do not exist
+    static uint16_t block_used[HUGE_BLOCKS];
 };
 
 extern PhysicalMemoryManager pmm;
@@ -0,0 +1,423 @@
+#include "vmm.hpp"
+#include "pmm.hpp"
+#include "cpu.hpp"
+#include "../drivers/console.hpp"
+#include "../lib/spinlock.hpp"
+#include "../lib/string.hpp"
+
+#define CR4_PGE   (1ULL << 7)
+#define CR4_PCIDE (1ULL << 17)
+#define MAX_PCID  4095
+
+#define MSR_EFER  0xC0000080
+#define EFER_NXE  (1ULL << 11)
+
+#define MSR_PAT   0x277
+// PAT memory type encodings
+#define PAT_UC    0x00
+#define PAT_WC    0x01
+
+AddressSpace VirtualMemoryManager::kernel_as = {0, 0, false};
+bool VirtualMemoryManager::pge = false;
+bool VirtualMemoryManager::pcid = false;
+bool VirtualMemoryManager::pat = false;
+bool VirtualMemoryManager::nx = false;
+uint16_t VirtualMemoryManager::next_pcid = 1;
+uint64_t VirtualMemoryManager::io_next = 0;
+
+// Page tables for the IO window. Static so device memory (the console)
+// can be mapped before the PMM is up.
+static uint64_t io_pd[512] __attribute__((aligned(4096)));
+static uint64_t io_pt[512] __attribute__((aligned(4096)));
+
+VirtualMemoryManager vmm;
+
+static Spinlock vmm_lock("vmm");
+
+static void zero_frame(uint64_t phys) {
+    memset(phys_to_virt(phys), 0, PAGE_SIZE);
+}
+
+void VirtualMemoryManager::init() {
+    kernel_as.pml4_phys = read_cr3() & PTE_ADDR_MASK;
+    kernel_as.pcid = 0;
+    kernel_as.stale = false;
+
+    // We run from the higher half now: drop the boot identity map
+    uint64_t* pml4 = (uint64_t*)phys_to_virt(kernel_as.pml4_phys);
+    pml4[0] = 0;
+
+    // Hook the IO window into the kernel PDPT (shared by every address space)
+    uint64_t* pdpt = (uint64_t*)phys_to_virt(pml4[511] & PTE_ADDR_MASK);
+    pdpt[(IO_WINDOW_BASE >> 30) & 511] = virt_to_phys(io_pd) | PTE_PRESENT | PTE_WRITABLE;
+    io_pd[(IO_WINDOW_BASE >> 21) & 511] = virt_to_phys(io_pt) | PTE_PRESENT | PTE_WRITABLE;
+    write_cr3(kernel_as.pml4_phys);
+
+    uint32_t a, b, c, d;
+    cpuid(1, 0, &a, &b, &c, &d);
+    pge = (d & (1 << 13)) != 0;
+    pcid = (c & (1 << 17)) != 0;
+    pat = (d & (1 << 16)) != 0;
+    if (pat) {
+        init_pat();
+    }
+
+    // No-execute is an extended feature; without NXE bit 63 is reserved
+    cpuid(0x80000000, 0, &a, &b, &c, &d);
+    if (a >= 0x80000001) {
+        cpuid(0x80000001, 0, &a, &b, &c, &d);
+        nx = (d & (1 << 20)) != 0;
+    }
+    if (nx) {
+        wrmsr(MSR_EFER, rdmsr(MSR_EFER) | EFER_NXE);
+    }
+
+    // The boot PD already marks every kernel mapping global; PGE makes the
+    // CPU honour that, so kernel translations survive CR3 writes.
+    uint64_t cr4 = read_cr4();
+    if (pge) cr4 |= CR4_PGE;
+    if (pcid) cr4 |= CR4_PCIDE; // CR3[11:0] is 0 here, as the CPU requires
+    write_cr4(cr4);
+
+    kprint("VMM: higher half at "); kprint_hex(KERNEL_VMA);
+    kprint(", PGE "); kprint(pge ? "on" : "unsupported");
+    kprint(", PCID "); kprint(pcid ? "on" : "unsupported");
+    kprint(", PAT WC "); kprint(pat ? "on" : "unsupported");
+    kprint(", NX "); kprint(nx ? "on" : "unsupported");
+    kprint("\n");
+}
+
+// Power-on PAT is WB, WT, UC-, UC (repeated). Turn entry 1 (PWT=1, PCD=0)
+// into write-combining and leave the rest alone, so existing PWT/PCD users
+// only change if they asked for write-through.
+void VirtualMemoryManager::init_pat() {
+    uint64_t value = rdmsr(MSR_PAT);
+    value &= ~(0xFFULL << 8);
+    value |= (uint64_t)PAT_WC << 8;
+
+    asm volatile("wbinvd" ::: "memory");
+    wrmsr(MSR_PAT, value);
+    asm volatile("wbinvd" ::: "memory");
+}
+
+uint64_t VirtualMemoryManager::cache_flags(MemType type) {
+    switch (type) {
+    case MemType::WriteCombining:
+        return pat ? PTE_PWT : (PTE_PCD | PTE_PWT);
+    case MemType::Uncached:
+        return PTE_PCD | PTE_PWT; // PAT entry 3: UC
+    case MemType::WriteBack:
+    default:
+        return 0;
+    }
+}
+
+void* VirtualMemoryManager::map_io(uint64_t phys, size_t size, MemType type) {
+    uint64_t offset = phys & (PAGE_SIZE - 1);
+    uint64_t pages = (offset + size + PAGE_SIZE - 1) / PAGE_SIZE;
+
+    ScopedIrqLock guard(vmm_lock);
+    if (io_next + pages > IO_WINDOW_SIZE / PAGE_SIZE) {
+        return nullptr;
+    }
+
+    uint64_t first = io_next;
+    io_next += pages;
+    uint64_t base = phys - offset;
+    for (uint64_t i = 0; i < pages; i++) {
+        io_pt[first + i] = (base + i * PAGE_SIZE) | PTE_PRESENT | PTE_WRITABLE | PTE_GLOBAL | cache_flags(type);
+        invlpg((void*)(IO_WINDOW_BASE + (first + i) * PAGE_SIZE));
+    }
+    return (void*)(IO_WINDOW_BASE + first * PAGE_SIZE + offset);
+}
+
+AddressSpace* VirtualMemoryManager::kernel_space() {
+    return &kernel_as;
+}
+
+bool VirtualMemoryManager::global_pages_enabled() {
+    return pge;
+}
+
+bool VirtualMemoryManager::pcid_enabled() {
+    return pcid;
+}
+
+bool VirtualMemoryManager::pat_enabled() {
+    return pat;
+}
+
+bool VirtualMemoryManager::nx_enabled() {
+    return nx;
+}
+
+bool VirtualMemoryManager::create_address_space(AddressSpace* as) {
+    void* frame = pmm.allocate_frame();
+    if (!frame) return false;
+
+    uint64_t phys = (uint64_t)frame;
+    zero_frame(phys);
+
+    // Share the kernel half so kernel code, data and the direct map stay mapped
+    uint64_t* src = (uint64_t*)phys_to_virt(kernel_as.pml4_phys);
+    uint64_t* dst = (uint64_t*)phys_to_virt(phys);
+    memcpy(&dst[KERNEL_PML4_START], &src[KERNEL_PML4_START], (512 - KERNEL_PML4_START) * sizeof(uint64_t));
+
+    as->pml4_phys = phys;
+    as->pcid = 0;
+    as->stale = true; // A recycled PCID may still have someone else's entries
+    if (pcid) {
+        ScopedIrqLock guard(vmm_lock);
+        as->pcid = next_pcid;
+        next_pcid = (next_pcid == MAX_PCID) ? 1 : next_pcid + 1;
+    }
+    return true;
+}
+
+void VirtualMemoryManager::free_table(uint64_t table_phys, int level) {
+    if (level > 1) {
+        uint64_t* table = (uint64_t*)phys_to_virt(table_phys);
+        for (int i = 0; i < 512; i++) {
+            uint64_t e = table[i];
+            if ((e & PTE_PRESENT) && !(e & PTE_HUGE)) {
+                free_table(e & PTE_ADDR_MASK, level - 1);
+            }
+        }
+    }
+    pmm.free_frame((void*)table_phys);
+}
+
+void VirtualMemoryManager::destroy_address_space(AddressSpace* as) {
+    if (as == &kernel_as || !as->pml4_phys) return;
+
+    uint64_t* pml4 = (uint64_t*)phys_to_virt(as->pml4_phys);
+    for (int i = 0; i < KERNEL_PML4_START; i++) {
+        if (pml4[i] & PTE_PRESENT) {
+            free_table(pml4[i] & PTE_ADDR_MASK, 3);
+        }
+    }
+    pmm.free_frame((void*)as->pml4_phys);
+    as->pml4_phys = 0;
+}
+
+void VirtualMemoryManager::switch_to(const AddressSpace* as) {
+    uint64_t cr3 = as->pml4_phys;
+    if (pcid && as->pcid) {
+        cr3 |= as->pcid;
+        if (!as->stale) {
+            cr3 |= CR3_NOFLUSH;
+        }
+        ((AddressSpace*)as)->stale = false;
+    }
+    write_cr3(cr3);
+}
+
+// Return the entry for virt at `level` (1 = page table, 2 = page
+// directory), allocating intermediate tables if asked
+uint64_t* VirtualMemoryManager::walk(AddressSpace* as, uint64_t virt, bool create, uint64_t flags, int level) {
+    uint64_t* table = (uint64_t*)phys_to_virt(as->pml4_phys);
+    for (int l = 4; l > level; l--) {
+        int idx = (virt >> (12 + 9 * (l - 1))) & 511;
+        uint64_t e = table[idx];
+        if (!(e & PTE_PRESENT)) {
+            if (!create) return nullptr;
+            void* frame = pmm.allocate_frame();
+            if (!frame) return nullptr;
+            zero_frame((uint64_t)frame);
+            e = (uint64_t)frame | PTE_PRESENT | PTE_WRITABLE | (flags & PTE_USER);
+            table[idx] = e;
+        } else if (e & PTE_HUGE) {
+            return nullptr; // Covered by a large page
+        } else if ((flags & PTE_USER) && !(e & PTE_USER)) {
+            e |= PTE_USER;
+            table[idx] = e;
+        }
+        table = (uint64_t*)phys_to_virt(e & PTE_ADDR_MASK);
+    }
+    return &table[(virt >> (12 + 9 * (level - 1))) & 511];
+}
+
+static bool is_current(const AddressSpace* as) {
+    return (read_cr3() & PTE_ADDR_MASK) == as->pml4_phys;
+}
+
+bool VirtualMemoryManager::map_page(AddressSpace* as, uint64_t virt, uint64_t phys, uint64_t flags) {
+    ScopedIrqLock guard(vmm_lock);
+    uint64_t* pte = walk(as, virt, true, flags);
+    if (!pte) return false;
+
+    bool was_present = (*pte & PTE_PRESENT) != 0;
+    *pte = (phys & PTE_ADDR_MASK) | flags | PTE_PRESENT;
+    if (was_present) {
+        if (is_current(as)) invlpg((void*)virt);
+        else as->stale = true;
+    }
+    return true;
+}
+
+void VirtualMemoryManager::unmap_page(AddressSpace* as, uint64_t virt) {
+    ScopedIrqLock guard(vmm_lock);
+    uint64_t* pte = walk(as, virt, false, 0);
+    if (!pte || !(*pte & PTE_PRESENT)) return;
+
+    *pte = 0;
+    if (is_current(as)) invlpg((void*)virt);
+    else as->stale = true;
+}
+
+uint64_t VirtualMemoryManager::query(AddressSpace* as, uint64_t virt) {
+    ScopedIrqLock guard(vmm_lock);
+    uint64_t* pde = walk(as, virt, false, 0, 2);
+    if (pde && (*pde & PTE_HUGE)) return *pde;
+    uint64_t* pte = walk(as, virt, false, 0);
+    return pte ? *pte : 0;
+}
+
+bool VirtualMemoryManager::map_huge_page(AddressSpace* as, uint64_t virt, uint64_t phys, uint64_t flags) {
+    ScopedIrqLock guard(vmm_lock);
+    uint64_t* pde = walk(as, virt, true, flags, 2);
+    if (!pde || (*pde & PTE_PRESENT)) return false;
+    *pde = (phys & PTE_ADDR_MASK) | flags | PTE_HUGE | PTE_PRESENT;
+    return true;
+}
+
+void VirtualMemoryManager::unmap_huge_page(AddressSpace* as, uint64_t virt) {
+    ScopedIrqLock guard(vmm_lock);
+    uint64_t* pde = walk(as, virt, false, 0, 2);
+    if (!pde || (*pde & (PTE_PRESENT | PTE_HUGE)) != (PTE_PRESENT | PTE_HUGE)) return;
+
+    *pde = 0;
+    if (is_current(as)) invlpg((void*)virt);
+    else as->stale = true;
+}
+
+void VirtualMemoryManager::free_user_frames(AddressSpace* as) {
+    if (as == &kernel_as || !as->pml4_phys) return;
+
+    ScopedIrqLock guard(vmm_lock);
+    uint64_t* pml4 = (uint64_t*)phys_to_virt(as->pml4_phys);
+    for (int i4 = 0; i4 < KERNEL_PML4_START; i4++) {
+        if (!(pml4[i4] & PTE_PRESENT)) continue;
+        uint64_t* pdpt = (uint64_t*)phys_to_virt(pml4[i4] & PTE_ADDR_MASK);
+        for (int i3 = 0; i3 < 512; i3++) {
+            if (!(pdpt[i3] & PTE_PRESENT) || (pdpt[i3] & PTE_HUGE)) continue;
+            uint64_t* pd = (uint64_t*)phys_to_virt(pdpt[i3] & PTE_ADDR_MASK);
+            for (int i2 = 0; i2 < 512; i2++) {
+                if (!(pd[i2] & PTE_PRESENT)) continue;
+                if (pd[i2] & PTE_HUGE) {
+                    if (pd[i2] & PTE_USER) pmm.free_huge_frame((void*)(pd[i2] & PTE_ADDR_MASK));
+                    pd[i2] = 0;
+                    continue;
+                }
+                uint64_t* pt = (uint64_t*)phys_to_virt(pd[i2] & PTE_ADDR_MASK);
+                for (int i1 = 0; i1 < 512; i1++) {
+                    if ((pt[i1] & (PTE_PRESENT | PTE_USER)) == (PTE_PRESENT | PTE_USER)) {
+                        pmm.free_frame((void*)(pt[i1] & PTE_ADDR_MASK));
+                    }
+                    pt[i1] = 0;
+                }
+            }
+        }
+    }
+    as->stale = true;
+}
+
+// --- CR3 switch microbenchmark ---
+
+#define BENCH_ITERATIONS 2000
+#define BENCH_USER_PAGES 32
+#define BENCH_USER_BASE  0x400000ULL
+#define BENCH_KERNEL_TOUCHES 16
+
+static volatile uint64_t bench_sink;
+
+// One round trip: into `other`, touch its private pages and some kernel
+// pages, then back to the kernel space and touch the kernel pages again.
+static uint64_t bench_round_trips(uint64_t cr3_kernel, uint64_t cr3_other) {
+    volatile uint8_t* kernel_pages = (volatile uint8_t*)KERNEL_VMA;
+
+    uint64_t start = rdtsc();
+    for (int it = 0; it < BENCH_ITERATIONS; it++) {
+        write_cr3(cr3_other);
+        for (int i = 0; i < BENCH_USER_PAGES; i++) {
+            bench_sink += *(volatile uint64_t*)(BENCH_USER_BASE + (uint64_t)i * PAGE_SIZE);
+        }
+        for (int i = 0; i < BENCH_KERNEL_TOUCHES; i++) {
+            bench_sink += kernel_pages[(uint64_t)i * 0x200000 + 0x100000];
+        }
+        write_cr3(cr3_kernel);
+        for (int i = 0; i < BENCH_KERNEL_TOUCHES; i++) {
+            bench_sink += kernel_pages[(uint64_t)i * 0x200000 + 0x100000];
+        }
+    }
+    return (rdtsc() - start) / BENCH_ITERATIONS;
+}
+
+static void print_result(const char* label, uint64_t cycles) {
+    kprint("  "); kprint(label); kprint(": ");
+    kprint_int(cycles);
+    kprint(" cycles/round trip\n");
+}
+
+void cr3_benchmark_command() {
+    AddressSpace other;
+    if (!vmm.create_address_space(&other)) {
+        kprint("cr3bench: out of memory\n");
+        return;
+    }
+
+    void* frames[BENCH_USER_PAGES];
+    int mapped = 0;
+    for (; mapped < BENCH_USER_PAGES; mapped++) {
+        frames[mapped] = pmm.allocate_frame();
+        if (!frames[mapped] ||
+            !vmm.map_page(&other, BENCH_USER_BASE + (uint64_t)mapped * PAGE_SIZE,
+                          (uint64_t)frames[mapped], PTE_WRITABLE)) {
+            if (frames[mapped]) pmm.free_frame(frames[mapped]);
+            break;
+        }
+    }
+
+    if (mapped == BENCH_USER_PAGES) {
+        uint64_t flags = irq_save();
+        uint64_t cr4 = read_cr4();
+        uint64_t kernel_cr3 = vmm.kernel_space()->pml4_phys;
+
+        kprint("\n--- CR3 switch cost (");
+        kprint_int(BENCH_USER_PAGES); kprint(" private + ");
+        kprint_int(BENCH_KERNEL_TOUCHES * 2); kprint(" kernel touches per trip) ---\n");
+
+        // Baseline: every switch flushes everything, kernel entries included
+        write_cr4(cr4 & ~CR4_PGE);
+        print_result("no PGE, no PCID", bench_round_trips(kernel_cr3, other.pml4_phys));
+
+        if (vmm.global_pages_enabled()) {
+            write_cr4(cr4 | CR4_PGE);
+            print_result("PGE,    no PCID", bench_round_trips(kernel_cr3, other.pml4_phys));
+        }
+
+        if (vmm.pcid_enabled() && other.pcid) {
+            // Prime the tagged entries once, then switch without flushing
+            write_cr3(other.pml4_phys | other.pcid);
+            write_cr3(kernel_cr3);
+            print_result("PGE + PCID     ",
+                         bench_round_trips(kernel_cr3 | CR3_NOFLUSH,
+                                           other.pml4_phys | other.pcid | CR3_NOFLUSH));
+        } else {
+            kprint("  PGE + PCID     : PCID not supported by this CPU\n");
+        }
+
+        // Toggling PGE flushes everything, including the PCID-tagged entries
+        write_cr4(cr4 & ~CR4_PGE);
+        write_cr4(cr4);
+        write_cr3(kernel_cr3);
+        irq_restore(flags);
+    } else {
+        kprint("cr3bench: out of memory\n");
+    }
+
+    for (int i = 0; i < mapped; i++) {
+        pmm.free_frame(frames[i]);
+    }
+    vmm.destroy_address_space(&other);
+}
@@ -0,0 +1,107 @@
+#ifndef VMM_HPP
+#define VMM_HPP
+
+#include "../lib/types.h"
+
+// The kernel is linked at KERNEL_VMA + physical address, and boot.asm maps
+// the first DIRECT_MAP_SIZE bytes of physical memory there, so any frame
+// handed out by the PMM (which works in physical addresses) is reachable
+// through phys_to_virt().
+#define KERNEL_VMA      0xFFFFFFFF80000000ULL
+#define DIRECT_MAP_SIZE (1ULL << 30)
+
+static inline void* phys_to_virt(uint64_t phys) {
+    return (void*)(phys + KERNEL_VMA);
+}
+
+static inline uint64_t virt_to_phys(const void* virt) {
+    return (uint64_t)virt - KERNEL_VMA;
+}
+
+// Page table entry bits
+#define PTE_PRESENT   (1ULL << 0)
+#define PTE_WRITABLE  (1ULL << 1)
+#define PTE_USER      (1ULL << 2)
+#define PTE_PWT       (1ULL << 3)
+#define PTE_PCD       (1ULL << 4)
+#define PTE_HUGE      (1ULL << 7)
+#define PTE_GLOBAL    (1ULL << 8)
+#define PTE_NX        (1ULL << 63)
+#define PTE_ADDR_MASK 0x000FFFFFFFFFF000ULL
+
+// CR3 bit 63: keep the TLB entries tagged with the new PCID
+#define CR3_NOFLUSH   (1ULL << 63)
+
+// First PML4 slot that belongs to the kernel; everything below is per process
+#define KERNEL_PML4_START 256
+
+// 2MB window right above the direct map for device memory (map_io)
+#define IO_WINDOW_BASE (KERNEL_VMA + DIRECT_MAP_SIZE)
+#define IO_WINDOW_SIZE (2ULL << 20)
+
+// Caching type of a mapping. vmm.init() reprograms PAT entry 1 to WC, so
+// WriteCombining is encoded as PWT; without PAT support it degrades to UC.
+enum class MemType : uint8_t {
+    WriteBack,
+    WriteCombining,
+    Uncached
+};
+
+struct AddressSpace {
+    uint64_t pml4_phys;
+    uint16_t pcid;  // 0 = untagged (kernel / PCID unsupported)
+    bool stale;     // Tagged TLB entries may be out of date: flush on next switch
+};
+
+class VirtualMemoryManager {
+public:
+    static void init(); // Drop the boot identity map and enable PGE/PCID
+    static AddressSpace* kernel_space();
+
+    // New address space sharing the kernel half of the kernel PML4
+    static bool create_address_space(AddressSpace* as);
+    static void destroy_address_space(AddressSpace* as); // Frees page tables only
+    static void switch_to(const AddressSpace* as);
+
+    static bool map_page(AddressSpace* as, uint64_t virt, uint64_t phys, uint64_t flags);
+    static void unmap_page(AddressSpace* as, uint64_t virt);
+    static uint64_t query(AddressSpace* as, uint64_t virt); // Level-1 entry (level 2 for a 2MB page), 0 if unmapped
+
+    // 2MB page at a 2MB-aligned virt; fails if anything is mapped in that range
+    static bool map_huge_page(AddressSpace* as, uint64_t virt, uint64_t phys, uint64_t flags);
+    static void unmap_huge_page(AddressSpace* as, uint64_t virt);
+
+    // Return every frame mapped with PTE_USER below the kernel half to the
+    // PMM, 2MB pages included (process teardown; the tables go with
+    // destroy_address_space)
+    static void free_user_frames(AddressSpace* as);
+
+    // Map device memory into the kernel IO window with the given caching
+    // type; returns the virtual address of `phys` or nullptr if the window is full.
+    static void* map_io(uint64_t phys, size_t size, MemType type);
+    static uint64_t cache_flags(MemType type); // PTE bits for a memory type
+
+    static bool global_pages_enabled();
+    static bool pcid_enabled();
+    static bool pat_enabled();
+    static bool nx_enabled(); // PTE_NX may be set (EFER.NXE is on)
+
+private:
+    static uint64_t* walk(AddressSpace* as, uint64_t virt, bool create, uint64_t flags, int level = 1);
+    static void free_table(uint64_t table_phys, int level);
+    static void init_pat();
+
+    static AddressSpace kernel_as;
+    static bool pge;
+    static bool pcid;
+    static bool pat;
+    static bool nx;
+    static uint16_t next_pcid;
+    static uint64_t io_next; // Next free page in the IO window
+};
+
+extern VirtualMemoryManager vmm;
+
+void cr3_benchmark_command();
+
+#endif
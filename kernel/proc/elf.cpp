@@ -0,0 +1,74 @@
+#include "elf.hpp"
+#include "process.hpp"
+#include "../fs/vfs.hpp"
+#include "../lib/string.hpp"
+#include "../mm/pmm.hpp"
+
+static int check_header(const Elf64Ehdr* eh) {
+    if (eh->magic != ELF_MAGIC || eh->elf_class != ELFCLASS64 || eh->data != ELFDATA2LSB ||
+        eh->type != ET_EXEC || eh->machine != EM_X86_64 ||
+        eh->phentsize != sizeof(Elf64Phdr) || eh->phnum == 0 || eh->phnum > ELF_MAX_PHDRS ||
+        eh->entry >= USER_STACK_TOP) {
+        return VFS_ENOEXEC;
+    }
+    return 0;
+}
+
+static int load_segment(int fd, const Elf64Phdr* ph, AddressSpace* as) {
+    if (ph->memsz == 0) return 0;
+    if (ph->filesz > ph->memsz || ph->vaddr < PAGE_SIZE ||
+        ph->vaddr >= USER_STACK_TOP || ph->memsz > USER_STACK_TOP - ph->vaddr) {
+        return VFS_ENOEXEC;
+    }
+
+    uint64_t flags = PTE_USER;
+    if (ph->flags & PF_W) flags |= PTE_WRITABLE;
+    if (!(ph->flags & PF_X) && vmm.nx_enabled()) flags |= PTE_NX;
+
+    uint64_t start = ph->vaddr & ~(PAGE_SIZE - 1);
+    uint64_t end = ph->vaddr + ph->memsz;
+    uint64_t file_end = ph->vaddr + ph->filesz;
+    for (uint64_t page = start; page < end; page += PAGE_SIZE) {
+        uint8_t* data = user_map_page(as, page, flags);
+        if (!data) return VFS_ENOMEM;
+
+        // The part of this page backed by the file; the rest stays zero
+        uint64_t from = page < ph->vaddr ? ph->vaddr : page;
+        uint64_t to = page + PAGE_SIZE < file_end ? page + PAGE_SIZE : file_end;
+        if (from >= to) continue;
+        int64_t n = vfs_pread(fd, data + (from - page), to - from, ph->offset + (from - ph->vaddr));
+        if (n < 0) return (int)n;
+        if ((uint64_t)n != to - from) return VFS_ENOEXEC; // Truncated file
+    }
+    return 0;
+}
+
+int elf_load(const char* path, AddressSpace* as, uint64_t* entry_out) {
+    int fd = vfs_open(path, VFS_O_RDONLY);
+    if (fd < 0) return fd;
+
+    Elf64Ehdr eh;
+    Elf64Phdr phdrs[ELF_MAX_PHDRS];
+    int err = 0;
+    int64_t n = vfs_pread(fd, &eh, sizeof(eh), 0);
+    if (n < 0) {
+        err = (int)n;
+    } else if ((size_t)n != sizeof(eh) || check_header(&eh) < 0) {
+        err = VFS_ENOEXEC;
+    } else {
+        size_t size = eh.phnum * sizeof(Elf64Phdr);
+        n = vfs_pread(fd, phdrs, size, eh.phoff);
+        if (n < 0) err = (int)n;
+        else if ((size_t)n != size) err = VFS_ENOEXEC;
+    }
+
+    for (int i = 0; err == 0 && i < eh.phnum; i++) {
+        if (phdrs[i].type == PT_LOAD) {
+            err = load_segment(fd, &phdrs[i], as);
+        }
+    }
+    vfs_close(fd);
+
+    if (err == 0) *entry_out = eh.entry;
+    return err;
+}
@@ -0,0 +1,55 @@
+#ifndef ELF_HPP
+#define ELF_HPP
+
+#include "../lib/types.h"
+#include "../mm/vmm.hpp"
+
+#define ELF_MAGIC      0x464C457F  // "\x7fELF"
+#define ELFCLASS64     2
+#define ELFDATA2LSB    1
+#define ET_EXEC        2
+#define EM_X86_64      62
+#define PT_LOAD        1
+#define PF_X           0x1
+#define PF_W           0x2
+#define ELF_MAX_PHDRS  16
+
+struct Elf64Ehdr {
+    uint32_t magic;
+    uint8_t  elf_class;
+    uint8_t  data;
+    uint8_t  version;
+    uint8_t  pad[9];
+    uint16_t type;
+    uint16_t machine;
+    uint32_t version2;
+    uint64_t entry;
+    uint64_t phoff;
+    uint64_t shoff;
+    uint32_t flags;
+    uint16_t ehsize;
+    uint16_t phentsize;
+    uint16_t phnum;
+    uint16_t shentsize;
+    uint16_t shnum;
+    uint16_t shstrndx;
+} __attribute__((packed));
+
+struct Elf64Phdr {
+    uint32_t type;
+    uint32_t flags;
+    uint64_t offset;
+    uint64_t vaddr;
+    uint64_t paddr;
+    uint64_t filesz;
+    uint64_t memsz;
+    uint64_t align;
+} __attribute__((packed));
+
+// Map the PT_LOAD segments of a static ELF64 x86-64 executable into the
+// user half of `as`. Segment pages are private copies of the file, with
+// the bss zeroed. VFS_ENOEXEC if the file is not such an executable;
+// pages already mapped on failure are left for the caller's teardown.
+int elf_load(const char* path, AddressSpace* as, uint64_t* entry_out);
+
+#endif
@@ -0,0 +1,179 @@
+#include "process.hpp"
+#include "elf.hpp"
+#include "../arch/x86_64/gdt.hpp"
+#include "../arch/x86_64/fpu.hpp"
+#include "../arch/x86_64/cpu.hpp"
+#include "../drivers/console.hpp"
+#include "../fs/vfs.hpp"
+#include "../lib/string.hpp"
+#include "../mm/pmm.hpp"
+#include "../lib/trace.hpp"
+
+extern "C" {
+    int64_t user_enter(uint64_t rip, uint64_t rsp, uint64_t* saved_rsp);
+    [[noreturn]] void user_return(uint64_t saved_rsp, int64_t code);
+    extern uint64_t syscall_kernel_rsp;
+}
+
+// Auxiliary vector terminator (the only entry we pass)
+#define AT_NULL 0
+
+static Process proc;
+static Process* current = nullptr;
+static uint32_t next_pid = 1;
+
+// Syscall entry and ring 3 interrupts run here; one process at a time
+static uint8_t kernel_stack[PROCESS_KSTACK_SIZE] __attribute__((aligned(16)));
+
+Process* process_current() {
+    return current;
+}
+
+uint8_t* user_map_page(AddressSpace* as, uint64_t virt, uint64_t flags) {
+    uint64_t pte = vmm.query(as, virt);
+    if (pte & PTE_PRESENT) {
+        // Executable wins over no-execute when segments share a page
+        uint64_t widened = (pte | flags) & ~PTE_NX;
+        if ((pte & PTE_NX) && (flags & PTE_NX)) widened |= PTE_NX;
+        if (widened != pte && !vmm.map_page(as, virt, pte & PTE_ADDR_MASK, widened & ~PTE_ADDR_MASK)) {
+            return nullptr;
+        }
+        return (uint8_t*)phys_to_virt(pte & PTE_ADDR_MASK);
+    }
+
+    void* frame = pmm.allocate_frame();
+    if (!frame) return nullptr;
+    uint8_t* data = (uint8_t*)phys_to_virt((uint64_t)frame);
+    memset(data, 0, PAGE_SIZE);
+    if (!vmm.map_page(as, virt, (uint64_t)frame, flags)) {
+        pmm.free_frame(frame);
+        return nullptr;
+    }
+    return data;
+}
+
+bool user_range_ok(uint64_t addr, size_t len, bool write) {
+    if (!current) return false;
+    if (len == 0) return true;
+    if (addr >= USER_SPACE_END || len > USER_SPACE_END - addr) return false;
+
+    uint64_t need = PTE_PRESENT | PTE_USER | (write ? PTE_WRITABLE : 0);
+    for (uint64_t page = addr & ~(PAGE_SIZE - 1); page < addr + len; page += PAGE_SIZE) {
+        if ((vmm.query(&current->as, page) & need) != need) return false;
+    }
+    return true;
+}
+
+// Map the stack and lay out argc, argv[], a null envp and an empty
+// auxiliary vector as the SysV ABI expects at _start. The strings and
+// pointers fit in the top page (a shell line is far shorter).
+static bool setup_stack(AddressSpace* as, int argc, char** argv, uint64_t* rsp_out) {
+    uint64_t flags = PTE_USER | PTE_WRITABLE | (vmm.nx_enabled() ? PTE_NX : 0);
+    uint8_t* top = nullptr;
+    for (uint64_t i = 1; i <= USER_STACK_PAGES; i++) {
+        uint8_t* page = user_map_page(as, USER_STACK_TOP - i * PAGE_SIZE, flags);
+        if (!page) return false;
+        if (i == 1) top = page + PAGE_SIZE;
+    }
+
+    // Strings first, at the very top
+    uint64_t user_ptrs[PROCESS_MAX_ARGS];
+    size_t off = 0;
+    for (int i = 0; i < argc; i++) {
+        size_t len = strlen(argv[i]) + 1;
+        off += len;
+        memcpy(top - off, argv[i], len);
+        user_ptrs[i] = USER_STACK_TOP - off;
+    }
+    off = (off + 15) & ~(size_t)15;
+
+    // argc, argv[argc + 1], envp[1], auxv[2]; rsp must end up 16-byte aligned
+    size_t words = 1 + (argc + 1) + 1 + 2;
+    if (words & 1) words++;
+    off += words * sizeof(uint64_t);
+    uint64_t* sp = (uint64_t*)(top - off);
+    memset(sp, 0, words * sizeof(uint64_t));
+    sp[0] = (uint64_t)argc;
+    for (int i = 0; i < argc; i++) {
+        sp[1 + i] = user_ptrs[i];
+    }
+    sp[1 + argc + 1 + 1] = AT_NULL; // argv and envp terminators are already zero
+
+    *rsp_out = USER_STACK_TOP - off;
+    return true;
+}
+
+static void teardown(Process* p) {
+    vmm.free_user_frames(&p->as);
+    vmm.destroy_address_space(&p->as);
+}
+
+int process_exec(const char* path, int argc, char** argv, int* status) {
+    if (current) return VFS_EBUSY;
+    if (argc < 1 || argc > PROCESS_MAX_ARGS) return VFS_EINVAL;
+    TRACE_SCOPE(TRACE_PROC, "exec");
+
+    Process* p = &proc;
+    memset(p, 0, sizeof(*p));
+    if (!vmm.create_address_space(&p->as)) return VFS_ENOMEM;
+
+    uint64_t entry, rsp;
+    TRACE_BEGIN(TRACE_PROC, "load", 0);
+    int err = elf_load(path, &p->as, &entry);
+    if (err == 0 && !setup_stack(&p->as, argc, argv, &rsp)) err = VFS_ENOMEM;
+    TRACE_END(TRACE_PROC, "load", 0);
+    if (err < 0) {
+        teardown(p);
+        return err;
+    }
+
+    p->pid = next_pid++;
+    p->mmap_next = USER_MMAP_BASE;
+
+    uint64_t stack_top = (uint64_t)&kernel_stack[PROCESS_KSTACK_SIZE];
+    syscall_kernel_rsp = stack_top;
+    gdt_set_kernel_stack(stack_top);
+
+    vmm.switch_to(&p->as);
+    fpu_set_state_live(true); // The SIMD registers now hold the process's state
+    current = p;
+    TRACE_BEGIN(TRACE_PROC, "run", p->pid);
+    int64_t code = user_enter(entry, rsp, &p->saved_rsp);
+    TRACE_END(TRACE_PROC, "run", p->pid);
+    current = nullptr;
+    fpu_set_state_live(false);
+    vmm.switch_to(vmm.kernel_space());
+    asm volatile("sti"); // A fault comes back with interrupts off
+
+    teardown(p);
+    *status = (int)code;
+    return 0;
+}
+
+void process_exit(int status) {
+    user_return(current->saved_rsp, status);
+}
+
+static const char* exception_name(uint64_t vector) {
+    switch (vector) {
+        case 0:  return "divide error";
+        case 3:  return "breakpoint";
+        case 6:  return "invalid opcode";
+        case 13: return "general protection fault";
+        case 14: return "page fault";
+        case 17: return "alignment check";
+        case 19: return "SIMD floating-point exception";
+        default: return "exception";
+    }
+}
+
+void process_fault(Registers* regs) {
+    kprint("[PROC] pid "); kprint_int(current->pid);
+    kprint(" killed: "); kprint(exception_name(regs->int_no));
+    kprint(" ("); kprint_int((int64_t)regs->int_no); kprint(") at rip "); kprint_hex(regs->rip);
+    if (regs->int_no == 14) {
+        kprint(", address "); kprint_hex(read_cr2());
+    }
+    kprint("\n");
+    process_exit(PROCESS_KILLED);
+}
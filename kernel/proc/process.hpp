@@ -0,0 +1,56 @@
+#ifndef PROCESS_HPP
+#define PROCESS_HPP
+
+#include "../lib/types.h"
+#include "../mm/vmm.hpp"
+#include "../arch/x86_64/interrupts.hpp"
+
+// Ring 3 processes. There is no scheduler: `exec` runs one process at a
+// time to completion on the shell's CPU, and the shell continues when it
+// exits or faults. A process that never makes a syscall keeps the CPU.
+
+// User half layout
+#define USER_SPACE_END    0x0000800000000000ULL  // First non-canonical address
+#define USER_STACK_TOP    0x00007FFFFFFFF000ULL  // One guard page below the end
+#define USER_STACK_PAGES  16
+#define USER_MMAP_BASE    0x0000100000000000ULL  // Anonymous mmap() regions grow up from here
+#define USER_MMAP_MAX_PAGES 4096                 // 16 MB per process
+
+#define PROCESS_KSTACK_SIZE 16384  // Syscalls and interrupts from ring 3
+#define PROCESS_MAX_ARGS    16
+
+#define PROCESS_KILLED -1  // Exit status of a process ended by an exception
+
+struct Process {
+    uint32_t pid;
+    AddressSpace as;
+    uint64_t mmap_next;      // Where the next anonymous mapping goes
+    uint64_t mmap_pages;
+    uint64_t syscalls;
+    uint64_t saved_rsp;      // Kernel context that user_enter returns to
+};
+
+// Load the ELF64 executable at `path` into a new address space and run it
+// with argv[0..argc). 0 with the exit status (0..255 or PROCESS_KILLED) in
+// *status, or a negative VFS_* error if the process could not be started.
+int process_exec(const char* path, int argc, char** argv, int* status);
+
+Process* process_current(); // nullptr in kernel context
+
+// End the current process from a syscall or exception; returns to the
+// caller of process_exec
+[[noreturn]] void process_exit(int status);
+
+// An exception in ring 3: report it and end the process
+[[noreturn]] void process_fault(Registers* regs);
+
+// Check that [addr, addr + len) is mapped for the current process (and
+// writable if `write`), so the kernel may access it directly
+bool user_range_ok(uint64_t addr, size_t len, bool write);
+
+// Allocate, zero and map one page of the process; if it is already mapped
+// (ELF segments may share a page) its flags are widened instead.
+// Returns the page's kernel address, nullptr when out of memory.
+uint8_t* user_map_page(AddressSpace* as, uint64_t virt, uint64_t flags);
+
+#endif
@@ -0,0 +1,188 @@
+#include "syscall.hpp"
+#include "process.hpp"
+#include "../arch/x86_64/cpu.hpp"
+#include "../arch/x86_64/gdt.hpp"
+#include "../drivers/console.hpp"
+#include "../drivers/serial.hpp"
+#include "../drivers/keyboard.hpp"
+#include "../fs/vfs.hpp"
+#include "../mm/pmm.hpp"
+#include "../lib/string.hpp"
+#include "../lib/trace.hpp"
+
+#define MSR_EFER   0xC0000080
+#define MSR_STAR   0xC0000081
+#define MSR_LSTAR  0xC0000082
+#define MSR_SFMASK 0xC0000084
+#define EFER_SCE   (1ULL << 0)
+
+// RFLAGS bits cleared on entry: TF, IF, DF and AC
+#define SYSCALL_RFLAGS_MASK ((1ULL << 8) | (1ULL << 9) | (1ULL << 10) | (1ULL << 18))
+
+extern "C" void syscall_entry();
+
+typedef int64_t (*SyscallFn)(SyscallFrame* f);
+
+static SyscallFn syscall_table[SYSCALL_MAX];
+
+// --- Console ---
+
+static int64_t sys_write(SyscallFrame* f) {
+    uint64_t fd = f->rdi;
+    const char* buf = (const char*)f->rsi;
+    size_t len = f->rdx;
+    if (fd != 1 && fd != 2) return VFS_EBADF;
+    if (!user_range_ok((uint64_t)buf, len, false)) return VFS_EFAULT;
+
+    for (size_t i = 0; i < len; i++) {
+        console.write_char(buf[i]);
+        Serial::write_char(buf[i]);
+    }
+    return (int64_t)len;
+}
+
+// A line from the keyboard, echoed, with backspace; Ctrl+D on an empty
+// line is end of file. Returns when the line ends or the buffer is full.
+static int64_t sys_read(SyscallFrame* f) {
+    uint64_t fd = f->rdi;
+    char* buf = (char*)f->rsi;
+    size_t len = f->rdx;
+    if (fd != 0) return VFS_EBADF;
+    if (!user_range_ok((uint64_t)buf, len, true)) return VFS_EFAULT;
+
+    size_t n = 0;
+    while (n < len) {
+        asm volatile("cli");
+        if (!keyboard_has_input()) {
+            asm volatile("sti; hlt");
+            continue;
+        }
+        asm volatile("sti");
+
+        int key;
+        while (n < len && (key = keyboard_read_key()) >= 0) {
+            if (key == 4 && n == 0) return 0; // Ctrl+D
+            if (key == '\b') {
+                if (n > 0) {
+                    n--;
+                    console.cursor_back(1);
+                    console.write_char(' ');
+                    console.cursor_back(1);
+                }
+                continue;
+            }
+            if (key != '\n' && (key < ' ' || key > '~')) continue;
+            buf[n++] = (char)key;
+            console.write_char((char)key);
+            if (key == '\n') return (int64_t)n;
+        }
+    }
+    return (int64_t)n;
+}
+
+// --- Memory ---
+
+// One zeroed 2MB page for an aligned chunk of a mapping; false means the
+// caller falls back to 4KB pages
+static bool map_huge(AddressSpace* as, uint64_t virt, uint64_t flags) {
+    void* frame = pmm.allocate_huge_frame();
+    if (!frame) return false;
+    memset(phys_to_virt((uint64_t)frame), 0, HUGE_FRAME_SIZE);
+    if (!vmm.map_huge_page(as, virt, (uint64_t)frame, flags)) {
+        pmm.free_huge_frame(frame);
+        return false;
+    }
+    return true;
+}
+
+static void unmap_range(AddressSpace* as, uint64_t start, uint64_t end) {
+    for (uint64_t va = start; va < end;) {
+        uint64_t e = vmm.query(as, va);
+        if (e & PTE_HUGE) {
+            vmm.unmap_huge_page(as, va);
+            pmm.free_huge_frame((void*)(e & PTE_ADDR_MASK));
+            va += HUGE_FRAME_SIZE;
+        } else {
+            vmm.unmap_page(as, va);
+            pmm.free_frame((void*)(e & PTE_ADDR_MASK));
+            va += PAGE_SIZE;
+        }
+    }
+}
+
+// Anonymous private mappings only, placed by the kernel. Regions of 2MB or
+// more start 2MB-aligned and use 2MB pages where the PMM has them.
+static int64_t sys_mmap(SyscallFrame* f) {
+    size_t len = f->rsi;
+    uint64_t prot = f->rdx;
+    uint64_t flags = f->r10;
+    Process* p = process_current();
+
+    if (len == 0 || (flags & MAP_FIXED) || (flags & (MAP_PRIVATE | MAP_ANONYMOUS)) != (MAP_PRIVATE | MAP_ANONYMOUS)) {
+        return VFS_EINVAL;
+    }
+    uint64_t pages = (len + PAGE_SIZE - 1) / PAGE_SIZE;
+    if (pages > USER_MMAP_MAX_PAGES - p->mmap_pages) return VFS_ENOMEM;
+
+    uint64_t pte = PTE_USER;
+    if (prot & PROT_WRITE) pte |= PTE_WRITABLE;
+    if (!(prot & PROT_EXEC) && vmm.nx_enabled()) pte |= PTE_NX;
+
+    uint64_t base = p->mmap_next;
+    if (pages >= HUGE_FRAME_PAGES) base = (base + HUGE_FRAME_SIZE - 1) & ~(HUGE_FRAME_SIZE - 1);
+    uint64_t end = base + pages * PAGE_SIZE;
+    for (uint64_t va = base; va < end;) {
+        if (va % HUGE_FRAME_SIZE == 0 && end - va >= HUGE_FRAME_SIZE && map_huge(&p->as, va, pte)) {
+            va += HUGE_FRAME_SIZE;
+        } else if (user_map_page(&p->as, va, pte)) {
+            va += PAGE_SIZE;
+        } else {
+            unmap_range(&p->as, base, va);
+            return VFS_ENOMEM;
+        }
+    }
+    // Leave an unmapped page between regions so overruns fault
+    p->mmap_next = end + PAGE_SIZE;
+    p->mmap_pages += pages;
+    return (int64_t)base;
+}
+
+// --- Process ---
+
+static int64_t sys_getpid(SyscallFrame* f) {
+    (void)f;
+    return process_current()->pid;
+}
+
+static int64_t sys_exit(SyscallFrame* f) {
+    TRACE_END(TRACE_SYSCALL, "syscall", SYS_exit);  // Does not return to the dispatcher
+    process_exit((int)(f->rdi & 0xFF));
+}
+
+extern "C" int64_t syscall_dispatch(SyscallFrame* f) {
+    process_current()->syscalls++;
+    if (f->rax >= SYSCALL_MAX || !syscall_table[f->rax]) return VFS_ENOSYS;
+    TRACE_BEGIN(TRACE_SYSCALL, "syscall", f->rax);
+    int64_t ret = syscall_table[f->rax](f);
+    TRACE_END(TRACE_SYSCALL, "syscall", f->rax);
+    return ret;
+}
+
+void syscall_init() {
+    syscall_table[SYS_read] = sys_read;
+    syscall_table[SYS_write] = sys_write;
+    syscall_table[SYS_mmap] = sys_mmap;
+    syscall_table[SYS_getpid] = sys_getpid;
+    syscall_table[SYS_exit] = sys_exit;
+
+    // SYSCALL loads CS = STAR[47:32] and SS = +8; SYSRET to 64-bit code
+    // loads SS = STAR[63:48] + 8 and CS = STAR[63:48] + 16, both with RPL 3
+    uint64_t star = ((uint64_t)GDT_KERNEL_CODE << 32) | ((uint64_t)(GDT_USER_DATA - 8) << 48);
+    wrmsr(MSR_STAR, star);
+    wrmsr(MSR_LSTAR, (uint64_t)syscall_entry);
+    wrmsr(MSR_SFMASK, SYSCALL_RFLAGS_MASK);
+    wrmsr(MSR_EFER, rdmsr(MSR_EFER) | EFER_SCE);
+
+    kprint("SYSCALL: entry at "); kprint_hex((uint64_t)syscall_entry);
+    kprint(", "); kprint_int(SYSCALL_MAX); kprint(" slots\n");
+}
@@ -0,0 +1,36 @@
+#ifndef SYSCALL_HPP
+#define SYSCALL_HPP
+
+#include "../lib/types.h"
+
+// System call numbers and flags. They are Linux's, so the programs in
+// user/ also run unchanged on a Linux host. Shared with user/ulib.hpp.
+#define SYS_read    0
+#define SYS_write   1
+#define SYS_mmap    9
+#define SYS_getpid  39   // Does no work: the null syscall of `sysbench`
+#define SYS_exit    60
+#define SYSCALL_MAX 64   // Size of the dispatch table
+
+#define PROT_READ     0x1
+#define PROT_WRITE    0x2
+#define PROT_EXEC     0x4
+#define MAP_PRIVATE   0x02
+#define MAP_FIXED     0x10
+#define MAP_ANONYMOUS 0x20
+
+#ifndef USER_PROGRAM
+
+// Registers pushed by syscall_entry, lowest address first
+struct SyscallFrame {
+    uint64_t r9, r8, r10, rdx, rsi, rdi;  // Arguments 6..1
+    uint64_t rax;                          // Number
+    uint64_t r11, rcx, rsp;                // User rflags, rip and stack
+};
+
+// Enable SYSCALL (EFER.SCE) and point LSTAR at syscall_entry
+void syscall_init();
+
+#endif
+
+#endif
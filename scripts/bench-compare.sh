@@ -0,0 +1,29 @@
+#!/bin/sh
+# Compare two `make bench` result files, e.g.
+#   scripts/bench-compare.sh bench-results/abc1234.txt bench-results/def5678.txt
+# Prints p50/p99 cycles per benchmark and the change of p50 in percent.
+if [ $# -ne 2 ]; then
+    echo "usage: $0 <old results> <new results>" >&2
+    exit 1
+fi
+
+awk '
+function field(key,    i) {
+    for (i = 3; i <= NF; i++) {
+        if (index($i, key "=") == 1) return substr($i, length(key) + 2)
+    }
+    return ""
+}
+$1 != "BENCH" || $3 == "skipped" { next }
+FNR == NR { old50[$2] = field("p50"); old99[$2] = field("p99"); next }
+{
+    p50 = field("p50"); p99 = field("p99")
+    if (!($2 in old50)) {
+        printf "%-16s %10s %10s -> %8s %8s\n", $2, "-", "-", p50, p99
+        next
+    }
+    delta = old50[$2] > 0 ? (p50 - old50[$2]) * 100 / old50[$2] : 0
+    printf "%-16s %10s %10s -> %8s %8s  p50 %+.1f%%\n", $2, old50[$2], old99[$2], p50, p99, delta
+}
+BEGIN { printf "%-16s %10s %10s    %8s %8s\n", "benchmark", "old p50", "old p99", "p50", "p99" }
+' "$1" "$2"
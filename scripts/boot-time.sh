@@ -0,0 +1,47 @@
+#!/bin/bash
+# Boot-to-prompt wall time under QEMU, e.g.
+#   make os.iso && scripts/boot-time.sh [runs]
+# Boots os.iso headless `runs` times (default 5) and times each boot from
+# starting QEMU until the kernel prints its "Boot:" summary just before the
+# first prompt. Prints every run with the kernel's own figures and the median
+# wall time. QEMU, ISO and DISK (attached as hda if present) can be overridden.
+QEMU=${QEMU:-qemu-system-x86_64}
+ISO=${ISO:-os.iso}
+DISK=${DISK:-build/disk.img}
+RUNS=${1:-5}
+TIMEOUT=${TIMEOUT:-30}
+
+if [ ! -f "$ISO" ]; then
+    echo "$0: $ISO not found, run make os.iso first" >&2
+    exit 1
+fi
+DRIVE=()
+if [ -f "$DISK" ]; then
+    DRIVE=(-drive "file=$DISK,format=raw,if=ide,index=0,snapshot=on")
+fi
+
+times=()
+for run in $(seq 1 "$RUNS"); do
+    start=$(date +%s%N)
+    coproc VM { exec "$QEMU" -boot d -cdrom "$ISO" "${DRIVE[@]}" -display none -serial stdio -monitor none -no-reboot; }
+    summary=""
+    while IFS= read -r -t "$TIMEOUT" line <&"${VM[0]}"; do
+        case "$line" in
+            Boot:*) summary=${line%$'\r'}; break ;;
+        esac
+    done
+    end=$(date +%s%N)
+    kill "$VM_PID" 2>/dev/null
+    wait "$VM_PID" 2>/dev/null
+
+    if [ -z "$summary" ]; then
+        echo "run $run: no boot summary within ${TIMEOUT}s" >&2
+        exit 1
+    fi
+    ms=$(( (end - start) / 1000000 ))
+    times+=("$ms")
+    echo "run $run: ${ms} ms wall | $summary"
+done
+
+median=$(printf '%s\n' "${times[@]}" | sort -n | awk '{ v[NR] = $1 } END { print v[int((NR + 1) / 2)] }')
+echo "median: ${median} ms wall over $RUNS runs"
@@ -0,0 +1,29 @@
+#!/bin/sh
+# Turn `nm -n kernel.elf | c++filt -p` on stdin into the C++ source of the
+# kernel symbol table (kernel/lib/ksyms.hpp). Only code symbols are kept,
+# one per address; NASM local labels (isr_common_stub.x) are left to their
+# parent. Empty input gives an empty table for the first link.
+awk '
+BEGIN {
+    print "// Generated by scripts/gen-ksyms.sh; do not edit"
+    print "#include \"lib/ksyms.hpp\""
+    print ""
+    print "const KernelSymbol ksyms[] = {"
+    n = 0
+}
+$2 ~ /^[TtWw]$/ && $3 !~ /^[A-Za-z_][A-Za-z0-9_]*\.[A-Za-z0-9_.]+$/ && $1 != last {
+    last = $1
+    name = $3
+    for (i = 4; i <= NF; i++) name = name " " $i
+    gsub(/\\/, "\\\\", name)
+    gsub(/"/, "\\\"", name)
+    printf "    {0x%sULL, \"%s\"},\n", $1, name
+    n++
+}
+END {
+    print "    {0, nullptr} // Keeps the array non-empty; not counted"
+    print "};"
+    print ""
+    printf "const size_t ksyms_count = %d;\n", n
+}
+'
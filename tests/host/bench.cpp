@@ -0,0 +1,131 @@
+// Hosted microbenchmarks for the PMM and tarfs. Output uses the same
+// BENCH line format as the in-kernel `bench` command, so results can be
+// compared with scripts/bench-compare.sh.
+#include "shim.hpp"
+#include "fixtures.hpp"
+#include "../../kernel/mm/pmm.hpp"
+#include "../../kernel/fs/tarfs.hpp"
+#include "../../kernel/arch/x86_64/multiboot.hpp"
+#include <stdio.h>
+#include <algorithm>
+
+#define MB (1024ULL * 1024)
+#define MAX_SAMPLES 100000
+
+typedef void (*BenchOp)(uint64_t i);
+
+static uint64_t samples[MAX_SAMPLES];
+static uint64_t overhead = 0;
+
+static void empty_op(uint64_t i) {
+    (void)i;
+}
+
+static void measure(BenchOp op, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        uint64_t start = rdtsc_ordered();
+        op(i);
+        uint64_t cycles = rdtsc_ordered() - start;
+        samples[i] = cycles > overhead ? cycles - overhead : 0;
+    }
+    std::sort(samples, samples + n);
+}
+
+static void run(const char* name, BenchOp op, size_t n) {
+    measure(op, n);
+    uint64_t total = 0;
+    for (size_t i = 0; i < n; i++) total += samples[i];
+    uint64_t ops_per_sec = total ? (uint64_t)n * tsc_hz() / total : 0;
+    printf("BENCH %s n=%zu ops/s=%lu p50=%lu p99=%lu max=%lu\n", name, n,
+           (unsigned long)ops_per_sec, (unsigned long)samples[n / 2],
+           (unsigned long)samples[n * 99 / 100], (unsigned long)samples[n - 1]);
+}
+
+// --- PMM ---
+
+static void pmm_boot_128mb() {
+    static const MemoryRegion map[] = {
+        {0x0, 0x9FC00, MULTIBOOT_MEMORY_AVAILABLE},
+        {1 * MB, 127 * MB, MULTIBOOT_MEMORY_AVAILABLE},
+    };
+    pmm.init(make_multiboot_info(map, 2, nullptr, 0));
+}
+
+// Leave the first eighths/8 of memory allocated, so first fit has to scan past it
+static void pmm_fill(size_t eighths) {
+    uint64_t target = pmm.get_total_memory() / PAGE_SIZE * eighths / 8;
+    while (pmm.get_used_memory() / PAGE_SIZE < target) {
+        if (!pmm.allocate_frame()) break;
+    }
+}
+
+static void pmm_alloc_free_op(uint64_t i) {
+    (void)i;
+    pmm.free_frame(pmm.allocate_frame());
+}
+
+static void pmm_alloc_frames16_op(uint64_t i) {
+    (void)i;
+    pmm.free_frames(pmm.allocate_frames(16), 16);
+}
+
+// --- tarfs ---
+
+static TarBuilder tree;
+static size_t tree_files = 0;
+static char (*tree_paths)[64] = nullptr;
+
+static void tarfs_lookup_op(uint64_t i) {
+    size_t size;
+    tarfs_lookup(tree_paths[(i * 7919) % tree_files], &size);
+}
+
+static void tarfs_lookup_miss_op(uint64_t i) {
+    size_t size;
+    (void)i;
+    tarfs_lookup("bench/d042/nothing.txt", &size);
+}
+
+static void tarfs_init_op(uint64_t i) {
+    (void)i;
+    tarfs_init(tree.data, tree.size);
+}
+
+static void tarfs_build(size_t files) {
+    tar_free(&tree);
+    tar_make_tree(&tree, files, 100);
+    free(tree_paths);
+    tree_paths = (char(*)[64])malloc(files * 64);
+    for (size_t n = 0; n < files; n++) tree_path(tree_paths[n], n, 100);
+    tree_files = files;
+    tarfs_init(tree.data, tree.size);
+}
+
+int main() {
+    shim_quiet = true;
+    tsc_calibrate();
+    measure(empty_op, 1024);
+    overhead = samples[512];
+    printf("BENCH_BEGIN tsc_hz=%lu overhead=%lu\n", (unsigned long)tsc_hz(), (unsigned long)overhead);
+
+    pmm_boot_128mb();
+    run("pmm_alloc_free", pmm_alloc_free_op, 10000);
+    run("pmm_alloc_frames16", pmm_alloc_frames16_op, 10000);
+    pmm_fill(4);
+    run("pmm_alloc_free_half_used", pmm_alloc_free_op, 10000);
+    run("pmm_alloc_frames16_half_used", pmm_alloc_frames16_op, 10000);
+
+    tarfs_build(10000);
+    run("tarfs_lookup_10k", tarfs_lookup_op, 100000);
+    run("tarfs_lookup_miss_10k", tarfs_lookup_miss_op, 100000);
+    run("tarfs_init_10k", tarfs_init_op, 100);
+    tarfs_build(100000);
+    run("tarfs_lookup_100k", tarfs_lookup_op, 100000);
+
+    printf("BENCH_END count=8\n");
+
+    // The kernel's own `tarbench` report, for the hashed vs linear numbers
+    shim_quiet = false;
+    tarfs_bench(10000);
+    return 0;
+}
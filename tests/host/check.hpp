@@ -0,0 +1,36 @@
+#ifndef HOST_CHECK_HPP
+#define HOST_CHECK_HPP
+
+#include <stdio.h>
+
+// Minimal assertions for the hosted tests: a failed CHECK is reported and
+// counted, and the test binary exits non-zero at the end.
+extern int check_failures;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if (!(cond)) {                                                      \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            check_failures++;                                               \
+        }                                                                   \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                      \
+    do {                                                                    \
+        unsigned long long va_ = (unsigned long long)(a);                   \
+        unsigned long long vb_ = (unsigned long long)(b);                   \
+        if (va_ != vb_) {                                                   \
+            fprintf(stderr, "%s:%d: CHECK failed: %s == %s (%llu vs %llu)\n", \
+                    __FILE__, __LINE__, #a, #b, va_, vb_);                  \
+            check_failures++;                                               \
+        }                                                                   \
+    } while (0)
+
+#define RUN_TEST(fn)                                                        \
+    do {                                                                    \
+        int before_ = check_failures;                                       \
+        fn();                                                               \
+        printf("%s %s\n", check_failures == before_ ? "PASS" : "FAIL", #fn); \
+    } while (0)
+
+#endif
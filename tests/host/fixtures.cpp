@@ -0,0 +1,129 @@
+#include "fixtures.hpp"
+#include "../../kernel/arch/x86_64/multiboot.hpp"
+#include <stdio.h>
+
+void* make_multiboot_info(const MemoryRegion* regions, size_t region_count,
+                          const BootModule* modules, size_t module_count) {
+    uint8_t* base = shim_boot_area();
+    memset(base, 0, SHIM_BOOT_AREA);
+    uint8_t* p = base + 8;
+
+    multiboot_tag_mmap* mmap = (multiboot_tag_mmap*)p;
+    mmap->type = MULTIBOOT_TAG_TYPE_MMAP;
+    mmap->entry_size = sizeof(multiboot_mmap_entry);
+    mmap->entry_version = 0;
+    for (size_t i = 0; i < region_count; i++) {
+        mmap->entries[i].addr = regions[i].addr;
+        mmap->entries[i].len = regions[i].len;
+        mmap->entries[i].type = regions[i].type;
+    }
+    mmap->size = (uint32_t)(sizeof(multiboot_tag_mmap) + region_count * sizeof(multiboot_mmap_entry));
+    p += (mmap->size + 7) & ~7u;
+
+    for (size_t i = 0; i < module_count; i++) {
+        multiboot_tag_module* mod = (multiboot_tag_module*)p;
+        mod->type = MULTIBOOT_TAG_TYPE_MODULE;
+        mod->mod_start = modules[i].start;
+        mod->mod_end = modules[i].end;
+        memcpy(mod->cmdline, "initrd", 7);
+        mod->size = (uint32_t)(sizeof(multiboot_tag_module) + 7);
+        p += (mod->size + 7) & ~7u;
+    }
+
+    multiboot_tag* end = (multiboot_tag*)p;
+    end->type = MULTIBOOT_TAG_TYPE_END;
+    end->size = 8;
+    p += 8;
+
+    *(uint32_t*)base = (uint32_t)(p - base);
+    return base;
+}
+
+// --- USTAR ---
+
+#define TAR_BLOCK 512
+
+static void tar_reserve(TarBuilder* tb, size_t more) {
+    if (tb->size + more <= tb->capacity) return;
+    size_t cap = tb->capacity ? tb->capacity : 64 * 1024;
+    while (cap < tb->size + more) cap *= 2;
+    tb->data = (uint8_t*)realloc(tb->data, cap);
+    memset(tb->data + tb->capacity, 0, cap - tb->capacity);
+    tb->capacity = cap;
+}
+
+void tar_init(TarBuilder* tb) {
+    tb->data = nullptr;
+    tb->size = 0;
+    tb->capacity = 0;
+}
+
+static void put_octal(char* field, size_t width, uint64_t value) {
+    snprintf(field, width, "%0*lo", (int)(width - 1), (unsigned long)value);
+}
+
+static void tar_add(TarBuilder* tb, const char* path, char type, const void* content, size_t len) {
+    size_t blocks = 1 + (len + TAR_BLOCK - 1) / TAR_BLOCK;
+    tar_reserve(tb, blocks * TAR_BLOCK);
+    char* hdr = (char*)(tb->data + tb->size);
+
+    // name[100] at 0, prefix[155] at 345
+    size_t path_len = strlen(path);
+    if (path_len <= 100) {
+        memcpy(hdr, path, path_len);
+    } else {
+        size_t split = path_len - 101; // Leaves at most 100 bytes after the '/'
+        while (path[split] != '/') split++;
+        memcpy(hdr + 345, path, split);
+        memcpy(hdr, path + split + 1, path_len - split - 1);
+    }
+    put_octal(hdr + 100, 8, type == '5' ? 0755 : 0644);
+    put_octal(hdr + 108, 8, 0);
+    put_octal(hdr + 116, 8, 0);
+    put_octal(hdr + 124, 12, len);
+    put_octal(hdr + 136, 12, 0);
+    hdr[156] = type;
+    memcpy(hdr + 257, "ustar", 6);
+    memcpy(hdr + 263, "00", 2);
+
+    memset(hdr + 148, ' ', 8);
+    unsigned sum = 0;
+    for (size_t i = 0; i < TAR_BLOCK; i++) sum += (uint8_t)hdr[i];
+    snprintf(hdr + 148, 8, "%06o", sum);
+
+    if (len) memcpy(hdr + TAR_BLOCK, content, len);
+    tb->size += blocks * TAR_BLOCK;
+}
+
+void tar_add_file(TarBuilder* tb, const char* path, const void* content, size_t len) {
+    tar_add(tb, path, '0', content, len);
+}
+
+void tar_add_dir(TarBuilder* tb, const char* path) {
+    tar_add(tb, path, '5', nullptr, 0);
+}
+
+void tar_finish(TarBuilder* tb) {
+    tar_reserve(tb, 2 * TAR_BLOCK);
+    memset(tb->data + tb->size, 0, 2 * TAR_BLOCK);
+    tb->size += 2 * TAR_BLOCK;
+}
+
+void tar_free(TarBuilder* tb) {
+    free(tb->data);
+    tar_init(tb);
+}
+
+void tree_path(char* out, size_t n, size_t files_per_dir) {
+    sprintf(out, "bench/d%03zu/file%06zu.txt", n / files_per_dir, n);
+}
+
+void tar_make_tree(TarBuilder* tb, size_t files, size_t files_per_dir) {
+    char path[64];
+    tar_init(tb);
+    for (size_t n = 0; n < files; n++) {
+        tree_path(path, n, files_per_dir);
+        tar_add_file(tb, path, path, strlen(path));
+    }
+    tar_finish(tb);
+}
@@ -0,0 +1,45 @@
+#ifndef HOST_FIXTURES_HPP
+#define HOST_FIXTURES_HPP
+
+#include "shim.hpp"
+
+// Synthetic boot inputs for the hosted tests and benchmarks.
+
+// --- multiboot2 information ---
+
+struct MemoryRegion {
+    uint64_t addr;
+    uint64_t len;
+    uint32_t type; // MULTIBOOT_MEMORY_*
+};
+
+struct BootModule {
+    uint32_t start;
+    uint32_t end;
+};
+
+// Build a multiboot2 info block (mmap tag, module tags, end tag) in the
+// shim's boot area, right after the kernel image, and return it
+void* make_multiboot_info(const MemoryRegion* regions, size_t region_count,
+                          const BootModule* modules, size_t module_count);
+
+// --- USTAR archives ---
+
+struct TarBuilder {
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+};
+
+void tar_init(TarBuilder* tb);
+// Paths longer than 100 bytes are split into prefix + name
+void tar_add_file(TarBuilder* tb, const char* path, const void* content, size_t len);
+void tar_add_dir(TarBuilder* tb, const char* path);
+void tar_finish(TarBuilder* tb); // Two zero blocks; data/size is the archive
+void tar_free(TarBuilder* tb);
+
+// "bench/dNNN/fileNNNNNN.txt" archives as used by the in-kernel tarbench
+void tar_make_tree(TarBuilder* tb, size_t files, size_t files_per_dir);
+void tree_path(char* out, size_t n, size_t files_per_dir);
+
+#endif
@@ -0,0 +1,82 @@
+#include "shim.hpp"
+#include "../../kernel/fs/vfs.hpp"
+#include <stdio.h>
+#include <time.h>
+
+bool shim_quiet = false;
+
+void kprint(const char* str) {
+    if (!shim_quiet) fputs(str, stdout);
+}
+
+void kprint_hex(uint64_t n) {
+    if (!shim_quiet) printf("0x%lx", (unsigned long)n);
+}
+
+void kprint_int(int64_t n) {
+    if (!shim_quiet) printf("%ld", (long)n);
+}
+
+void klog(const char* msg) {
+    if (!shim_quiet) printf("[LOG] %s\n", msg);
+}
+
+void panic(const char* msg) {
+    fprintf(stderr, "panic: %s\n", msg);
+    abort();
+}
+
+// --- TSC ---
+
+static uint64_t tsc_frequency = 0;
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void tsc_calibrate() {
+    uint64_t ns0 = now_ns();
+    uint64_t c0 = rdtsc();
+    while (now_ns() - ns0 < 50000000ULL) {} // 50 ms, like the PIT window in the kernel
+    uint64_t c1 = rdtsc();
+    uint64_t ns1 = now_ns();
+    tsc_frequency = (c1 - c0) * 1000000000ULL / (ns1 - ns0);
+}
+
+uint64_t tsc_hz() {
+    return tsc_frequency;
+}
+
+uint64_t tsc_cycles_to_ns(uint64_t cycles) {
+    if (tsc_frequency == 0) return 0;
+    uint64_t sec = cycles / tsc_frequency;
+    uint64_t rem = cycles % tsc_frequency;
+    return sec * 1000000000ULL + rem * 1000000000ULL / tsc_frequency;
+}
+
+// --- Physical memory layout ---
+
+// Stands in for the linker script symbol; the boot area follows it
+extern "C" uint8_t _kernel_end[SHIM_BOOT_AREA];
+uint8_t _kernel_end[SHIM_BOOT_AREA] __attribute__((aligned(4096)));
+
+uint64_t shim_phys_base = (uint64_t)_kernel_end - SHIM_KERNEL_END;
+
+uint8_t* shim_boot_area() {
+    return _kernel_end;
+}
+
+// --- VFS ---
+
+const VfsOps* shim_mounted_ops = nullptr;
+
+int vfs_mount(const char* path, const VfsOps* ops, void* fs_data) {
+    (void)path;
+    (void)fs_data;
+    shim_mounted_ops = ops;
+    return 0;
+}
+
+void vfs_dcache_invalidate() {}
@@ -0,0 +1,110 @@
+#ifndef HOST_SHIM_HPP
+#define HOST_SHIM_HPP
+
+// Hosted (Linux user space) stand-ins for the kernel headers that
+// kernel/mm/pmm.cpp and kernel/fs/tarfs.cpp depend on. The Makefile
+// force-includes this file (-include) ahead of each kernel source, and
+// defining a header's include guard here makes the real header a no-op,
+// so the kernel sources build unchanged. Headers that are pure
+// declarations (multiboot.hpp, pmm.hpp, vfs.hpp, tarfs.hpp) are used as is.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <x86intrin.h>
+
+// kernel/lib/types.h
+#define TYPES_H
+
+// kernel/drivers/console.hpp: kprint & co. go to stdout unless muted
+#define CONSOLE_HPP
+extern bool shim_quiet;
+void kprint(const char* str);
+void kprint_hex(uint64_t n);
+void kprint_int(int64_t n);
+void klog(const char* msg);
+void panic(const char* msg);
+
+// kernel/arch/x86_64/cpu.hpp
+#define CPU_HPP
+static inline uint64_t rdtsc() {
+    return __rdtsc();
+}
+
+static inline uint64_t rdtsc_ordered() {
+    _mm_lfence();
+    uint64_t t = __rdtsc();
+    _mm_lfence();
+    return t;
+}
+
+// kernel/arch/x86_64/tsc.hpp: calibrated against CLOCK_MONOTONIC
+#define TSC_HPP
+void tsc_calibrate();
+uint64_t tsc_hz();
+uint64_t tsc_cycles_to_ns(uint64_t cycles);
+
+// kernel/lib/string.hpp: the C library provides mem*/str*
+#define STRING_HPP
+
+// kernel/mm/heap.hpp
+#define HEAP_HPP
+static inline void* kmalloc(size_t size) { return malloc(size); }
+static inline void* kzalloc(size_t size) { return calloc(1, size); }
+static inline void kfree(void* ptr) { free(ptr); }
+
+// kernel/lib/spinlock.hpp: single-threaded, and interrupts do not exist
+#define SPINLOCK_HPP
+class Spinlock {
+public:
+    constexpr Spinlock(const char* name = nullptr) : locked(false) { (void)name; }
+    bool try_lock() { if (locked) return false; locked = true; return true; }
+    void lock() { if (!try_lock()) panic("spinlock: deadlock"); }
+    void unlock() { locked = false; }
+    uint64_t lock_irqsave() { lock(); return 0; }
+    void unlock_irqrestore(uint64_t flags) { (void)flags; unlock(); }
+    bool is_locked() const { return locked; }
+
+private:
+    bool locked;
+};
+
+class ScopedIrqLock {
+public:
+    explicit ScopedIrqLock(Spinlock& l) : lock(l) { lock.lock(); }
+    ~ScopedIrqLock() { lock.unlock(); }
+
+private:
+    Spinlock& lock;
+};
+
+// kernel/lib/rcu.hpp: with one thread every grace period is already over
+#define RCU_HPP
+static inline void rcu_read_lock() {}
+static inline void rcu_read_unlock() {}
+class RcuReadGuard {
+public:
+    RcuReadGuard() {}
+};
+#define rcu_dereference(p) __atomic_load_n(&(p), __ATOMIC_CONSUME)
+#define rcu_assign_pointer(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+static inline void synchronize_rcu() {}
+
+// kernel/mm/vmm.hpp: physical address 0 is host address shim_phys_base.
+// The image "ends" at SHIM_KERNEL_END, and the SHIM_BOOT_AREA bytes after
+// it (shim_boot_area()) are where tests put multiboot info, as GRUB does.
+#define VMM_HPP
+#define SHIM_KERNEL_END (2ULL << 20)
+#define SHIM_BOOT_AREA  (64 * 1024)
+extern uint64_t shim_phys_base;
+static inline void* phys_to_virt(uint64_t phys) { return (void*)(phys + shim_phys_base); }
+static inline uint64_t virt_to_phys(const void* virt) { return (uint64_t)virt - shim_phys_base; }
+uint8_t* shim_boot_area();
+
+// The filesystem most recently passed to vfs_mount (kernel/fs/vfs.cpp is
+// not part of the hosted build)
+struct VfsOps;
+extern const VfsOps* shim_mounted_ops;
+
+#endif
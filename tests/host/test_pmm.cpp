@@ -0,0 +1,342 @@
+// Hosted tests for kernel/mm/pmm.cpp: synthetic multiboot2 memory maps in,
+// frame allocations out.
+#include "shim.hpp"
+#include "check.hpp"
+#include "fixtures.hpp"
+#include "../../kernel/mm/pmm.hpp"
+#include "../../kernel/arch/x86_64/multiboot.hpp"
+
+int check_failures = 0;
+
+#define MB (1024ULL * 1024)
+
+static const MemoryRegion pc_map[] = {
+    {0x0, 0x9FC00, MULTIBOOT_MEMORY_AVAILABLE},
+    {0x9FC00, 0x60400, MULTIBOOT_MEMORY_RESERVED},   // EBDA, VGA, BIOS
+    {1 * MB, 31 * MB, MULTIBOOT_MEMORY_AVAILABLE},
+};
+
+static void init_with(const MemoryRegion* regions, size_t count,
+                      const BootModule* modules = nullptr, size_t module_count = 0) {
+    pmm.set_reclaim_hook(nullptr);
+    pmm.init(make_multiboot_info(regions, count, modules, module_count));
+}
+
+static uint64_t free_frames() {
+    return pmm.get_free_memory() / PAGE_SIZE;
+}
+
+// Allocate until the PMM runs dry; returns how many frames it gave out
+static size_t drain(uint64_t* out, size_t max) {
+    size_t n = 0;
+    void* f;
+    while (n < max && (f = pmm.allocate_frame()) != nullptr) {
+        out[n++] = (uint64_t)f;
+    }
+    return n;
+}
+
+static uint64_t frames[FRAMES_COUNT];
+
+static void test_low_memory_and_kernel_reserved() {
+    init_with(pc_map, 3);
+    CHECK_EQ(pmm.get_total_memory(), 32 * MB);
+
+    // Everything below the end of the kernel, plus the multiboot info
+    // right after it, stays out of reach
+    uint64_t first = (uint64_t)pmm.allocate_frame();
+    CHECK_EQ(first, SHIM_KERNEL_END + PAGE_SIZE);
+    pmm.free_frame((void*)first);
+    CHECK_EQ(free_frames(), 32 * MB / PAGE_SIZE - SHIM_KERNEL_END / PAGE_SIZE - 1);
+}
+
+static void test_drain_and_refill() {
+    init_with(pc_map, 3);
+    uint64_t before = free_frames();
+
+    size_t n = drain(frames, FRAMES_COUNT);
+    CHECK_EQ(n, before);
+    CHECK_EQ(free_frames(), 0);
+    for (size_t i = 0; i < n; i++) {
+        CHECK(frames[i] % PAGE_SIZE == 0);
+        CHECK(frames[i] >= SHIM_KERNEL_END && frames[i] < 32 * MB);
+        if (i > 0) CHECK(frames[i] > frames[i - 1]); // First fit: ascending, distinct
+    }
+
+    for (size_t i = 0; i < n; i++) pmm.free_frame((void*)frames[i]);
+    CHECK_EQ(free_frames(), before);
+}
+
+static void test_holes_are_never_allocated() {
+    static const MemoryRegion map[] = {
+        {1 * MB, 7 * MB, MULTIBOOT_MEMORY_AVAILABLE},
+        {8 * MB, 1 * MB, MULTIBOOT_MEMORY_RESERVED},
+        {9 * MB, 1 * MB, MULTIBOOT_MEMORY_ACPI_RECLAIMABLE},
+        {10 * MB, 6 * MB, MULTIBOOT_MEMORY_AVAILABLE},
+    };
+    init_with(map, 4);
+
+    size_t n = drain(frames, FRAMES_COUNT);
+    CHECK_EQ(n, (6 * MB - PAGE_SIZE + 6 * MB) / PAGE_SIZE);
+    for (size_t i = 0; i < n; i++) {
+        CHECK(frames[i] < 8 * MB || frames[i] >= 10 * MB);
+    }
+    for (size_t i = 0; i < n; i++) pmm.free_frame((void*)frames[i]);
+}
+
+static void test_unaligned_regions_are_trimmed() {
+    // Only whole frames inside an available range may be handed out
+    static const MemoryRegion map[] = {
+        {3 * MB + 0x800, 1 * MB - 0x800, MULTIBOOT_MEMORY_AVAILABLE},
+        {5 * MB, 1 * MB + 0x800, MULTIBOOT_MEMORY_AVAILABLE},
+    };
+    init_with(map, 2);
+
+    size_t n = drain(frames, FRAMES_COUNT);
+    CHECK_EQ(n, (1 * MB - PAGE_SIZE) / PAGE_SIZE + 1 * MB / PAGE_SIZE);
+    for (size_t i = 0; i < n; i++) {
+        bool in_first = frames[i] >= 3 * MB + PAGE_SIZE && frames[i] + PAGE_SIZE <= 4 * MB;
+        bool in_second = frames[i] >= 5 * MB && frames[i] + PAGE_SIZE <= 6 * MB;
+        CHECK(in_first || in_second);
+    }
+    for (size_t i = 0; i < n; i++) pmm.free_frame((void*)frames[i]);
+}
+
+static void test_modules_are_reserved() {
+    BootModule initrd = {(uint32_t)(4 * MB), (uint32_t)(4 * MB + 10000)};
+    init_with(pc_map, 3, &initrd, 1);
+
+    size_t n = drain(frames, FRAMES_COUNT);
+    for (size_t i = 0; i < n; i++) {
+        CHECK(frames[i] + PAGE_SIZE <= 4 * MB || frames[i] >= 4 * MB + 3 * PAGE_SIZE);
+    }
+    for (size_t i = 0; i < n; i++) pmm.free_frame((void*)frames[i]);
+}
+
+static void test_memory_above_limit_is_ignored() {
+    static const MemoryRegion map[] = {
+        {1 * MB, 4096 * MB, MULTIBOOT_MEMORY_AVAILABLE},
+    };
+    init_with(map, 1);
+    CHECK_EQ(pmm.get_total_memory(), MAX_PHYSICAL_MEMORY);
+
+    size_t n = drain(frames, FRAMES_COUNT);
+    CHECK_EQ(frames[n - 1], MAX_PHYSICAL_MEMORY - PAGE_SIZE);
+    for (size_t i = 0; i < n; i++) pmm.free_frame((void*)frames[i]);
+}
+
+static void test_double_free_keeps_counts() {
+    init_with(pc_map, 3);
+    uint64_t before = free_frames();
+    void* f = pmm.allocate_frame();
+    pmm.free_frame(f);
+    pmm.free_frame(f);
+    pmm.free_frame(nullptr);
+    CHECK_EQ(free_frames(), before);
+}
+
+static void test_contiguous_runs() {
+    static const MemoryRegion map[] = {
+        {2 * MB, 2 * MB, MULTIBOOT_MEMORY_AVAILABLE},
+        {4 * MB, 1 * MB, MULTIBOOT_MEMORY_RESERVED},
+        {5 * MB, 3 * MB, MULTIBOOT_MEMORY_AVAILABLE},
+    };
+    init_with(map, 3);
+
+    // Pin a frame in the middle of the first region so a large run has to
+    // come from the second one
+    void* pins[300];
+    for (int i = 0; i < 300; i++) pins[i] = pmm.allocate_frame();
+    for (int i = 0; i < 299; i++) pmm.free_frame(pins[i]);
+    uint64_t pinned = (uint64_t)pins[299];
+
+    uint64_t run = (uint64_t)pmm.allocate_frames(512); // 2 MB
+    CHECK(run != 0);
+    CHECK(run >= 5 * MB && run + 512 * PAGE_SIZE <= 8 * MB);
+
+    uint64_t small = (uint64_t)pmm.allocate_frames(16);
+    CHECK(small != 0);
+    CHECK(small + 16 * PAGE_SIZE <= pinned || small > pinned);
+
+    CHECK(pmm.allocate_frames(1024) == nullptr); // Nothing that long left
+    CHECK(pmm.allocate_frames(0) == nullptr);
+
+    pmm.free_frames((void*)run, 512);
+    pmm.free_frames((void*)small, 16);
+    pmm.free_frame((void*)pinned);
+}
+
+static void* stash = nullptr;
+static int reclaim_calls = 0;
+
+static uint64_t give_back_stash(uint64_t wanted) {
+    (void)wanted;
+    reclaim_calls++;
+    if (!stash) return 0;
+    pmm.free_frame(stash);
+    stash = nullptr;
+    return 1;
+}
+
+static void test_reclaim_hook() {
+    init_with(pc_map, 3);
+    size_t n = drain(frames, FRAMES_COUNT);
+    stash = (void*)frames[--n];
+
+    pmm.set_reclaim_hook(give_back_stash);
+    void* f = pmm.allocate_frame();
+    CHECK(f != nullptr);
+    CHECK_EQ(reclaim_calls, 1);
+    CHECK(pmm.allocate_frame() == nullptr); // Hook has nothing left
+    CHECK_EQ(reclaim_calls, 2);
+    pmm.set_reclaim_hook(nullptr);
+
+    pmm.free_frame(f);
+    for (size_t i = 0; i < n; i++) pmm.free_frame((void*)frames[i]);
+}
+
+static void test_huge_frames() {
+    init_with(pc_map, 3);
+    uint64_t before = free_frames();
+
+    // 2..4 MB holds the multiboot info, so 4..32 MB gives 14 blocks, top down
+    uint64_t huge[16];
+    size_t n = 0;
+    void* f;
+    while (n < 16 && (f = pmm.allocate_huge_frame()) != nullptr) {
+        huge[n++] = (uint64_t)f;
+    }
+    CHECK_EQ(n, 14);
+    CHECK_EQ(huge[0], 30 * MB);
+    for (size_t i = 0; i < n; i++) CHECK(huge[i] % HUGE_FRAME_SIZE == 0 && huge[i] >= 4 * MB);
+    CHECK(pmm.compaction_wanted());
+
+    PmmHugeStats st;
+    pmm.get_huge_stats(&st);
+    CHECK_EQ(st.allocs, 14);
+    CHECK_EQ(st.failures, 1);
+    CHECK_EQ(st.free_blocks, 0);
+
+    for (size_t i = 0; i < n; i++) pmm.free_huge_frame((void*)huge[i]);
+    CHECK_EQ(free_frames(), before);
+}
+
+// Movable test frames: the owner is the slot holding the frame's address.
+// Frames are not backed by memory here, so a tag per frame stands in for
+// the data that a real mover copies.
+static bool refuse_moves = false;
+static uint8_t frame_tag[FRAMES_COUNT];
+
+static bool move_slot(void* owner, uint64_t from, uint64_t to) {
+    uint64_t* slot = (uint64_t*)owner;
+    if (refuse_moves || *slot != from) return false;
+    frame_tag[to / PAGE_SIZE] = frame_tag[from / PAGE_SIZE];
+    *slot = to;
+    return true;
+}
+
+static int slot_mover = 0;
+
+// Fill memory with movable frames (owned by their slot in frames[]), then
+// keep only the first one in every block: nothing 2MB is left although
+// almost everything is free. Returns the kept slots.
+static size_t fragment(uint64_t** kept) {
+    size_t n = 0;
+    void* f;
+    while ((f = pmm.allocate_movable_frame(slot_mover, &frames[n])) != nullptr) {
+        frames[n++] = (uint64_t)f;
+    }
+    size_t k = 0;
+    uint64_t last_block = UINT64_MAX;
+    for (size_t i = 0; i < n; i++) {
+        if (frames[i] / HUGE_FRAME_SIZE != last_block) {
+            last_block = frames[i] / HUGE_FRAME_SIZE;
+            kept[k++] = &frames[i];
+        } else {
+            pmm.free_frame((void*)frames[i]);
+        }
+    }
+    return k;
+}
+
+static uint64_t* kept[64];
+
+static void test_compaction() {
+    init_with(pc_map, 3);
+    uint64_t before = free_frames();
+    size_t k = fragment(kept);
+    CHECK_EQ(k, 15); // Blocks 1..15; block 0 is the kernel
+    for (size_t i = 0; i < k; i++) frame_tag[*kept[i] / PAGE_SIZE] = (uint8_t)(i + 1);
+
+    CHECK(pmm.allocate_huge_frame() == nullptr);
+    CHECK(pmm.compaction_wanted());
+
+    // Block 1 also has the pinned multiboot info: it stays and takes the
+    // pages from the other 14
+    CHECK_EQ(pmm.compact(UINT64_MAX), 14);
+    CHECK(!pmm.compaction_wanted());
+    for (size_t i = 0; i < k; i++) {
+        CHECK(*kept[i] >= 2 * MB && *kept[i] < 4 * MB);
+        CHECK_EQ(frame_tag[*kept[i] / PAGE_SIZE], i + 1);
+    }
+
+    PmmHugeStats st;
+    pmm.get_huge_stats(&st);
+    CHECK_EQ(st.free_blocks, 14);
+    CHECK_EQ(st.pages_moved, 14);
+    CHECK_EQ(st.blocks_freed, 14);
+    CHECK_EQ(st.movable_frames, k);
+    CHECK_EQ(free_frames(), before - k);
+
+    void* huge = pmm.allocate_huge_frame();
+    CHECK(huge != nullptr);
+    pmm.free_huge_frame(huge);
+    for (size_t i = 0; i < k; i++) pmm.free_frame((void*)*kept[i]);
+    pmm.get_huge_stats(&st);
+    CHECK_EQ(st.movable_frames, 0);
+}
+
+static void test_compaction_leaves_pinned_and_busy_frames() {
+    init_with(pc_map, 3);
+
+    // Pin the top frame first
+    size_t n = drain(frames, FRAMES_COUNT);
+    uint64_t pinned = frames[n - 1];
+    for (size_t i = 0; i + 1 < n; i++) pmm.free_frame((void*)frames[i]);
+    CHECK_EQ(pinned, 32 * MB - PAGE_SIZE);
+    size_t k = fragment(kept);
+
+    refuse_moves = true;
+    CHECK_EQ(pmm.compact(UINT64_MAX), 0);
+    PmmHugeStats st;
+    pmm.get_huge_stats(&st);
+    CHECK_EQ(st.moves_refused, 1);
+    CHECK_EQ(st.free_blocks, 0);
+
+    refuse_moves = false;
+    CHECK_EQ(pmm.compact(UINT64_MAX), 13); // Not the block with the pinned frame
+    pmm.get_huge_stats(&st);
+    CHECK_EQ(st.free_blocks, 13);
+    CHECK_EQ(st.compactions, 2);
+
+    pmm.free_frame((void*)pinned);
+    for (size_t i = 0; i < k; i++) pmm.free_frame((void*)*kept[i]);
+}
+
+int main() {
+    shim_quiet = true;
+    RUN_TEST(test_low_memory_and_kernel_reserved);
+    RUN_TEST(test_drain_and_refill);
+    RUN_TEST(test_holes_are_never_allocated);
+    RUN_TEST(test_unaligned_regions_are_trimmed);
+    RUN_TEST(test_modules_are_reserved);
+    RUN_TEST(test_memory_above_limit_is_ignored);
+    RUN_TEST(test_double_free_keeps_counts);
+    RUN_TEST(test_contiguous_runs);
+    RUN_TEST(test_reclaim_hook);
+    slot_mover = pmm.register_mover(move_slot);
+    RUN_TEST(test_huge_frames);
+    RUN_TEST(test_compaction);
+    RUN_TEST(test_compaction_leaves_pinned_and_busy_frames);
+    return check_failures ? 1 : 0;
+}
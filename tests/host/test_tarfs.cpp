@@ -0,0 +1,216 @@
+// Hosted tests for kernel/fs/tarfs.cpp: generated USTAR archives, looked up
+// and read through tarfs_lookup() and the VfsOps that tarfs_mount() registers.
+#include "shim.hpp"
+#include "check.hpp"
+#include "fixtures.hpp"
+#include "../../kernel/fs/tarfs.hpp"
+#include "../../kernel/fs/vfs.hpp"
+
+int check_failures = 0;
+
+static const VfsOps* mount_ops() {
+    shim_mounted_ops = nullptr;
+    tarfs_mount("/");
+    return shim_mounted_ops;
+}
+
+// Read a whole file through the VFS ops into buf (NUL-terminated)
+static int64_t read_file(const VfsOps* ops, const char* path, char* buf, size_t len) {
+    Vnode vn;
+    if (ops->lookup(nullptr, path, &vn) < 0) return -1;
+    int64_t n = ops->read(&vn, buf, len - 1, 0);
+    if (n >= 0) buf[n] = '\0';
+    return n;
+}
+
+static size_t list_dir(const VfsOps* ops, const char* path, char names[][VFS_NAME_MAX], size_t max) {
+    Vnode vn;
+    if (ops->lookup(nullptr, path, &vn) < 0 || vn.type != VnodeType::Directory) return 0;
+    uint64_t cookie = 0;
+    VfsDirent d;
+    size_t n = 0;
+    while (ops->readdir(&vn, &cookie, &d) == 1) {
+        if (n < max) strcpy(names[n], d.name);
+        n++;
+    }
+    return n;
+}
+
+static void test_files_dirs_and_implied_dirs() {
+    TarBuilder tb;
+    tar_init(&tb);
+    tar_add_file(&tb, "hello.txt", "hello\n", 6);
+    tar_add_dir(&tb, "docs/");
+    tar_add_file(&tb, "docs/guide.txt", "guide text", 10);
+    tar_add_file(&tb, "a/b/c.txt", "c", 1); // No entries for a/ and a/b/
+    tar_finish(&tb);
+
+    CHECK(tarfs_init(tb.data, tb.size));
+    CHECK(tarfs_is_ready());
+
+    size_t size = 0;
+    CHECK(tarfs_lookup("hello.txt", &size));
+    CHECK_EQ(size, 6);
+    CHECK(tarfs_lookup("docs/guide.txt", &size));
+    CHECK_EQ(size, 10);
+    CHECK(!tarfs_lookup("missing.txt", &size));
+    CHECK(!tarfs_lookup("docs/guide", &size));
+
+    const VfsOps* ops = mount_ops();
+    CHECK(ops != nullptr);
+    Vnode vn;
+    CHECK(ops->lookup(nullptr, "a", &vn) == 0 && vn.type == VnodeType::Directory);
+    CHECK(ops->lookup(nullptr, "a/b", &vn) == 0 && vn.type == VnodeType::Directory);
+    CHECK(ops->lookup(nullptr, "docs", &vn) == 0 && vn.type == VnodeType::Directory);
+    CHECK(ops->lookup(nullptr, "", &vn) == 0 && vn.type == VnodeType::Directory);
+    CHECK_EQ(ops->lookup(nullptr, "a/x", &vn), VFS_ENOENT);
+
+    char buf[64];
+    CHECK_EQ(read_file(ops, "a/b/c.txt", buf, sizeof(buf)), 1);
+    CHECK(strcmp(buf, "c") == 0);
+    CHECK_EQ(read_file(ops, "docs/guide.txt", buf, sizeof(buf)), 10);
+    CHECK(strcmp(buf, "guide text") == 0);
+
+    // Partial reads at an offset, and past the end
+    CHECK(ops->lookup(nullptr, "hello.txt", &vn) == 0);
+    CHECK_EQ(ops->read(&vn, buf, 3, 2), 3);
+    CHECK(memcmp(buf, "llo", 3) == 0);
+    CHECK_EQ(ops->read(&vn, buf, 10, 6), 0);
+
+    // Root children in archive order
+    char names[8][VFS_NAME_MAX];
+    CHECK_EQ(list_dir(ops, "", names, 8), 3);
+    CHECK(strcmp(names[0], "hello.txt") == 0);
+    CHECK(strcmp(names[1], "docs") == 0);
+    CHECK(strcmp(names[2], "a") == 0);
+    CHECK_EQ(list_dir(ops, "a/b", names, 8), 1);
+    CHECK(strcmp(names[0], "c.txt") == 0);
+
+    tarfs_init(nullptr, 0);
+    tar_free(&tb);
+}
+
+static void test_dot_slash_names() {
+    // What `tar -C dir .` produces
+    TarBuilder tb;
+    tar_init(&tb);
+    tar_add_dir(&tb, "./");
+    tar_add_file(&tb, "./hello.txt", "hi", 2);
+    tar_add_dir(&tb, "./docs/");
+    tar_add_file(&tb, "./docs/guide.txt", "g", 1);
+    tar_finish(&tb);
+
+    CHECK(tarfs_init(tb.data, tb.size));
+    size_t size;
+    CHECK(tarfs_lookup("hello.txt", &size) && size == 2);
+    CHECK(tarfs_lookup("docs/guide.txt", &size) && size == 1);
+
+    char names[8][VFS_NAME_MAX];
+    CHECK_EQ(list_dir(mount_ops(), "", names, 8), 2);
+
+    tarfs_init(nullptr, 0);
+    tar_free(&tb);
+}
+
+static void test_long_paths_use_prefix() {
+    char dir[160];
+    char path[260];
+    memset(dir, 'd', 120);
+    dir[60] = '/';
+    dir[120] = '\0';
+    snprintf(path, sizeof(path), "%s/%s", dir, "a-file-name-that-is-fairly-long.txt");
+    CHECK(strlen(path) > 100);
+
+    TarBuilder tb;
+    tar_init(&tb);
+    tar_add_file(&tb, path, "long", 4);
+    tar_finish(&tb);
+
+    CHECK(tarfs_init(tb.data, tb.size));
+    size_t size;
+    CHECK(tarfs_lookup(path, &size) && size == 4);
+
+    tarfs_init(nullptr, 0);
+    tar_free(&tb);
+}
+
+static void test_later_members_win() {
+    TarBuilder tb;
+    tar_init(&tb);
+    tar_add_file(&tb, "f.txt", "old", 3);
+    tar_add_file(&tb, "f.txt", "newer", 5);
+    tar_finish(&tb);
+
+    CHECK(tarfs_init(tb.data, tb.size));
+    char buf[16];
+    CHECK_EQ(read_file(mount_ops(), "f.txt", buf, sizeof(buf)), 5);
+    CHECK(strcmp(buf, "newer") == 0);
+
+    tarfs_init(nullptr, 0);
+    tar_free(&tb);
+}
+
+static void test_bad_archives_are_rejected() {
+    static uint8_t zeros[4096];
+    CHECK(!tarfs_init(nullptr, 0));
+    CHECK(!tarfs_init(zeros, 100));
+    CHECK(!tarfs_init(zeros, sizeof(zeros))); // No ustar magic
+    CHECK(!tarfs_is_ready());
+
+    // A member whose data runs past the end: earlier members still resolve
+    TarBuilder tb;
+    tar_init(&tb);
+    tar_add_file(&tb, "first.txt", "1", 1);
+    static char big[8192];
+    tar_add_file(&tb, "cut.bin", big, sizeof(big));
+    tar_finish(&tb);
+
+    CHECK(tarfs_init(tb.data, 512 * 4));
+    size_t size;
+    CHECK(tarfs_lookup("first.txt", &size));
+    CHECK(!tarfs_lookup("cut.bin", &size));
+
+    tarfs_init(nullptr, 0);
+    tar_free(&tb);
+}
+
+static void test_large_tree() {
+    const size_t files = 10000;
+    TarBuilder tb;
+    tar_make_tree(&tb, files, 100);
+    CHECK(tarfs_init(tb.data, tb.size));
+
+    char path[64];
+    size_t found = 0;
+    for (size_t n = 0; n < files; n++) {
+        tree_path(path, n, 100);
+        size_t size;
+        if (tarfs_lookup(path, &size) && size == strlen(path)) found++;
+    }
+    CHECK_EQ(found, files);
+
+    const VfsOps* ops = mount_ops();
+    char names[128][VFS_NAME_MAX];
+    CHECK_EQ(list_dir(ops, "bench", names, 128), files / 100);
+    CHECK_EQ(list_dir(ops, "bench/d042", names, 128), 100);
+    CHECK(strcmp(names[0], "file004200.txt") == 0);
+
+    char buf[64];
+    tree_path(path, 9999, 100);
+    CHECK_EQ(read_file(ops, path, buf, sizeof(buf)), strlen(path));
+    CHECK(strcmp(buf, path) == 0);
+
+    tarfs_init(nullptr, 0);
+    tar_free(&tb);
+}
+
+int main() {
+    shim_quiet = true;
+    RUN_TEST(test_files_dirs_and_implied_dirs);
+    RUN_TEST(test_dot_slash_names);
+    RUN_TEST(test_long_paths_use_prefix);
+    RUN_TEST(test_later_members_win);
+    RUN_TEST(test_bad_archives_are_rejected);
+    RUN_TEST(test_large_tree);
+    return check_failures ? 1 : 0;
+}
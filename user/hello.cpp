@@ -0,0 +1,32 @@
+#include "ulib.hpp"
+
+// Smoke test for exec: arguments, write, mmap and read
+int main(int argc, char** argv) {
+    print("Hello from ring 3, pid ");
+    print_uint(sys_getpid());
+    print("\n");
+    for (int i = 0; i < argc; i++) {
+        print("  argv["); print_uint(i); print("] = "); print(argv[i]); print("\n");
+    }
+
+    uint64_t* mem = (uint64_t*)sys_mmap_anon(3 * 4096);
+    if (!mem) {
+        print("hello: mmap failed\n");
+        return 1;
+    }
+    uint64_t sum = 0;
+    for (int i = 0; i < 3 * 512; i++) mem[i] = i;
+    for (int i = 0; i < 3 * 512; i++) sum += mem[i];
+    print("  mmap: 12 KB, sum "); print_uint(sum); print("\n");
+
+    if (argc > 1) {
+        char line[64];
+        print("  type a line: ");
+        int64_t n = sys_read(0, line, sizeof(line));
+        if (n > 0) {
+            print("  read "); print_uint(n); print(" bytes: ");
+            sys_write(1, line, n);
+        }
+    }
+    return 0;
+}
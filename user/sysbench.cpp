@@ -0,0 +1,51 @@
+#include "ulib.hpp"
+
+// Null-syscall latency: ring 3 -> SYSCALL -> dispatch -> SYSRET, timed
+// one call at a time with the TSC and reported in the `bench` format
+// (cycles, minus the cost of an empty timed region).
+#define ITERATIONS 4096
+#define WARMUP     256
+
+static void sort(uint64_t* v, int n) {
+    for (int gap = n / 2; gap > 0; gap /= 2) {
+        for (int i = gap; i < n; i++) {
+            uint64_t x = v[i];
+            int j = i;
+            for (; j >= gap && v[j - gap] > x; j -= gap) v[j] = v[j - gap];
+            v[j] = x;
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    uint64_t* samples = (uint64_t*)sys_mmap_anon(ITERATIONS * sizeof(uint64_t));
+    if (!samples) {
+        print("sysbench: mmap failed\n");
+        return 1;
+    }
+
+    for (int i = 0; i < ITERATIONS; i++) {
+        uint64_t start = rdtsc_ordered();
+        samples[i] = rdtsc_ordered() - start;
+    }
+    sort(samples, ITERATIONS);
+    uint64_t overhead = samples[ITERATIONS / 2];
+
+    for (int i = 0; i < WARMUP; i++) sys_getpid();
+    for (int i = 0; i < ITERATIONS; i++) {
+        uint64_t start = rdtsc_ordered();
+        sys_getpid();
+        uint64_t cycles = rdtsc_ordered() - start;
+        samples[i] = cycles > overhead ? cycles - overhead : 0;
+    }
+    sort(samples, ITERATIONS);
+
+    print("BENCH syscall_null n="); print_uint(ITERATIONS);
+    print(" p50="); print_uint(samples[ITERATIONS / 2]);
+    print(" p99="); print_uint(samples[ITERATIONS * 99 / 100]);
+    print(" max="); print_uint(samples[ITERATIONS - 1]);
+    print("\n");
+    return 0;
+}
@@ -0,0 +1,47 @@
+#include "ulib.hpp"
+
+// The kernel enters here with rsp pointing at argc, then argv[]
+asm(".global _start\n"
+    "_start:\n"
+    "    xor %ebp, %ebp\n"
+    "    mov (%rsp), %rdi\n"
+    "    lea 8(%rsp), %rsi\n"
+    "    call main\n"
+    "    mov %eax, %edi\n"
+    "    mov $60, %eax\n"       // SYS_exit
+    "    syscall\n"
+    "    hlt\n");
+
+// The compiler may emit calls to these for plain loops and copies
+extern "C" void* memset(void* dst, int c, size_t n) {
+    uint8_t* d = (uint8_t*)dst;
+    for (size_t i = 0; i < n; i++) d[i] = (uint8_t)c;
+    return dst;
+}
+
+extern "C" void* memcpy(void* dst, const void* src, size_t n) {
+    uint8_t* d = (uint8_t*)dst;
+    const uint8_t* s = (const uint8_t*)src;
+    for (size_t i = 0; i < n; i++) d[i] = s[i];
+    return dst;
+}
+
+size_t strlen(const char* s) {
+    size_t n = 0;
+    while (s[n]) n++;
+    return n;
+}
+
+void print(const char* s) {
+    sys_write(1, s, strlen(s));
+}
+
+void print_uint(uint64_t n) {
+    char buf[21];
+    int i = sizeof(buf);
+    do {
+        buf[--i] = (char)('0' + n % 10);
+        n /= 10;
+    } while (n > 0);
+    sys_write(1, &buf[i], sizeof(buf) - i);
+}
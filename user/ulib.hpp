@@ -0,0 +1,69 @@
+#ifndef ULIB_HPP
+#define ULIB_HPP
+
+// Minimal runtime for ring 3 programs: raw syscalls and a few helpers.
+// Built with USER_PROGRAM so only the numbers and flags of syscall.hpp are seen.
+#include "proc/syscall.hpp"
+
+static inline int64_t syscall1(uint64_t nr, uint64_t a0) {
+    int64_t ret;
+    asm volatile("syscall" : "=a"(ret) : "a"(nr), "D"(a0) : "rcx", "r11", "memory");
+    return ret;
+}
+
+static inline int64_t syscall3(uint64_t nr, uint64_t a0, uint64_t a1, uint64_t a2) {
+    int64_t ret;
+    asm volatile("syscall" : "=a"(ret) : "a"(nr), "D"(a0), "S"(a1), "d"(a2) : "rcx", "r11", "memory");
+    return ret;
+}
+
+static inline int64_t syscall6(uint64_t nr, uint64_t a0, uint64_t a1, uint64_t a2,
+                               uint64_t a3, uint64_t a4, uint64_t a5) {
+    int64_t ret;
+    register uint64_t r10 asm("r10") = a3;
+    register uint64_t r8 asm("r8") = a4;
+    register uint64_t r9 asm("r9") = a5;
+    asm volatile("syscall" : "=a"(ret) : "a"(nr), "D"(a0), "S"(a1), "d"(a2), "r"(r10), "r"(r8), "r"(r9)
+                 : "rcx", "r11", "memory");
+    return ret;
+}
+
+static inline int64_t sys_read(int fd, void* buf, size_t len) {
+    return syscall3(SYS_read, fd, (uint64_t)buf, len);
+}
+
+static inline int64_t sys_write(int fd, const void* buf, size_t len) {
+    return syscall3(SYS_write, fd, (uint64_t)buf, len);
+}
+
+// Anonymous memory; nullptr on failure
+static inline void* sys_mmap_anon(size_t len) {
+    int64_t ret = syscall6(SYS_mmap, 0, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, (uint64_t)-1, 0);
+    return ret < 0 ? nullptr : (void*)ret;
+}
+
+static inline int64_t sys_getpid() {
+    int64_t ret;
+    asm volatile("syscall" : "=a"(ret) : "a"((uint64_t)SYS_getpid) : "rcx", "r11", "memory");
+    return ret;
+}
+
+[[noreturn]] static inline void sys_exit(int code) {
+    syscall1(SYS_exit, (uint64_t)code);
+    __builtin_unreachable();
+}
+
+static inline uint64_t rdtsc_ordered() {
+    uint32_t lo, hi;
+    asm volatile("lfence; rdtsc; lfence" : "=a"(lo), "=d"(hi) : : "memory");
+    return ((uint64_t)hi << 32) | lo;
+}
+
+size_t strlen(const char* s);
+void print(const char* s);
+void print_uint(uint64_t n);
+
+// Provided by each program; its return value is the exit status
+int main(int argc, char** argv);
+
+#endif